@@ -6,10 +6,23 @@ echo "=================================================="
 
 echo ""
 
-g++ -std=c++20 -O3 -march=native -flto tests/test.cpp -o bin/test
-if [ $? -eq 0 ]; then
-    echo "Compilation successful! The executable 'bin/test' has been created."
+CXXFLAGS="-std=c++20 -O3 -march=native -flto -pthread"
+TOOLS="test denoise lightbvh lod svo accel perf quality inflation heatmap synth regress cachesim packetsim rays flight counters verify difftest stackdepth autotune hotlayout treelets"
+
+mkdir -p bin
+failed=0
+
+for tool in $TOOLS; do
+    g++ $CXXFLAGS -DRT_BUILD_FLAGS="\"$CXXFLAGS\"" tests/$tool.cpp -o bin/$tool
+    if [ $? -eq 0 ]; then
+        echo "Compilation successful! The executable 'bin/$tool' has been created."
+    else
+        echo "Compilation of '$tool' failed. Please check the errors and see what went wrong."
+        failed=1
+    fi
+done
+
+if [ $failed -eq 0 ]; then
     echo "Done!"
-else
-    echo "Compilation failed. Please check the errors and see what went wrong."
-fi
\ No newline at end of file
+fi
+exit $failed
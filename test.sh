@@ -1,6 +1,5 @@
 #!/bin/bash
 
-for ((i=0; i<100; i++))
-do
-    ./bin/test
-done
\ No newline at end of file
+# 100 timed conversions in one process (plus warm-ups); extra args go to
+# bin/test, e.g. --json bench.json.
+./bin/test --bench 100 "$@"
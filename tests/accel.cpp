@@ -0,0 +1,146 @@
+// accel.cpp
+// Runs every acceleration structure in accel.hpp over the same scenes and
+// the same ray sets, and reports build time, memory and Mrays/s per ray type.
+//
+// Ray sets are generated once per scene from exact primary hits (via the
+// BVH4, rayset.hpp): primary and diffuse-bounce rays ask for the closest
+// hit, sun shadow and AO rays only for occlusion. Every structure's answers
+// are checked against the BVH4's; a closest hit counts as a mismatch only if
+// t differs, since coplanar triangles may tie.
+//
+//   bin/accel [--scenes public/assets/dragon.glb,public/assets/plane.glb]
+//             [--accels bvh4,kdtree,grid] [--size 640x360] [--builds 3]
+//             [--ao-dist 0.25]
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "accel.hpp"
+#include "args.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "rayset.hpp"
+#include "trace.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+struct SetResult {
+    double   ms = 0.0;
+    uint64_t mismatches = 0;
+    uint64_t nodes = 0;
+    uint64_t triTests = 0;
+};
+
+static SetResult run_set(const Accel& accel, const RaySet& set, uint32_t kind) {
+    SetResult r;
+    size_t begin, end;
+    set.range(kind, begin, end);
+    const bool closest = ray_kind_closest(kind);
+    std::vector<uint8_t> bad(end - begin, 0);
+    auto t0 = Clock::now();
+    parallel_for(begin, end, 256, [&](size_t i) {
+        Hit hit;
+        if (closest) hit = accel.intersect(set.rays[i]);
+        else hit.tri = accel.occluded(set.rays[i]) ? 0u : INVALID;
+        bad[i - begin] = !ray_result_matches(kind, hit, set.ref[i]);
+    });
+    r.ms = ms_since(t0);
+    for (uint8_t b : bad) r.mismatches += b;
+
+    // Work counters from a second, untimed pass.
+    std::vector<TraceStats> perWorker(worker_count());
+    parallel_for_chunks(begin, end, 256, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) {
+            if (closest) accel.intersect(set.rays[i], &perWorker[w]);
+            else accel.occluded(set.rays[i], &perWorker[w]);
+        }
+    });
+    for (const TraceStats& ts : perWorker) {
+        r.nodes += ts.nodes;
+        r.triTests += ts.triTests;
+    }
+    return r;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::vector<std::string> scenes =
+        args.strs("scenes", "public/assets/dragon.glb,public/assets/plane.glb,public/assets/steve.glb");
+    std::vector<std::string> accelNames = args.strs("accels", "bvh4,kdtree,grid");
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+    uint32_t builds = std::max(args.u32("builds", 3), 1u);
+    float aoDist = float(args.num("ao-dist", 0.25));
+
+    for (const std::string& name : accelNames) {
+        if (!make_accel(name)) {
+            std::cerr << "Unknown accel '" << name << "' (have: bvh4, kdtree, grid)\n";
+            return 1;
+        }
+    }
+
+    std::cout << width << "x" << height << ", best of " << builds << " builds, " << worker_count() << " threads\n";
+
+    for (const std::string& scenePath : scenes) {
+        Triangles tris;
+        if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+        Bvh4Accel ref;
+        ref.build(tris);
+        RaySet set = generate_ray_set(
+            tris, Camera{}, width, height, (1u << RAY_KINDS) - 1, aoDist,
+            [&](const Ray& r) { return ref.intersect(r, nullptr); }, [&](const Ray& r) { return ref.occluded(r, nullptr); });
+        size_t kindSize[RAY_KINDS];
+        for (uint32_t k = 0; k < RAY_KINDS; ++k) {
+            size_t b, e;
+            set.range(k, b, e);
+            kindSize[k] = e - b;
+        }
+
+        std::cout << "\nscene: " << scenePath << " (" << tris.count() << " tris), rays:";
+        for (uint32_t k = 0; k < RAY_KINDS; ++k) std::cout << " " << RAY_KIND_NAMES[k] << " " << kindSize[k];
+        std::cout << "\n\n";
+
+        std::printf("%-8s %9s %8s %10s %8s %6s", "accel", "build ms", "MB", "nodes", "refs/tri", "depth");
+        for (uint32_t k = 0; k < RAY_KINDS; ++k)
+            std::printf(" %12s", (std::string(RAY_KIND_NAMES[k]) + " Mr/s").c_str());
+        std::printf(" %10s %10s %10s\n", "nodes/ray", "tris/ray", "mismatch");
+
+        for (const std::string& name : accelNames) {
+            std::unique_ptr<Accel> accel = make_accel(name);
+            double buildMs = INF;
+            for (uint32_t b = 0; b < builds; ++b) {
+                accel = make_accel(name);
+                auto t0 = Clock::now();
+                accel->build(tris);
+                buildMs = std::min(buildMs, ms_since(t0));
+            }
+            AccelMemory mem = accel->memory();
+
+            std::printf("%-8s %9.1f %8.2f %10llu %8.2f %6u", accel->name(), buildMs, mem.bytes / double(1 << 20),
+                        (unsigned long long)mem.nodes, double(mem.refs) / tris.count(), mem.depth);
+
+            uint64_t rays = 0, nodes = 0, triTests = 0, mismatches = 0;
+            for (uint32_t k = 0; k < RAY_KINDS; ++k) {
+                SetResult r = run_set(*accel, set, k);
+                std::printf(" %12.3f", kindSize[k] / r.ms * 1e-3);
+                rays += kindSize[k];
+                nodes += r.nodes;
+                triTests += r.triTests;
+                mismatches += r.mismatches;
+            }
+            std::printf(" %10.2f %10.2f %10llu\n", double(nodes) / rays, double(triTests) / rays,
+                        (unsigned long long)mismatches);
+        }
+    }
+    std::printf("\nnodes/ray counts BVH4 nodes popped, k-d tree nodes visited, or grid cells (both levels).\n");
+    return 0;
+}
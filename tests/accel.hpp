@@ -0,0 +1,209 @@
+#pragma once
+
+// accel.hpp
+// One interface over the acceleration structures the tools can build, so a
+// driver can run them all over the same scenes and rays:
+//
+//   bvh4     LBVH2 + promotion exactly as the app builds it (lbvh.hpp)
+//   kdtree   SAH k-d tree (kdtree.hpp)
+//   grid     two-level uniform grid (grid.hpp)
+//
+// make_accel_or_file() also takes a BVH2 / BVH4 file path in place of a
+// name, for the app's own GPU buffers.
+//
+// An Accel keeps a pointer to the triangles it was built over; they must
+// outlive it.
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "grid.hpp"
+#include "kdtree.hpp"
+#include "lbvh.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+struct AccelMemory {
+    size_t   bytes = 0;
+    uint64_t nodes = 0; // nodes or cells
+    uint64_t refs = 0;  // triangle references (> triangles when they are duplicated)
+    uint32_t depth = 0; // tree depth, 0 for grids
+};
+
+class Accel {
+public:
+    virtual ~Accel() = default;
+
+    virtual const char* name() const = 0;
+    virtual void        build(const Triangles& tris) = 0;
+    virtual Hit         intersect(const Ray& ray, TraceStats* stats = nullptr) const = 0;
+    virtual bool        occluded(const Ray& ray, TraceStats* stats = nullptr) const = 0;
+    virtual AccelMemory memory() const = 0;
+};
+
+/* ================= BVH4 ================= */
+
+class Bvh4Accel : public Accel {
+public:
+    const char* name() const override { return "bvh4"; }
+
+    void build(const Triangles& tris) override {
+        tris_ = &tris;
+        raw_ = promote_bvh4(build_lbvh2(tris, morton_sort(tris)));
+        bvh_ = decode_bvh4(raw_);
+    }
+
+    Hit intersect(const Ray& ray, TraceStats* stats) const override { return trace_closest(bvh_, *tris_, ray, stats); }
+    bool occluded(const Ray& ray, TraceStats* stats) const override { return trace_occluded(bvh_, *tris_, ray, stats); }
+
+    // The GPU buffer, promotion orphans included; the decoded f32 copy used
+    // for CPU traversal is not counted.
+    AccelMemory memory() const override {
+        AccelMemory m;
+        m.bytes = raw_.size() * sizeof(uint32_t);
+        m.nodes = bvh_.nodes.size();
+        m.refs = tris_ ? tris_->count() : 0;
+        if (bvh_.nodes.empty()) return m;
+
+        std::vector<std::pair<uint32_t, uint32_t>> stack{{0u, 1u}};
+        while (!stack.empty()) {
+            auto [n, d] = stack.back();
+            stack.pop_back();
+            m.depth = std::max(m.depth, d);
+            const Bvh4Node& node = bvh_.nodes[n];
+            if (!node.leaf())
+                for (uint32_t c : node.child)
+                    if (c != INVALID) stack.push_back({c, d + 1});
+        }
+        return m;
+    }
+
+    const Bvh4& bvh() const { return bvh_; }
+
+private:
+    const Triangles*      tris_ = nullptr;
+    std::vector<uint32_t> raw_;
+    Bvh4                  bvh_;
+};
+
+/* ================= k-d tree ================= */
+
+class KdTreeAccel : public Accel {
+public:
+    const char* name() const override { return "kdtree"; }
+
+    void build(const Triangles& tris) override {
+        tris_ = &tris;
+        tree_ = build_kdtree(tris);
+    }
+
+    Hit intersect(const Ray& ray, TraceStats* stats) const override {
+        return trace_kdtree(tree_, *tris_, ray, false, stats);
+    }
+    bool occluded(const Ray& ray, TraceStats* stats) const override {
+        return trace_kdtree(tree_, *tris_, ray, true, stats).hit();
+    }
+
+    AccelMemory memory() const override {
+        return {tree_.bytes(), tree_.nodes.size(), tree_.prims.size(), tree_.depth};
+    }
+
+private:
+    const Triangles* tris_ = nullptr;
+    KdTree           tree_;
+};
+
+/* ================= Two-level grid ================= */
+
+class GridAccel : public Accel {
+public:
+    const char* name() const override { return "grid"; }
+
+    void build(const Triangles& tris) override {
+        tris_ = &tris;
+        grid_ = build_grid(tris);
+    }
+
+    Hit intersect(const Ray& ray, TraceStats* stats) const override {
+        return trace_grid(grid_, *tris_, ray, false, stats);
+    }
+    bool occluded(const Ray& ray, TraceStats* stats) const override {
+        return trace_grid(grid_, *tris_, ray, true, stats).hit();
+    }
+
+    AccelMemory memory() const override {
+        return {grid_.bytes(), grid_.top.size() + grid_.leaves.size(), grid_.refs.size(), 0};
+    }
+
+private:
+    const Triangles* tris_ = nullptr;
+    TwoLevelGrid     grid_;
+};
+
+/* ================= BVH file ================= */
+
+// A BVH2 / BVH4 file as uploaded to the GPU (fp16 boxes as stored), walked
+// with trace.hpp. build() only takes the triangles; the file must have
+// been built over them.
+class BvhFileAccel : public Accel {
+public:
+    explicit BvhFileAccel(std::string path) : path_(std::move(path)) {}
+
+    const char* name() const override { return path_.c_str(); }
+
+    bool load() {
+        if (!load_u32_file(path_.c_str(), raw_) || raw_.empty()) {
+            std::cerr << "Failed to read " << path_ << "\n";
+            return false;
+        }
+        arity_ = bvh_file_arity(raw_);
+        if (!arity_) {
+            std::cerr << path_ << ": length matches neither the BVH2 nor the BVH4 stride\n";
+            return false;
+        }
+        bvh_ = arity_ == 2 ? decode_bvh2(raw_) : decode_bvh4(raw_);
+        return true;
+    }
+
+    void build(const Triangles& tris) override { tris_ = &tris; }
+    Hit intersect(const Ray& ray, TraceStats* stats) const override { return trace_closest(bvh_, *tris_, ray, stats); }
+    bool occluded(const Ray& ray, TraceStats* stats) const override { return trace_occluded(bvh_, *tris_, ray, stats); }
+
+    AccelMemory memory() const override {
+        AccelMemory m;
+        m.bytes = raw_.size() * sizeof(uint32_t);
+        m.nodes = bvh_.nodes.size();
+        m.refs = 0;
+        return m;
+    }
+
+private:
+    std::string           path_;
+    std::vector<uint32_t> raw_;
+    uint32_t              arity_ = 0;
+    Bvh4                  bvh_;
+    const Triangles*      tris_ = nullptr;
+};
+
+/* ================= Registry ================= */
+
+static inline const char* const ACCEL_NAMES[] = {"bvh4", "kdtree", "grid"};
+
+// nullptr for unknown names.
+static inline std::unique_ptr<Accel> make_accel(const std::string& name) {
+    if (name == "bvh4") return std::make_unique<Bvh4Accel>();
+    if (name == "kdtree") return std::make_unique<KdTreeAccel>();
+    if (name == "grid") return std::make_unique<GridAccel>();
+    return nullptr;
+}
+
+// An ACCEL_NAMES entry, else a BVH file path; nullptr, with the reason on
+// stderr, when it is neither.
+static inline std::unique_ptr<Accel> make_accel_or_file(const std::string& name) {
+    if (std::unique_ptr<Accel> a = make_accel(name)) return a;
+    auto file = std::make_unique<BvhFileAccel>(name);
+    if (!file->load()) return nullptr;
+    return file;
+}
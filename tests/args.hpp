@@ -0,0 +1,102 @@
+#pragma once
+
+// args.hpp
+// `--key value` / `--flag` command-line parsing shared by the tools.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class Args {
+public:
+    Args(int argc, char** argv) {
+        for (int i = 1; i < argc; ++i) {
+            if (std::strncmp(argv[i], "--", 2) == 0) {
+                Opt o{argv[i] + 2, ""};
+                if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) o.value = argv[++i];
+                opts_.push_back(o);
+            } else {
+                positional_.push_back(argv[i]);
+            }
+        }
+    }
+
+    bool has(const char* key) const { return find(key) != nullptr; }
+
+    std::string str(const char* key, const char* fallback) const {
+        const Opt* o = find(key);
+        return (o && !o->value.empty()) ? o->value : std::string(fallback);
+    }
+
+    double num(const char* key, double fallback) const {
+        const Opt* o = find(key);
+        return (o && !o->value.empty()) ? std::atof(o->value.c_str()) : fallback;
+    }
+
+    uint32_t u32(const char* key, uint32_t fallback) const {
+        const Opt* o = find(key);
+        return (o && !o->value.empty()) ? uint32_t(std::strtoul(o->value.c_str(), nullptr, 10)) : fallback;
+    }
+
+    // "0.5,1,2" style lists; empty or missing -> parse `fallback` instead.
+    std::vector<double> nums(const char* key, const char* fallback) const {
+        std::string s = str(key, fallback);
+        std::vector<double> out;
+        const char* p = s.c_str();
+        while (*p) {
+            char* end = nullptr;
+            double v = std::strtod(p, &end);
+            if (end == p) break;
+            out.push_back(v);
+            p = end;
+            while (*p == ',' || *p == ' ') ++p;
+        }
+        return out;
+    }
+
+    // "a.glb,b.glb" style lists.
+    std::vector<std::string> strs(const char* key, const char* fallback) const {
+        std::string s = str(key, fallback);
+        std::vector<std::string> out;
+        size_t b = 0;
+        while (b <= s.size()) {
+            size_t e = s.find(',', b);
+            if (e == std::string::npos) e = s.size();
+            if (e > b) out.push_back(s.substr(b, e - b));
+            b = e + 1;
+        }
+        return out;
+    }
+
+    // "1920x1080" style pairs.
+    bool size2(const char* key, uint32_t& w, uint32_t& h) const {
+        const Opt* o = find(key);
+        if (!o) return false;
+        unsigned a = 0, b = 0;
+        if (std::sscanf(o->value.c_str(), "%ux%u", &a, &b) != 2 || !a || !b) return false;
+        w = a;
+        h = b;
+        return true;
+    }
+
+    const std::vector<std::string>& positional() const { return positional_; }
+
+private:
+    struct Opt {
+        std::string key;
+        std::string value;
+    };
+
+    std::vector<Opt> opts_;
+    std::vector<std::string> positional_;
+
+    const Opt* find(const char* key) const {
+        for (auto it = opts_.rbegin(); it != opts_.rend(); ++it) {
+            if (it->key == key) return &*it;
+        }
+        return nullptr;
+    }
+};
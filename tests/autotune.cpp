@@ -0,0 +1,392 @@
+// autotune.cpp
+// Picks the BVH build and layout settings (autotune.hpp) that trace a
+// mesh's rays fastest. Every combination of the listed settings is a
+// candidate; successive halving runs them all on a small sample of the
+// rays, keeps the best 1/eta, and repeats with eta times the rays until one
+// is left or the full set has been traced. The first rung traces at least
+// --min-rays, so a small set gets fewer rungs and the last one ranks more
+// than one survivor on the full set. Each evaluation builds the tree
+// (timed), checks it with verify.hpp, and traces the sample on all threads
+// at least --reps times and for at least --min-ms, keeping the fastest
+// pass.
+//
+//   bin/autotune [--scene public/assets/dragon.glb] [--rays rays.bin | --size 320x180]
+//                [--arity 4] [--collapse grandchildren,greedy-sah]
+//                [--order file,dfs,bfs] [--bounds widened,tight]
+//                [--max-stack 64,40] [--eta 3] [--min-rays 4096]
+//                [--reps 3] [--min-ms 20] [--frames 0] [--budget 120] [--seed 1]
+//                [--write-bvh out.bin] [--json out.json|-]
+//
+// Rays come from a bin/rays set, or are generated for the default camera
+// (all four kinds, answered by the app's configuration). --frames F scores
+// rays/s over F frames of the set plus one build, so cheap builds win for
+// assets that are rebuilt often; 0 scores traversal only. A candidate is
+// dropped if verify.hpp finds an error, if its worst-case stack exceeds its
+// max-stack, or if more than --max-mismatch of its answers differ from the
+// references. When --budget seconds run out the search stops and the best
+// candidate of the deepest rung reached wins. The app's configuration is
+// always traced on the full set as the baseline.
+//
+// The winner's name is printed last (and is the "winner" of --json), in
+// the form parse_tune_config() reads back; --write-bvh writes its buffer
+// in the data/BVH2.bin / BVH4_wide.bin layout. Exits 1 if no candidate
+// qualifies.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "autotune.hpp"
+#include "bench.hpp"
+#include "json.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "rayset.hpp"
+#include "verify.hpp"
+
+struct Candidate {
+    TuneConfig  cfg;
+    int         rung = -1;          // deepest rung evaluated
+    uint64_t    rays = 0;           // traced in that rung
+    uint32_t    passes = 0;         // over those rays
+    double      raysPerSec = 0.0;
+    double      score = 0.0;        // raysPerSec, or amortized over --frames
+    double      buildMs = 0.0;      // LBVH2 (+ depth bound) + promotion, bounds, relayout
+    uint64_t    mismatches = 0;
+    uint32_t    worstStack = 0;
+    std::string dropped;            // why it left the search, empty if it did not
+};
+
+struct Rung {
+    uint64_t               rays = 0;
+    std::vector<uint32_t>  evaluated; // candidate indices, best first
+    std::vector<Candidate> results;   // their state after this rung, same order
+};
+
+// build_lbvh2 + bound_lbvh2_depth, once per depth limit.
+struct Lbvh2Cache {
+    const Triangles* tris = nullptr;
+    MortonOrder      order;
+    double           sortMs = 0.0;
+    struct Entry {
+        std::vector<uint32_t> bvh2;
+        double                ms = 0.0;
+        bool                  ok = false;
+    };
+    std::map<uint32_t, Entry> byDepth;
+
+    const Entry& get(uint32_t maxDepth) {
+        auto it = byDepth.find(maxDepth);
+        if (it != byDepth.end()) return it->second;
+        Entry& e = byDepth[maxDepth];
+        BenchTimer t;
+        e.bvh2 = build_lbvh2(*tris, order);
+        e.ok = bound_lbvh2_depth(e.bvh2, order, maxDepth);
+        e.ms = sortMs + t.ms();
+        return e;
+    }
+};
+
+// Fastest pass over rays[idx], repeated at least `reps` times and until
+// the passes add up to `minMs`, so small samples are not scored off one
+// short pass. Answers of the first pass are checked against the references.
+static double trace_sample(const Bvh4& bvh, const Triangles& tris, const RaySet& set,
+                           const std::vector<uint32_t>& idx, uint32_t reps, double minMs, uint32_t& passes,
+                           uint64_t& mismatches) {
+    std::vector<uint64_t> bad(worker_count(), 0);
+    double best = 0.0, total = 0.0;
+    uint32_t rep = 0;
+    for (; rep < reps || total < minMs; ++rep) {
+        BenchTimer t;
+        parallel_for_chunks(0, idx.size(), 256, [&](size_t b, size_t e, unsigned w) {
+            for (size_t i = b; i < e; ++i) {
+                const uint32_t r = idx[i], kind = set.kind[r];
+                Hit h;
+                if (ray_kind_closest(kind)) h = trace_closest(bvh, tris, set.rays[r]);
+                else h.tri = trace_occluded(bvh, tris, set.rays[r]) ? 0u : INVALID;
+                if (rep == 0 && !set.ref.empty() && !ray_result_matches(kind, h, set.ref[r])) bad[w]++;
+            }
+        });
+        const double ms = t.ms();
+        if (rep == 0 || ms < best) best = ms;
+        total += ms;
+    }
+    passes = rep;
+    mismatches = std::accumulate(bad.begin(), bad.end(), uint64_t(0));
+    return best;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string raysPath = args.str("rays", "");
+    std::string writePath = args.str("write-bvh", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    const uint32_t eta = std::max(args.u32("eta", 3), 2u);
+    const uint32_t reps = std::max(args.u32("reps", 3), 1u);
+    const uint32_t minRays = std::max(args.u32("min-rays", 4096), 1u);
+    const double minMs = args.num("min-ms", 20.0);
+    const double frames = args.num("frames", 0.0);
+    const double budgetS = args.num("budget", 120.0);
+    const double maxMismatch = args.num("max-mismatch", 1e-4);
+    BenchTimer clock;
+
+    // The search space.
+    std::vector<Candidate> cands;
+    {
+        bool bad = false;
+        auto lookup_all = [&](const char* key, const char* fallback, const char* const* names, uint32_t count) {
+            std::vector<uint32_t> out;
+            for (const std::string& s : args.strs(key, fallback)) {
+                out.push_back(tune_lookup(s, names, count));
+                bad |= out.back() == count;
+            }
+            return out;
+        };
+        std::vector<uint32_t> collapses = lookup_all("collapse", "grandchildren,greedy-sah", COLLAPSE_NAMES, 2);
+        std::vector<uint32_t> orders = lookup_all("order", "file,dfs,bfs", ORDER_NAMES, ORDER_COUNT);
+        std::vector<uint32_t> bounds = lookup_all("bounds", "widened,tight", BOUNDS_NAMES, BOUNDS_COUNT);
+        std::vector<double> arities = args.nums("arity", "4"), stacks = args.nums("max-stack", "64,40");
+        for (double a : arities) bad |= a != 2.0 && a != 4.0;
+        for (double s : stacks) bad |= s < 2.0;
+        if (bad || collapses.empty() || orders.empty() || bounds.empty() || arities.empty() || stacks.empty()) {
+            std::cerr << "Unknown setting in --arity / --collapse / --order / --bounds / --max-stack\n";
+            return 1;
+        }
+        for (double a : arities)
+            for (size_t c = 0; c < (a == 2.0 ? 1 : collapses.size()); ++c)
+                for (uint32_t o : orders)
+                    for (uint32_t b : bounds)
+                        for (double s : stacks) {
+                            Candidate cand;
+                            cand.cfg.arity = uint32_t(a);
+                            cand.cfg.collapse = a == 2.0 ? COLLAPSE_GRANDCHILDREN : Bvh4Collapse(collapses[c]);
+                            cand.cfg.order = TuneOrder(o);
+                            cand.cfg.bounds = TuneBounds(b);
+                            cand.cfg.maxStack = uint32_t(s);
+                            cands.push_back(cand);
+                        }
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    Lbvh2Cache lbvh;
+    lbvh.tris = &tris;
+    {
+        BenchTimer t;
+        lbvh.order = morton_sort(tris);
+        lbvh.sortMs = t.ms();
+    }
+    const TuneConfig baseCfg;
+
+    RaySet set;
+    if (!raysPath.empty()) {
+        if (!read_ray_set(raysPath.c_str(), set)) return 1;
+        if (set.sceneTris != tris.count() || set.sceneHash != scene_hash(tris)) {
+            std::cerr << raysPath << " was captured over a different scene (" << set.sceneTris << " tris) than "
+                      << scenePath << " (" << tris.count() << " tris)\n";
+            return 1;
+        }
+    } else {
+        Bvh4 app = build_tuned_bvh(lbvh.get(baseCfg.lbvh2_depth()).bvh2, tris, baseCfg);
+        set = generate_ray_set(
+            tris, Camera{}, width, height, (1u << RAY_KINDS) - 1, 0.25f,
+            [&](const Ray& r) { return trace_closest(app, tris, r); },
+            [&](const Ray& r) { return trace_occluded(app, tris, r); });
+    }
+    if (set.size() == 0) {
+        std::cerr << "No rays to trace\n";
+        return 1;
+    }
+
+    // One shuffle; rung k traces its first n_k rays, kept in set order so
+    // the sample stays as coherent as the full set.
+    std::vector<uint32_t> perm(set.size());
+    std::iota(perm.begin(), perm.end(), 0u);
+    Rng rng(uint64_t(args.u32("seed", 1)), 7);
+    for (size_t i = perm.size(); i > 1; --i) std::swap(perm[i - 1], perm[rng.next() % i]);
+    auto sample = [&](uint64_t n) {
+        std::vector<uint32_t> idx(perm.begin(), perm.begin() + n);
+        std::sort(idx.begin(), idx.end());
+        return idx;
+    };
+
+    // Rung sizes: survivors shrink by eta, rays grow by eta up to the set.
+    // Rungs past what halving needs, or below --min-rays, are not run, so
+    // every rung traces strictly more rays than the one before.
+    uint32_t numRungs = 1;
+    for (size_t alive = cands.size(); alive > 1; alive = (alive + eta - 1) / eta) numRungs++;
+    uint32_t fitRungs = 1;
+    for (uint64_t n = set.size() / eta; n >= minRays && fitRungs < numRungs; n /= eta) fitRungs++;
+    numRungs = fitRungs;
+    std::vector<uint64_t> rungRays(numRungs);
+    rungRays[numRungs - 1] = set.size();
+    for (uint32_t k = numRungs - 1; k > 0; --k) rungRays[k - 1] = rungRays[k] / eta;
+
+    auto evaluate = [&](Candidate& c, uint32_t rung, const std::vector<uint32_t>& idx) {
+        const Lbvh2Cache::Entry& base = lbvh.get(c.cfg.lbvh2_depth());
+        if (!base.ok) {
+            c.dropped = "depth";
+            return;
+        }
+        BenchTimer t;
+        Bvh4 bvh = build_tuned_bvh(base.bvh2, tris, c.cfg);
+        c.buildMs = base.ms + t.ms();
+        if (c.rung < 0) {
+            VerifyReport vr = verify_bvh(bvh, c.cfg.arity, &tris, c.cfg.bounds == BOUNDS_FP32 ? 0.0 : 1.0, 0);
+            c.worstStack = vr.maxStack;
+            if (vr.errors()) c.dropped = "verify";
+            else if (vr.maxStack > c.cfg.maxStack) c.dropped = "stack";
+            if (!c.dropped.empty()) return;
+        }
+        const double ms = trace_sample(bvh, tris, set, idx, reps, minMs, c.passes, c.mismatches);
+        c.rung = int(rung);
+        c.rays = idx.size();
+        c.raysPerSec = double(idx.size()) / (ms * 1e-3);
+        c.score = c.raysPerSec;
+        if (frames > 0.0) {
+            const double frameS = double(set.size()) / c.raysPerSec;
+            c.score = double(set.size()) / (frameS + c.buildMs * 1e-3 / frames);
+        }
+        if (double(c.mismatches) > maxMismatch * double(idx.size())) c.dropped = "mismatch";
+    };
+
+    std::vector<Rung> rungs;
+    std::vector<uint32_t> alive(cands.size());
+    std::iota(alive.begin(), alive.end(), 0u);
+    bool outOfTime = false;
+    for (uint32_t k = 0; k < numRungs && !outOfTime && !alive.empty(); ++k) {
+        Rung rung;
+        rung.rays = rungRays[k];
+        const std::vector<uint32_t> idx = sample(rung.rays);
+        for (uint32_t ci : alive) {
+            if (clock.ms() * 1e-3 > budgetS) {
+                outOfTime = true;
+                break;
+            }
+            evaluate(cands[ci], k, idx);
+            if (cands[ci].dropped.empty()) rung.evaluated.push_back(ci);
+        }
+        std::sort(rung.evaluated.begin(), rung.evaluated.end(),
+                  [&](uint32_t a, uint32_t b) { return cands[a].score > cands[b].score; });
+        if (rung.evaluated.empty()) break;
+        for (uint32_t ci : rung.evaluated) rung.results.push_back(cands[ci]);
+        alive.assign(rung.evaluated.begin(),
+                     rung.evaluated.begin() + std::max<size_t>(1, (rung.evaluated.size() + eta - 1) / eta));
+        rungs.push_back(std::move(rung));
+        if (rungs.back().rays == set.size() && alive.size() == 1) break;
+    }
+
+    Candidate base;
+    base.cfg = baseCfg;
+    evaluate(base, uint32_t(rungs.size()), sample(set.size()));
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %zu rays, %zu candidates, eta %u, %u reps, %u threads\n\n", scenePath.c_str(),
+                 tris.count(), set.size(), cands.size(), eta, reps, worker_count());
+    for (size_t k = 0; k < rungs.size(); ++k) {
+        std::fprintf(text, "rung %zu: %zu candidates x %llu rays\n", k, rungs[k].evaluated.size(),
+                     (unsigned long long)rungs[k].rays);
+        std::fprintf(text, "  %-34s %9s %9s %9s %6s\n", "config", "Mrays/s", "score", "build ms", "stack");
+        for (const Candidate& c : rungs[k].results) {
+            std::fprintf(text, "  %-34s %9.3f %9.3f %9.1f %6u\n", c.cfg.name().c_str(), c.raysPerSec * 1e-6,
+                         c.score * 1e-6, c.buildMs, c.worstStack);
+        }
+    }
+    for (const Candidate& c : cands)
+        if (!c.dropped.empty())
+            std::fprintf(text, "dropped %-34s %s (stack %u, %llu mismatches)\n", c.cfg.name().c_str(),
+                         c.dropped.c_str(), c.worstStack, (unsigned long long)c.mismatches);
+    if (outOfTime) std::fprintf(text, "budget of %.0f s ran out in rung %zu\n", budgetS, rungs.size());
+
+    if (rungs.empty()) {
+        std::fprintf(text, "\nFAIL: no candidate qualified\n");
+        return 1;
+    }
+    const Candidate& win = cands[rungs.back().evaluated.front()];
+    std::fprintf(text, "\nbaseline %-34s %9.3f Mrays/s over %llu rays, build %.1f ms\n", base.cfg.name().c_str(),
+                 base.raysPerSec * 1e-6, (unsigned long long)base.rays, base.buildMs);
+    std::fprintf(text, "winner   %-34s %9.3f Mrays/s over %llu rays, build %.1f ms, %+.1f%% vs baseline%s\n",
+                 win.cfg.name().c_str(), win.raysPerSec * 1e-6, (unsigned long long)win.rays, win.buildMs,
+                 base.score > 0.0 ? (win.score / base.score - 1.0) * 100.0 : 0.0,
+                 win.cfg.gpu_ready() ? "" : " (CPU only)");
+    std::fprintf(text, "searched in %.1f s\n", clock.ms() * 1e-3);
+
+    if (!writePath.empty()) {
+        if (win.cfg.bounds == BOUNDS_FP32) {
+            std::cerr << "fp32 bounds have no file format; not writing " << writePath << "\n";
+            return 1;
+        }
+        Bvh4 bvh = build_tuned_bvh(lbvh.get(win.cfg.lbvh2_depth()).bvh2, tris, win.cfg);
+        if (!save_u32_file(writePath.c_str(), encode_bvh(bvh, win.cfg.arity))) {
+            std::cerr << "Failed to write " << writePath << "\n";
+            return 1;
+        }
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream file;
+        std::ostream* out = open_json_output(jsonPath, file);
+        if (!out) return 1;
+        JsonWriter w(*out);
+        auto write_candidate = [&](const Candidate& c) {
+            w.value("config", c.cfg.name());
+            w.value("rung", c.rung);
+            w.value("rays", c.rays);
+            w.value("passes", c.passes);
+            w.value("rays_per_s", c.raysPerSec);
+            w.value("score", c.score);
+            w.value("build_ms", c.buildMs);
+            w.value("worst_stack", c.worstStack);
+            w.value("mismatches", c.mismatches);
+            if (!c.dropped.empty()) w.value("dropped", c.dropped);
+        };
+        w.begin_object();
+        w.value("tool", "bin/autotune");
+        w.value("scene", scenePath);
+        w.value("rays", uint64_t(set.size()));
+        w.value("eta", eta);
+        w.value("frames", frames);
+        w.value("out_of_time", outOfTime);
+        w.value("winner", win.cfg.name());
+        w.value("gpu_ready", win.cfg.gpu_ready());
+        w.begin_object("winner_result");
+        write_candidate(win);
+        w.end_object();
+        w.begin_object("baseline");
+        write_candidate(base);
+        w.end_object();
+        w.begin_array("rungs");
+        for (const Rung& r : rungs) {
+            w.begin_object();
+            w.value("rays", r.rays);
+            w.begin_array("results");
+            for (const Candidate& c : r.results) {
+                w.begin_object();
+                write_candidate(c);
+                w.end_object();
+            }
+            w.end_array();
+            w.end_object();
+        }
+        w.end_array();
+        w.begin_array("candidates");
+        for (const Candidate& c : cands) {
+            w.begin_object();
+            write_candidate(c);
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+    }
+    std::fprintf(text, "%s\n", win.cfg.name().c_str());
+    return 0;
+}
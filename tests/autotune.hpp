@@ -0,0 +1,120 @@
+#pragma once
+
+// autotune.hpp
+// The build and layout settings of the traversed BVH as one value, so a
+// tuner can enumerate them and a pipeline can rebuild the winner from its
+// name ("bvh4/greedy-sah/dfs/tight/s40"):
+//
+//   arity      2 (the LBVH2 as built) or 4 (promoted, lbvh.hpp)
+//   collapse   grandchildren | greedy-sah, how BVH2 nodes are promoted
+//              (arity 4 only)
+//   order      file   node index order as built, promotion orphans kept
+//              dfs    reachable nodes in depth-first preorder
+//              bfs    reachable nodes breadth-first (siblings adjacent)
+//   bounds     widened  BVHBuilder.wgsl's one fp16 ULP per side per level
+//              tight    tight_f16_boxes() (inflation.hpp)
+//              fp32     exact boxes; the node formats have no room for
+//                       them, so this is a CPU-only reference
+//   max-stack  worst-case stack the LBVH2 is depth-bounded to
+//              (bound_lbvh2_depth); STACK_MAX leaves it as built
+//
+// Leaf size is not a setting: both node formats hold one triangle index per
+// leaf. The renderer only traverses BVH4, so a configuration is GPU-ready
+// when it is arity 4 without fp32 bounds.
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bvh.hpp"
+#include "inflation.hpp"
+#include "lbvh.hpp"
+#include "scene.hpp"
+
+enum TuneOrder : uint32_t { ORDER_FILE = 0, ORDER_DFS, ORDER_BFS, ORDER_COUNT };
+enum TuneBounds : uint32_t { BOUNDS_WIDENED = 0, BOUNDS_TIGHT, BOUNDS_FP32, BOUNDS_COUNT };
+
+static inline const char* const ORDER_NAMES[ORDER_COUNT] = {"file", "dfs", "bfs"};
+static inline const char* const BOUNDS_NAMES[BOUNDS_COUNT] = {"widened", "tight", "fp32"};
+
+struct TuneConfig {
+    uint32_t     arity = 4;
+    Bvh4Collapse collapse = COLLAPSE_GRANDCHILDREN;
+    TuneOrder    order = ORDER_FILE;
+    TuneBounds   bounds = BOUNDS_WIDENED;
+    uint32_t     maxStack = STACK_MAX;
+
+    bool gpu_ready() const { return arity == 4 && bounds != BOUNDS_FP32; }
+
+    std::string name() const {
+        std::string s = arity == 2 ? "bvh2" : std::string("bvh4/") + COLLAPSE_NAMES[collapse];
+        return s + "/" + ORDER_NAMES[order] + "/" + BOUNDS_NAMES[bounds] + "/s" + std::to_string(maxStack);
+    }
+
+    // Deepest LBVH2 that keeps the traversed tree within maxStack entries.
+    uint32_t lbvh2_depth() const { return arity == 2 ? maxStack - 1 : lbvh2_depth_for_stack(maxStack); }
+};
+
+// Index of `name` in `names`, or `count` if it is not there.
+static inline uint32_t tune_lookup(const std::string& name, const char* const* names, uint32_t count) {
+    uint32_t i = 0;
+    while (i < count && name != names[i]) ++i;
+    return i;
+}
+
+// Inverse of TuneConfig::name(); false on anything malformed.
+static inline bool parse_tune_config(const std::string& name, TuneConfig& cfg) {
+    std::vector<std::string> parts;
+    for (size_t b = 0, e; b <= name.size(); b = e + 1) {
+        e = name.find('/', b);
+        if (e == std::string::npos) e = name.size();
+        parts.push_back(name.substr(b, e - b));
+    }
+    if (parts.empty() || (parts[0] != "bvh2" && parts[0] != "bvh4")) return false;
+    cfg = TuneConfig{};
+    cfg.arity = parts[0] == "bvh2" ? 2 : 4;
+    size_t i = 1;
+    if (cfg.arity == 4) {
+        if (parts.size() != 5) return false;
+        uint32_t c = tune_lookup(parts[i++], COLLAPSE_NAMES, 2);
+        if (c == 2) return false;
+        cfg.collapse = Bvh4Collapse(c);
+    } else if (parts.size() != 4) {
+        return false;
+    }
+    uint32_t o = tune_lookup(parts[i++], ORDER_NAMES, ORDER_COUNT);
+    uint32_t b = tune_lookup(parts[i++], BOUNDS_NAMES, BOUNDS_COUNT);
+    const std::string& s = parts[i];
+    if (o == ORDER_COUNT || b == BOUNDS_COUNT || s.size() < 2 || s[0] != 's') return false;
+    cfg.order = TuneOrder(o);
+    cfg.bounds = TuneBounds(b);
+    cfg.maxStack = uint32_t(std::strtoul(s.c_str() + 1, nullptr, 10));
+    return cfg.maxStack >= 2;
+}
+
+// The configured tree from an LBVH2 already bounded to cfg.lbvh2_depth()
+// (several configurations share one). Promotion, bounds and relayout in
+// that order, so the boxes are final before nodes move.
+static inline Bvh4 build_tuned_bvh(const std::vector<uint32_t>& bvh2, const Triangles& tris, const TuneConfig& cfg) {
+    Bvh4 bvh = cfg.arity == 2 ? decode_bvh2(bvh2) : decode_bvh4(promote_bvh4(bvh2, cfg.collapse));
+    if (cfg.bounds == BOUNDS_TIGHT) {
+        tight_f16_boxes(bvh, cfg.arity, tris);
+    } else if (cfg.bounds == BOUNDS_FP32) {
+        std::vector<Aabb> exact = exact_node_bounds(bvh, cfg.arity, tris);
+        for (size_t n = 0; n < bvh.nodes.size(); ++n)
+            if (!exact[n].empty()) bvh.nodes[n].box = exact[n];
+    }
+    if (cfg.order != ORDER_FILE) bvh = relayout_bvh(bvh, bvh_reachable_order(bvh, cfg.order == ORDER_DFS));
+    return bvh;
+}
+
+// The whole pipeline from triangles; false if the scene cannot fit the
+// configured depth.
+static inline bool build_tuned_bvh(const Triangles& tris, const TuneConfig& cfg, Bvh4& out) {
+    MortonOrder order = morton_sort(tris);
+    std::vector<uint32_t> bvh2 = build_lbvh2(tris, order);
+    if (!bound_lbvh2_depth(bvh2, order, cfg.lbvh2_depth())) return false;
+    out = build_tuned_bvh(bvh2, tris, cfg);
+    return true;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+// bench.hpp
+// Repetition statistics for in-process benchmarks: per-phase sample lists,
+// min / median / mean / stddev / p99, and their JSON form. Two-sample
+// comparisons for regression gates: the Mann-Whitney rank test and a
+// bootstrap interval on the ratio of medians (or on the median of paired
+// ratios).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+struct BenchSummary {
+    size_t n = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0; // sample standard deviation (n - 1)
+    double p99 = 0.0;    // nearest rank
+    double max = 0.0;
+};
+
+static inline BenchSummary summarize(std::vector<double> v) {
+    BenchSummary s;
+    s.n = v.size();
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+
+    s.min = v.front();
+    s.max = v.back();
+    s.median = (v.size() & 1) ? v[v.size() / 2] : 0.5 * (v[v.size() / 2 - 1] + v[v.size() / 2]);
+    size_t rank = size_t(std::ceil(0.99 * double(v.size())));
+    s.p99 = v[std::max<size_t>(rank, 1) - 1];
+
+    double sum = 0.0;
+    for (double x : v) sum += x;
+    s.mean = sum / double(v.size());
+    double sq = 0.0;
+    for (double x : v) sq += (x - s.mean) * (x - s.mean);
+    s.stddev = v.size() > 1 ? std::sqrt(sq / double(v.size() - 1)) : 0.0;
+    return s;
+}
+
+// A named phase timed once per repetition. `items` and `bytes` are the work
+// one repetition does; throughput is derived from the median.
+struct BenchPhase {
+    std::string         name;
+    uint64_t            items = 0;
+    uint64_t            bytes = 0;
+    std::vector<double> ms;
+
+    double items_per_s(const BenchSummary& s) const { return s.median > 0.0 ? items / (s.median * 1e-3) : 0.0; }
+    double gb_per_s(const BenchSummary& s) const { return s.median > 0.0 ? bytes / (s.median * 1e-3) * 1e-9 : 0.0; }
+};
+
+class BenchTimer {
+public:
+    BenchTimer() : t0_(std::chrono::steady_clock::now()) {}
+
+    double ms() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0_).count(); }
+
+private:
+    std::chrono::steady_clock::time_point t0_;
+};
+
+static inline void write_bench_phase(JsonWriter& w, const BenchPhase& p, const char* itemName) {
+    BenchSummary s = summarize(p.ms);
+    w.begin_object(p.name.c_str());
+    w.value("reps", uint64_t(s.n));
+    w.value(itemName, p.items);
+    w.value("bytes", p.bytes);
+    w.value("min_ms", s.min);
+    w.value("median_ms", s.median);
+    w.value("mean_ms", s.mean);
+    w.value("stddev_ms", s.stddev);
+    w.value("p99_ms", s.p99);
+    w.value("max_ms", s.max);
+    w.value((std::string(itemName) + "_per_s").c_str(), p.items_per_s(s));
+    w.value("gb_per_s", p.gb_per_s(s));
+    w.begin_array("samples_ms");
+    for (double ms : p.ms) w.value(ms);
+    w.end_array();
+    w.end_object();
+}
+
+/* ================= Two-sample comparison ================= */
+
+struct RankTest {
+    double u = 0.0; // Mann-Whitney U of b over a
+    double z = 0.0; // > 0 when b tends to be larger
+    double p = 1.0; // one-sided: P(b stochastically larger than a) by chance
+};
+
+// Normal approximation with continuity and tie corrections; fine from ~8
+// samples per side, which is what the gates use.
+static inline RankTest mann_whitney_greater(const std::vector<double>& a, const std::vector<double>& b) {
+    RankTest t;
+    const size_t na = a.size(), nb = b.size(), n = na + nb;
+    if (!na || !nb) return t;
+    std::vector<std::pair<double, int>> all;
+    all.reserve(n);
+    for (double x : a) all.push_back({x, 0});
+    for (double x : b) all.push_back({x, 1});
+    std::sort(all.begin(), all.end());
+
+    double rankB = 0.0, ties = 0.0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && all[j].first == all[i].first) ++j;
+        double rank = 0.5 * double(i + 1 + j); // mean of ranks i+1 .. j
+        for (size_t k = i; k < j; ++k)
+            if (all[k].second) rankB += rank;
+        double tn = double(j - i);
+        ties += tn * tn * tn - tn;
+        i = j;
+    }
+    t.u = rankB - 0.5 * double(nb) * double(nb + 1);
+    const double mean = 0.5 * double(na) * double(nb);
+    const double var = double(na) * double(nb) / 12.0 * (double(n + 1) - ties / (double(n) * double(n - 1)));
+    if (var <= 0.0) return t;
+    t.z = (t.u - mean - 0.5) / std::sqrt(var);
+    t.p = 0.5 * std::erfc(t.z / std::sqrt(2.0));
+    return t;
+}
+
+struct RatioInterval {
+    double ratio = 1.0; // median(b) / median(a)
+    double lo = 1.0, hi = 1.0;
+};
+
+// Percentile bootstrap of median(b) / median(a), resampling both sides.
+static inline RatioInterval bootstrap_median_ratio(const std::vector<double>& a, const std::vector<double>& b,
+                                                   uint32_t resamples = 2000, double confidence = 0.95,
+                                                   uint64_t seed = 1) {
+    RatioInterval r;
+    if (a.empty() || b.empty()) return r;
+    auto median = [](std::vector<double>& v) {
+        size_t k = v.size() / 2;
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        double hi = v[k];
+        if (v.size() & 1) return hi;
+        return 0.5 * (hi + *std::max_element(v.begin(), v.begin() + k));
+    };
+    std::vector<double> ca = a, cb = b;
+    double ma = median(ca);
+    r.ratio = ma > 0.0 ? median(cb) / ma : 1.0;
+
+    std::mt19937_64 rng(seed);
+    std::vector<double> ratios;
+    ratios.reserve(resamples);
+    for (uint32_t i = 0; i < resamples; ++i) {
+        for (double& x : ca) x = a[rng() % a.size()];
+        for (double& x : cb) x = b[rng() % b.size()];
+        double m = median(ca);
+        if (m > 0.0) ratios.push_back(median(cb) / m);
+    }
+    if (ratios.empty()) return r;
+    std::sort(ratios.begin(), ratios.end());
+    const double tail = 0.5 * (1.0 - confidence);
+    r.lo = ratios[size_t(tail * double(ratios.size() - 1))];
+    r.hi = ratios[size_t((1.0 - tail) * double(ratios.size() - 1))];
+    return r;
+}
+
+// Percentile bootstrap of the median of paired ratios (e.g. per-rep
+// after / before times measured back to back).
+static inline RatioInterval bootstrap_median_interval(const std::vector<double>& v, uint32_t resamples = 2000,
+                                                      double confidence = 0.95, uint64_t seed = 1) {
+    RatioInterval r;
+    if (v.empty()) return r;
+    std::vector<double> c = v;
+    auto median = [&] {
+        size_t k = c.size() / 2;
+        std::nth_element(c.begin(), c.begin() + k, c.end());
+        double hi = c[k];
+        if (c.size() & 1) return hi;
+        return 0.5 * (hi + *std::max_element(c.begin(), c.begin() + k));
+    };
+    r.ratio = r.lo = r.hi = median();
+    if (!resamples) return r;
+
+    std::mt19937_64 rng(seed);
+    std::vector<double> medians(resamples);
+    for (double& m : medians) {
+        for (double& x : c) x = v[rng() % v.size()];
+        m = median();
+    }
+    std::sort(medians.begin(), medians.end());
+    const double tail = 0.5 * (1.0 - confidence);
+    r.lo = medians[size_t(tail * double(resamples - 1))];
+    r.hi = medians[size_t((1.0 - tail) * double(resamples - 1))];
+    return r;
+}
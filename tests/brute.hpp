@@ -0,0 +1,132 @@
+#pragma once
+
+// brute.hpp
+// Closest hit by testing every triangle: the reference the BVH traversals
+// are checked against. Triangles are stored as SoA v0 / e1 / e2 and tested
+// SIMD_W at a time (simd.hpp) with intersect_triangle()'s arithmetic and
+// epsilons, so a hit agrees with the scalar test up to FMA contraction.
+//
+// brute_closest_block() answers a block of rays per pass over the
+// triangles, tile by tile, so each tile is read from memory once per block
+// instead of once per ray. Padding lanes are degenerate (det = 0) and never
+// hit. Ties on t go to the lowest triangle index.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "scene.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t BRUTE_MAX_TRIS = 1u << 24;
+
+struct BruteTris {
+    uint32_t           count = 0;
+    uint32_t           padded = 0; // count rounded up to SIMD_W
+    std::vector<float> v0[3], e1[3], e2[3];
+};
+
+static inline BruteTris make_brute_tris(const Triangles& tris) {
+    BruteTris b;
+    b.count = tris.count();
+    b.padded = (b.count + SIMD_W - 1) / SIMD_W * SIMD_W;
+    for (int k = 0; k < 3; ++k) {
+        b.v0[k].assign(b.padded, 0.0f);
+        b.e1[k].assign(b.padded, 0.0f);
+        b.e2[k].assign(b.padded, 0.0f);
+    }
+    for (uint32_t i = 0; i < b.count; ++i) {
+        Vec3 v0 = tris.vertex(i, 0), e1 = tris.vertex(i, 1) - v0, e2 = tris.vertex(i, 2) - v0;
+        const float a[3] = {v0.x, v0.y, v0.z}, c[3] = {e1.x, e1.y, e1.z}, d[3] = {e2.x, e2.y, e2.z};
+        for (int k = 0; k < 3; ++k) {
+            b.v0[k][i] = a[k];
+            b.e1[k][i] = c[k];
+            b.e2[k][i] = d[k];
+        }
+    }
+    return b;
+}
+
+namespace brute_detail {
+
+// Per-ray, per-lane running best (t, triangle index as float: exact below
+// BRUTE_MAX_TRIS; -1 until the lane hits).
+struct Lanes {
+    float t[SIMD_W];
+    float idx[SIMD_W];
+};
+
+static inline void test_range(const BruteTris& b, const Ray& r, uint32_t begin, uint32_t end, Lanes& lanes) {
+    const vfloat eps = vset1(1e-7f), zero = vset1(0.0f), one = vset1(1.0f), inf = vset1(INF);
+    const vfloat ox = vset1(r.origin.x), oy = vset1(r.origin.y), oz = vset1(r.origin.z);
+    const vfloat dx = vset1(r.dir.x), dy = vset1(r.dir.y), dz = vset1(r.dir.z);
+    const vfloat tmin = vset1(r.tmin);
+    vfloat best = vload(lanes.t), bestIdx = vload(lanes.idx);
+    alignas(32) float base[SIMD_W];
+    for (int l = 0; l < SIMD_W; ++l) base[l] = float(l);
+    vfloat idx = vload(base) + vset1(float(begin));
+    const vfloat step = vset1(float(SIMD_W));
+
+    for (uint32_t i = begin; i < end; i += SIMD_W) {
+        vfloat e1x = vload(&b.e1[0][i]), e1y = vload(&b.e1[1][i]), e1z = vload(&b.e1[2][i]);
+        vfloat e2x = vload(&b.e2[0][i]), e2y = vload(&b.e2[1][i]), e2z = vload(&b.e2[2][i]);
+        // p = cross(dir, e2), det = dot(e1, p)
+        vfloat px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+        vfloat det = e1x * px + e1y * py + e1z * pz;
+        vfloat invDet = one / det;
+        vfloat sx = ox - vload(&b.v0[0][i]), sy = oy - vload(&b.v0[1][i]), sz = oz - vload(&b.v0[2][i]);
+        vfloat u = invDet * (sx * px + sy * py + sz * pz);
+        // q = cross(s, e1)
+        vfloat qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+        vfloat v = invDet * (dx * qx + dy * qy + dz * qz);
+        vfloat t = invDet * (e2x * qx + e2y * qy + e2z * qz);
+        // The scalar test's early outs; a NaN u or v passes them there too.
+        vmask reject = (vabs(det) < eps) | (u < zero) | (one < u) | (v < zero) | (one < u + v);
+        t = vselect(reject, inf, t);
+        vmask take = (eps < t) & (tmin < t) & (t < best);
+        best = vselect(take, t, best);
+        bestIdx = vselect(take, idx, bestIdx);
+        idx = idx + step;
+    }
+    vstore(lanes.t, best);
+    vstore(lanes.idx, bestIdx);
+}
+
+static inline Hit reduce(const Lanes& lanes) {
+    Hit h;
+    for (int l = 0; l < SIMD_W; ++l) {
+        if (lanes.idx[l] < 0.0f) continue;
+        uint32_t i = uint32_t(lanes.idx[l]);
+        if (!h.hit() || lanes.t[l] < h.t || (lanes.t[l] == h.t && i < h.tri)) {
+            h.t = lanes.t[l];
+            h.tri = i;
+        }
+    }
+    return h;
+}
+
+} // namespace brute_detail
+
+// `tile` triangles per pass; 4096 x 36 B keeps a tile in L2.
+static inline void brute_closest_block(const BruteTris& b, const Ray* rays, size_t n, Hit* out, uint32_t tile = 4096) {
+    using namespace brute_detail;
+    std::vector<Lanes> lanes(n);
+    for (size_t r = 0; r < n; ++r)
+        for (int l = 0; l < SIMD_W; ++l) {
+            lanes[r].t[l] = rays[r].tmax;
+            lanes[r].idx[l] = -1.0f;
+        }
+    tile = std::max<uint32_t>(tile / SIMD_W * SIMD_W, SIMD_W);
+    for (uint32_t t0 = 0; t0 < b.padded; t0 += tile) {
+        uint32_t t1 = std::min(b.padded, t0 + tile);
+        for (size_t r = 0; r < n; ++r) test_range(b, rays[r], t0, t1, lanes[r]);
+    }
+    for (size_t r = 0; r < n; ++r) out[r] = reduce(lanes[r]);
+}
+
+static inline Hit brute_closest(const BruteTris& b, const Ray& r) {
+    Hit h;
+    brute_closest_block(b, &r, 1, &h, b.padded ? b.padded : SIMD_W);
+    return h;
+}
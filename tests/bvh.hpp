@@ -0,0 +1,418 @@
+#pragma once
+
+// bvh.hpp
+// Shared BVH2 / BVH4 file layout helpers for the C++ tools in tests/.
+// Layouts match BVHBuilder.wgsl (LBVH2) and renderer.wgsl (BVH4):
+//
+//   u32[0]            node count
+//   node2 (6 u32)     b0 b1 b2 | left right meta
+//   node4 (8 u32)     b0 b1 b2 | c0 c1 c2 c3 meta
+//
+// Bounds are three pack2x16float words: (mn.x mn.y) (mn.z mx.x) (mx.y mx.z).
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include "timeline.hpp"
+
+static constexpr uint32_t NODE2_STRIDE_U32 = 6;
+static constexpr uint32_t NODE4_STRIDE_U32 = 8;
+static constexpr uint32_t LEAF_FLAG = 0x80000000u;
+static constexpr uint32_t INVALID   = 0xFFFFFFFFu;
+static constexpr uint32_t STACK_MAX = 64; // renderer.wgsl
+
+/* ================= File IO ================= */
+
+static inline bool load_u32_file(const char* path, std::vector<uint32_t>& out) {
+    TIMELINE_ZONE("load");
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return false;
+    std::streamsize size = f.tellg();
+    if (size <= 0 || (size & 3)) return false;
+    f.seekg(0, std::ios::beg);
+    out.resize(size_t(size >> 2));
+    return bool(f.read(reinterpret_cast<char*>(out.data()), size));
+}
+
+static inline bool save_u32_file(const char* path, const std::vector<uint32_t>& data) {
+    TIMELINE_ZONE("save");
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f.write(reinterpret_cast<const char*>(data.data()),
+            std::streamsize(data.size() << 2));
+    return bool(f);
+}
+
+static inline bool load_bytes_file(const char* path, std::vector<uint8_t>& out) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return false;
+    std::streamsize size = f.tellg();
+    if (size < 0) return false;
+    f.seekg(0, std::ios::beg);
+    out.resize(size_t(size));
+    return bool(f.read(reinterpret_cast<char*>(out.data()), size));
+}
+
+/* ================= Vec3 / AABB ================= */
+
+struct Vec3 {
+    float x, y, z;
+
+    float  operator[](int i) const { return (&x)[i]; }
+    float& operator[](int i)       { return (&x)[i]; }
+};
+
+static inline Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+static inline Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+static inline Vec3 operator*(Vec3 a, Vec3 b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+static inline Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+static inline Vec3 operator*(float s, Vec3 a) { return {a.x * s, a.y * s, a.z * s}; }
+static inline Vec3 operator-(Vec3 a) { return {-a.x, -a.y, -a.z}; }
+
+static inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+static inline Vec3 cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static inline float length(Vec3 a) { return std::sqrt(dot(a, a)); }
+
+static inline Vec3 normalize(Vec3 a) {
+    float l = length(a);
+    return l > 0.0f ? a * (1.0f / l) : a;
+}
+
+static inline Vec3 vmin(Vec3 a, Vec3 b) {
+    return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+
+static inline Vec3 vmax(Vec3 a, Vec3 b) {
+    return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+
+struct Aabb {
+    Vec3 mn{ 1e30f,  1e30f,  1e30f};
+    Vec3 mx{-1e30f, -1e30f, -1e30f};
+
+    void grow(Vec3 p)        { mn = vmin(mn, p); mx = vmax(mx, p); }
+    void grow(const Aabb& b) { mn = vmin(mn, b.mn); mx = vmax(mx, b.mx); }
+    bool empty() const       { return mn.x > mx.x || mn.y > mx.y || mn.z > mx.z; }
+    Vec3 center() const      { return (mn + mx) * 0.5f; }
+
+    float area() const {
+        if (empty()) return 0.0f;
+        Vec3 d = mx - mn;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    bool contains(const Aabb& b) const {
+        return b.mn.x >= mn.x && b.mn.y >= mn.y && b.mn.z >= mn.z &&
+               b.mx.x <= mx.x && b.mx.y <= mx.y && b.mx.z <= mx.z;
+    }
+};
+
+/* ================= FP16 ================= */
+
+static inline float f16_to_f32(uint32_t h) {
+    uint32_t s = (h & 0x8000u) << 16;
+    uint32_t e = (h >> 10) & 0x1Fu;
+    uint32_t m = h & 0x03FFu;
+    uint32_t u;
+
+    if (e == 0) {
+        if (m == 0) {
+            u = s;
+        } else {
+            // subnormal
+            e = 113;
+            while ((m & 0x0400u) == 0) { m <<= 1; e--; }
+            m &= 0x03FFu;
+            u = s | (e << 23) | (m << 13);
+        }
+    } else if (e == 31) {
+        u = s | 0x7F800000u | (m << 13);
+    } else {
+        u = s | ((e + 112) << 23) | (m << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &u, 4);
+    return f;
+}
+
+// Round-to-nearest-even. WGSL leaves pack2x16float rounding to the backend.
+static inline uint32_t f32_to_f16(float v) {
+    uint32_t u;
+    std::memcpy(&u, &v, 4);
+
+    uint32_t s = (u >> 16) & 0x8000u;
+    uint32_t a = u & 0x7FFFFFFFu;
+
+    if (a >= 0x7F800000u) return s | 0x7C00u | (a > 0x7F800000u ? 0x200u : 0u);
+    if (a >= 0x477FF000u) return s | 0x7C00u; // rounds past 65504
+
+    if (a < 0x38800000u) {
+        // subnormal / zero
+        if (a < 0x33000000u) return s;
+        uint32_t e = a >> 23;
+        uint32_t m = (a & 0x007FFFFFu) | 0x00800000u;
+        uint32_t shift = 126 - e;
+        uint32_t r = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1u);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (r & 1u))) r++;
+        return s | r;
+    }
+
+    uint32_t r = ((a - 0x38000000u) >> 13);
+    uint32_t rem = a & 0x1FFFu;
+    if (rem > 0x1000u || (rem == 0x1000u && (r & 1u))) r++;
+    return s | r;
+}
+
+// Round-toward-zero, as f32ToF16 in PathTracer.js (collapse re-pack), which
+// flushes fp16 subnormals to zero. The GPU that produced data/BVH2.bin also
+// truncates but keeps subnormals (flush = false): its leaf boxes reproduce
+// bit-exactly through increment_f16 below, not through f32_to_f16.
+static inline uint32_t f32_to_f16_trunc(float v, bool flush = true) {
+    uint32_t u;
+    std::memcpy(&u, &v, 4);
+    uint32_t s = (u >> 16) & 0x8000u;
+    int32_t  e = int32_t((u >> 23) & 0xFFu) - 112;
+    uint32_t m = (u >> 13) & 0x03FFu;
+
+    if (e <= 0) {
+        if (flush || e < -10) return s;
+        return s | (((u & 0x007FFFFFu) | 0x00800000u) >> (14 - e));
+    }
+    if (e >= 31) return s | 0x7C00u;
+    return s | (uint32_t(e) << 10) | m;
+}
+
+// incrementF16 from BVHBuilder.wgsl: step `iterations` fp16 ULPs up or down.
+static inline float increment_f16(float value, bool up, uint32_t iterations) {
+    uint32_t bits = f32_to_f16_trunc(value, false) & 0xFFFFu;
+    bool sign = (bits & 0x8000u) != 0;
+    uint32_t ord = sign ? ((~bits) & 0xFFFFu) : (bits ^ 0x8000u);
+    ord = up ? ord + iterations : ord - iterations;
+    bool ordSign = (ord & 0x8000u) != 0;
+    uint32_t bits2 = ordSign ? (ord ^ 0x8000u) : ((~ord) & 0xFFFFu);
+    return f16_to_f32(bits2 & 0xFFFFu);
+}
+
+// Nearest fp16 value at or below (up = false) / at or above v: no padding
+// beyond what rounding needs.
+static inline float f16_round_out(float v, bool up) {
+    float t = increment_f16(v, up, 0); // truncated toward zero
+    if (up ? t < v : t > v) t = increment_f16(v, up, 1);
+    return t;
+}
+
+// Spacing of fp16 values around v: 2^-24 through the subnormal range, then
+// 2^(exponent - 10).
+static inline double f16_ulp(float v) {
+    int e = -24;
+    if (v != 0.0f) std::frexp(std::fabs(double(v)), &e);
+    return std::ldexp(1.0, std::max(e - 11, -24));
+}
+
+// Largest amount, in fp16 ULPs at `outer`'s face, by which `inner` sticks
+// out of `outer`; 0 when contained. `axis` gets the face (0..2 min x..z,
+// 3..5 max x..z) when given.
+static inline double aabb_overshoot_ulps(const Aabb& outer, const Aabb& inner, int* axis = nullptr) {
+    const float o[6] = {outer.mn.x, outer.mn.y, outer.mn.z, outer.mx.x, outer.mx.y, outer.mx.z};
+    const float i[6] = {inner.mn.x, inner.mn.y, inner.mn.z, inner.mx.x, inner.mx.y, inner.mx.z};
+    double worst = 0.0;
+    for (int f = 0; f < 6; ++f) {
+        double over = f < 3 ? double(o[f]) - double(i[f]) : double(i[f]) - double(o[f]);
+        if (over > 0.0 && over / f16_ulp(o[f]) > worst) {
+            worst = over / f16_ulp(o[f]);
+            if (axis) *axis = f;
+        }
+    }
+    return worst;
+}
+
+static inline uint32_t pack2x16(float a, float b) {
+    return f32_to_f16(a) | (f32_to_f16(b) << 16);
+}
+
+static inline Aabb decode_bounds(const uint32_t* b) {
+    Aabb box;
+    box.mn = {f16_to_f32(b[0] & 0xFFFFu), f16_to_f32(b[0] >> 16), f16_to_f32(b[1] & 0xFFFFu)};
+    box.mx = {f16_to_f32(b[1] >> 16), f16_to_f32(b[2] & 0xFFFFu), f16_to_f32(b[2] >> 16)};
+    return box;
+}
+
+static inline void encode_bounds(const Aabb& box, uint32_t* b) {
+    b[0] = pack2x16(box.mn.x, box.mn.y);
+    b[1] = pack2x16(box.mn.z, box.mx.x);
+    b[2] = pack2x16(box.mx.y, box.mx.z);
+}
+
+/* ================= BVH helpers ================= */
+
+static inline size_t node2_off(uint32_t n) {
+    return size_t(1u + n * NODE2_STRIDE_U32);
+}
+
+static inline size_t node4_off(uint32_t n) {
+    return size_t(1u + n * NODE4_STRIDE_U32);
+}
+
+static inline bool is_leaf2(const std::vector<uint32_t>& bvh2,
+                            uint32_t n,
+                            uint32_t numNodes2) {
+    if (n >= numNodes2) return true;
+    return (bvh2[node2_off(n) + 5] & LEAF_FLAG) != 0;
+}
+
+// Decoded BVH4 node: fp16 bounds widened to f32 once at load time so the
+// CPU traversal does not pay for unpack2x16float on every box test.
+struct Bvh4Node {
+    Aabb     box;
+    uint32_t child[4];
+    uint32_t meta;
+
+    bool     leaf() const { return (meta & LEAF_FLAG) != 0; }
+    uint32_t tri()  const { return meta & 0x7FFFFFFFu; }
+};
+
+struct Bvh4 {
+    std::vector<Bvh4Node> nodes;
+};
+
+static inline Bvh4 decode_bvh4(const std::vector<uint32_t>& raw) {
+    Bvh4 out;
+    if (raw.empty()) return out;
+
+    uint32_t numNodes = raw[0];
+    if (size_t(1) + size_t(numNodes) * NODE4_STRIDE_U32 > raw.size()) {
+        numNodes = uint32_t((raw.size() - 1) / NODE4_STRIDE_U32);
+    }
+
+    out.nodes.resize(numNodes);
+    for (uint32_t n = 0; n < numNodes; ++n) {
+        const uint32_t* p = raw.data() + node4_off(n);
+        Bvh4Node& node = out.nodes[n];
+        node.box = decode_bounds(p);
+        for (int c = 0; c < 4; ++c) node.child[c] = p[3 + c];
+        node.meta = p[7];
+    }
+    return out;
+}
+
+// A BVH2 readback in the same decoded form, child[2..3] = INVALID, so tools
+// that walk Bvh4 can take either file.
+static inline Bvh4 decode_bvh2(const std::vector<uint32_t>& raw) {
+    Bvh4 out;
+    if (raw.empty()) return out;
+
+    uint32_t numNodes = raw[0];
+    if (size_t(1) + size_t(numNodes) * NODE2_STRIDE_U32 > raw.size()) {
+        numNodes = uint32_t((raw.size() - 1) / NODE2_STRIDE_U32);
+    }
+
+    out.nodes.resize(numNodes);
+    for (uint32_t n = 0; n < numNodes; ++n) {
+        const uint32_t* p = raw.data() + node2_off(n);
+        Bvh4Node& node = out.nodes[n];
+        node.box = decode_bounds(p);
+        node.child[0] = p[3];
+        node.child[1] = p[4];
+        node.child[2] = node.child[3] = INVALID;
+        node.meta = p[5];
+        if (node.leaf()) node.child[0] = node.child[1] = INVALID;
+    }
+    return out;
+}
+
+// 2 or 4 from the node count in word 0 and the file length, 0 if neither
+// stride fits.
+static inline uint32_t bvh_file_arity(const std::vector<uint32_t>& raw) {
+    if (raw.empty()) return 0;
+    size_t n = raw[0];
+    if (raw.size() == 1 + n * NODE4_STRIDE_U32) return 4;
+    if (raw.size() == 1 + n * NODE2_STRIDE_U32) return 2;
+    return 0;
+}
+
+// Inverse of decode_bvh4 / decode_bvh2. Boxes go through encode_bounds, so
+// they round-trip exactly only when they already hold fp16 values.
+static inline std::vector<uint32_t> encode_bvh(const Bvh4& bvh, uint32_t arity) {
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    const uint32_t stride = arity == 2 ? NODE2_STRIDE_U32 : NODE4_STRIDE_U32;
+    std::vector<uint32_t> raw(1 + size_t(numNodes) * stride, 0u);
+    raw[0] = numNodes;
+    for (uint32_t n = 0; n < numNodes; ++n) {
+        const Bvh4Node& node = bvh.nodes[n];
+        uint32_t* p = raw.data() + 1 + size_t(n) * stride;
+        encode_bounds(node.box, p);
+        if (arity == 2) {
+            p[3] = node.leaf() ? 0u : node.child[0];
+            p[4] = node.leaf() ? 0u : node.child[1];
+            p[5] = node.meta;
+        } else {
+            for (int c = 0; c < 4; ++c) p[3 + c] = node.child[c];
+            p[7] = node.meta;
+        }
+    }
+    return raw;
+}
+
+// Reachable nodes in depth-first preorder (child 0 first) or breadth-first
+// order, where each node's children are adjacent.
+static inline std::vector<uint32_t> bvh_reachable_order(const Bvh4& bvh, bool depthFirst) {
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    std::vector<uint32_t> order, work{0};
+    std::vector<uint8_t> seen(numNodes, 0);
+    if (!numNodes) return order;
+    seen[0] = 1;
+    for (size_t head = 0; depthFirst ? !work.empty() : head < work.size();) {
+        uint32_t n;
+        if (depthFirst) {
+            n = work.back();
+            work.pop_back();
+        } else {
+            n = work[head++];
+        }
+        order.push_back(n);
+        const Bvh4Node& node = bvh.nodes[n];
+        if (node.leaf()) continue;
+        for (int k = 0; k < 4; ++k) {
+            uint32_t c = node.child[depthFirst ? 3 - k : k];
+            if (c == INVALID || c >= numNodes || seen[c]) continue;
+            seen[c] = 1;
+            work.push_back(c);
+        }
+    }
+    return order;
+}
+
+// The nodes listed in `order` (root first), renumbered by their position in
+// it; everything else (promotion orphans) is dropped.
+static inline Bvh4 relayout_bvh(const Bvh4& bvh, const std::vector<uint32_t>& order) {
+    std::vector<uint32_t> slot(bvh.nodes.size(), INVALID);
+    for (uint32_t i = 0; i < order.size(); ++i) slot[order[i]] = i;
+    Bvh4 out;
+    out.nodes.resize(order.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        Bvh4Node& node = out.nodes[i];
+        node = bvh.nodes[order[i]];
+        if (node.leaf()) continue;
+        for (uint32_t& c : node.child)
+            if (c != INVALID) c = c < slot.size() ? slot[c] : INVALID;
+    }
+    return out;
+}
+
+static inline bool load_bvh4(const char* path, Bvh4& out) {
+    std::vector<uint32_t> raw;
+    if (!load_u32_file(path, raw)) return false;
+    out = decode_bvh4(raw);
+    return !out.nodes.empty();
+}
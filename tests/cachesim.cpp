@@ -0,0 +1,188 @@
+// cachesim.cpp
+// Cache behaviour of the traversal per BVH format and node layout: traces
+// one primary ray per pixel, recording the node and triangle reads the
+// shader makes, and replays them through the cache model in cachesim.hpp
+// under each layout and replay mode.
+//
+//   bin/cachesim [--scene public/assets/dragon.glb]
+//                [--bvh data/BVH4_wide.bin,data/BVH2.bin|lbvh]
+//                [--size 320x180] [--pos 0,0,2.5] [--quat 0,0,0,1] [--fov 70]
+//                [--l1 64K,64,8] [--l2 512K,64,16|0] [--simd 8]
+//                [--layouts file,aligned,dfs,bfs] [--modes ray,packet,simd]
+//                [--json out.json|-]
+//
+// Caches are given as SIZE,LINE,WAYS. The defaults are in the range of an
+// integrated GPU's data cache and last-level cache; set them to the target.
+// BVH2 files are read with 24-byte nodes, BVH4 with 32-byte ones.
+//
+// Per row: reads = node + triangle fetches per ray, req = L1 line requests
+// per ray after merging, the L1 hit rate, the L2 hit rate of L1 misses,
+// bytes moved into L1 per ray and bytes from DRAM per ray.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "cachesim.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+
+struct SimRow {
+    std::string   bvh, layout;
+    uint32_t      arity = 4;
+    ReplayMode    mode = ReplayMode::Ray;
+    CacheCounters c;
+};
+
+static bool load_tree(const std::string& path, const Triangles& tris, Bvh4& bvh, uint32_t& arity) {
+    if (path == "lbvh") {
+        bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, morton_sort(tris))));
+        arity = 4;
+        return true;
+    }
+    std::vector<uint32_t> raw;
+    if (!load_u32_file(path.c_str(), raw) || raw.empty()) {
+        std::cerr << "Failed to read " << path << "\n";
+        return false;
+    }
+    arity = bvh_file_arity(raw);
+    if (!arity) {
+        std::cerr << path << ": length matches neither the BVH2 nor the BVH4 stride\n";
+        return false;
+    }
+    bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::vector<std::string> bvhPaths = args.strs("bvh", "data/BVH4_wide.bin,data/BVH2.bin");
+    std::vector<std::string> layoutNames = args.strs("layouts", "file,aligned,dfs,bfs");
+    std::vector<std::string> modeNames = args.strs("modes", "ray,packet,simd");
+    std::string jsonPath = args.str("json", "");
+    uint32_t simd = args.u32("simd", 8);
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+
+    Camera cam;
+    std::vector<double> pos = args.nums("pos", ""), quat = args.nums("quat", "");
+    if (pos.size() == 3) cam.pos = {float(pos[0]), float(pos[1]), float(pos[2])};
+    if (quat.size() == 4)
+        for (int k = 0; k < 4; ++k) cam.quat[k] = float(quat[k]);
+    cam.fovDeg = float(args.num("fov", cam.fovDeg));
+
+    CacheConfig l1, l2;
+    std::string l1Spec = args.str("l1", "64K,64,8"), l2Spec = args.str("l2", "512K,64,16");
+    if (!parse_cache_config(l1Spec, l1) || !l1.size) {
+        std::cerr << "--l1 must be SIZE,LINE,WAYS (got " << l1Spec << ")\n";
+        return 1;
+    }
+    if (!parse_cache_config(l2Spec, l2) || (l2.size && l2.line % l1.line != 0)) {
+        std::cerr << "--l2 must be 0 or SIZE,LINE,WAYS with LINE a multiple of the L1 line (got " << l2Spec
+                  << ")\n";
+        return 1;
+    }
+
+    std::vector<ReplayMode> modes;
+    for (const std::string& m : modeNames) {
+        if (m == "ray") modes.push_back(ReplayMode::Ray);
+        else if (m == "packet") modes.push_back(ReplayMode::Packet);
+        else if (m == "simd") modes.push_back(ReplayMode::Simd);
+        else {
+            std::cerr << "Unknown mode " << m << " (ray, packet, simd)\n";
+            return 1;
+        }
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %ux%u primary rays, simd %u\n", scenePath.c_str(), tris.count(), width,
+                 height, simd);
+    std::fprintf(text, "L1 %s  L2 %s  (size,line,ways)\n\n", l1Spec.c_str(), l2Spec.c_str());
+    std::fprintf(text, "%-22s %-8s %-6s %8s %8s %7s %7s %10s %10s\n", "bvh", "layout", "mode", "reads", "req",
+                 "L1 hit", "L2 hit", "L1 B/ray", "DRAM B/ray");
+
+    std::vector<SimRow> rows;
+    for (const std::string& path : bvhPaths) {
+        Bvh4 bvh;
+        uint32_t arity = 4;
+        if (!load_tree(path, tris, bvh, arity)) return 1;
+        const uint32_t nodeBytes = (arity == 2 ? NODE2_STRIDE_U32 : NODE4_STRIDE_U32) * 4;
+        RayTraces traces = record_primary_traces(bvh, tris, cam, width, height);
+        std::vector<MemoryLayout> layouts = make_layouts(bvh, nodeBytes);
+
+        for (const std::string& name : layoutNames) {
+            const MemoryLayout* lay = nullptr;
+            for (const MemoryLayout& m : layouts)
+                if (m.name == name) lay = &m;
+            if (!lay) {
+                std::cerr << "Unknown layout " << name << " (file, aligned, dfs, bfs)\n";
+                return 1;
+            }
+            for (ReplayMode mode : modes) {
+                CacheHierarchy mem;
+                mem.init(l1, l2);
+                SimRow row;
+                row.bvh = path;
+                row.layout = name;
+                row.arity = arity;
+                row.mode = mode;
+                row.c = replay_traces(traces, *lay, mode, simd, mem);
+
+                const double rays = double(std::max<uint64_t>(row.c.rays, 1));
+                const double misses = double(row.c.requests - row.c.l1Hits);
+                std::fprintf(text, "%-22s %-8s %-6s %8.1f %8.1f %6.1f%% %6.1f%% %10.0f %10.0f\n", path.c_str(),
+                             name.c_str(), replay_mode_name(mode), row.c.reads / rays, row.c.requests / rays,
+                             row.c.requests ? 100.0 * row.c.l1Hits / row.c.requests : 0.0,
+                             misses > 0.0 ? 100.0 * row.c.l2Hits / misses : 0.0, misses * l1.line / rays,
+                             double(row.c.dramLines) * mem.dram_line() / rays);
+                rows.push_back(row);
+            }
+        }
+    }
+
+    if (jsonPath.empty()) return 0;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/cachesim");
+    w.value("scene", scenePath);
+    w.value("width", width);
+    w.value("height", height);
+    w.value("simd", simd);
+    for (int level = 0; level < 2; ++level) {
+        const CacheConfig& c = level ? l2 : l1;
+        w.begin_object(level ? "l2" : "l1");
+        w.value("size", c.size);
+        w.value("line", c.line);
+        w.value("ways", c.ways);
+        w.end_object();
+    }
+    w.begin_array("results");
+    for (const SimRow& r : rows) {
+        w.begin_object();
+        w.value("bvh", r.bvh);
+        w.value("arity", r.arity);
+        w.value("layout", r.layout);
+        w.value("mode", replay_mode_name(r.mode));
+        w.value("rays", r.c.rays);
+        w.value("reads", r.c.reads);
+        w.value("requests", r.c.requests);
+        w.value("l1_hits", r.c.l1Hits);
+        w.value("l2_hits", r.c.l2Hits);
+        w.value("dram_lines", r.c.dramLines);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return 0;
+}
@@ -0,0 +1,376 @@
+#pragma once
+
+// cachesim.hpp
+// Memory-hierarchy model for the traversal's buffer reads. Rays are traced
+// once on the CPU with TraceStats::accesses recording every node and
+// triangle fetch the shader makes; those traces are then mapped to byte
+// addresses under a buffer layout and replayed in GPU dispatch order
+// through a set-associative LRU L1 backed by an optional L2.
+//
+// Dispatch order follows renderer.wgsl: @workgroup_size(16,16,1) with one
+// 2x2 packet per invocation, so a workgroup covers 32x32 pixels;
+// workgroups run row-major, one at a time. Replay modes:
+//
+//   ray     one ray at a time, no merging (a CPU-style baseline)
+//   packet  the 4 rays of a packet step together; reads of the same line
+//           in the same step merge into one request
+//   simd    the same across `simd` consecutive invocations (4*simd lanes)
+//
+// In packet / simd mode every lock-step group of a workgroup advances one
+// read per round, so the groups share the caches the way resident threads
+// do. The per-ray traces stand in for the packet walk, which visits the
+// union of its lanes' nodes; step k of a group is each lane's k-th read.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+/* ================= Cache model ================= */
+
+struct CacheConfig {
+    uint32_t size = 0;  // bytes; 0 = level absent
+    uint32_t line = 64;
+    uint32_t ways = 8;
+};
+
+// "SIZE,LINE,WAYS" with K / M suffixes on SIZE, e.g. "64K,64,8"; "0" disables.
+static inline bool parse_cache_config(const std::string& s, CacheConfig& out) {
+    char* end = nullptr;
+    unsigned long long size = std::strtoull(s.c_str(), &end, 10);
+    if (end == s.c_str()) return false;
+    if (*end == 'K' || *end == 'k') size <<= 10, ++end;
+    else if (*end == 'M' || *end == 'm') size <<= 20, ++end;
+    CacheConfig c;
+    c.size = uint32_t(size);
+    if (*end == ',') {
+        c.line = uint32_t(std::strtoul(end + 1, &end, 10));
+        if (*end == ',') c.ways = uint32_t(std::strtoul(end + 1, &end, 10));
+    }
+    if (*end != '\0' || c.line == 0 || (c.line & (c.line - 1)) != 0 || c.ways == 0) return false;
+    if (c.size && c.size < c.line * c.ways) return false;
+    out = c;
+    return true;
+}
+
+// One level: `size / (line * ways)` sets indexed by line address modulo the
+// set count, true LRU within a set.
+class CacheLevel {
+public:
+    void init(const CacheConfig& c) {
+        cfg_ = c;
+        sets_ = c.size ? c.size / (c.line * c.ways) : 0;
+        tag_.assign(size_t(sets_) * c.ways, ~uint64_t(0));
+        stamp_.assign(tag_.size(), 0);
+        clock_ = 0;
+    }
+
+    bool present() const { return sets_ != 0; }
+    const CacheConfig& config() const { return cfg_; }
+
+    // `lineAddr` is a byte address divided by the line size.
+    bool access(uint64_t lineAddr) {
+        if (!sets_) return false;
+        size_t base = size_t(lineAddr % sets_) * cfg_.ways, victim = base;
+        ++clock_;
+        for (size_t w = base; w < base + cfg_.ways; ++w) {
+            if (tag_[w] == lineAddr) {
+                stamp_[w] = clock_;
+                return true;
+            }
+            if (stamp_[w] < stamp_[victim]) victim = w;
+        }
+        tag_[victim] = lineAddr;
+        stamp_[victim] = clock_;
+        return false;
+    }
+
+private:
+    CacheConfig           cfg_;
+    uint32_t              sets_ = 0;
+    std::vector<uint64_t> tag_, stamp_;
+    uint64_t              clock_ = 0;
+};
+
+struct CacheCounters {
+    uint64_t rays = 0;
+    uint64_t reads = 0;     // node / triangle fetches before merging
+    uint64_t requests = 0;  // L1 line requests after merging
+    uint64_t l1Hits = 0;
+    uint64_t l2Hits = 0;
+    uint64_t dramLines = 0; // L2 misses (L1 misses when there is no L2)
+};
+
+class CacheHierarchy {
+public:
+    // The L2 line must be a multiple of the L1 line.
+    bool init(const CacheConfig& l1, const CacheConfig& l2) {
+        if (!l1.size || (l2.size && l2.line % l1.line != 0)) return false;
+        l1_.init(l1);
+        l2_.init(l2);
+        counters = {};
+        return true;
+    }
+
+    uint32_t line() const { return l1_.config().line; }
+    uint32_t dram_line() const { return l2_.present() ? l2_.config().line : l1_.config().line; }
+
+    void request(uint64_t lineAddr) {
+        counters.requests++;
+        if (l1_.access(lineAddr)) {
+            counters.l1Hits++;
+        } else if (l2_.present() && l2_.access(lineAddr * l1_.config().line / l2_.config().line)) {
+            counters.l2Hits++;
+        } else {
+            counters.dramLines++;
+        }
+    }
+
+    CacheCounters counters;
+
+private:
+    CacheLevel l1_, l2_;
+};
+
+/* ================= Buffer layouts ================= */
+
+// Where a trace's node and triangle reads land. `slot` renumbers nodes and
+// `triSlot` triangles (empty = file order); nodes sit at nodeBase + slot *
+// nodeBytes in the BVH buffer, triangles at triBase + triSlot * 36 in their
+// own buffer.
+struct MemoryLayout {
+    std::string           name;
+    uint64_t              nodeBase = 4; // the u32 node-count header
+    uint32_t              nodeBytes = NODE4_STRIDE_U32 * 4;
+    uint64_t              triBase = 0;
+    std::vector<uint32_t> slot;
+    std::vector<uint32_t> triSlot;
+
+    uint64_t address(uint32_t access, uint32_t& bytes) const {
+        if (access & TRACE_TRI_BIT) {
+            const uint32_t t = access & ~TRACE_TRI_BIT;
+            bytes = 36;
+            return triBase + uint64_t(triSlot.empty() ? t : triSlot[t]) * 36;
+        }
+        bytes = nodeBytes;
+        return nodeBase + uint64_t(slot.empty() ? access : slot[access]) * nodeBytes;
+    }
+};
+
+// file     the buffer as uploaded: 4-byte header, nodes in stored order
+// aligned  same order with the header padded to a whole node, so 32-byte
+//          BVH4 nodes never straddle a line
+// dfs      reachable nodes only, depth-first preorder, padded header
+// bfs      reachable nodes only, breadth-first (siblings adjacent)
+// Unreachable nodes map past the end in the compacted layouts; traces never
+// read them.
+static inline std::vector<MemoryLayout> make_layouts(const Bvh4& bvh, uint32_t nodeBytes) {
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    std::vector<MemoryLayout> out(4);
+    out[0].name = "file";
+    out[1].name = "aligned";
+    out[2].name = "dfs";
+    out[3].name = "bfs";
+    for (size_t l = 0; l < out.size(); ++l) {
+        MemoryLayout& m = out[l];
+        m.nodeBytes = nodeBytes;
+        m.nodeBase = l == 0 ? 4 : nodeBytes;
+        if (l >= 2) {
+            std::vector<uint32_t> order = bvh_reachable_order(bvh, l == 2);
+            m.slot.assign(numNodes, uint32_t(order.size()));
+            for (uint32_t i = 0; i < order.size(); ++i) m.slot[order[i]] = i;
+        }
+        // Separate GPU buffers; start the triangles on a fresh page.
+        m.triBase = (m.nodeBase + uint64_t(numNodes) * nodeBytes + 4095) & ~uint64_t(4095);
+    }
+    return out;
+}
+
+/* ================= Traces ================= */
+
+// Primary-ray reads for a width x height frame, ray i = y * width + x,
+// reads of ray i in access[offset[i] .. offset[i + 1]).
+struct RayTraces {
+    uint32_t              width = 0, height = 0;
+    std::vector<uint64_t> offset;
+    std::vector<uint32_t> access;
+
+    size_t rays() const { return size_t(width) * height; }
+};
+
+static inline RayTraces record_primary_traces(const Bvh4& bvh, const Triangles& tris, const Camera& cam,
+                                              uint32_t width, uint32_t height) {
+    RayTraces out;
+    out.width = width;
+    out.height = height;
+    struct Row {
+        std::vector<uint32_t> access, count;
+    };
+    std::vector<Row> rows(height);
+    parallel_for(0, height, 1, [&](size_t y) {
+        Row& row = rows[y];
+        row.count.resize(width);
+        for (uint32_t x = 0; x < width; ++x) {
+            TraceStats ts;
+            ts.accesses = &row.access;
+            size_t before = row.access.size();
+            trace_closest(bvh, tris, primary_ray(cam, float(x), float(y), width, height), &ts);
+            row.count[x] = uint32_t(row.access.size() - before);
+        }
+    });
+    out.offset.assign(out.rays() + 1, 0);
+    size_t total = 0;
+    for (const Row& row : rows) total += row.access.size();
+    out.access.reserve(total);
+    for (uint32_t y = 0; y < height; ++y) {
+        Row& row = rows[y];
+        for (uint32_t x = 0; x < width; ++x) {
+            size_t i = size_t(y) * width + x;
+            out.offset[i + 1] = out.offset[i] + row.count[x];
+        }
+        out.access.insert(out.access.end(), row.access.begin(), row.access.end());
+        row = Row{};
+    }
+    return out;
+}
+
+/* ================= Footprint ================= */
+
+// Distinct lines and pages a set of traces reads under a layout: the
+// compulsory misses of any cache with that line size, and the pages the
+// GPU must have resident (and translated) for the frame.
+struct TraceFootprint {
+    uint64_t lines = 0;
+    uint64_t pages = 0;
+};
+
+static inline TraceFootprint trace_footprint(const RayTraces& tr, const MemoryLayout& lay, uint32_t line = 64,
+                                             uint32_t page = 4096) {
+    std::vector<uint64_t> lines;
+    lines.reserve(tr.access.size());
+    for (uint32_t a : tr.access) {
+        uint32_t bytes;
+        uint64_t addr = lay.address(a, bytes);
+        for (uint64_t l = addr / line; l <= (addr + bytes - 1) / line; ++l) lines.push_back(l);
+    }
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+    TraceFootprint f;
+    f.lines = lines.size();
+    uint64_t last = ~uint64_t(0);
+    for (uint64_t l : lines) {
+        uint64_t p = l * line / page;
+        if (p != last) f.pages++;
+        last = p;
+    }
+    return f;
+}
+
+/* ================= Replay ================= */
+
+enum class ReplayMode { Ray, Packet, Simd };
+
+static inline const char* replay_mode_name(ReplayMode m) {
+    return m == ReplayMode::Ray ? "ray" : m == ReplayMode::Packet ? "packet" : "simd";
+}
+
+// renderer.wgsl: @workgroup_size(16,16,1), PACKET_W = PACKET_H = 2.
+static constexpr uint32_t SHADER_WORKGROUP = 16;
+static constexpr uint32_t SHADER_PACKET = 2;
+
+namespace cachesim_detail {
+
+// Ray indices of one workgroup in invocation order, 4 per packet (missing
+// pixels at the frame edge are left out).
+static inline void workgroup_rays(const RayTraces& tr, uint32_t wx, uint32_t wy, std::vector<uint32_t>& out,
+                                  std::vector<uint32_t>& packetStart) {
+    out.clear();
+    packetStart.clear();
+    for (uint32_t ly = 0; ly < SHADER_WORKGROUP; ++ly)
+        for (uint32_t lx = 0; lx < SHADER_WORKGROUP; ++lx) {
+            packetStart.push_back(uint32_t(out.size()));
+            uint32_t px = (wx * SHADER_WORKGROUP + lx) * SHADER_PACKET;
+            uint32_t py = (wy * SHADER_WORKGROUP + ly) * SHADER_PACKET;
+            for (uint32_t k = 0; k < SHADER_PACKET * SHADER_PACKET; ++k) {
+                uint32_t x = px + k % SHADER_PACKET, y = py + k / SHADER_PACKET;
+                if (x < tr.width && y < tr.height) out.push_back(y * tr.width + x);
+            }
+        }
+    packetStart.push_back(uint32_t(out.size()));
+}
+
+static inline void push_lines(const MemoryLayout& lay, uint32_t access, uint32_t line, std::vector<uint64_t>& out) {
+    uint32_t bytes;
+    uint64_t a = lay.address(access, bytes);
+    for (uint64_t l = a / line; l <= (a + bytes - 1) / line; ++l) out.push_back(l);
+}
+
+} // namespace cachesim_detail
+
+// One batch of resident lock-step groups: group g steps traces
+// ids[groupStart[g] .. groupStart[g + 1]) together, and every group issues
+// its next step before any issues the one after. Same-line reads within a
+// group's step merge into one request.
+static inline void replay_lockstep(const RayTraces& tr, const MemoryLayout& lay, const std::vector<uint32_t>& ids,
+                                   const std::vector<uint32_t>& groupStart, CacheHierarchy& mem) {
+    const uint32_t line = mem.line();
+    std::vector<uint64_t> lines;
+    for (uint64_t step = 0;; ++step) {
+        bool active = false;
+        for (size_t g = 0; g + 1 < groupStart.size(); ++g) {
+            lines.clear();
+            for (uint32_t k = groupStart[g]; k < groupStart[g + 1]; ++k) {
+                uint32_t r = ids[k];
+                uint64_t i = tr.offset[r] + step;
+                if (i >= tr.offset[r + 1]) continue;
+                mem.counters.reads++;
+                cachesim_detail::push_lines(lay, tr.access[i], line, lines);
+            }
+            if (lines.empty()) continue;
+            active = true;
+            std::sort(lines.begin(), lines.end());
+            lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+            for (uint64_t l : lines) mem.request(l);
+        }
+        if (!active) break;
+    }
+}
+
+// Replays every ray of `tr` under `lay`; `simd` is the invocations per
+// lock-step group in ReplayMode::Simd. Caches start cold.
+static inline CacheCounters replay_traces(const RayTraces& tr, const MemoryLayout& lay, ReplayMode mode,
+                                          uint32_t simd, CacheHierarchy& mem) {
+    using namespace cachesim_detail;
+    const uint32_t line = mem.line();
+    const uint32_t span = SHADER_WORKGROUP * SHADER_PACKET;
+    const uint32_t groupPackets = mode == ReplayMode::Simd ? std::max(simd, 1u) : 1u;
+    std::vector<uint32_t> rays, packetStart, groupStart;
+    std::vector<uint64_t> lines;
+
+    for (uint32_t wy = 0; wy * span < tr.height; ++wy)
+        for (uint32_t wx = 0; wx * span < tr.width; ++wx) {
+            workgroup_rays(tr, wx, wy, rays, packetStart);
+            mem.counters.rays += rays.size();
+
+            if (mode == ReplayMode::Ray) {
+                for (uint32_t r : rays)
+                    for (uint64_t i = tr.offset[r]; i < tr.offset[r + 1]; ++i) {
+                        mem.counters.reads++;
+                        lines.clear();
+                        push_lines(lay, tr.access[i], line, lines);
+                        for (uint64_t l : lines) mem.request(l);
+                    }
+                continue;
+            }
+
+            groupStart.clear();
+            for (size_t p = 0; p + 1 < packetStart.size(); p += groupPackets) groupStart.push_back(packetStart[p]);
+            groupStart.push_back(uint32_t(rays.size()));
+            replay_lockstep(tr, lay, rays, groupStart, mem);
+        }
+    return mem.counters;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// campath.hpp
+// Camera paths: timestamped FPSCamera poses, one per line,
+//
+//   # time_s  px py pz  qx qy qz qw
+//   0.000     0 0 2.5   0 0 0 1
+//
+// position and rotation exactly as FPSCamera.position / .rotation give
+// them ([x,y,z,w] quaternion), so a flight recorded in the app with
+//
+//   console.log(now / 1000, ...fpsCamera.position, ...fpsCamera.rotation)
+//
+// in main()'s render loop replays here unchanged. Fields may be separated
+// by spaces, tabs or commas; '#' starts a comment. Times must not
+// decrease. Quaternions are renormalized on load.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+struct CameraPose {
+    double time = 0.0;
+    Vec3   pos{0.0f, 0.0f, 2.5f};
+    float  quat[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    Camera camera(float fovDeg = 70.0f) const {
+        Camera c;
+        c.pos = pos;
+        for (int k = 0; k < 4; ++k) c.quat[k] = quat[k];
+        c.fovDeg = fovDeg;
+        return c;
+    }
+};
+
+// Prints the offending line to stderr on failure.
+static inline bool read_camera_path(const char* path, std::vector<CameraPose>& out) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Failed to read " << path << "\n";
+        return false;
+    }
+    out.clear();
+    std::string line;
+    for (int lineNo = 1; std::getline(f, line); ++lineNo) {
+        line = line.substr(0, line.find('#'));
+        for (char& c : line)
+            if (c == ',' || c == '\t' || c == '\r') c = ' ';
+        if (line.find_first_not_of(' ') == std::string::npos) continue;
+        std::istringstream in(line);
+        double v[8];
+        int n = 0;
+        while (n < 8 && in >> v[n]) ++n;
+        std::string rest;
+        if (n != 8 || (in >> rest)) {
+            std::cerr << path << ":" << lineNo << ": expected time px py pz qx qy qz qw\n";
+            return false;
+        }
+        CameraPose p;
+        p.time = v[0];
+        p.pos = {float(v[1]), float(v[2]), float(v[3])};
+        double len = std::sqrt(v[4] * v[4] + v[5] * v[5] + v[6] * v[6] + v[7] * v[7]);
+        if (!(len > 0.0) || (!out.empty() && p.time < out.back().time)) {
+            std::cerr << path << ":" << lineNo << ": zero quaternion or time going backwards\n";
+            return false;
+        }
+        for (int k = 0; k < 4; ++k) p.quat[k] = float(v[4 + k] / len);
+        out.push_back(p);
+    }
+    if (out.empty()) {
+        std::cerr << path << ": no poses\n";
+        return false;
+    }
+    return true;
+}
+
+static inline bool write_camera_path(const char* path, const std::vector<CameraPose>& poses) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+    std::fprintf(f, "# time_s px py pz qx qy qz qw\n");
+    for (const CameraPose& p : poses)
+        std::fprintf(f, "%.4f %.6g %.6g %.6g %.7g %.7g %.7g %.7g\n", p.time, p.pos.x, p.pos.y, p.pos.z, p.quat[0],
+                     p.quat[1], p.quat[2], p.quat[3]);
+    return std::fclose(f) == 0;
+}
+
+// One turn around the origin in the y = 0 plane, looking at it, with the
+// distance swinging between radius - swing and radius + swing twice per
+// turn so the flight passes close to the mesh and away again.
+static inline std::vector<CameraPose> orbit_camera_path(uint32_t poses, double seconds, float radius = 2.0f,
+                                                        float swing = 0.5f) {
+    std::vector<CameraPose> out(poses);
+    for (uint32_t i = 0; i < poses; ++i) {
+        double u = poses > 1 ? double(i) / double(poses) : 0.0;
+        float a = float(6.28318530718 * u);
+        float r = radius + swing * std::cos(2.0f * a);
+        CameraPose& p = out[i];
+        p.time = seconds * u;
+        p.pos = {r * std::sin(a), 0.0f, r * std::cos(a)};
+        // Yaw by a about +y turns the -z view direction toward the origin.
+        p.quat[0] = 0.0f;
+        p.quat[1] = std::sin(0.5f * a);
+        p.quat[2] = 0.0f;
+        p.quat[3] = std::cos(0.5f * a);
+    }
+    return out;
+}
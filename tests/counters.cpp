@@ -0,0 +1,211 @@
+// counters.cpp
+// Checks the ray counters (counters.hpp): builds the dragon's BVH4
+// with lbvh.hpp, traces primary + sun shadow rays over a frame in
+// interleaved row bands with trace.hpp's plain walks and the counted ones
+// (one counters_add_rays() flush per chunk), and reports the overhead as
+// the median of the per-rep counted / plain ratios with a bootstrap
+// confidence interval. The plain walks compile the counting out, so the
+// baseline is the uninstrumented kernel. One extra pass with TraceStats
+// checks that the sharded totals add up to exactly the per-ray work.
+// Prints the final snapshot and optionally exports it.
+//
+//   bin/counters [--scene public/assets/dragon.glb] [--size 1280x720]
+//                [--reps 15] [--max-overhead 1] [--prom FILE|-]
+//                [--report FILE] [--period 1000] [--json out.json|-]
+//
+// --report runs a CounterReporter that rewrites FILE every --period ms
+// while the tool runs (Prometheus text, or JSON if FILE ends in .json).
+// Exits 1 if the totals disagree, if the two walks shadow different rays,
+// if the median overhead is above --max-overhead percent, or if the
+// traced loop allocates.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "counters.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+struct FrameCount {
+    uint64_t rays = 0;
+    uint64_t shadowed = 0; // shadow rays that hit; also keeps the walks from being dropped as dead code
+};
+
+// perf.cpp's traverse phase over pixels [first, last); the counted walk
+// flushes once per chunk. `perWorker` (Stats only) also collects TraceStats
+// for the exactness check, and is a template flag so the timed passes have
+// no stats branch.
+template <bool Counted, bool Stats = false>
+static FrameCount trace_frame(const Bvh4& bvh, const Triangles& tris, uint32_t width, uint32_t height,
+                              size_t first, size_t last, std::vector<TraceStats>* perWorker = nullptr) {
+    const Camera cam;
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    std::vector<uint64_t> shadowRays(worker_count(), 0), shadowed(worker_count(), 0);
+    parallel_for_chunks(first, last, 256, [&](size_t b, size_t e, unsigned w) {
+        MemHotLoop hot("traverse");
+        TraceStats* st = Stats ? &(*perWorker)[w] : nullptr;
+        RayCounts counts;
+        for (size_t i = b; i < e; ++i) {
+            Ray r = primary_ray(cam, float(i % width), float(i / width), width, height);
+            Hit hit = Counted ? trace_closest_counted(bvh, tris, r, counts, st) : trace_closest(bvh, tris, r);
+            if (!hit.hit()) continue;
+            Vec3 nrm = tris.normal(hit.tri);
+            if (dot(nrm, r.dir) > 0.0f) nrm = -nrm;
+            if (dot(nrm, lightDir) <= 0.0f) continue;
+            shadowRays[w]++;
+            const Ray shadow{r.origin + r.dir * hit.t + nrm * 1e-4f, lightDir, 0.0f, INF};
+            shadowed[w] += Counted ? trace_occluded_counted(bvh, tris, shadow, counts, st)
+                                   : trace_occluded(bvh, tris, shadow);
+        }
+        if (Counted) counters_add_rays(counts);
+    });
+    FrameCount fc;
+    fc.rays = last - first;
+    for (unsigned w = 0; w < worker_count(); ++w) {
+        fc.rays += shadowRays[w];
+        fc.shadowed += shadowed[w];
+    }
+    return fc;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string promPath = args.str("prom", "");
+    std::string reportPath = args.str("report", "");
+    std::string jsonPath = args.str("json", "");
+    const uint32_t reps = std::max(args.u32("reps", 15), 2u);
+    const uint32_t periodMs = std::max(args.u32("period", 1000), 1u);
+    const double maxOverhead = args.num("max-overhead", 1.0);
+    uint32_t width = 1280, height = 720;
+    args.size2("size", width, height);
+
+    std::unique_ptr<CounterReporter> reporter;
+    if (!reportPath.empty()) reporter = std::make_unique<CounterReporter>(reportPath, periodMs);
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    std::vector<uint64_t> keys = morton_keys(tris);
+    MortonOrder order = sort_morton_keys(keys);
+    Bvh4 bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, order)));
+
+    // Exactness: the counter delta over one pass must equal the TraceStats
+    // sums of the same pass.
+    std::vector<TraceStats> perWorker(worker_count());
+    CounterSnapshot before = counters_snapshot();
+    const size_t pixels = size_t(width) * height;
+    const FrameCount frame = trace_frame<true, true>(bvh, tris, width, height, 0, pixels, &perWorker);
+    const uint64_t rays = frame.rays;
+    CounterSnapshot after = counters_snapshot();
+    TraceStats total;
+    for (const TraceStats& ts : perWorker) total.add(ts);
+    const uint64_t expect[] = {rays, total.nodes, total.boxTests, total.triTests, total.stackDrops};
+    bool exact = true;
+    for (uint32_t c = 0; c <= CTR_STACK_DROPS; ++c) exact &= after.value[c] - before.value[c] == expect[c];
+
+    // Overhead: each rep traces the frame twice, plain and counted, in
+    // SLICES row bands with the two walks back to back per band (which goes
+    // first alternates), so drift over the rep hits both sides alike. The
+    // overhead is the median over reps of counted / plain time. Both walks
+    // must shadow the same rays (the TraceStats pass above is a different
+    // instantiation and may round an edge ray the other way).
+    constexpr uint32_t SLICES = 16;
+    std::vector<double> offMs, onMs, ratios;
+    bool same = true;
+    for (uint32_t rep = 0; rep < reps; ++rep) {
+        double off = 0.0, on = 0.0;
+        uint64_t offShadowed = 0, onShadowed = 0;
+        for (uint32_t s = 0; s < SLICES; ++s) {
+            const size_t first = pixels * s / SLICES, last = pixels * (s + 1) / SLICES;
+            for (int k = 0; k < 2; ++k) {
+                const bool counted = (k == 0) == ((rep + s) % 2 == 0);
+                BenchTimer t;
+                if (counted) onShadowed += trace_frame<true>(bvh, tris, width, height, first, last).shadowed;
+                else offShadowed += trace_frame<false>(bvh, tris, width, height, first, last).shadowed;
+                (counted ? on : off) += t.ms();
+            }
+        }
+        offMs.push_back(off);
+        onMs.push_back(on);
+        ratios.push_back(on / off);
+        same &= onShadowed == offShadowed;
+    }
+    RatioInterval ri = bootstrap_median_interval(ratios);
+    const double overhead = (ri.ratio - 1.0) * 100.0, lo = (ri.lo - 1.0) * 100.0, hi = (ri.hi - 1.0) * 100.0;
+    BenchSummary off = summarize(offMs), on = summarize(onMs);
+
+    reporter.reset(); // final write
+    CounterSnapshot snap = counters_snapshot();
+
+    FILE* text = jsonPath == "-" || promPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %ux%u primary + shadow (%llu rays/pass), %u reps, %u threads%s\n\n",
+                 scenePath.c_str(), tris.count(), width, height, (unsigned long long)rays, reps, worker_count(),
+                 RT_COUNTERS ? "" : ", built with RT_COUNTERS=0");
+    std::fprintf(text, "totals     %s (counter delta vs TraceStats over one pass)\n",
+                 exact ? "exact" : RT_COUNTERS ? "MISMATCH" : "not counted");
+    std::fprintf(text, "pass ms    plain %.2f  counted %.2f (medians)\n", off.median, on.median);
+    std::fprintf(text, "overhead   %+.2f%% [%+.2f%%, %+.2f%%] 95%% CI, limit %.2f%%\n\n", overhead, lo, hi,
+                 maxOverhead);
+    for (uint32_t c = 0; c < CTR_COUNT; ++c)
+        std::fprintf(text, "%-26s %llu\n", COUNTER_INFO[c].name, (unsigned long long)snap.value[c]);
+    std::fprintf(text, "%-26s %.2f\n", "build ns/triangle", snap.build_ns_per_tri());
+    if (snap[CTR_RAYS])
+        std::fprintf(text, "%-26s %.1f\n", "nodes/ray", double(snap[CTR_NODES]) / double(snap[CTR_RAYS]));
+
+    int status = 0;
+    if (RT_COUNTERS && !exact) {
+        std::fprintf(text, "\nFAIL: sharded totals differ from the traced work\n");
+        status = 1;
+    }
+    if (!same) {
+        std::fprintf(text, "\nFAIL: counted and plain walks shadow different rays\n");
+        status = 1;
+    }
+    if (RT_COUNTERS && overhead > maxOverhead) {
+        std::fprintf(text, "\nFAIL: counter overhead is above %.2f%%\n", maxOverhead);
+        status = 1;
+    }
+    if (report_hot_loop_violations(text)) status = 1;
+
+    if (promPath == "-") write_counters_prometheus(stdout, snap);
+    else if (!promPath.empty()) {
+        FILE* f = std::fopen(promPath.c_str(), "w");
+        if (!f) {
+            std::cerr << "Failed to write " << promPath << "\n";
+            return 1;
+        }
+        write_counters_prometheus(f, snap);
+        std::fclose(f);
+    }
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/counters");
+    w.value("scene", scenePath);
+    w.value("width", width);
+    w.value("height", height);
+    w.value("reps", reps);
+    w.value("exact", exact);
+    w.value("off_median_ms", off.median);
+    w.value("on_median_ms", on.median);
+    w.value("overhead_pct", overhead);
+    w.value("overhead_lo_pct", lo);
+    w.value("overhead_hi_pct", hi);
+    write_counters_json(w, snap);
+    w.end_object();
+    return status;
+}
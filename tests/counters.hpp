@@ -0,0 +1,306 @@
+#pragma once
+
+// counters.hpp
+// Production counters: rays traced, BVH nodes visited, triangles
+// tested, stack pushes dropped at STACK_MAX, and build time / triangles.
+//
+//   counter_add(CTR_RAYS);                   // owning thread's shard only
+//   CounterTimer t(CTR_BUILD_NS);            // adds the scope's nanoseconds
+//   CounterSnapshot s = counters_snapshot(); // sum of all shards, lock-free
+//   write_counters_prometheus(stdout, s);
+//
+//   CounterReporter rep("rt.prom", 1000);    // rewrites the file every second
+//
+// Each thread adds to its own cache-line-aligned shard with plain relaxed
+// load + store (no locked instruction); readers sum the shards with relaxed
+// loads and never block a writer. Shards are claimed on a thread's first
+// add and handed to the next thread when it exits, like the memtrack and
+// timeline buffers; a recycled shard keeps its counts, so totals only
+// grow and nothing is folded on exit. Threads past MAX_SHARDS share shard
+// 0 with atomic adds.
+//
+// Counting is opt-in per call site: trace_closest_counted /
+// trace_occluded_counted (trace.hpp) count a ray in registers and add it
+// to a caller-owned RayCounts, and the caller flushes that batch to its
+// shard with counters_add_rays() once per chunk of rays, so no shard is
+// touched per ray. The plain trace_closest / trace_occluded pay nothing.
+// bin/counters measures the counted walk against the plain one; the per-node
+// increments still cost about 2% on a one-core box, over its 1% gate, so the
+// tools use the plain walks. trace_treelets() flushes the per-ray work it
+// already keeps, once per queue run.
+// counters_set_enabled(false) turns the flush into one relaxed load;
+// -DRT_COUNTERS=0 removes the counting entirely.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "json.hpp"
+
+#ifndef RT_COUNTERS
+#define RT_COUNTERS 1
+#endif
+
+enum CounterId : uint32_t {
+    CTR_RAYS = 0,
+    CTR_NODES,
+    CTR_BOX_TESTS,
+    CTR_TRI_TESTS,
+    CTR_STACK_DROPS,
+    CTR_BUILD_NS,
+    CTR_BUILD_TRIS,
+    CTR_COUNT
+};
+
+struct CounterInfo {
+    const char* name; // Prometheus metric name without the prefix
+    const char* help;
+};
+
+static inline const CounterInfo COUNTER_INFO[CTR_COUNT] = {
+    {"rays_total", "Rays traced by the CPU traversal."},
+    {"nodes_visited_total", "BVH nodes popped by the traversal."},
+    {"box_tests_total", "Ray-box tests."},
+    {"triangle_tests_total", "Ray-triangle tests."},
+    {"stack_drops_total", "Child pushes dropped at STACK_MAX (the shader drops them silently)."},
+    {"build_nanoseconds_total", "Time in the Morton, sort, LBVH2 and promotion phases."},
+    {"build_triangles_total", "Triangles put through an LBVH2 build."},
+};
+
+struct CounterSnapshot {
+    uint64_t value[CTR_COUNT] = {};
+    uint64_t ns = 0; // steady-clock time of the snapshot
+
+    uint64_t operator[](CounterId id) const { return value[id]; }
+
+    double build_ns_per_tri() const {
+        return value[CTR_BUILD_TRIS] ? double(value[CTR_BUILD_NS]) / double(value[CTR_BUILD_TRIS]) : 0.0;
+    }
+};
+
+namespace counters_detail {
+
+static constexpr unsigned MAX_SHARDS = 1024;
+
+struct alignas(64) Shard {
+    std::atomic<uint64_t> value[CTR_COUNT];
+};
+static_assert(sizeof(Shard) == 64, "one cache line per shard");
+
+// Constant-initialized and trivially destructible, so adds work during
+// static initialization and teardown.
+struct State {
+    Shard                 shards[MAX_SHARDS]; // [0] is shared by threads that find no free shard
+    std::atomic<unsigned> used{1};
+    std::atomic_flag      freeLock = ATOMIC_FLAG_INIT;
+    unsigned              freeList[MAX_SHARDS];
+    unsigned              freeCount = 0;
+    std::atomic<bool>     enabled{true};
+};
+
+static inline State& state() {
+    static State s;
+    return s;
+}
+
+static inline unsigned claim_shard() {
+    State& s = state();
+    while (s.freeLock.test_and_set(std::memory_order_acquire)) {}
+    unsigned idx = s.freeCount ? s.freeList[--s.freeCount] : 0;
+    s.freeLock.clear(std::memory_order_release);
+    if (idx) return idx;
+    idx = s.used.fetch_add(1, std::memory_order_relaxed);
+    return idx < MAX_SHARDS ? idx : 0;
+}
+
+static inline void release_shard(unsigned idx) {
+    State& s = state();
+    if (!idx) return;
+    while (s.freeLock.test_and_set(std::memory_order_acquire)) {}
+    s.freeList[s.freeCount++] = idx;
+    s.freeLock.clear(std::memory_order_release);
+}
+
+struct Slot {
+    int idx = -1; // -1 before the first add, -2 once the thread is exiting
+    ~Slot() {
+        if (idx > 0) release_shard(unsigned(idx));
+        idx = -2;
+    }
+};
+
+static inline unsigned thread_shard() {
+    thread_local Slot slot;
+    if (slot.idx == -1) slot.idx = int(claim_shard());
+    return slot.idx < 0 ? 0u : unsigned(slot.idx);
+}
+
+static inline void add(unsigned shard, CounterId id, uint64_t n) {
+    std::atomic<uint64_t>& v = state().shards[shard].value[id];
+    if (shard) v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    else v.fetch_add(n, std::memory_order_relaxed);
+}
+
+static inline uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count());
+}
+
+} // namespace counters_detail
+
+static inline bool counters_enabled() {
+    return RT_COUNTERS && counters_detail::state().enabled.load(std::memory_order_relaxed);
+}
+
+static inline void counters_set_enabled(bool on) {
+    counters_detail::state().enabled.store(on, std::memory_order_relaxed);
+}
+
+static inline void counter_add(CounterId id, uint64_t n = 1) {
+    if (!counters_enabled()) return;
+    counters_detail::add(counters_detail::thread_shard(), id, n);
+}
+
+// A batch of rays' work, summed in plain fields by the traversal and
+// flushed with counters_add_rays().
+struct RayCounts {
+    uint64_t rays = 0;
+    uint64_t nodes = 0;
+    uint64_t boxTests = 0;
+    uint64_t triTests = 0;
+    uint64_t stackDrops = 0;
+};
+
+// One shard lookup for the whole batch; clears it for reuse.
+static inline void counters_add_rays(RayCounts& c) {
+    if (counters_enabled() && c.rays) {
+        unsigned s = counters_detail::thread_shard();
+        counters_detail::add(s, CTR_RAYS, c.rays);
+        counters_detail::add(s, CTR_NODES, c.nodes);
+        counters_detail::add(s, CTR_BOX_TESTS, c.boxTests);
+        counters_detail::add(s, CTR_TRI_TESTS, c.triTests);
+        if (c.stackDrops) counters_detail::add(s, CTR_STACK_DROPS, c.stackDrops);
+    }
+    c = RayCounts{};
+}
+
+// Adds the scope's wall time in nanoseconds to `id`.
+class CounterTimer {
+public:
+    explicit CounterTimer(CounterId id) : id_(id), t0_(counters_enabled() ? counters_detail::now_ns() : 0) {}
+    ~CounterTimer() {
+        if (t0_) counter_add(id_, counters_detail::now_ns() - t0_);
+    }
+
+    CounterTimer(const CounterTimer&) = delete;
+    CounterTimer& operator=(const CounterTimer&) = delete;
+
+private:
+    CounterId id_;
+    uint64_t  t0_;
+};
+
+// Sum over every shard claimed so far. A concurrent add may or may not be
+// included; each counter is individually monotonic.
+static inline CounterSnapshot counters_snapshot() {
+    counters_detail::State& s = counters_detail::state();
+    CounterSnapshot out;
+    unsigned used = std::min(s.used.load(std::memory_order_relaxed), counters_detail::MAX_SHARDS);
+    for (unsigned i = 0; i < used; ++i)
+        for (uint32_t c = 0; c < CTR_COUNT; ++c) out.value[c] += s.shards[i].value[c].load(std::memory_order_relaxed);
+    out.ns = counters_detail::now_ns();
+    return out;
+}
+
+/* ================= Export ================= */
+
+// Prometheus text exposition format 0.0.4: one counter per CounterId plus
+// the derived build_nanoseconds_per_triangle gauge.
+static inline void write_counters_prometheus(FILE* out, const CounterSnapshot& s, const char* prefix = "rt_") {
+    for (uint32_t c = 0; c < CTR_COUNT; ++c) {
+        std::fprintf(out, "# HELP %s%s %s\n# TYPE %s%s counter\n%s%s %llu\n", prefix, COUNTER_INFO[c].name,
+                     COUNTER_INFO[c].help, prefix, COUNTER_INFO[c].name, prefix, COUNTER_INFO[c].name,
+                     (unsigned long long)s.value[c]);
+    }
+    std::fprintf(out, "# HELP %sbuild_nanoseconds_per_triangle Build time per triangle since start.\n", prefix);
+    std::fprintf(out, "# TYPE %sbuild_nanoseconds_per_triangle gauge\n", prefix);
+    std::fprintf(out, "%sbuild_nanoseconds_per_triangle %.3f\n", prefix, s.build_ns_per_tri());
+}
+
+static inline void write_counters_json(JsonWriter& w, const CounterSnapshot& s, const char* key = "counters") {
+    w.begin_object(key);
+    for (uint32_t c = 0; c < CTR_COUNT; ++c) w.value(COUNTER_INFO[c].name, s.value[c]);
+    w.value("build_nanoseconds_per_triangle", s.build_ns_per_tri());
+    w.end_object();
+}
+
+// Background aggregation: every `periodMs` takes a snapshot and rewrites
+// `path` in Prometheus format (written to path.tmp, then renamed, so a
+// scraper never sees half a file), or JSON when the path ends in ".json".
+// The last write happens on destruction.
+class CounterReporter {
+public:
+    CounterReporter(std::string path, uint32_t periodMs) : path_(std::move(path)), periodMs_(periodMs) {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~CounterReporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        write(counters_snapshot());
+    }
+
+    CounterReporter(const CounterReporter&) = delete;
+    CounterReporter& operator=(const CounterReporter&) = delete;
+
+    uint64_t writes() const { return writes_.load(std::memory_order_relaxed); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, std::chrono::milliseconds(periodMs_), [this] { return stop_; })) {
+            lock.unlock();
+            write(counters_snapshot());
+            lock.lock();
+        }
+    }
+
+    void write(const CounterSnapshot& s) {
+        std::string tmp = path_ + ".tmp";
+        bool json = path_.size() >= 5 && path_.compare(path_.size() - 5, 5, ".json") == 0;
+        if (json) {
+            std::ofstream f(tmp);
+            if (!f) return;
+            JsonWriter w(f);
+            w.begin_object();
+            write_counters_json(w, s);
+            w.end_object();
+        } else {
+            FILE* f = std::fopen(tmp.c_str(), "w");
+            if (!f) return;
+            write_counters_prometheus(f, s);
+            std::fclose(f);
+        }
+        if (std::rename(tmp.c_str(), path_.c_str()) == 0) writes_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string             path_;
+    uint32_t                periodMs_;
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool                    stop_ = false;
+    std::atomic<uint64_t>   writes_{0};
+    std::thread             thread_;
+};
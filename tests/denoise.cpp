@@ -0,0 +1,774 @@
+// denoise.cpp
+// Edge-aware a-trous wavelet denoiser (Dammertz et al. 2010) guided by the
+// normal and depth of a visibility buffer, with optional reprojected temporal
+// accumulation in front of it (SVGF order).
+//
+// The tool renders the scene headlessly with the renderer.wgsl camera and a
+// stochastic version of shade() -- the 0.15 ambient term becomes Monte Carlo
+// sky visibility and the sun gets an angular radius -- then reports how many
+// samples per pixel each pipeline needs to stay under an RMSE threshold
+// against a high-spp reference.
+//
+//   bin/denoise [--scene public/assets/dragon.glb] [--bvh data/BVH4_wide.bin]
+//               [--size 320x180] [--max-spp 64] [--ref-spp 256]
+//               [--threshold 0.01] [--iterations 5]
+//               [--temporal FRAMES] [--spp N] [--orbit DEG_PER_FRAME]
+//               [--time-size 1920x1080] [--out DIR]
+//
+// The filter is compute-bound: each of the 25 taps per pixel and level is
+// 7 loads, ~20 vector ops and a cubic exp, about 1 G vector instructions
+// for 5 levels at 1080p. A desktop core retires a few G of those per
+// second, so one core needs a few hundred ms. "A few ms" at 1080p takes on
+// the order of 100 cores' worth of throughput, i.e. the GPU; the CPU
+// path is here for the spp study and as the reference the shader port
+// is checked against.
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "image.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t TILE = 32;
+static constexpr float MISS_DEPTH = 1e4f;
+
+/* ================= Visibility buffer ================= */
+
+// One primary hit per pixel: triangle id + distance, expanded into the planar
+// guide channels the filter reads (face-forwarded normal, depth, |grad depth|).
+struct GBuffer {
+    uint32_t width = 0, height = 0;
+    std::vector<uint32_t> tri;
+    std::vector<float> depth, nx, ny, nz, grad;
+
+    void resize(uint32_t w, uint32_t h) {
+        width = w;
+        height = h;
+        size_t n = size_t(w) * h;
+        tri.assign(n, INVALID);
+        depth.assign(n, MISS_DEPTH);
+        nx.assign(n, 0.0f);
+        ny.assign(n, 0.0f);
+        nz.assign(n, 0.0f);
+        grad.assign(n, 0.0f);
+    }
+
+    Vec3 normal(size_t i) const { return {nx[i], ny[i], nz[i]}; }
+};
+
+static void render_gbuffer(const Bvh4& bvh, const Triangles& tris, const Camera& cam, GBuffer& g) {
+    parallel_for_tiles(g.width, g.height, TILE, [&](Tile t, unsigned) {
+        for (uint32_t y = t.y0; y < t.y1; ++y)
+            for (uint32_t x = t.x0; x < t.x1; ++x) {
+                size_t i = size_t(y) * g.width + x;
+                Ray r = primary_ray(cam, float(x), float(y), g.width, g.height);
+                Hit h = trace_closest(bvh, tris, r);
+                if (!h.hit()) continue;
+
+                Vec3 n = tris.normal(h.tri);
+                if (dot(n, r.dir) > 0.0f) n = -n;
+                g.tri[i] = h.tri;
+                g.depth[i] = h.t;
+                g.nx[i] = n.x;
+                g.ny[i] = n.y;
+                g.nz[i] = n.z;
+            }
+    });
+
+    // Screen-space depth gradient for the SVGF-style depth weight.
+    parallel_for(0, g.height, 8, [&](size_t y) {
+        for (uint32_t x = 0; x < g.width; ++x) {
+            size_t i = y * g.width + x;
+            if (g.tri[i] == INVALID) continue;
+            auto d = [&](uint32_t xx, uint32_t yy) {
+                size_t j = size_t(yy) * g.width + xx;
+                return g.tri[j] == INVALID ? g.depth[i] : g.depth[j];
+            };
+            float dx = 0.5f * (d(std::min(x + 1, g.width - 1), uint32_t(y)) - d(x ? x - 1 : 0, uint32_t(y)));
+            float dy = 0.5f * (d(x, std::min(uint32_t(y) + 1, g.height - 1)) - d(x, y ? uint32_t(y) - 1 : 0));
+            g.grad[i] = std::max(std::fabs(dx), std::fabs(dy));
+        }
+    });
+}
+
+/* ================= Stochastic shade() ================= */
+
+struct ShadeParams {
+    Vec3  baseColor{0.9f, 0.7f, 0.3f};
+    Vec3  lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    float sunRadius = 0.07f;  // radians
+    float ambient = 0.4f;
+    float aoRadius = 0.5f;
+    float background = 0.01f;
+};
+
+// The filter works on demodulated lighting, not colour: the dragon's
+// triangles are mostly sub-pixel, so albedo * n.l is legitimately
+// high-frequency and blurring it is pure bias. Only the two visibility
+// terms are noisy, so they are what gets filtered:
+//   x = sun visibility * n.l(sample) / sun_scale(pixel),  y = sky visibility
+// and remodulate() puts albedo and the exact per-pixel n.l back.
+static inline float sun_scale(const ShadeParams& sp, Vec3 n) {
+    return std::max(dot(n, sp.lightDir), 0.05f);
+}
+
+static Vec3 lighting_sample(const Bvh4& bvh, const Triangles& tris, const ShadeParams& sp,
+                            Vec3 p, Vec3 n, Rng& rng) {
+    const float eps = 1e-4f;
+    Vec3 origin = p + n * eps;
+
+    // Sun: uniform direction inside a small cone around lightDir.
+    Vec3 t, b;
+    orthonormal_basis(sp.lightDir, t, b);
+    float cosMax = std::cos(sp.sunRadius);
+    float cosT = 1.0f - rng.uniform() * (1.0f - cosMax);
+    float sinT = std::sqrt(std::max(0.0f, 1.0f - cosT * cosT));
+    float phi = 6.28318530718f * rng.uniform();
+    Vec3 L = normalize(t * (sinT * std::cos(phi)) + b * (sinT * std::sin(phi)) + sp.lightDir * cosT);
+
+    float sun = 0.0f;
+    float ndotl = dot(n, L);
+    if (ndotl > 0.0f) {
+        Ray sr{origin, L, 0.0f, INF};
+        if (!trace_occluded(bvh, tris, sr)) sun = ndotl / sun_scale(sp, n);
+    }
+
+    // Sky: cosine-weighted visibility within aoRadius.
+    Ray ar{origin, sample_cosine_hemisphere(n, rng.uniform(), rng.uniform()), 0.0f, sp.aoRadius};
+    float sky = trace_occluded(bvh, tris, ar) ? 0.0f : 1.0f;
+
+    return {sun, sky, 0.0f};
+}
+
+// Colour = albedo * (ambient * sky + n.l * sun); misses show the background.
+static void remodulate(const ImageRGB& light, const GBuffer& g, const ShadeParams& sp, ImageRGB& out) {
+    out.resize(g.width, g.height);
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (g.tri[i] == INVALID) {
+            out.r[i] = out.g[i] = out.b[i] = sp.background;
+            continue;
+        }
+        float e = sp.ambient * light.g[i] + sun_scale(sp, g.normal(i)) * light.r[i];
+        out.r[i] = sp.baseColor.x * e;
+        out.g[i] = sp.baseColor.y * e;
+        out.b[i] = sp.baseColor.z * e;
+    }
+}
+
+// Running sums of lighting and of its squared norm; means come from resolve().
+struct SampleSums {
+    ImageRGB sum;
+    std::vector<float> sumSq;
+    uint32_t count = 0;
+
+    void reset(uint32_t w, uint32_t h) {
+        sum.resize(w, h);
+        sumSq.assign(size_t(w) * h, 0.0f);
+        count = 0;
+    }
+};
+
+// Adds samples [first, first + count) with per-(pixel, sample) RNG streams,
+// so results do not depend on the thread count.
+static void render_samples(const Bvh4& bvh, const Triangles& tris, const Camera& cam,
+                           const GBuffer& g, const ShadeParams& sp,
+                           uint32_t first, uint32_t count, uint64_t seed, SampleSums& acc) {
+    ImageRGB& sum = acc.sum;
+    parallel_for_tiles(g.width, g.height, TILE, [&](Tile tl, unsigned) {
+        for (uint32_t y = tl.y0; y < tl.y1; ++y)
+            for (uint32_t x = tl.x0; x < tl.x1; ++x) {
+                size_t i = size_t(y) * g.width + x;
+                if (g.tri[i] == INVALID) continue;
+
+                Ray r = primary_ray(cam, float(x), float(y), g.width, g.height);
+                Vec3 p = r.origin + r.dir * g.depth[i];
+                Vec3 n = g.normal(i);
+
+                for (uint32_t s = first; s < first + count; ++s) {
+                    Rng rng(seed ^ (uint64_t(s) << 32), i);
+                    Vec3 c = lighting_sample(bvh, tris, sp, p, n, rng);
+                    sum.r[i] += c.x;
+                    sum.g[i] += c.y;
+                    acc.sumSq[i] += c.x * c.x + c.y * c.y;
+                }
+            }
+    });
+    acc.count += count;
+}
+
+// Mean lighting plus the variance of that mean (summed over channels, the
+// expected |c_p - c_q|^2 / 2 between two independent estimates). With a
+// single sample there is no per-pixel estimate, so a 3x3 spatial variance
+// over geometry pixels stands in (as SVGF does for short histories).
+static void resolve(const SampleSums& acc, const GBuffer& g, ImageRGB& mean, std::vector<float>& var) {
+    const uint32_t w = g.width, h = g.height;
+    const float inv = 1.0f / float(acc.count);
+    mean.resize(w, h);
+    var.assign(size_t(w) * h, 0.0f);
+
+    for (size_t i = 0; i < mean.size(); ++i) {
+        mean.r[i] = acc.sum.r[i] * inv;
+        mean.g[i] = acc.sum.g[i] * inv;
+        if (acc.count > 1) {
+            float m2 = mean.r[i] * mean.r[i] + mean.g[i] * mean.g[i];
+            float v = (acc.sumSq[i] * inv - m2) * float(acc.count) / float(acc.count - 1);
+            var[i] = std::max(v, 0.0f) * inv;
+        }
+    }
+    if (acc.count > 1) return;
+
+    parallel_for(0, h, 8, [&](size_t y) {
+        for (uint32_t x = 0; x < w; ++x) {
+            size_t i = y * w + x;
+            if (g.tri[i] == INVALID) continue;
+            float s1r = 0.0f, s1g = 0.0f, s2 = 0.0f, n = 0.0f;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int xx = int(x) + dx, yy = int(y) + dy;
+                    if (xx < 0 || yy < 0 || xx >= int(w) || yy >= int(h)) continue;
+                    size_t j = size_t(yy) * w + size_t(xx);
+                    if (g.tri[j] == INVALID) continue;
+                    s1r += mean.r[j];
+                    s1g += mean.g[j];
+                    s2 += mean.r[j] * mean.r[j] + mean.g[j] * mean.g[j];
+                    n += 1.0f;
+                }
+            float mr = s1r / n, mg = s1g / n;
+            var[i] = std::max(s2 / n - mr * mr - mg * mg, 0.0f);
+        }
+    });
+}
+
+/* ================= A-trous filter ================= */
+
+struct DenoiseParams {
+    uint32_t iterations = 5;
+    float sigmaColor = 2.0f;   // in standard deviations of the pixel's noise
+    float sigmaNormal = 1.0f;  // loose: dragon triangles are mostly sub-pixel
+    float sigmaDepth = 1.0f;   // in units of |grad z| * tap distance
+};
+
+// B3-spline taps of the 5x5 kernel.
+static const float KERNEL[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+// Per tap of the 5x5 kernel (row-major): log h(i) h(j), and 1 / |offset| in
+// units of the level's step (the centre's depth term is zero anyway).
+struct TapTables {
+    float logH[25], invDist[25];
+    TapTables() {
+        for (int dy = -2; dy <= 2; ++dy)
+            for (int dx = -2; dx <= 2; ++dx) {
+                const int k = (dy + 2) * 5 + dx + 2;
+                logH[k] = std::log(KERNEL[dx + 2] * KERNEL[dy + 2]);
+                invDist[k] = dx || dy ? 1.0f / std::sqrt(float(dx * dx + dy * dy)) : 0.0f;
+            }
+    }
+};
+static const TapTables TAPS;
+
+// Owns padded copies of the guide and colour planes. The apron is as wide as
+// the largest tap offset and filled with "sky" (MISS_DEPTH) so every pixel,
+// borders included, runs the same branch-free SIMD loop: apron taps get
+// ~zero depth weight instead of being bounds-checked.
+class AtrousDenoiser {
+public:
+    void set_guide(const GBuffer& g, uint32_t iterations) {
+        width_ = g.width;
+        height_ = g.height;
+        pad_ = 2u << (iterations ? iterations - 1 : 0);
+        stride_ = (width_ + 2 * pad_ + SIMD_W - 1) / SIMD_W * SIMD_W + SIMD_W;
+        size_t n = size_t(stride_) * (height_ + 2 * pad_);
+
+        depth_.assign(n, MISS_DEPTH);
+        nx_.assign(n, 0.0f);
+        ny_.assign(n, 0.0f);
+        nz_.assign(n, 0.0f);
+        invGrad_.assign(n, 0.0f);
+        for (int k = 0; k < 2; ++k)
+            for (auto* p : {&r_[k], &g_[k], &b_[k]}) p->assign(n, 0.0f);
+        invVar_.assign(n, 0.0f);
+
+        parallel_for(0, height_, 16, [&](size_t y) {
+            for (uint32_t x = 0; x < width_; ++x) {
+                size_t i = y * width_ + x, j = at(x, uint32_t(y));
+                depth_[j] = g.depth[i];
+                nx_[j] = g.nx[i];
+                ny_[j] = g.ny[i];
+                nz_[j] = g.nz[i];
+                invGrad_[j] = 1.0f / (g.grad[i] + 1e-4f);
+            }
+        });
+    }
+
+    // `var` is the per-pixel variance of the input (see resolve()); the colour
+    // weight is measured in units of that noise and tightens 2x per level
+    // as each level averages ~4x more samples.
+    void run(const ImageRGB& in, const std::vector<float>& var, const DenoiseParams& dp, ImageRGB& out) {
+        parallel_for(0, height_, 16, [&](size_t y) {
+            for (uint32_t x = 0; x < width_; ++x) {
+                size_t i = y * width_ + x, j = at(x, uint32_t(y));
+                r_[0][j] = in.r[i];
+                g_[0][j] = in.g[i];
+                b_[0][j] = in.b[i];
+                invVar_[j] = 1.0f / (dp.sigmaColor * dp.sigmaColor * var[i] + 1e-6f);
+            }
+        });
+
+        int src = 0;
+        for (uint32_t it = 0; it < dp.iterations; ++it) {
+            int step = 1 << it;
+            float colorScale = float(1u << (2 * it));
+            float invN = 1.0f / (dp.sigmaNormal * dp.sigmaNormal);
+            float invZ = 1.0f / dp.sigmaDepth;
+
+            // Bands of whole rows, not square tiles: a tap row reads 7
+            // planes at 5 row offsets, and full-width runs keep those 35
+            // streams sequential. 32x32 tiles restarted them every 32
+            // pixels and ran ~1.8x slower at 1080p.
+            parallel_for_chunks(0, height_, 8, [&](size_t y0, size_t y1, unsigned) {
+                for (size_t y = y0; y < y1; ++y)
+                    for (uint32_t x = 0; x < width_; x += SIMD_W)
+                        filter_run(src, x, uint32_t(y), step, colorScale, invN, invZ);
+            });
+            src ^= 1;
+        }
+
+        out.resize(width_, height_);
+        for (uint32_t y = 0; y < height_; ++y)
+            for (uint32_t x = 0; x < width_; ++x) {
+                size_t i = size_t(y) * width_ + x, j = at(x, y);
+                out.r[i] = r_[src][j];
+                out.g[i] = g_[src][j];
+                out.b[i] = b_[src][j];
+            }
+    }
+
+private:
+    uint32_t width_ = 0, height_ = 0, pad_ = 0, stride_ = 0;
+    std::vector<float> depth_, nx_, ny_, nz_, invGrad_, invVar_; // invGrad_ = 1 / (|grad z| + eps)
+    std::vector<float> r_[2], g_[2], b_[2];
+
+    size_t at(uint32_t x, uint32_t y) const { return size_t(y + pad_) * stride_ + x + pad_; }
+
+    // SIMD_W horizontally adjacent pixels. Tap q of centre p weighs
+    //   h(i) h(j) exp(-|c_p-c_q|^2 / (sc^2 var_p) - |n_p-n_q|^2 / sn^2
+    //                 - |z_p-z_q| / (sz |grad z_p| |p-q|))
+    // with one exp per tap: the edge-stopping terms add in the exponent.
+    // Everything that depends only on p or on the tap offset is hoisted.
+    // Normals are unit (sky is zero and loses on depth anyway), so
+    // |n_p-n_q|^2 = 2 - 2 n_p.n_q is one dot product against a prescaled
+    // n_p. 1 / |grad z_p| comes from the guide and 1 / |p-q| from TAPS, and
+    // log h(i) h(j) and the constant normal term are folded into the
+    // exponent. That leaves 7 loads, ~20 vector ops and vexp_neg_fast.
+    inline void filter_run(int src, uint32_t x, uint32_t y, int step,
+                           float colorScale, float invNormal2, float invDepth) {
+        const size_t i = at(x, y);
+        const float *ir = r_[src].data(), *ig = g_[src].data(), *ib = b_[src].data();
+        const float *nx = nx_.data(), *ny = ny_.data(), *nz = nz_.data(), *depth = depth_.data();
+
+        const vfloat cr = vload(ir + i), cg = vload(ig + i), cb = vload(ib + i);
+        const vfloat nScale = vset1(-2.0f * invNormal2);
+        const vfloat anx = vload(nx + i) * nScale, any = vload(ny + i) * nScale, anz = vload(nz + i) * nScale;
+        const vfloat zp = vload(depth + i);
+        const vfloat rz = vload(invGrad_.data() + i) * vset1(invDepth / float(step));
+        const vfloat invC = vload(invVar_.data() + i) * vset1(colorScale);
+        const vfloat zero = vset1(0.0f);
+        // Capped so weights and weighted colours never go denormal.
+        const vfloat cap = vset1(40.0f - 2.0f * invNormal2);
+
+        vfloat sr = zero, sg = zero, sb = zero, sw = zero;
+
+        for (int dy = -2; dy <= 2; ++dy) {
+            const size_t row = i + ptrdiff_t(dy * step) * ptrdiff_t(stride_);
+            for (int dx = -2; dx <= 2; ++dx) {
+                const size_t j = row + ptrdiff_t(dx * step);
+                const int k = (dy + 2) * 5 + dx + 2;
+
+                const vfloat qr = vload(ir + j), qg = vload(ig + j), qb = vload(ib + j);
+                const vfloat dr = qr - cr, dg = qg - cg, db = qb - cb;
+                const vfloat dz = vabs(vload(depth + j) - zp);
+
+                vfloat e = vfmadd(anx, vload(nx + j), vfmadd(any, vload(ny + j), anz * vload(nz + j)));
+                e = vfmadd(dz, rz * vset1(TAPS.invDist[k]), e);
+                e = vfmadd(vfmadd(dr, dr, vfmadd(dg, dg, db * db)), invC, e);
+
+                const vfloat wgt = vexp_neg_fast(vset1(TAPS.logH[k] - 2.0f * invNormal2) - vmin(e, cap));
+                sr = vfmadd(qr, wgt, sr);
+                sg = vfmadd(qg, wgt, sg);
+                sb = vfmadd(qb, wgt, sb);
+                sw = sw + wgt;
+            }
+        }
+
+        // Sky pixels pass through unfiltered.
+        const vmask sky = vset1(0.5f * MISS_DEPTH) < zp;
+        const vfloat inv = vset1(1.0f) / sw;
+        float* orr = r_[src ^ 1].data();
+        float* og = g_[src ^ 1].data();
+        float* ob = b_[src ^ 1].data();
+        vstore(orr + i, vselect(sky, cr, sr * inv));
+        vstore(og + i, vselect(sky, cg, sg * inv));
+        vstore(ob + i, vselect(sky, cb, sb * inv));
+    }
+};
+
+/* ================= Temporal accumulation ================= */
+
+struct History {
+    ImageRGB color;
+    std::vector<float> length, m2;
+    GBuffer g;
+    Camera cam;
+    bool valid = false;
+};
+
+// Reprojects every pixel's primary hit into the previous frame and blends
+// with an exponential moving average (alpha = max(1/len, alphaMin)),
+// tracking the second moment alongside (the first is the colour itself) so
+// the filter knows the remaining noise. A history sample is reused only if
+// the previous visibility buffer saw the same triangle there, or a surface
+// with matching normal and depth.
+static void temporal_accumulate(const ImageRGB& current, const std::vector<float>& curVar,
+                                const GBuffer& g, const Camera& cam, History& hist,
+                                float alphaMin, ImageRGB& out, std::vector<float>& outVar) {
+    const size_t n = current.size();
+    out.resize(current.width, current.height);
+    outVar = curVar;
+    std::vector<float> len(n, 1.0f), m2(n);
+
+    parallel_for(0, g.height, 4, [&](size_t y) {
+        for (uint32_t x = 0; x < g.width; ++x) {
+            size_t i = y * g.width + x;
+            float sq = current.r[i] * current.r[i] + current.g[i] * current.g[i] + current.b[i] * current.b[i];
+            out.r[i] = current.r[i];
+            out.g[i] = current.g[i];
+            out.b[i] = current.b[i];
+            m2[i] = sq;
+            if (!hist.valid || g.tri[i] == INVALID) continue;
+
+            Ray r = primary_ray(cam, float(x), float(y), g.width, g.height);
+            Vec3 p = r.origin + r.dir * g.depth[i];
+
+            float px, py;
+            if (!project_to_pixel(hist.cam, p, g.width, g.height, px, py)) continue;
+            int qx = int(std::lround(px)), qy = int(std::lround(py));
+            if (qx < 0 || qy < 0 || qx >= int(g.width) || qy >= int(g.height)) continue;
+            size_t j = size_t(qy) * g.width + size_t(qx);
+
+            const GBuffer& pg = hist.g;
+            bool same = pg.tri[j] == g.tri[i];
+            if (!same && pg.tri[j] != INVALID) {
+                float prevDist = length(p - hist.cam.pos);
+                same = dot(pg.normal(j), g.normal(i)) > 0.9f &&
+                       std::fabs(pg.depth[j] - prevDist) < 0.02f * prevDist;
+            }
+            if (!same) continue;
+
+            float l = std::min(hist.length[j] + 1.0f, 1.0f / alphaMin);
+            float a = 1.0f / l;
+            out.r[i] = hist.color.r[j] + (current.r[i] - hist.color.r[j]) * a;
+            out.g[i] = hist.color.g[j] + (current.g[i] - hist.color.g[j]) * a;
+            out.b[i] = hist.color.b[j] + (current.b[i] - hist.color.b[j]) * a;
+            m2[i] = hist.m2[j] + (sq - hist.m2[j]) * a;
+            len[i] = l;
+
+            // Once a few frames are in, the temporal moments beat the spatial
+            // single-frame estimate; either way it is the variance of a mean.
+            float m1sq = out.r[i] * out.r[i] + out.g[i] * out.g[i] + out.b[i] * out.b[i];
+            if (l >= 4.0f) outVar[i] = std::max(m2[i] - m1sq, 0.0f) / l;
+            else outVar[i] = curVar[i] / l;
+        }
+    });
+
+    hist.color = out;
+    hist.length.swap(len);
+    hist.m2.swap(m2);
+    hist.g = g;
+    hist.cam = cam;
+    hist.valid = true;
+}
+
+/* ================= Reporting ================= */
+
+// RMSE over pixels that hit geometry; sky pixels are exact in every image.
+static double rmse_geometry(const ImageRGB& a, const ImageRGB& b, const GBuffer& g) {
+    double sum = 0.0;
+    size_t n = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (g.tri[i] == INVALID) continue;
+        double dr = a.r[i] - b.r[i], dg = a.g[i] - b.g[i], db = a.b[i] - b.b[i];
+        sum += dr * dr + dg * dg + db * db;
+        n++;
+    }
+    return n ? std::sqrt(sum / double(3 * n)) : 0.0;
+}
+
+// Error against the true image: the reference's own noise (`floor`) is
+// independent of the estimate's, so it comes off in quadrature.
+static double remove_floor(double err, double floor) {
+    return std::sqrt(std::max(err * err - floor * floor, 0.0));
+}
+
+// Smallest measured spp under the threshold, else a 1/sqrt(spp) extrapolation
+// from the last measurement (optimistic for the filtered curve, whose bias
+// does not shrink with spp).
+static std::string spp_needed(const std::vector<uint32_t>& spp, const std::vector<double>& err,
+                              double floor, double thr) {
+    for (size_t k = 0; k < spp.size(); ++k) {
+        if (remove_floor(err[k], floor) <= thr) return std::to_string(spp[k]);
+    }
+    double last = spp.empty() ? 0.0 : remove_floor(err.back(), floor);
+    if (last <= 0.0) return "n/a";
+    double est = double(spp.back()) * (last / thr) * (last / thr);
+    return "~" + std::to_string(uint64_t(std::ceil(est))) + " (extrapolated)";
+}
+
+static double ms_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void save_image(const std::string& dir, const std::string& name, const ImageRGB& img) {
+    if (dir.empty()) return;
+    std::string path = dir + "/" + name + ".ppm";
+    if (!write_ppm(path.c_str(), img)) std::cerr << "Failed to write " << path << "\n";
+}
+
+// Yaw the camera `deg` degrees about the world Y axis through the origin.
+static void orbit_camera(Camera& cam, float deg) {
+    float a = deg * 3.14159265358979f / 180.0f;
+    float c = std::cos(a), s = std::sin(a);
+    cam.pos = {cam.pos.x * c + cam.pos.z * s, cam.pos.y, -cam.pos.x * s + cam.pos.z * c};
+
+    float qy[4] = {0.0f, std::sin(0.5f * a), 0.0f, std::cos(0.5f * a)};
+    const float* q = cam.quat;
+    float r[4] = {
+        qy[3] * q[0] + qy[0] * q[3] + qy[1] * q[2] - qy[2] * q[1],
+        qy[3] * q[1] - qy[0] * q[2] + qy[1] * q[3] + qy[2] * q[0],
+        qy[3] * q[2] + qy[0] * q[1] - qy[1] * q[0] + qy[2] * q[3],
+        qy[3] * q[3] - qy[0] * q[0] - qy[1] * q[1] - qy[2] * q[2],
+    };
+    for (int k = 0; k < 4; ++k) cam.quat[k] = r[k];
+}
+
+static void render_reference(const Bvh4& bvh, const Triangles& tris, const Camera& cam,
+                             const GBuffer& g, const ShadeParams& sp, uint32_t spp, ImageRGB& ref) {
+    SampleSums acc;
+    acc.reset(g.width, g.height);
+    render_samples(bvh, tris, cam, g, sp, 0, spp, 0x5EEDull, acc);
+    ImageRGB light;
+    std::vector<float> unused;
+    resolve(acc, g, light, unused);
+    remodulate(light, g, sp, ref);
+}
+
+/* ================= Main ================= */
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string bvhPath = args.str("bvh", "data/BVH4_wide.bin");
+    std::string outDir = args.str("out", "");
+
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    uint32_t timeW = 1920, timeH = 1080;
+    args.size2("time-size", timeW, timeH);
+
+    uint32_t maxSpp = args.u32("max-spp", 64);
+    uint32_t refSpp = args.u32("ref-spp", 256);
+    double threshold = args.num("threshold", 0.01);
+    uint32_t temporalFrames = args.u32("temporal", 0);
+    float orbitDeg = float(args.num("orbit", 1.0));
+    const uint32_t temporalSpp = args.u32("spp", 1);
+    if (maxSpp < 1 || refSpp < 1 || temporalSpp < 1) {
+        std::cerr << "--max-spp, --ref-spp and --spp must be at least 1\n";
+        return 1;
+    }
+
+    DenoiseParams dp;
+    dp.iterations = std::min(args.u32("iterations", dp.iterations), 8u);
+    dp.sigmaColor = float(args.num("sigma-color", dp.sigmaColor));
+    dp.sigmaNormal = float(args.num("sigma-normal", dp.sigmaNormal));
+    dp.sigmaDepth = float(args.num("sigma-depth", dp.sigmaDepth));
+
+    ShadeParams sp;
+    Camera cam;
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    Bvh4 bvh;
+    if (!load_bvh4(bvhPath.c_str(), bvh)) {
+        std::cerr << "Failed to read BVH4 " << bvhPath << "\n";
+        return 1;
+    }
+
+    std::cout << "scene: " << scenePath << " (" << tris.count() << " tris), bvh: " << bvhPath
+              << " (" << bvh.nodes.size() << " nodes)\n";
+    std::cout << "threads: " << worker_count() << ", SIMD width: " << SIMD_W << "\n";
+
+    GBuffer g;
+    g.resize(width, height);
+    render_gbuffer(bvh, tris, cam, g);
+
+    AtrousDenoiser filter;
+    ImageRGB light, filtered;        // demodulated
+    ImageRGB denoised, noisy, ref;   // colour
+    std::vector<float> var;
+
+    if (temporalFrames == 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        render_reference(bvh, tris, cam, g, sp, refSpp, ref);
+        std::cout << "reference: " << refSpp << " spp at " << width << "x" << height
+                  << " in " << ms_since(t0) << " ms\n\n";
+        save_image(outDir, "reference", ref);
+
+        filter.set_guide(g, dp.iterations);
+
+        std::vector<uint32_t> sppList;
+        std::vector<double> errNoisy, errDenoised;
+        SampleSums acc;
+        acc.reset(width, height);
+
+        std::printf("%6s %14s %14s %12s\n", "spp", "RMSE noisy", "RMSE denoised", "filter ms");
+
+        // Independent seed from the reference; samples accumulate progressively.
+        for (uint32_t spp = 1; spp <= maxSpp; spp *= 2) {
+            render_samples(bvh, tris, cam, g, sp, acc.count, spp - acc.count, 0xC0FFEEull, acc);
+            resolve(acc, g, light, var);
+
+            auto tf = std::chrono::steady_clock::now();
+            filter.run(light, var, dp, filtered);
+            double fms = ms_since(tf);
+
+            remodulate(light, g, sp, noisy);
+            remodulate(filtered, g, sp, denoised);
+
+            sppList.push_back(spp);
+            errNoisy.push_back(rmse_geometry(noisy, ref, g));
+            errDenoised.push_back(rmse_geometry(denoised, ref, g));
+            std::printf("%6u %14.6f %14.6f %12.3f\n", spp, errNoisy.back(), errDenoised.back(), fms);
+
+            save_image(outDir, "noisy_" + std::to_string(spp) + "spp", noisy);
+            save_image(outDir, "denoised_" + std::to_string(spp) + "spp", denoised);
+        }
+
+        // The 1 spp error is almost all noise; the reference has refSpp x less variance.
+        double floor = errNoisy.front() / std::sqrt(double(refSpp));
+        std::cout << "\nreference noise floor ~" << floor << " (removed in quadrature below)\n"
+                  << "RMSE threshold " << threshold << ":\n"
+                  << "  without denoiser: " << spp_needed(sppList, errNoisy, floor, threshold) << " spp\n"
+                  << "  with denoiser:    " << spp_needed(sppList, errDenoised, floor, threshold) << " spp\n";
+    } else {
+        const uint32_t spp = temporalSpp;
+        History hist;
+        ImageRGB accum, accumColor;
+        std::vector<float> accVar;
+        std::vector<uint32_t> frames;
+        std::vector<double> errRaw, errTemporal, errBoth;
+
+        std::printf("%6s %14s %14s %14s\n", "frame", "RMSE 1 frame", "RMSE temporal", "RMSE temp+atr");
+
+        for (uint32_t f = 0; f < temporalFrames; ++f) {
+            if (f > 0) {
+                orbit_camera(cam, orbitDeg);
+                g.resize(width, height);
+                render_gbuffer(bvh, tris, cam, g);
+            }
+
+            SampleSums acc;
+            acc.reset(width, height);
+            render_samples(bvh, tris, cam, g, sp, f * spp, spp, 0xC0FFEEull, acc);
+            resolve(acc, g, light, var);
+
+            temporal_accumulate(light, var, g, cam, hist, 0.05f, accum, accVar);
+            filter.set_guide(g, dp.iterations);
+            filter.run(accum, accVar, dp, filtered);
+
+            remodulate(light, g, sp, noisy);
+            remodulate(accum, g, sp, accumColor);
+            remodulate(filtered, g, sp, denoised);
+
+            render_reference(bvh, tris, cam, g, sp, refSpp, ref);
+
+            frames.push_back(f + 1);
+            errRaw.push_back(rmse_geometry(noisy, ref, g));
+            errTemporal.push_back(rmse_geometry(accumColor, ref, g));
+            errBoth.push_back(rmse_geometry(denoised, ref, g));
+            std::printf("%6u %14.6f %14.6f %14.6f\n", f + 1, errRaw.back(), errTemporal.back(), errBoth.back());
+        }
+
+        auto framesNeeded = [&](const std::vector<double>& err) -> std::string {
+            for (size_t k = 0; k < err.size(); ++k) {
+                if (err[k] <= threshold) return std::to_string(frames[k]) + " frames (" +
+                                                std::to_string(frames[k] * spp) + " spp total)";
+            }
+            return "not reached in " + std::to_string(temporalFrames) + " frames";
+        };
+
+        std::cout << "\nRMSE threshold " << threshold << " at " << spp << " spp/frame, orbit "
+                  << orbitDeg << " deg/frame:\n"
+                  << "  single frame:      " << (errRaw.back() <= threshold ? "met" : "not met") << "\n"
+                  << "  temporal only:     " << framesNeeded(errTemporal) << "\n"
+                  << "  temporal + atrous: " << framesNeeded(errBoth) << "\n";
+        save_image(outDir, "temporal_last", denoised);
+    }
+
+    // Filter cost at the target resolution. The kernel is branch-free, so the
+    // study buffers are nearest-upsampled rather than re-rendered at full size.
+    {
+        GBuffer gt;
+        gt.resize(timeW, timeH);
+        ImageRGB in;
+        in.resize(timeW, timeH);
+        std::vector<float> vt(size_t(timeW) * timeH);
+
+        for (uint32_t y = 0; y < timeH; ++y)
+            for (uint32_t x = 0; x < timeW; ++x) {
+                size_t i = size_t(y) * timeW + x;
+                size_t j = size_t(y * height / timeH) * width + size_t(x * width / timeW);
+                gt.tri[i] = g.tri[j];
+                gt.depth[i] = g.depth[j];
+                gt.nx[i] = g.nx[j];
+                gt.ny[i] = g.ny[j];
+                gt.nz[i] = g.nz[j];
+                gt.grad[i] = g.grad[j] * float(width) / float(timeW);
+                in.r[i] = light.r[j];
+                in.g[i] = light.g[j];
+                in.b[i] = light.b[j];
+                vt[i] = var[j];
+            }
+
+        AtrousDenoiser big;
+        ImageRGB out;
+        std::vector<double> guide, times;
+        for (int rep = 0; rep < 11; ++rep) {
+            auto t0 = std::chrono::steady_clock::now();
+            big.set_guide(gt, dp.iterations);
+            double tg = ms_since(t0);
+            t0 = std::chrono::steady_clock::now();
+            big.run(in, vt, dp, out);
+            if (rep > 0) { // first run warms the caches
+                guide.push_back(tg);
+                times.push_back(ms_since(t0));
+            }
+        }
+        std::sort(guide.begin(), guide.end());
+        std::sort(times.begin(), times.end());
+
+        std::cout << "\nfilter at " << timeW << "x" << timeH << ": " << dp.iterations
+                  << " iterations, median " << times[times.size() / 2] << " ms (min "
+                  << times.front() << " ms) + guide upload " << guide[guide.size() / 2]
+                  << " ms, " << worker_count() << " threads\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,459 @@
+// difftest.cpp
+// Differential test of the BVH4 traversal (trace.hpp) against the SIMD
+// brute-force loop (brute.hpp). Both answer the same rays in parallel;
+// every disagreement is classified and the first few of each class are
+// printed as a one-line reproducer with a diagnosis of why the traversal
+// did not reach the right triangle.
+//
+//   bin/difftest [--scene public/assets/dragon.glb | --synth random --tris 4096]
+//                [--bvh built|data/BVH4_wide.bin|FILE] [--rays 4096]
+//                [--mix random,targeted,camera] [--seed 1] [--t-tol 1e-5]
+//                [--list 5] [--json out.json|-]
+//   bin/difftest ... --ray ox,oy,oz,dx,dy,dz
+//
+// Ray kinds: "random" starts anywhere in the scene bounds (grown by half)
+// in a uniform direction; "targeted" aims such an origin at a random point
+// on a random triangle; "camera" is a jittered primary ray from one of 16
+// poses of the orbit path (campath.hpp). Kinds take turns by ray index.
+//
+// Per ray: closest hit, plus trace_occluded() with tmax = INF and with
+// tmax = half the closest t. The build's -march=native lets the compiler
+// contract the scalar intersect_triangle() into FMAs, so it and the SIMD
+// loop round differently at edges and in t (~1e-5 on grazing hits). Every
+// disagreement is therefore re-scored with the scalar test on the brute
+// force triangle ("reference t") before it counts as an error:
+//
+//   missed    the scalar test hits the reference triangle, the traversal
+//             misses
+//   farther   the traversal's hit is farther than the reference t beyond
+//             --t-tol: it skipped a nearer triangle
+//   t-error   the traversal's t is not the scalar t of the triangle it
+//             returns (wrong index or corrupt triangle data)
+//   occluded  an occlusion query contradicts the closest hit or the
+//             reference
+//   tie       different triangle at the same t (shared edge)
+//   rounding  other disagreement beyond --t-tol, explained by the two
+//             tests' rounding
+//
+// tie and rounding are not errors.
+//
+// Reproducers print the ray as hex floats for --ray, which re-runs that one
+// ray and prints the diagnosis: whether the expected triangle's leaf is
+// reachable, and the first node on its root path whose box the hit point
+// leaves (in fp16 ULPs) or whose slab test misses.
+//
+// Brute force costs rays x triangles: ~1 ms per ray on the dragon per
+// core, microseconds on a few-thousand-triangle --synth scene, where
+// millions of rays take seconds. Exits 1 on any error.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "brute.hpp"
+#include "campath.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "synth.hpp"
+#include "trace.hpp"
+
+enum RayGen : uint32_t { GEN_RANDOM = 0, GEN_TARGETED, GEN_CAMERA, GEN_KINDS };
+static const char* const GEN_NAMES[GEN_KINDS] = {"random", "targeted", "camera"};
+
+enum DiffClass : uint32_t {
+    DIFF_MISSED = 0,
+    DIFF_FARTHER,
+    DIFF_T,
+    DIFF_OCCLUDED,
+    DIFF_TIE, // first class that is not an error
+    DIFF_ROUNDING,
+    DIFF_CLASSES
+};
+static const char* const DIFF_NAMES[DIFF_CLASSES] = {"missed", "farther", "t-error", "occluded", "tie", "rounding"};
+
+struct DiffRay {
+    Ray      ray;
+    uint32_t kind = 0;
+    Hit      bvh, brute;
+    float    refT = INF;   // scalar test on brute.tri
+    float    bvhRefT = INF; // scalar test on bvh.tri
+    bool     occInf = false, occHalf = false;
+};
+
+struct DiffCounts {
+    uint64_t rays = 0, hits = 0;
+    uint64_t n[DIFF_CLASSES] = {};
+};
+
+// Node -> parent and triangle -> leaf over the reachable tree.
+struct TreeIndex {
+    std::vector<uint32_t> parent, leafOf;
+};
+
+static TreeIndex index_tree(const Bvh4& bvh, uint32_t numTris) {
+    TreeIndex ix;
+    ix.parent.assign(bvh.nodes.size(), INVALID);
+    ix.leafOf.assign(numTris, INVALID);
+    if (bvh.nodes.empty()) return ix;
+    std::vector<uint8_t> seen(bvh.nodes.size(), 0);
+    std::vector<uint32_t> stack{0u};
+    seen[0] = 1;
+    while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        const Bvh4Node& node = bvh.nodes[n];
+        if (node.leaf()) {
+            if (node.tri() < numTris && ix.leafOf[node.tri()] == INVALID) ix.leafOf[node.tri()] = n;
+            continue;
+        }
+        for (uint32_t c : node.child) {
+            if (c == INVALID || c >= bvh.nodes.size() || seen[c]) continue;
+            seen[c] = 1;
+            ix.parent[c] = n;
+            stack.push_back(c);
+        }
+    }
+    return ix;
+}
+
+// Why the traversal does not reach `tri` at distance t along `ray`.
+static std::string explain(const Bvh4& bvh, const Triangles& tris, const TreeIndex& ix, const Ray& ray, Hit expect) {
+    char buf[256];
+    if (!expect.hit()) return "no triangle expected";
+    if (ix.leafOf[expect.tri] == INVALID) {
+        std::snprintf(buf, sizeof(buf), "tri %u is in no reachable leaf", expect.tri);
+        return buf;
+    }
+    std::vector<uint32_t> path;
+    for (uint32_t n = ix.leafOf[expect.tri]; n != INVALID; n = ix.parent[n]) path.push_back(n);
+    std::reverse(path.begin(), path.end());
+
+    const Vec3 p = ray.origin + ray.dir * expect.t;
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+    static const char* const FACE[6] = {"min x", "min y", "min z", "max x", "max y", "max z"};
+    std::string out = "path";
+    for (size_t i = 0; i < path.size(); ++i) {
+        std::snprintf(buf, sizeof(buf), "%s%u", i ? " > " : " ", path[i]);
+        out += buf;
+    }
+    for (size_t i = 0; i < path.size(); ++i) {
+        const Aabb& box = bvh.nodes[path[i]].box;
+        if (box.empty()) {
+            std::snprintf(buf, sizeof(buf), "; node %u (depth %zu) has an empty box, so it is skipped", path[i], i);
+            return out + buf;
+        }
+        Aabb hitBox;
+        hitBox.grow(p);
+        int face = 0;
+        double over = aabb_overshoot_ulps(box, hitBox, &face);
+        if (over > 0.0) {
+            std::snprintf(buf, sizeof(buf), "; hit point is %.2f fp16 ulps outside node %u (depth %zu) at its %s face",
+                          over, path[i], i, FACE[face]);
+            return out + buf;
+        }
+        if (intersect_aabb(ray, invDir, box, INF) >= INF) {
+            std::snprintf(buf, sizeof(buf), "; slab test misses node %u (depth %zu) though the hit point is inside",
+                          path[i], i);
+            return out + buf;
+        }
+    }
+    TraceStats st;
+    trace_closest(bvh, tris, ray, &st);
+    std::snprintf(buf, sizeof(buf), "; every box on the path is hit (%llu stack drops, %llu nodes)",
+                  (unsigned long long)st.stackDrops, (unsigned long long)st.nodes);
+    return out + buf;
+}
+
+static std::string ray_arg(const Ray& r) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%a,%a,%a,%a,%a,%a", r.origin.x, r.origin.y, r.origin.z, r.dir.x, r.dir.y,
+                  r.dir.z);
+    return buf;
+}
+
+static std::string hit_str(Hit h) {
+    if (!h.hit()) return "miss";
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "tri %u t %.9g", h.tri, h.t);
+    return buf;
+}
+
+static Vec3 uniform_direction(Rng& rng) {
+    float z = 1.0f - 2.0f * rng.uniform();
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float phi = 6.28318530718f * rng.uniform();
+    return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+static std::vector<DiffRay> generate_rays(const Triangles& tris, size_t n, const std::vector<uint32_t>& kinds,
+                                          uint64_t seed) {
+    Aabb scene;
+    for (uint32_t t = 0; t < tris.count(); ++t) scene.grow(tris.bounds(t));
+    const Vec3 c = scene.center(), half = (scene.mx - scene.mn) * 0.75f;
+    const std::vector<CameraPose> poses = orbit_camera_path(16, 1.0);
+    const uint32_t width = 640, height = 360;
+
+    std::vector<DiffRay> rays(n);
+    parallel_for(0, n, 1024, [&](size_t i) {
+        Rng rng(seed, i);
+        DiffRay& d = rays[i];
+        d.kind = kinds[i % kinds.size()];
+        Vec3 o{c.x + half.x * (2.0f * rng.uniform() - 1.0f), c.y + half.y * (2.0f * rng.uniform() - 1.0f),
+               c.z + half.z * (2.0f * rng.uniform() - 1.0f)};
+        if (d.kind == GEN_RANDOM) {
+            d.ray = Ray{o, uniform_direction(rng), 0.0f, INF};
+        } else if (d.kind == GEN_TARGETED) {
+            uint32_t t = std::min(uint32_t(rng.uniform() * float(tris.count())), tris.count() - 1);
+            float su = std::sqrt(rng.uniform()), v = rng.uniform();
+            Vec3 p = tris.vertex(t, 0) * (1.0f - su) + tris.vertex(t, 1) * (su * (1.0f - v)) +
+                     tris.vertex(t, 2) * (su * v);
+            Vec3 dir = p - o;
+            d.ray = Ray{o, length(dir) > 0.0f ? normalize(dir) : uniform_direction(rng), 0.0f, INF};
+        } else {
+            const CameraPose& pose = poses[rng.next() % poses.size()];
+            d.ray = primary_ray(pose.camera(), rng.uniform() * float(width) - 0.5f,
+                                rng.uniform() * float(height) - 0.5f, width, height);
+        }
+    });
+    return rays;
+}
+
+static bool t_close(float a, float b, double tol) {
+    return std::fabs(double(a) - double(b)) <= tol * std::max(1.0, std::fabs(double(b)));
+}
+
+// Classes of one ray (bit per DiffClass).
+static uint32_t classify(const DiffRay& d, double tol) {
+    uint32_t m = 0;
+    const bool refHit = d.refT < INF;
+    if (d.bvh.hit() && !t_close(d.bvh.t, d.bvhRefT, tol)) m |= 1u << DIFF_T;
+    else if (refHit && !d.bvh.hit()) m |= 1u << DIFF_MISSED;
+    else if (refHit && d.bvh.t > d.refT && !t_close(d.bvh.t, d.refT, tol)) m |= 1u << DIFF_FARTHER;
+    else if (d.bvh.tri != d.brute.tri && d.bvh.hit() && d.brute.hit() && d.bvh.t == d.brute.t) m |= 1u << DIFF_TIE;
+    else if (d.bvh.tri != d.brute.tri || !t_close(d.bvh.t, d.brute.t, tol)) m |= 1u << DIFF_ROUNDING;
+
+    const bool halfHit = d.bvh.hit() && d.bvh.t < 0.5f * d.brute.t;
+    if ((refHit && !d.occInf) || (d.occInf && !d.bvh.hit()) || (d.occHalf && !halfHit)) m |= 1u << DIFF_OCCLUDED;
+    return m;
+}
+
+// Needs d.brute.
+static void trace_bvh(const Bvh4& bvh, const Triangles& tris, DiffRay& d) {
+    auto scalar_t = [&](uint32_t tri) {
+        return tri < tris.count() ? intersect_triangle(d.ray, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2))
+                                  : INF;
+    };
+    d.bvh = trace_closest(bvh, tris, d.ray);
+    d.refT = d.brute.hit() ? scalar_t(d.brute.tri) : INF;
+    d.bvhRefT = d.bvh.hit() ? scalar_t(d.bvh.tri) : INF;
+    d.occInf = trace_occluded(bvh, tris, d.ray);
+    d.occHalf = false;
+    if (d.brute.hit()) {
+        Ray half = d.ray;
+        half.tmax = 0.5f * d.brute.t;
+        d.occHalf = half.tmax > half.tmin && trace_occluded(bvh, tris, half);
+    }
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string synthKind = args.str("synth", "");
+    std::string bvhName = args.str("bvh", "built");
+    std::string jsonPath = args.str("json", "");
+    const size_t numRays = std::max<size_t>(args.u32("rays", 4096), 1);
+    const uint64_t seed = args.u32("seed", 1);
+    const double tol = args.num("t-tol", 1e-5);
+    const size_t list = args.u32("list", 5);
+
+    std::vector<uint32_t> kinds;
+    for (const std::string& k : args.strs("mix", "random,targeted,camera")) {
+        uint32_t g = 0;
+        while (g < GEN_KINDS && k != GEN_NAMES[g]) ++g;
+        if (g == GEN_KINDS) {
+            std::cerr << "--mix takes random, targeted, camera\n";
+            return 1;
+        }
+        kinds.push_back(g);
+    }
+    if (kinds.empty()) kinds = {GEN_RANDOM, GEN_TARGETED, GEN_CAMERA};
+
+    Triangles tris;
+    if (!synthKind.empty()) {
+        SynthParams sp;
+        sp.kind = synthKind;
+        sp.tris = args.u32("tris", 4096);
+        sp.seed = seed;
+        if (!generate_scene(sp, tris)) return 1;
+        scenePath = "synth " + synthKind + " " + std::to_string(sp.tris);
+    } else if (!load_scene(scenePath.c_str(), tris)) {
+        return 1;
+    }
+    if (tris.count() == 0 || tris.count() > BRUTE_MAX_TRIS) {
+        std::cerr << "Scene needs 1.." << BRUTE_MAX_TRIS << " triangles, has " << tris.count() << "\n";
+        return 1;
+    }
+
+    Bvh4 bvh;
+    if (bvhName == "built") {
+        std::vector<uint64_t> keys = morton_keys(tris);
+        MortonOrder order = sort_morton_keys(keys);
+        bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, order)));
+    } else {
+        std::vector<uint32_t> raw;
+        uint32_t arity = load_u32_file(bvhName.c_str(), raw) ? bvh_file_arity(raw) : 0;
+        if (!arity) {
+            std::cerr << "Failed to read a BVH2 / BVH4 from " << bvhName << "\n";
+            return 1;
+        }
+        bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+    }
+    const BruteTris brute = make_brute_tris(tris);
+    const TreeIndex ix = index_tree(bvh, tris.count());
+
+    std::vector<double> single = args.nums("ray", "");
+    if (!single.empty()) {
+        if (single.size() != 6) {
+            std::cerr << "--ray takes ox,oy,oz,dx,dy,dz\n";
+            return 1;
+        }
+        DiffRay d;
+        d.ray = Ray{{float(single[0]), float(single[1]), float(single[2])},
+                    {float(single[3]), float(single[4]), float(single[5])}, 0.0f, INF};
+        d.brute = brute_closest(brute, d.ray);
+        trace_bvh(bvh, tris, d);
+        uint32_t m = classify(d, tol);
+        std::printf("ray      %s\nbrute    %s\ntraverse %s\noccluded %s (tmax inf), %s (tmax t/2)\n",
+                    ray_arg(d.ray).c_str(), hit_str(d.brute).c_str(), hit_str(d.bvh).c_str(),
+                    d.occInf ? "yes" : "no", d.occHalf ? "yes" : "no");
+        for (uint32_t c = 0; c < DIFF_CLASSES; ++c)
+            if (m & (1u << c)) std::printf("class    %s\n", DIFF_NAMES[c]);
+        if (d.brute.hit()) std::printf("%s\n", explain(bvh, tris, ix, d.ray, d.brute).c_str());
+        return (m & ((1u << DIFF_TIE) - 1)) ? 1 : 0;
+    }
+
+    std::vector<DiffRay> rays = generate_rays(tris, numRays, kinds, seed);
+
+    // Blocks of BLOCK rays share each pass over the triangles.
+    static constexpr size_t BLOCK = 64;
+    BenchTimer bt;
+    parallel_for_chunks(0, rays.size(), BLOCK, [&](size_t b, size_t e, unsigned) {
+        Ray block[BLOCK];
+        Hit hits[BLOCK];
+        for (size_t b0 = b; b0 < e; b0 += BLOCK) {
+            size_t n = std::min(BLOCK, e - b0);
+            for (size_t i = 0; i < n; ++i) block[i] = rays[b0 + i].ray;
+            brute_closest_block(brute, block, n, hits);
+            for (size_t i = 0; i < n; ++i) rays[b0 + i].brute = hits[i];
+        }
+    });
+    const double bruteMs = bt.ms();
+
+    BenchTimer tt;
+    parallel_for(0, rays.size(), 256, [&](size_t i) { trace_bvh(bvh, tris, rays[i]); });
+    const double bvhMs = tt.ms();
+
+    DiffCounts total, byKind[GEN_KINDS];
+    uint64_t errors = 0;
+    std::vector<size_t> examples[DIFF_CLASSES];
+    double maxTErr = 0.0;
+    for (size_t i = 0; i < rays.size(); ++i) {
+        const DiffRay& d = rays[i];
+        uint32_t m = classify(d, tol);
+        for (DiffCounts* dc : {&total, &byKind[d.kind]}) {
+            dc->rays++;
+            dc->hits += d.brute.hit();
+            for (uint32_t c = 0; c < DIFF_CLASSES; ++c) dc->n[c] += (m >> c) & 1u;
+        }
+        for (uint32_t c = 0; c < DIFF_CLASSES; ++c)
+            if ((m & (1u << c)) && examples[c].size() < list) examples[c].push_back(i);
+        errors += (m & ((1u << DIFF_TIE) - 1)) != 0;
+        if (d.bvh.hit() && d.bvh.tri == d.brute.tri)
+            maxTErr = std::max(maxTErr, std::fabs(double(d.bvh.t) - double(d.brute.t)));
+    }
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, bvh %s, %zu rays, seed %llu, %u threads, SIMD width %d\n\n", scenePath.c_str(),
+                 tris.count(), bvhName.c_str(), rays.size(), (unsigned long long)seed, worker_count(), SIMD_W);
+    std::fprintf(text, "brute force  %9.1f ms  %8.3f Mrays/s\n", bruteMs, double(rays.size()) / bruteMs * 1e-3);
+    std::fprintf(text, "traversal    %9.1f ms  %8.3f Mrays/s (closest + 2 occlusion queries)\n\n", bvhMs,
+                 double(rays.size()) / bvhMs * 1e-3);
+    std::fprintf(text, "%-9s %8s %8s", "kind", "rays", "hits");
+    for (uint32_t c = 0; c < DIFF_CLASSES; ++c) std::fprintf(text, " %9s", DIFF_NAMES[c]);
+    std::fprintf(text, "\n");
+    auto row = [&](const char* name, const DiffCounts& dc) {
+        std::fprintf(text, "%-9s %8llu %8llu", name, (unsigned long long)dc.rays, (unsigned long long)dc.hits);
+        for (uint32_t c = 0; c < DIFF_CLASSES; ++c) std::fprintf(text, " %9llu", (unsigned long long)dc.n[c]);
+        std::fprintf(text, "\n");
+    };
+    for (uint32_t k = 0; k < GEN_KINDS; ++k)
+        if (byKind[k].rays) row(GEN_NAMES[k], byKind[k]);
+    row("total", total);
+    std::fprintf(text, "\nmax |t| difference on matching hits: %.3g\n", maxTErr);
+
+    for (uint32_t c = 0; c < DIFF_CLASSES; ++c) {
+        if (c >= DIFF_TIE || examples[c].empty()) continue;
+        std::fprintf(text, "\n%s (first %zu):\n", DIFF_NAMES[c], examples[c].size());
+        for (size_t i : examples[c]) {
+            const DiffRay& d = rays[i];
+            std::fprintf(text, "  #%zu %s: expect %s, got %s\n    --ray %s\n    %s\n", i, GEN_NAMES[d.kind],
+                         hit_str(d.brute).c_str(), hit_str(d.bvh).c_str(), ray_arg(d.ray).c_str(),
+                         explain(bvh, tris, ix, d.ray, d.brute).c_str());
+        }
+    }
+    int status = errors ? 1 : 0;
+    if (status) std::fprintf(text, "\nFAIL: %llu rays disagree with brute force\n", (unsigned long long)errors);
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/difftest");
+    w.value("scene", scenePath);
+    w.value("bvh", bvhName);
+    w.value("rays", uint64_t(rays.size()));
+    w.value("seed", seed);
+    w.value("brute_ms", bruteMs);
+    w.value("traversal_ms", bvhMs);
+    w.value("max_t_diff", maxTErr);
+    w.value("errors", errors);
+    w.begin_object("kinds");
+    for (uint32_t k = 0; k < GEN_KINDS; ++k) {
+        if (!byKind[k].rays) continue;
+        w.begin_object(GEN_NAMES[k]);
+        w.value("rays", byKind[k].rays);
+        w.value("hits", byKind[k].hits);
+        for (uint32_t c = 0; c < DIFF_CLASSES; ++c) w.value(DIFF_NAMES[c], byKind[k].n[c]);
+        w.end_object();
+    }
+    w.end_object();
+    w.begin_array("reproducers");
+    for (uint32_t c = 0; c < DIFF_CLASSES; ++c) {
+        if (c >= DIFF_TIE) continue;
+        for (size_t i : examples[c]) {
+            const DiffRay& d = rays[i];
+            w.begin_object();
+            w.value("class", DIFF_NAMES[c]);
+            w.value("index", uint64_t(i));
+            w.value("kind", GEN_NAMES[d.kind]);
+            w.value("ray", ray_arg(d.ray));
+            w.value("expect", hit_str(d.brute));
+            w.value("got", hit_str(d.bvh));
+            w.value("diagnosis", explain(bvh, tris, ix, d.ray, d.brute));
+            w.end_object();
+        }
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,199 @@
+// flight.cpp
+// Headless flythrough benchmark: renders every pose of a camera path
+// (campath.hpp) with the CPU traversal the way the shader does (one
+// primary ray per pixel, N.L sun shading, 0.01 background) and reports
+// frame times, the worst frame and rays per second, so scene, layout and
+// builder changes can be compared on the same flight.
+//
+//   bin/flight [--path data/orbit.path] [--scene public/assets/dragon.glb]
+//              [--kernel data/BVH4_wide.bin|bvh4|kdtree|grid|FILE]
+//              [--size 640x360] [--fov 70] [--shadows] [--reps 3]
+//              [--out DIR] [--json out.json|-]
+//   bin/flight --write-orbit data/orbit.path [--poses 120] [--seconds 4]
+//
+// --shadows adds the sun shadow ray the shader does not trace yet. Each
+// frame's time is the median over --reps passes of the whole path, after
+// one untimed warm-up frame. --out writes every frame of the last pass as
+// frame_NNNN.ppm. "recorded" is the path's own frame rate (poses over its
+// duration), i.e. what the app reached while the path was captured.
+//
+// The render loop must not allocate (memtrack.hpp MemHotLoop); the tool
+// exits 1 if it does.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "accel.hpp"
+#include "args.hpp"
+#include "bench.hpp"
+#include "campath.hpp"
+#include "image.hpp"
+#include "json.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+
+static constexpr uint32_t TILE = 16;
+
+// renderer.wgsl shade(): geometric normal, not flipped toward the viewer.
+// Returns the rays traced; `shadowRays` holds one counter per worker.
+static uint64_t render_frame(const Accel& accel, const Triangles& tris, const Camera& cam, bool shadows,
+                             ImageRGB& img, std::vector<uint64_t>& shadowRays) {
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    const Vec3 baseColor{0.9f, 0.7f, 0.3f};
+    const uint32_t width = img.width, height = img.height;
+    std::fill(shadowRays.begin(), shadowRays.end(), 0);
+
+    parallel_for_tiles(width, height, TILE, [&](Tile tl, unsigned w) {
+        MemHotLoop hot("render");
+        for (uint32_t y = tl.y0; y < tl.y1; ++y)
+            for (uint32_t x = tl.x0; x < tl.x1; ++x) {
+                size_t i = size_t(y) * width + x;
+                Ray r = primary_ray(cam, float(x), float(y), width, height);
+                Hit hit = accel.intersect(r, nullptr);
+                if (!hit.hit()) {
+                    img.r[i] = img.g[i] = img.b[i] = 0.01f;
+                    continue;
+                }
+                Vec3 n = tris.normal(hit.tri);
+                float ndotl = std::max(dot(n, lightDir), 0.0f);
+                if (shadows && ndotl > 0.0f) {
+                    Vec3 nf = dot(n, r.dir) > 0.0f ? -n : n;
+                    shadowRays[w]++;
+                    if (accel.occluded(Ray{r.origin + r.dir * hit.t + nf * 1e-4f, lightDir, 0.0f, INF}, nullptr))
+                        ndotl = 0.0f;
+                }
+                float e = 0.15f + ndotl;
+                img.r[i] = baseColor.x * e;
+                img.g[i] = baseColor.y * e;
+                img.b[i] = baseColor.z * e;
+            }
+    });
+
+    uint64_t rays = uint64_t(width) * height;
+    for (uint64_t s : shadowRays) rays += s;
+    return rays;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string orbitPath = args.str("write-orbit", "");
+    if (!orbitPath.empty()) {
+        std::vector<CameraPose> poses =
+            orbit_camera_path(std::max(args.u32("poses", 120), 1u), args.num("seconds", 4.0));
+        if (!write_camera_path(orbitPath.c_str(), poses)) {
+            std::cerr << "Failed to write " << orbitPath << "\n";
+            return 1;
+        }
+        std::printf("%s: %zu poses\n", orbitPath.c_str(), poses.size());
+        return 0;
+    }
+
+    std::string pathFile = args.str("path", "data/orbit.path");
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string kernelName = args.str("kernel", "data/BVH4_wide.bin");
+    std::string outDir = args.str("out", "");
+    std::string jsonPath = args.str("json", "");
+    const bool shadows = args.has("shadows");
+    const uint32_t reps = std::max(args.u32("reps", 3), 1u);
+    const float fovDeg = float(args.num("fov", 70.0));
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+
+    std::vector<CameraPose> poses;
+    if (!read_camera_path(pathFile.c_str(), poses)) return 1;
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    std::unique_ptr<Accel> accel = make_accel_or_file(kernelName);
+    if (!accel) return 1;
+    accel->build(tris);
+
+    ImageRGB img;
+    img.resize(width, height);
+    std::vector<uint64_t> shadowRays(worker_count(), 0);
+    render_frame(*accel, tris, poses[0].camera(fovDeg), shadows, img, shadowRays); // warm-up
+
+    const size_t frames = poses.size();
+    std::vector<std::vector<double>> frameMs(frames);
+    std::vector<uint64_t> frameRays(frames, 0);
+    for (uint32_t rep = 0; rep < reps; ++rep)
+        for (size_t f = 0; f < frames; ++f) {
+            BenchTimer t;
+            frameRays[f] = render_frame(*accel, tris, poses[f].camera(fovDeg), shadows, img, shadowRays);
+            frameMs[f].push_back(t.ms());
+            if (rep + 1 == reps && !outDir.empty()) {
+                char name[64];
+                std::snprintf(name, sizeof(name), "/frame_%04zu.ppm", f);
+                if (!write_ppm((outDir + name).c_str(), img)) {
+                    std::cerr << "Failed to write " << outDir << name << "\n";
+                    return 1;
+                }
+            }
+        }
+
+    std::vector<double> medians(frames);
+    uint64_t totalRays = 0;
+    double totalMs = 0.0;
+    size_t worst = 0;
+    for (size_t f = 0; f < frames; ++f) {
+        medians[f] = summarize(frameMs[f]).median;
+        totalRays += frameRays[f];
+        totalMs += medians[f];
+        if (medians[f] > medians[worst]) worst = f;
+    }
+    BenchSummary s = summarize(medians);
+    const double duration = poses.back().time - poses.front().time;
+    const double recordedFps = frames > 1 && duration > 0.0 ? double(frames - 1) / duration : 0.0;
+    const double mraysPerS = totalMs > 0.0 ? double(totalRays) / (totalMs * 1e-3) * 1e-6 : 0.0;
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %zu poses over %.2f s (recorded %.1f fps), %s, %ux%u%s, kernel %s, %u reps, %u threads\n\n",
+                 pathFile.c_str(), frames, duration, recordedFps, scenePath.c_str(), width, height,
+                 shadows ? " + shadows" : "", kernelName.c_str(), reps, worker_count());
+    std::fprintf(text, "frame ms   mean %.2f  median %.2f  p99 %.2f  min %.2f  stddev %.2f\n", s.mean, s.median,
+                 s.p99, s.min, s.stddev);
+    std::fprintf(text, "worst      frame %zu at %.2f s: %.2f ms (%.1fx median)\n", worst, poses[worst].time,
+                 medians[worst], s.median > 0.0 ? medians[worst] / s.median : 0.0);
+    std::fprintf(text, "throughput %.1f fps mean, %.2f Mrays/s (%.2f rays/pixel)\n",
+                 s.mean > 0.0 ? 1000.0 / s.mean : 0.0, mraysPerS,
+                 double(totalRays) / (double(frames) * width * height));
+
+    int status = report_hot_loop_violations(text) ? 1 : 0;
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/flight");
+    w.value("path", pathFile);
+    w.value("scene", scenePath);
+    w.value("kernel", kernelName);
+    w.value("width", width);
+    w.value("height", height);
+    w.value("shadows", shadows);
+    w.value("reps", reps);
+    w.value("recorded_fps", recordedFps);
+    w.value("mean_ms", s.mean);
+    w.value("median_ms", s.median);
+    w.value("p99_ms", s.p99);
+    w.value("worst_frame", uint64_t(worst));
+    w.value("worst_ms", medians[worst]);
+    w.value("mrays_per_s", mraysPerS);
+    w.begin_array("frames");
+    for (size_t f = 0; f < frames; ++f) {
+        w.begin_object();
+        w.value("time", poses[f].time);
+        w.value("ms", medians[f]);
+        w.value("rays", frameRays[f]);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+// grid.hpp
+// Two-level uniform grid (Kalojanov et al. 2011): a coarse top grid sized by
+// triangle density, and inside every non-empty top cell a second grid sized
+// by that cell's own triangle count. Triangles are binned by their bounding
+// boxes. Both levels are walked with the same 3D DDA; a closest hit is final
+// once it lies inside the leaf cell being visited.
+//
+//   top cell    firstLeaf (u32) | res x y z (u8 each, 0 = empty)
+//   leaf cell   begin count     (into refs)
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+struct GridTopCell {
+    uint32_t firstLeaf = 0;
+    uint8_t  res[3] = {0, 0, 0};
+    uint8_t  pad = 0;
+};
+
+struct GridLeaf {
+    uint32_t begin = 0;
+    uint32_t count = 0;
+};
+
+struct TwoLevelGrid {
+    Aabb                     box;
+    uint32_t                 res[3] = {0, 0, 0};
+    Vec3                     cellSize{0.0f, 0.0f, 0.0f};
+    std::vector<GridTopCell> top;
+    std::vector<GridLeaf>    leaves;
+    std::vector<uint32_t>    refs;
+
+    size_t bytes() const {
+        return top.size() * sizeof(GridTopCell) + leaves.size() * sizeof(GridLeaf) + refs.size() * sizeof(uint32_t);
+    }
+};
+
+struct GridBuildParams {
+    float topDensity = 1.0f / 16.0f; // top cells per triangle
+    float leafDensity = 2.0f;        // leaf cells per triangle reference in a top cell
+};
+
+/* ================= Build ================= */
+
+namespace grid_detail {
+
+// Cells per axis so that the total is about density * count, shaped like box.
+static inline void grid_res(Vec3 ext, float density, size_t count, uint32_t maxRes, uint32_t out[3]) {
+    float vol = std::max(ext.x * ext.y * ext.z, 1e-30f);
+    float k = std::cbrt(density * float(count) / vol);
+    for (int a = 0; a < 3; ++a) out[a] = std::clamp(uint32_t(ext[a] * k), 1u, maxRes);
+}
+
+static inline void cell_range(const Aabb& b, Vec3 origin, Vec3 cellSize, const uint32_t res[3], uint32_t lo[3],
+                              uint32_t hi[3]) {
+    for (int a = 0; a < 3; ++a) {
+        float inv = 1.0f / cellSize[a];
+        lo[a] = uint32_t(std::clamp(int32_t((b.mn[a] - origin[a]) * inv), 0, int32_t(res[a]) - 1));
+        hi[a] = uint32_t(std::clamp(int32_t((b.mx[a] - origin[a]) * inv), 0, int32_t(res[a]) - 1));
+    }
+}
+
+} // namespace grid_detail
+
+static inline TwoLevelGrid build_grid(const Triangles& tris, const GridBuildParams& params = {}) {
+    using namespace grid_detail;
+    TIMELINE_ZONE("grid build");
+    TwoLevelGrid g;
+    const uint32_t n = tris.count();
+    if (n == 0) return g;
+
+    std::vector<Aabb> triBox(n);
+    parallel_for(0, n, 1 << 14, [&](size_t t) { triBox[t] = tris.bounds(uint32_t(t)); });
+    for (const Aabb& b : triBox) g.box.grow(b);
+
+    Vec3 ext = g.box.mx - g.box.mn;
+    grid_res(ext, params.topDensity, n, 256, g.res);
+    for (int a = 0; a < 3; ++a) g.cellSize[a] = std::max(ext[a], 1e-6f) / float(g.res[a]);
+    const size_t numTop = size_t(g.res[0]) * g.res[1] * g.res[2];
+
+    // Top level: (cell, tri) pairs, sorted so each cell's triangles are a run.
+    std::vector<std::vector<uint64_t>> perWorker(worker_count());
+    parallel_for_chunks(0, n, 1 << 13, [&](size_t b, size_t e, unsigned w) {
+        for (size_t t = b; t < e; ++t) {
+            uint32_t lo[3], hi[3];
+            cell_range(triBox[t], g.box.mn, g.cellSize, g.res, lo, hi);
+            for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+                for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+                    for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+                        perWorker[w].push_back((uint64_t((z * g.res[1] + y) * g.res[0] + x) << 32) | t);
+        }
+    });
+    std::vector<uint64_t> pairs;
+    for (auto& v : perWorker) {
+        pairs.insert(pairs.end(), v.begin(), v.end());
+        std::vector<uint64_t>().swap(v);
+    }
+    parallel_sort(pairs.data(), pairs.data() + pairs.size(), std::less<uint64_t>());
+
+    std::vector<uint32_t> topBegin(numTop + 1, 0);
+    for (uint64_t p : pairs) topBegin[(p >> 32) + 1]++;
+    for (size_t c = 0; c < numTop; ++c) topBegin[c + 1] += topBegin[c];
+
+    // Second level, one top cell per task: local leaves and refs, spliced
+    // together after a prefix sum.
+    struct Local {
+        std::vector<GridLeaf> leaves;
+        std::vector<uint32_t> refs;
+    };
+    std::vector<Local> local(numTop);
+    g.top.resize(numTop);
+
+    parallel_for(0, numTop, 16, [&](size_t c) {
+        const uint32_t b = topBegin[c], e = topBegin[c + 1];
+        if (b == e) return;
+
+        uint32_t cx = uint32_t(c % g.res[0]), cy = uint32_t((c / g.res[0]) % g.res[1]),
+                 cz = uint32_t(c / (size_t(g.res[0]) * g.res[1]));
+        Vec3 origin = g.box.mn + Vec3{float(cx), float(cy), float(cz)} * g.cellSize;
+
+        uint32_t res[3];
+        grid_res(g.cellSize, params.leafDensity, e - b, 255, res);
+        Vec3 sub{g.cellSize.x / float(res[0]), g.cellSize.y / float(res[1]), g.cellSize.z / float(res[2])};
+
+        std::vector<uint64_t> sp;
+        for (uint32_t i = b; i < e; ++i) {
+            uint32_t t = uint32_t(pairs[i]);
+            uint32_t lo[3], hi[3];
+            cell_range(triBox[t], origin, sub, res, lo, hi);
+            for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+                for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+                    for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+                        sp.push_back((uint64_t((z * res[1] + y) * res[0] + x) << 32) | t);
+        }
+        std::sort(sp.begin(), sp.end());
+
+        Local& L = local[c];
+        L.leaves.resize(size_t(res[0]) * res[1] * res[2]);
+        L.refs.resize(sp.size());
+        for (size_t i = 0; i < sp.size(); ++i) {
+            GridLeaf& leaf = L.leaves[sp[i] >> 32];
+            if (leaf.count == 0) leaf.begin = uint32_t(i);
+            leaf.count++;
+            L.refs[i] = uint32_t(sp[i]);
+        }
+        for (int a = 0; a < 3; ++a) g.top[c].res[a] = uint8_t(res[a]);
+    });
+    std::vector<uint64_t>().swap(pairs);
+
+    std::vector<uint32_t> refBase(numTop + 1, 0);
+    size_t leafTotal = 0;
+    for (size_t c = 0; c < numTop; ++c) {
+        g.top[c].firstLeaf = uint32_t(leafTotal);
+        leafTotal += local[c].leaves.size();
+        refBase[c + 1] = refBase[c] + uint32_t(local[c].refs.size());
+    }
+    g.leaves.resize(leafTotal);
+    g.refs.resize(refBase[numTop]);
+
+    parallel_for(0, numTop, 64, [&](size_t c) {
+        Local& L = local[c];
+        for (size_t i = 0; i < L.leaves.size(); ++i) {
+            GridLeaf leaf = L.leaves[i];
+            leaf.begin += refBase[c];
+            g.leaves[g.top[c].firstLeaf + i] = leaf;
+        }
+        std::copy(L.refs.begin(), L.refs.end(), g.refs.begin() + refBase[c]);
+        Local().leaves.swap(L.leaves);
+        Local().refs.swap(L.refs);
+    });
+    return g;
+}
+
+/* ================= Traversal ================= */
+
+namespace grid_detail {
+
+// Amanatides-Woo over a res[0] x res[1] x res[2] grid at `origin`, starting
+// at t0. fn(cellIndex, tEnter, tExit) returns false to stop the walk.
+template <typename Fn>
+static inline void dda(const Ray& ray, Vec3 invDir, Vec3 origin, Vec3 cellSize, const uint32_t res[3], float t0,
+                       float t1, Fn&& fn) {
+    int32_t cell[3], step[3], end[3];
+    float tNext[3], tDelta[3];
+    for (int a = 0; a < 3; ++a) {
+        float p = ray.origin[a] + ray.dir[a] * t0;
+        cell[a] = std::clamp(int32_t((p - origin[a]) / cellSize[a]), 0, int32_t(res[a]) - 1);
+        if (ray.dir[a] > 0.0f) {
+            step[a] = 1;
+            end[a] = int32_t(res[a]);
+            tNext[a] = (origin[a] + float(cell[a] + 1) * cellSize[a] - ray.origin[a]) * invDir[a];
+            tDelta[a] = cellSize[a] * invDir[a];
+        } else if (ray.dir[a] < 0.0f) {
+            step[a] = -1;
+            end[a] = -1;
+            tNext[a] = (origin[a] + float(cell[a]) * cellSize[a] - ray.origin[a]) * invDir[a];
+            tDelta[a] = -cellSize[a] * invDir[a];
+        } else {
+            step[a] = 0;
+            end[a] = -1;
+            tNext[a] = INF;
+            tDelta[a] = INF;
+        }
+    }
+
+    float t = t0;
+    for (;;) {
+        int a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        float tExit = std::min(tNext[a], t1);
+        uint32_t idx = (uint32_t(cell[2]) * res[1] + uint32_t(cell[1])) * res[0] + uint32_t(cell[0]);
+        if (!fn(idx, t, tExit)) return;
+        if (tNext[a] > t1) return;
+        cell[a] += step[a];
+        if (cell[a] == end[a]) return;
+        t = tNext[a];
+        tNext[a] += tDelta[a];
+    }
+}
+
+} // namespace grid_detail
+
+static inline Hit trace_grid(const TwoLevelGrid& g, const Triangles& tris, const Ray& ray, bool anyHit,
+                             TraceStats* stats = nullptr) {
+    using namespace grid_detail;
+    Hit out;
+    out.t = ray.tmax;
+    if (g.top.empty()) { out.t = INF; return out; }
+
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+    float t0 = ray.tmin, t1 = ray.tmax;
+    for (int a = 0; a < 3; ++a) {
+        float ta = (g.box.mn[a] - ray.origin[a]) * invDir[a];
+        float tb = (g.box.mx[a] - ray.origin[a]) * invDir[a];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+    }
+    if (t0 > t1) { out.t = INF; return out; }
+
+    bool done = false;
+    dda(ray, invDir, g.box.mn, g.cellSize, g.res, t0, t1, [&](uint32_t c, float cEnter, float cExit) {
+        if (stats) stats->nodes++;
+        const GridTopCell& tc = g.top[c];
+        if (tc.res[0] == 0) return true;
+
+        uint32_t res[3] = {tc.res[0], tc.res[1], tc.res[2]};
+        uint32_t cx = c % g.res[0], cy = (c / g.res[0]) % g.res[1], cz = c / (g.res[0] * g.res[1]);
+        Vec3 origin = g.box.mn + Vec3{float(cx), float(cy), float(cz)} * g.cellSize;
+        Vec3 sub{g.cellSize.x / float(res[0]), g.cellSize.y / float(res[1]), g.cellSize.z / float(res[2])};
+
+        dda(ray, invDir, origin, sub, res, cEnter, cExit, [&](uint32_t l, float, float lExit) {
+            if (stats) stats->nodes++;
+            const GridLeaf& leaf = g.leaves[tc.firstLeaf + l];
+            for (uint32_t i = 0; i < leaf.count; ++i) {
+                uint32_t ti = g.refs[leaf.begin + i];
+                if (stats) stats->triTests++;
+                float t = intersect_triangle(ray, tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+                if (t < out.t) {
+                    out.t = t;
+                    out.tri = ti;
+                    if (anyHit) { done = true; return false; }
+                }
+            }
+            if (out.hit() && out.t <= lExit) { done = true; return false; }
+            return true;
+        });
+        return !done;
+    });
+
+    if (!out.hit()) out.t = INF;
+    return out;
+}
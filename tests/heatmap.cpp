@@ -0,0 +1,210 @@
+// heatmap.cpp
+// Per-pixel traversal cost: node visits, box tests and triangle tests for
+// one ray per pixel, written as false-colour PPMs (turbo, image.hpp) and raw
+// PFMs (count in every channel), with a histogram per image.
+//
+//   bin/heatmap [--scene public/assets/dragon.glb] [--bvh data/BVH4_wide.bin|lbvh]
+//               [--size 640x360] [--pos 0,0,2.5] [--quat 0,0,0,1] [--fov 70]
+//               [--rays primary|shadow] [--max visits,box,tri] [--out .]
+//               [--json out.json|-]
+//
+// --pos / --quat take the FPSCamera position and quaternion, so any view in
+// the app can be reproduced. --bvh accepts a BVH2 or BVH4 file (picked from
+// the length) or "lbvh" to build from the scene in-process. --rays shadow
+// costs the sun shadow ray from each primary hit instead of the primary ray.
+// The colour scale runs from 0 to --max per metric, by default the image's
+// p99, so fix it with --max when comparing two trees.
+//
+// Writes <out>/heat_visits.{ppm,pfm}, heat_box.{ppm,pfm}, heat_tri.{ppm,pfm}.
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "image.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t TILE = 16;
+static constexpr int METRICS = 3;
+static const char* METRIC_NAMES[METRICS] = {"visits", "box", "tri"};
+
+// log2 buckets: [0], [1], [2,3], [4,7], ...
+struct CostHistogram {
+    std::vector<uint64_t> buckets;
+    uint64_t              max = 0;
+    double                mean = 0.0;
+    uint32_t              median = 0, p90 = 0, p99 = 0;
+};
+
+static CostHistogram histogram(std::vector<uint32_t> v) {
+    CostHistogram h;
+    if (v.empty()) return h;
+    double sum = 0.0;
+    for (uint32_t x : v) {
+        size_t b = x ? size_t(std::bit_width(x)) : 0;
+        if (h.buckets.size() <= b) h.buckets.resize(b + 1, 0);
+        h.buckets[b]++;
+        sum += x;
+    }
+    h.mean = sum / double(v.size());
+    auto rank = [&](double q) {
+        size_t k = std::min(v.size() - 1, size_t(q * double(v.size())));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    };
+    h.median = rank(0.5);
+    h.p90 = rank(0.9);
+    h.p99 = rank(0.99);
+    h.max = *std::max_element(v.begin(), v.end());
+    return h;
+}
+
+static void print_histogram(FILE* out, const char* name, const CostHistogram& h, double scale) {
+    std::fprintf(out, "%-7s mean %.1f  median %u  p90 %u  p99 %u  max %llu  (colour scale 0..%g)\n", name, h.mean,
+                 h.median, h.p90, h.p99, (unsigned long long)h.max, scale);
+    uint64_t total = 0, peak = 1;
+    for (uint64_t c : h.buckets) {
+        total += c;
+        peak = std::max(peak, c);
+    }
+    for (size_t b = 0; b < h.buckets.size(); ++b) {
+        uint32_t lo = b ? 1u << (b - 1) : 0u, hi = b ? (1u << b) - 1 : 0u;
+        char range[32];
+        std::snprintf(range, sizeof(range), lo == hi ? "%u" : "%u-%u", lo, hi);
+        int bar = int(40.0 * double(h.buckets[b]) / double(peak) + 0.5);
+        std::fprintf(out, "  %11s %6.2f%% %.*s\n", range, total ? 100.0 * h.buckets[b] / total : 0.0, bar,
+                     "########################################");
+    }
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string bvhPath = args.str("bvh", "data/BVH4_wide.bin");
+    std::string rays = args.str("rays", "primary");
+    std::string outDir = args.str("out", ".");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+
+    Camera cam;
+    std::vector<double> pos = args.nums("pos", ""), quat = args.nums("quat", ""), maxes = args.nums("max", "");
+    if (pos.size() == 3) cam.pos = {float(pos[0]), float(pos[1]), float(pos[2])};
+    if (quat.size() == 4)
+        for (int k = 0; k < 4; ++k) cam.quat[k] = float(quat[k]);
+    cam.fovDeg = float(args.num("fov", cam.fovDeg));
+    if (rays != "primary" && rays != "shadow") {
+        std::cerr << "--rays must be primary or shadow\n";
+        return 1;
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    Bvh4 bvh;
+    if (bvhPath == "lbvh") {
+        bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, morton_sort(tris))));
+    } else {
+        std::vector<uint32_t> raw;
+        if (!load_u32_file(bvhPath.c_str(), raw) || raw.empty()) {
+            std::cerr << "Failed to read " << bvhPath << "\n";
+            return 1;
+        }
+        uint32_t arity = bvh_file_arity(raw);
+        if (!arity) {
+            std::cerr << bvhPath << ": length matches neither the BVH2 nor the BVH4 stride\n";
+            return 1;
+        }
+        bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+    }
+
+    // ---- per-pixel counters ----
+    const size_t n = size_t(width) * height;
+    std::vector<uint32_t> cost[METRICS];
+    for (auto& c : cost) c.assign(n, 0);
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    const bool shadow = rays == "shadow";
+
+    parallel_for_tiles(width, height, TILE, [&](Tile tl, unsigned) {
+        for (uint32_t y = tl.y0; y < tl.y1; ++y)
+            for (uint32_t x = tl.x0; x < tl.x1; ++x) {
+                size_t i = size_t(y) * width + x;
+                Ray r = primary_ray(cam, float(x), float(y), width, height);
+                TraceStats ts;
+                Hit hit = trace_closest(bvh, tris, r, shadow ? nullptr : &ts);
+                if (shadow) {
+                    if (!hit.hit()) continue;
+                    Vec3 nrm = tris.normal(hit.tri);
+                    if (dot(nrm, r.dir) > 0.0f) nrm = -nrm;
+                    if (dot(nrm, lightDir) <= 0.0f) continue;
+                    trace_occluded(bvh, tris, Ray{r.origin + r.dir * hit.t + nrm * 1e-4f, lightDir, 0.0f, INF}, &ts);
+                }
+                cost[0][i] = uint32_t(ts.nodes);
+                cost[1][i] = uint32_t(ts.boxTests);
+                cost[2][i] = uint32_t(ts.triTests);
+            }
+    });
+
+    // ---- images + histograms ----
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %s, %ux%u %s rays\n\n", scenePath.c_str(), tris.count(), bvhPath.c_str(), width,
+                 height, rays.c_str());
+    CostHistogram hists[METRICS];
+    double scales[METRICS];
+    for (int m = 0; m < METRICS; ++m) {
+        hists[m] = histogram(cost[m]);
+        scales[m] = m < int(maxes.size()) && maxes[m] > 0.0 ? maxes[m] : std::max<double>(hists[m].p99, 1.0);
+
+        ImageRGB heat, raw;
+        heat.resize(width, height);
+        raw.resize(width, height);
+        for (size_t i = 0; i < n; ++i) {
+            turbo(float(cost[m][i] / scales[m]), heat.r[i], heat.g[i], heat.b[i]);
+            raw.r[i] = raw.g[i] = raw.b[i] = float(cost[m][i]);
+        }
+        std::string base = outDir + "/heat_" + METRIC_NAMES[m];
+        if (!write_ppm((base + ".ppm").c_str(), heat, false) || !write_pfm((base + ".pfm").c_str(), raw)) {
+            std::cerr << "Failed to write " << base << ".ppm/.pfm\n";
+            return 1;
+        }
+        print_histogram(text, METRIC_NAMES[m], hists[m], scales[m]);
+    }
+
+    if (jsonPath.empty()) return 0;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/heatmap");
+    w.value("scene", scenePath);
+    w.value("bvh", bvhPath);
+    w.value("rays", rays);
+    w.value("width", width);
+    w.value("height", height);
+    for (int m = 0; m < METRICS; ++m) {
+        const CostHistogram& h = hists[m];
+        w.begin_object(METRIC_NAMES[m]);
+        w.value("mean", h.mean);
+        w.value("median", h.median);
+        w.value("p90", h.p90);
+        w.value("p99", h.p99);
+        w.value("max", h.max);
+        w.value("scale", scales[m]);
+        w.begin_array("log2_buckets");
+        for (uint64_t c : h.buckets) w.value(c);
+        w.end_array();
+        w.end_object();
+    }
+    w.end_object();
+    return 0;
+}
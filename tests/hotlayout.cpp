@@ -0,0 +1,247 @@
+// hotlayout.cpp
+// Profile-guided buffer order (hotlayout.hpp): counts node and triangle
+// reads over a camera path or a recorded ray set, reorders the BVH and the
+// triangles so the hot part of the tree is contiguous at the front, and
+// reports what that does to the primary-ray frames of an evaluation path:
+// L1 / DRAM misses through the cachesim.hpp model (packet replay, caches
+// cold at each frame) and distinct lines and 4 KiB pages read per frame,
+// next to the file, aligned, dfs and bfs orders.
+//
+//   bin/hotlayout [--scene public/assets/dragon.glb] [--bvh built|data/BVH4_wide.bin]
+//                 [--path flight.txt | --rays rays.bin] [--poses 16]
+//                 [--eval-path flight.txt] [--size 320x180] [--fov 70]
+//                 [--hot 0.99] [--l1 64K,64,8] [--l2 512K,64,16|0]
+//                 [--out bvh.bin] [--out-tris tris.bin] [--json out.json|-]
+//
+// The profile comes from --rays (every ray of the set, all kinds), else
+// --path, else an orbit of --poses poses (campath.hpp). Evaluation frames
+// are --eval-path, else the profiling path (or the ray set's camera);
+// profile on one flight and evaluate on another to see how well it
+// generalizes. --out / --out-tris write the reordered BVH (same arity as
+// the input) and triangle buffer. Exits 1 if the reordered buffers do not
+// answer the evaluation's first frame exactly like the original.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "cachesim.hpp"
+#include "campath.hpp"
+#include "hotlayout.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "rayset.hpp"
+
+struct LayoutRow {
+    std::string name;
+    double      l1Misses = 0.0;  // per frame
+    double      dramLines = 0.0;
+    double      lines = 0.0;
+    double      pages = 0.0;
+};
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string bvhPath = args.str("bvh", "built");
+    std::string pathPath = args.str("path", ""), evalPath = args.str("eval-path", "");
+    std::string raysPath = args.str("rays", "");
+    std::string outPath = args.str("out", ""), outTrisPath = args.str("out-tris", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    const float fov = float(args.num("fov", 70.0));
+    const double hotShare = args.num("hot", 0.99);
+
+    CacheConfig l1, l2;
+    if (!parse_cache_config(args.str("l1", "64K,64,8"), l1) || !l1.size ||
+        !parse_cache_config(args.str("l2", "512K,64,16"), l2) || (l2.size && l2.line % l1.line != 0)) {
+        std::cerr << "Bad --l1 / --l2 (SIZE,LINE,WAYS; the L2 line a multiple of the L1 line)\n";
+        return 1;
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    Bvh4 bvh;
+    uint32_t arity = 4;
+    if (bvhPath == "built") {
+        bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, morton_sort(tris))));
+    } else {
+        std::vector<uint32_t> raw;
+        if (!load_u32_file(bvhPath.c_str(), raw) || !(arity = bvh_file_arity(raw))) {
+            std::cerr << "Failed to read a BVH2 / BVH4 from " << bvhPath << "\n";
+            return 1;
+        }
+        bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+    }
+    const uint32_t nodeBytes = (arity == 2 ? NODE2_STRIDE_U32 : NODE4_STRIDE_U32) * 4;
+
+    // Profile.
+    VisitProfile prof;
+    prof.init(bvh, tris);
+    std::vector<Camera> evalCams;
+    std::string source;
+    if (!raysPath.empty()) {
+        RaySet set;
+        if (!read_ray_set(raysPath.c_str(), set)) return 1;
+        if (set.sceneTris != tris.count() || set.sceneHash != scene_hash(tris)) {
+            std::cerr << raysPath << " was captured over a different scene than " << scenePath << "\n";
+            return 1;
+        }
+        profile_rays(bvh, tris, set.rays.data(), set.size(),
+                     [&](size_t i) { return ray_kind_closest(set.kind[i]); }, prof);
+        evalCams.push_back(set.camera);
+        source = raysPath;
+    } else {
+        std::vector<CameraPose> poses;
+        if (!pathPath.empty()) {
+            if (!read_camera_path(pathPath.c_str(), poses)) return 1;
+            source = pathPath;
+        } else {
+            poses = orbit_camera_path(std::max(args.u32("poses", 16), 1u), 10.0);
+            source = "orbit";
+        }
+        std::vector<Ray> rays(size_t(width) * height);
+        for (const CameraPose& p : poses) {
+            const Camera cam = p.camera(fov);
+            for (size_t i = 0; i < rays.size(); ++i)
+                rays[i] = primary_ray(cam, float(i % width), float(i / width), width, height);
+            profile_rays(bvh, tris, rays.data(), rays.size(), [](size_t) { return true; }, prof);
+            evalCams.push_back(cam);
+        }
+    }
+    if (!evalPath.empty()) {
+        std::vector<CameraPose> poses;
+        if (!read_camera_path(evalPath.c_str(), poses)) return 1;
+        evalCams.clear();
+        for (const CameraPose& p : poses) evalCams.push_back(p.camera(fov));
+    }
+    if (evalCams.empty()) {
+        std::cerr << "No evaluation frames\n";
+        return 1;
+    }
+
+    const HotLayout hot = hot_layout(bvh, arity, prof, hotShare);
+    Bvh4 outBvh;
+    Triangles outTris;
+    apply_hot_layout(bvh, tris, hot, outBvh, outTris);
+
+    // The layouts to compare, all addressing the original tree's traces.
+    std::vector<MemoryLayout> layouts = make_layouts(bvh, nodeBytes);
+    {
+        MemoryLayout nodesOnly;
+        nodesOnly.name = "hot-nodes";
+        nodesOnly.nodeBytes = nodeBytes;
+        nodesOnly.nodeBase = nodeBytes;
+        nodesOnly.slot = hot.node_slots(bvh.nodes.size());
+        for (uint32_t& s : nodesOnly.slot)
+            if (s == INVALID) s = uint32_t(hot.nodeOrder.size());
+        nodesOnly.triBase = layouts.back().triBase;
+        MemoryLayout both = nodesOnly;
+        both.name = "hot";
+        both.triSlot = hot.tri_slots();
+        layouts.push_back(std::move(nodesOnly));
+        layouts.push_back(std::move(both));
+    }
+
+    std::vector<LayoutRow> rows(layouts.size());
+    for (size_t l = 0; l < layouts.size(); ++l) rows[l].name = layouts[l].name;
+    uint64_t mismatches = 0;
+    for (size_t f = 0; f < evalCams.size(); ++f) {
+        RayTraces tr = record_primary_traces(bvh, tris, evalCams[f], width, height);
+        for (size_t l = 0; l < layouts.size(); ++l) {
+            CacheHierarchy mem;
+            mem.init(l1, l2);
+            CacheCounters c = replay_traces(tr, layouts[l], ReplayMode::Packet, 1, mem);
+            TraceFootprint fp = trace_footprint(tr, layouts[l], l1.line);
+            rows[l].l1Misses += double(c.requests - c.l1Hits);
+            rows[l].dramLines += double(c.dramLines);
+            rows[l].lines += double(fp.lines);
+            rows[l].pages += double(fp.pages);
+        }
+        if (f == 0) {
+            const std::vector<uint32_t> triSlot = hot.tri_slots();
+            for (uint32_t i = 0; i < width * height; ++i) {
+                Ray r = primary_ray(evalCams[0], float(i % width), float(i / width), width, height);
+                Hit a = trace_closest(bvh, tris, r), b = trace_closest(outBvh, outTris, r);
+                if (a.hit() != b.hit() || (a.hit() && (a.t != b.t || triSlot[a.tri] != b.tri))) mismatches++;
+            }
+        }
+    }
+    for (LayoutRow& r : rows) {
+        r.l1Misses /= double(evalCams.size());
+        r.dramLines /= double(evalCams.size());
+        r.lines /= double(evalCams.size());
+        r.pages /= double(evalCams.size());
+    }
+
+    const uint64_t reads = prof.node_reads();
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %s BVH%u (%zu nodes), %u threads\n", scenePath.c_str(), tris.count(),
+                 bvhPath.c_str(), arity, bvh.nodes.size(), worker_count());
+    std::fprintf(text, "profile %s: %llu rays, %llu node reads\n", source.c_str(), (unsigned long long)prof.rays,
+                 (unsigned long long)reads);
+    std::fprintf(text, "hot (%.1f%% of reads, >= %llu reads): %u of %zu placed nodes (%.1f%%, %.0f KB), %u tris\n",
+                 hotShare * 100.0, (unsigned long long)hot.threshold, hot.hotNodes, hot.nodeOrder.size(),
+                 100.0 * hot.hotNodes / std::max<size_t>(hot.nodeOrder.size(), 1),
+                 double(hot.hotNodes) * nodeBytes / 1024.0, hot.hotTris);
+    std::fprintf(text, "eval: %zu frames of %ux%u primary rays, L1 %uK/%u/%u, L2 %uK, packet replay\n\n",
+                 evalCams.size(), width, height, l1.size >> 10, l1.line, l1.ways, l2.size >> 10);
+    std::fprintf(text, "%-10s %12s %12s %12s %10s %9s %9s\n", "layout", "L1 miss/f", "DRAM line/f", "lines/f",
+                 "pages/f", "miss", "pages");
+    for (const LayoutRow& r : rows)
+        std::fprintf(text, "%-10s %12.0f %12.0f %12.0f %10.0f %+8.1f%% %+8.1f%%\n", r.name.c_str(), r.l1Misses,
+                     r.dramLines, r.lines, r.pages, (r.dramLines / rows[0].dramLines - 1.0) * 100.0,
+                     (r.pages / rows[0].pages - 1.0) * 100.0);
+
+    int status = 0;
+    if (mismatches) {
+        std::fprintf(text, "\nFAIL: reordered buffers answer %llu rays differently\n",
+                     (unsigned long long)mismatches);
+        status = 1;
+    }
+    if (!outPath.empty() && !save_u32_file(outPath.c_str(), encode_bvh(outBvh, arity))) {
+        std::cerr << "Failed to write " << outPath << "\n";
+        return 1;
+    }
+    if (!outTrisPath.empty() && !save_triangle_file(outTrisPath.c_str(), outTris)) {
+        std::cerr << "Failed to write " << outTrisPath << "\n";
+        return 1;
+    }
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/hotlayout");
+    w.value("scene", scenePath);
+    w.value("bvh", bvhPath);
+    w.value("profile", source);
+    w.value("profile_rays", prof.rays);
+    w.value("node_reads", reads);
+    w.value("hot_share", hotShare);
+    w.value("hot_threshold", hot.threshold);
+    w.value("hot_nodes", hot.hotNodes);
+    w.value("hot_tris", hot.hotTris);
+    w.value("frames", uint64_t(evalCams.size()));
+    w.value("mismatches", mismatches);
+    w.begin_array("layouts");
+    for (const LayoutRow& r : rows) {
+        w.begin_object();
+        w.value("name", r.name);
+        w.value("l1_misses_per_frame", r.l1Misses);
+        w.value("dram_lines_per_frame", r.dramLines);
+        w.value("lines_per_frame", r.lines);
+        w.value("pages_per_frame", r.pages);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+// hotlayout.hpp
+// Profile-guided node and triangle order. A VisitProfile counts every node
+// and triangle read (TraceStats::accesses convention) of a CPU traversal
+// over recorded rays; hot_layout() then orders the buffers so the reads
+// that dominate sit together at the front:
+//
+//   hot   nodes read at least as often as the node that completes
+//         `hotShare` of all node reads, depth-first from the root, hottest
+//         child first, with each node's hot children stored side by side
+//         (popping a node reads all of its children's boxes)
+//   cold  every other subtree, hottest subtree root first and never-read
+//         ones last, in the same children-adjacent order
+//
+// Triangles follow their leaves: in the order the leaves appear in the new
+// node order, so hot triangles also come first. Unreferenced triangles
+// and unreachable nodes (promotion orphans) go to the end / are dropped.
+// Child slots are not touched, so a traversal visits the same nodes in the
+// same order and returns the same hits (up to the triangle renumbering).
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+struct VisitProfile {
+    std::vector<uint64_t> node; // reads per node
+    std::vector<uint64_t> tri;  // reads per triangle
+    uint64_t              rays = 0;
+
+    void init(const Bvh4& bvh, const Triangles& tris) {
+        node.assign(bvh.nodes.size(), 0);
+        tri.assign(tris.count(), 0);
+        rays = 0;
+    }
+
+    void add(const std::vector<uint32_t>& accesses) {
+        for (uint32_t a : accesses) {
+            if (a & TRACE_TRI_BIT) tri[a & ~TRACE_TRI_BIT]++;
+            else node[a]++;
+        }
+    }
+
+    uint64_t node_reads() const { return std::accumulate(node.begin(), node.end(), uint64_t(0)); }
+};
+
+// Traces rays [0, n) and counts their reads; `closest(i)` picks a
+// closest-hit or an occlusion query for ray i.
+template <class Closest>
+static inline void profile_rays(const Bvh4& bvh, const Triangles& tris, const Ray* rays, size_t n,
+                                Closest&& closest, VisitProfile& prof) {
+    std::vector<std::vector<uint32_t>> perWorker(worker_count());
+    std::vector<VisitProfile> partial(worker_count());
+    for (VisitProfile& p : partial) p.init(bvh, tris);
+    parallel_for_chunks(0, n, 1024, [&](size_t b, size_t e, unsigned w) {
+        std::vector<uint32_t>& acc = perWorker[w];
+        for (size_t i = b; i < e; ++i) {
+            TraceStats st;
+            acc.clear();
+            st.accesses = &acc;
+            if (closest(i)) trace_closest(bvh, tris, rays[i], &st);
+            else trace_occluded(bvh, tris, rays[i], &st);
+            partial[w].add(acc);
+        }
+    });
+    for (const VisitProfile& p : partial) {
+        for (size_t i = 0; i < p.node.size(); ++i) prof.node[i] += p.node[i];
+        for (size_t i = 0; i < p.tri.size(); ++i) prof.tri[i] += p.tri[i];
+    }
+    prof.rays += n;
+}
+
+struct HotLayout {
+    std::vector<uint32_t> nodeOrder; // new index -> old node
+    std::vector<uint32_t> triOrder;  // new index -> old triangle
+    uint32_t              hotNodes = 0;
+    uint32_t              hotTris = 0;
+    uint64_t              threshold = 0; // reads a node needs to be hot
+
+    // old -> new, INVALID for dropped nodes.
+    std::vector<uint32_t> node_slots(size_t numNodes) const {
+        std::vector<uint32_t> slot(numNodes, INVALID);
+        for (uint32_t i = 0; i < nodeOrder.size(); ++i) slot[nodeOrder[i]] = i;
+        return slot;
+    }
+    std::vector<uint32_t> tri_slots() const {
+        std::vector<uint32_t> slot(triOrder.size(), INVALID);
+        for (uint32_t i = 0; i < triOrder.size(); ++i) slot[triOrder[i]] = i;
+        return slot;
+    }
+};
+
+static inline HotLayout hot_layout(const Bvh4& bvh, uint32_t arity, const VisitProfile& prof,
+                                   double hotShare = 0.99) {
+    HotLayout out;
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    if (!numNodes) return out;
+
+    // The read count at which the hottest nodes reach hotShare of all reads.
+    {
+        std::vector<uint64_t> counts(prof.node);
+        std::sort(counts.begin(), counts.end(), std::greater<uint64_t>());
+        const double want = hotShare * double(prof.node_reads());
+        double sum = 0.0;
+        out.threshold = ~uint64_t(0);
+        for (uint64_t c : counts) {
+            if (c == 0 || sum >= want) break;
+            sum += double(c);
+            out.threshold = c;
+        }
+    }
+
+    std::vector<uint8_t> placed(numNodes, 0);
+    std::vector<uint32_t> coldRoots, work, kids;
+    auto place = [&](uint32_t n) {
+        placed[n] = 1;
+        out.nodeOrder.push_back(n);
+    };
+    // Children-adjacent depth-first walk from `root` (already placed);
+    // children below `threshold` are left for the cold pass.
+    auto walk = [&](uint32_t root, uint64_t threshold) {
+        work.assign(1, root);
+        while (!work.empty()) {
+            const uint32_t n = work.back();
+            work.pop_back();
+            const Bvh4Node& node = bvh.nodes[n];
+            if (node.leaf()) continue;
+            kids.clear();
+            for (uint32_t s = 0; s < arity; ++s) {
+                uint32_t c = node.child[s];
+                if (c == INVALID || c >= numNodes || placed[c]) continue;
+                if (prof.node[c] >= threshold) kids.push_back(c);
+                else coldRoots.push_back(c);
+            }
+            std::stable_sort(kids.begin(), kids.end(),
+                             [&](uint32_t a, uint32_t b) { return prof.node[a] > prof.node[b]; });
+            for (uint32_t c : kids) place(c);
+            for (size_t i = kids.size(); i-- > 0;) work.push_back(kids[i]);
+        }
+    };
+
+    place(0);
+    walk(0, out.threshold);
+    out.hotNodes = uint32_t(out.nodeOrder.size());
+    std::vector<uint32_t> cold;
+    cold.swap(coldRoots);
+    std::stable_sort(cold.begin(), cold.end(), [&](uint32_t a, uint32_t b) { return prof.node[a] > prof.node[b]; });
+    for (uint32_t r : cold) {
+        if (placed[r]) continue;
+        place(r);
+        walk(r, 0);
+    }
+
+    std::vector<uint8_t> triPlaced(prof.tri.size(), 0);
+    for (uint32_t i = 0; i < out.nodeOrder.size(); ++i) {
+        const Bvh4Node& node = bvh.nodes[out.nodeOrder[i]];
+        if (!node.leaf() || node.tri() >= triPlaced.size() || triPlaced[node.tri()]) continue;
+        triPlaced[node.tri()] = 1;
+        out.triOrder.push_back(node.tri());
+        if (i < out.hotNodes) out.hotTris++;
+    }
+    for (uint32_t t = 0; t < triPlaced.size(); ++t)
+        if (!triPlaced[t]) out.triOrder.push_back(t);
+    return out;
+}
+
+// The reordered buffers: nodes renumbered by relayout_bvh(), leaf triangle
+// indices and the triangle buffer permuted to match.
+static inline void apply_hot_layout(const Bvh4& bvh, const Triangles& tris, const HotLayout& lay, Bvh4& outBvh,
+                                    Triangles& outTris) {
+    outBvh = relayout_bvh(bvh, lay.nodeOrder);
+    const std::vector<uint32_t> triSlot = lay.tri_slots();
+    for (Bvh4Node& node : outBvh.nodes)
+        if (node.leaf() && node.tri() < triSlot.size()) node.meta = LEAF_FLAG | triSlot[node.tri()];
+    outTris.v.resize(tris.v.size());
+    for (uint32_t i = 0; i < lay.triOrder.size(); ++i)
+        std::copy_n(tris.v.begin() + size_t(lay.triOrder[i]) * 9, 9, outTris.v.begin() + size_t(i) * 9);
+}
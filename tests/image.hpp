@@ -0,0 +1,103 @@
+#pragma once
+
+// image.hpp
+// Planar float images and PPM / PFM writers for the headless tools.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Planar (SoA) RGB so per-channel loops vectorize.
+struct ImageRGB {
+    uint32_t width = 0, height = 0;
+    std::vector<float> r, g, b;
+
+    void resize(uint32_t w, uint32_t h, float fill = 0.0f) {
+        width = w;
+        height = h;
+        size_t n = size_t(w) * h;
+        r.assign(n, fill);
+        g.assign(n, fill);
+        b.assign(n, fill);
+    }
+
+    size_t size() const { return size_t(width) * height; }
+};
+
+// tonemapper.wgsl: Reinhard, then gamma 1/2.2.
+static inline uint8_t tonemap8(float v) {
+    v = std::max(v, 0.0f);
+    v = std::pow(v / (v + 1.0f), 1.0f / 2.2f);
+    return uint8_t(std::min(v, 1.0f) * 255.0f + 0.5f);
+}
+
+static inline uint8_t unorm8(float v) {
+    return uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Binary P6, top row first. The tonemapper samples the storage texture with
+// uv.y = 0 at the bottom of the canvas, so pixel row height-1 is the top.
+static inline bool write_ppm(const char* path, const ImageRGB& img, bool tonemap = true) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f << "P6\n" << img.width << " " << img.height << "\n255\n";
+
+    std::vector<uint8_t> row(size_t(img.width) * 3);
+    for (uint32_t yy = 0; yy < img.height; ++yy) {
+        uint32_t y = img.height - 1 - yy;
+        for (uint32_t x = 0; x < img.width; ++x) {
+            size_t i = size_t(y) * img.width + x;
+            row[x * 3 + 0] = tonemap ? tonemap8(img.r[i]) : unorm8(img.r[i]);
+            row[x * 3 + 1] = tonemap ? tonemap8(img.g[i]) : unorm8(img.g[i]);
+            row[x * 3 + 2] = tonemap ? tonemap8(img.b[i]) : unorm8(img.b[i]);
+        }
+        f.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size()));
+    }
+    return bool(f);
+}
+
+// Little-endian PF; PFM stores the bottom row first, which is already our
+// pixel order.
+static inline bool write_pfm(const char* path, const ImageRGB& img) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f << "PF\n" << img.width << " " << img.height << "\n-1.0\n";
+
+    std::vector<float> row(size_t(img.width) * 3);
+    for (uint32_t y = 0; y < img.height; ++y) {
+        for (uint32_t x = 0; x < img.width; ++x) {
+            size_t i = size_t(y) * img.width + x;
+            row[x * 3 + 0] = img.r[i];
+            row[x * 3 + 1] = img.g[i];
+            row[x * 3 + 2] = img.b[i];
+        }
+        f.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+    }
+    return bool(f);
+}
+
+// Turbo false-colour map (Mikhailov 2019, polynomial fit), t in [0, 1]:
+// dark blue -> cyan -> green -> yellow -> red. Output is display-referred,
+// so write with tonemap = false.
+static inline void turbo(float t, float& r, float& g, float& b) {
+    t = std::clamp(t, 0.0f, 1.0f);
+    r = 0.13572138f + t * (4.61539260f + t * (-42.66032258f + t * (132.13108234f + t * (-152.94239396f + t * 59.28637943f))));
+    g = 0.09140261f + t * (2.19418839f + t * (4.84296658f + t * (-14.18503333f + t * (4.27729857f + t * 2.82956604f))));
+    b = 0.10667330f + t * (12.64194608f + t * (-60.58204836f + t * (110.36276771f + t * (-89.90310912f + t * 27.34824973f))));
+    r = std::clamp(r, 0.0f, 1.0f);
+    g = std::clamp(g, 0.0f, 1.0f);
+    b = std::clamp(b, 0.0f, 1.0f);
+}
+
+// Root-mean-square error over all three channels.
+static inline double rmse(const ImageRGB& a, const ImageRGB& b) {
+    double sum = 0.0;
+    size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        double dr = a.r[i] - b.r[i], dg = a.g[i] - b.g[i], db = a.b[i] - b.b[i];
+        sum += dr * dr + dg * dg + db * db;
+    }
+    return n ? std::sqrt(sum / double(3 * n)) : 0.0;
+}
@@ -0,0 +1,238 @@
+// inflation.cpp
+// Cost of the fp16 node boxes (inflation.hpp): stored boxes vs exact fp32
+// boxes recomputed from the triangles, per depth and per height, with the
+// SAH-model extra node visits per ray and every non-conservative box.
+//
+//   bin/inflation [data/BVH2.bin data/BVH4_wide.bin ...]
+//                 [--scene public/assets/dragon.glb] [--size 320x180]
+//                 [--list 10] [--json out.json|-]
+//
+// The scene must be the mesh the BVH was built from. BVH4 files are scored
+// twice: boxes as stored (the C++ in-place promotion keeps the BVH2 boxes)
+// and as the JS collapse would re-pack them. Each variant is also measured
+// with primary rays from the default camera, through the stored boxes and
+// through the same tree with exact boxes: visits, box and triangle tests,
+// and closest hits the stored boxes lose.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "inflation.hpp"
+#include "json.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+struct RayCompare {
+    uint64_t   rays = 0;
+    TraceStats stored, exact;
+    uint64_t   missed = 0; // exact tree hits, stored tree misses
+    uint64_t   later = 0;  // stored tree returns a farther hit
+};
+
+static RayCompare compare_rays(const Bvh4& stored, const Bvh4& exact, const Triangles& tris, uint32_t width,
+                               uint32_t height) {
+    Camera cam;
+    const size_t n = size_t(width) * height;
+    std::vector<RayCompare> perWorker(worker_count());
+    parallel_for_chunks(0, n, 256, [&](size_t b, size_t e, unsigned w) {
+        RayCompare& rc = perWorker[w];
+        for (size_t i = b; i < e; ++i) {
+            Ray r = primary_ray(cam, float(i % width), float(i / width), width, height);
+            Hit hs = trace_closest(stored, tris, r, &rc.stored);
+            Hit he = trace_closest(exact, tris, r, &rc.exact);
+            rc.rays++;
+            if (!he.hit()) continue;
+            if (!hs.hit()) rc.missed++;
+            else if (hs.t > he.t * (1.0f + 1e-5f)) rc.later++;
+        }
+    });
+    RayCompare out;
+    for (const RayCompare& rc : perWorker) {
+        out.rays += rc.rays;
+        out.stored.add(rc.stored);
+        out.exact.add(rc.exact);
+        out.missed += rc.missed;
+        out.later += rc.later;
+    }
+    return out;
+}
+
+struct Variant {
+    std::string     path, boxes;
+    InflationReport report;
+    RayCompare      rays;
+};
+
+static void print_variant(FILE* out, const Variant& v, size_t list) {
+    const InflationReport& r = v.report;
+    auto pct = [](double a, double b) { return b > 0.0 ? 100.0 * (a / b - 1.0) : 0.0; };
+
+    std::fprintf(out, "=== BVH%u %s: %s boxes ===\n", r.arity, v.path.c_str(), v.boxes.c_str());
+    std::fprintf(out, "reachable        %llu nodes\n", (unsigned long long)r.reachable);
+    std::fprintf(out, "visits per ray   %.2f stored, %.2f exact: %+.2f (%+.1f%%) under the SAH model\n",
+                 r.visitsStored, r.visitsExact, r.visitsStored - r.visitsExact, pct(r.visitsStored, r.visitsExact));
+    std::fprintf(out, "non-conservative %llu boxes, %llu triangles at risk\n", (unsigned long long)r.nonConservative,
+                 (unsigned long long)r.trisAtRisk);
+
+    std::fprintf(out, "\n%6s %10s %9s %12s %8s    %6s %10s %9s %8s\n", "depth", "nodes", "SA infl", "extra/ray",
+                 "noncons", "height", "nodes", "SA infl", "noncons");
+    const double invRoot = r.rootSA > 0.0 ? 1.0 / r.rootSA : 0.0;
+    for (size_t i = 0; i < std::max(r.byDepth.size(), r.byHeight.size()); ++i) {
+        if (i < r.byDepth.size()) {
+            const InflationLevel& d = r.byDepth[i];
+            std::fprintf(out, "%6zu %10llu %8.2f%% %12.4f %8llu", i, (unsigned long long)d.nodes, 100.0 * d.inflation(),
+                         i ? (d.storedSA - d.exactSA) * invRoot : 0.0, (unsigned long long)d.nonConservative);
+        } else {
+            std::fprintf(out, "%6s %10s %9s %12s %8s", "", "", "", "", "");
+        }
+        if (i < r.byHeight.size()) {
+            const InflationLevel& h = r.byHeight[i];
+            std::fprintf(out, "    %6zu %10llu %8.2f%% %8llu", i, (unsigned long long)h.nodes, 100.0 * h.inflation(),
+                         (unsigned long long)h.nonConservative);
+        }
+        std::fprintf(out, "\n");
+    }
+
+    if (!r.worst.empty()) {
+        std::fprintf(out, "\nworst non-conservative boxes:\n%10s %6s %8s %6s %12s %12s %8s\n", "node", "depth", "tris",
+                     "face", "exact", "stored", "ULPs");
+        for (size_t i = 0; i < std::min(list, r.worst.size()); ++i) {
+            const InflationViolation& w = r.worst[i];
+            std::fprintf(out, "%10u %6u %8u %3s.%c %12.6f %12.6f %8.1f\n", w.node, w.depth, w.tris,
+                         w.maxSide ? "max" : "min", "xyz"[w.axis], w.exact, w.stored, w.ulps);
+        }
+    }
+
+    const RayCompare& rc = v.rays;
+    if (rc.rays) {
+        double n = double(rc.rays);
+        std::fprintf(out, "\nprimary rays     %llu: per ray stored/exact visits %.1f/%.1f (%+.1f%%), box tests "
+                          "%.1f/%.1f, tri tests %.1f/%.1f\n",
+                     (unsigned long long)rc.rays, rc.stored.nodes / n, rc.exact.nodes / n,
+                     pct(double(rc.stored.nodes), double(rc.exact.nodes)), rc.stored.boxTests / n,
+                     rc.exact.boxTests / n, rc.stored.triTests / n, rc.exact.triTests / n);
+        std::fprintf(out, "lost hits        %llu missed, %llu farther\n", (unsigned long long)rc.missed,
+                     (unsigned long long)rc.later);
+    }
+    std::fprintf(out, "\n");
+}
+
+static void write_variant_json(JsonWriter& w, const Variant& v, size_t list) {
+    const InflationReport& r = v.report;
+    w.begin_object();
+    w.value("path", v.path);
+    w.value("boxes", v.boxes);
+    w.value("arity", r.arity);
+    w.value("reachable", r.reachable);
+    w.value("visits_stored", r.visitsStored);
+    w.value("visits_exact", r.visitsExact);
+    w.value("non_conservative", r.nonConservative);
+    w.value("tris_at_risk", r.trisAtRisk);
+    const char* keys[2] = {"by_depth", "by_height"};
+    const std::vector<InflationLevel>* tables[2] = {&r.byDepth, &r.byHeight};
+    for (int t = 0; t < 2; ++t) {
+        w.begin_array(keys[t]);
+        for (const InflationLevel& l : *tables[t]) {
+            w.begin_object();
+            w.value("nodes", l.nodes);
+            w.value("stored_sa", l.storedSA);
+            w.value("exact_sa", l.exactSA);
+            w.value("inflation", l.inflation());
+            w.value("non_conservative", l.nonConservative);
+            w.end_object();
+        }
+        w.end_array();
+    }
+    w.begin_array("worst");
+    for (size_t i = 0; i < std::min(list, r.worst.size()); ++i) {
+        const InflationViolation& x = r.worst[i];
+        w.begin_object();
+        w.value("node", x.node);
+        w.value("depth", x.depth);
+        w.value("tris", x.tris);
+        w.value("axis", x.axis);
+        w.value("side", x.maxSide ? "max" : "min");
+        w.value("exact", double(x.exact));
+        w.value("stored", double(x.stored));
+        w.value("ulps", x.ulps);
+        w.end_object();
+    }
+    w.end_array();
+    if (v.rays.rays) {
+        w.begin_object("primary_rays");
+        w.value("rays", v.rays.rays);
+        w.value("visits_stored", v.rays.stored.nodes);
+        w.value("visits_exact", v.rays.exact.nodes);
+        w.value("box_tests_stored", v.rays.stored.boxTests);
+        w.value("box_tests_exact", v.rays.exact.boxTests);
+        w.value("tri_tests_stored", v.rays.stored.triTests);
+        w.value("tri_tests_exact", v.rays.exact.triTests);
+        w.value("missed", v.rays.missed);
+        w.value("farther", v.rays.later);
+        w.end_object();
+    }
+    w.end_object();
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::vector<std::string> paths = args.positional();
+    if (paths.empty()) paths = {"data/BVH2.bin", "data/BVH4_wide.bin"};
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string jsonPath = args.str("json", "");
+    size_t list = args.u32("list", 10);
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::vector<Variant> variants;
+    for (const std::string& path : paths) {
+        std::vector<uint32_t> raw;
+        if (!load_u32_file(path.c_str(), raw) || raw.empty()) {
+            std::cerr << "Failed to read " << path << "\n";
+            return 1;
+        }
+        uint32_t arity = bvh_file_arity(raw);
+        if (!arity) {
+            std::cerr << path << ": length matches neither the BVH2 nor the BVH4 stride\n";
+            return 1;
+        }
+        Bvh4 bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+        std::vector<Aabb> exact = exact_node_bounds(bvh, arity, tris);
+        Bvh4 exactBvh = bvh;
+        for (size_t n = 0; n < exact.size(); ++n) exactBvh.nodes[n].box = exact[n];
+
+        for (int repack = 0; repack < (arity == 4 ? 2 : 1); ++repack) {
+            Variant v;
+            v.path = path;
+            v.boxes = repack ? "JS re-packed" : "stored";
+            if (repack) js_repack_boxes(bvh, arity);
+            v.report = analyze_inflation(bvh, arity, tris, exact, list);
+            if (width && height) v.rays = compare_rays(bvh, exactBvh, tris, width, height);
+            print_variant(text, v, list);
+            variants.push_back(std::move(v));
+        }
+    }
+
+    if (jsonPath.empty()) return 0;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/inflation");
+    w.value("scene", scenePath);
+    w.begin_array("variants");
+    for (const Variant& v : variants) write_variant_json(w, v, list);
+    w.end_array();
+    w.end_object();
+    return 0;
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+// inflation.hpp
+// What the fp16 node boxes cost. writeBounds2 (BVHBuilder.wgsl) widens
+// every box by one fp16 ULP on each side as it is written, and a parent is
+// written from its already widened children, so the padding compounds with
+// height; near |x| ~ 1 one ULP is ~0.001, the size of a dragon triangle.
+//
+// Every reachable node's stored box is compared with the exact fp32 box of
+// the triangles below it:
+//
+//   SA inflation      sum SA(stored) / sum SA(exact) - 1, per depth and per
+//                     height (levels above the leaves)
+//   extra visits      under the SAH ray model a node is entered with
+//                     probability SA(box) / SA(root), so the expected extra
+//                     node visits per ray that hits the root box are
+//                     sum (SA(stored) - SA(exact)) / SA(stored root)
+//   non-conservative  stored boxes that do not contain the exact box; rays
+//                     through the gap can miss triangles. Each is reported
+//                     with its overshoot in fp16 ULPs, and triangles whose
+//                     bounds leave the intersection of their ancestors'
+//                     stored boxes are counted as at risk.
+//
+// js_repack_boxes() recomputes internal boxes as collapseLBVH2ToBVH4 in
+// PathTracer.js does (fp32 union of the children, re-packed with the
+// truncating f32ToF16), so the C++ in-place promotion and the JS collapse
+// can be scored side by side. tight_f16_boxes() is the conservative
+// lower limit of fp16 boxes: leaves rounded outward from their triangle,
+// parents the exact union of their children, no padding compounding.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+
+struct InflationLevel {
+    uint64_t nodes = 0;
+    uint64_t nonConservative = 0;
+    double   exactSA = 0.0;
+    double   storedSA = 0.0;
+
+    double inflation() const { return exactSA > 0.0 ? storedSA / exactSA - 1.0 : 0.0; }
+};
+
+struct InflationViolation {
+    uint32_t node = 0, depth = 0, tris = 0;
+    int      axis = 0;      // 0..2
+    bool     maxSide = false;
+    float    exact = 0.0f;  // exact bound on that face
+    float    stored = 0.0f; // stored bound on that face
+    double   ulps = 0.0;    // overshoot in fp16 ULPs at the stored value
+};
+
+struct InflationReport {
+    uint32_t arity = 4;
+    uint64_t reachable = 0;
+    double   rootSA = 0.0;        // stored root box
+    double   visitsStored = 0.0;  // expected node visits per root-hitting ray
+    double   visitsExact = 0.0;
+    uint64_t nonConservative = 0;
+    uint64_t trisAtRisk = 0;
+    std::vector<InflationLevel>     byDepth, byHeight;
+    std::vector<InflationViolation> worst; // largest overshoot first
+};
+
+namespace inflation_detail {
+
+// Pre-order over the reachable tree; shared children are not followed.
+static inline std::vector<uint32_t> preorder(const Bvh4& bvh, uint32_t arity, std::vector<uint32_t>* depthOut) {
+    std::vector<uint32_t> order, depth(bvh.nodes.size(), 0);
+    std::vector<uint8_t> seen(bvh.nodes.size(), 0);
+    if (bvh.nodes.empty()) return order;
+    std::vector<uint32_t> stack{0u};
+    seen[0] = 1;
+    while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        order.push_back(n);
+        const Bvh4Node& node = bvh.nodes[n];
+        if (node.leaf()) continue;
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c == INVALID || c >= bvh.nodes.size() || seen[c]) continue;
+            seen[c] = 1;
+            depth[c] = depth[n] + 1;
+            stack.push_back(c);
+        }
+    }
+    if (depthOut) *depthOut = std::move(depth);
+    return order;
+}
+
+} // namespace inflation_detail
+
+// Exact fp32 bounds of every reachable node's triangles (unreachable nodes
+// stay empty).
+static inline std::vector<Aabb> exact_node_bounds(const Bvh4& bvh, uint32_t arity, const Triangles& tris) {
+    std::vector<uint32_t> order = inflation_detail::preorder(bvh, arity, nullptr);
+    std::vector<Aabb> exact(bvh.nodes.size());
+    for (size_t i = order.size(); i-- > 0;) {
+        const Bvh4Node& node = bvh.nodes[order[i]];
+        Aabb& b = exact[order[i]];
+        if (node.leaf()) {
+            if (node.tri() < tris.count()) b = tris.bounds(node.tri());
+            continue;
+        }
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c != INVALID && c < bvh.nodes.size()) b.grow(exact[c]);
+        }
+    }
+    return exact;
+}
+
+// Internal boxes as the JS collapse writes them: children first, fp32 union,
+// then pack2x16 with round-toward-zero. Leaves pass through unchanged.
+static inline void js_repack_boxes(Bvh4& bvh, uint32_t arity) {
+    std::vector<uint32_t> order = inflation_detail::preorder(bvh, arity, nullptr);
+    for (size_t i = order.size(); i-- > 0;) {
+        Bvh4Node& node = bvh.nodes[order[i]];
+        if (node.leaf()) continue;
+        Aabb b;
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c != INVALID && c < bvh.nodes.size()) b.grow(bvh.nodes[c].box);
+        }
+        uint32_t packed[3] = {f32_to_f16_trunc(b.mn.x) | (f32_to_f16_trunc(b.mn.y) << 16),
+                              f32_to_f16_trunc(b.mn.z) | (f32_to_f16_trunc(b.mx.x) << 16),
+                              f32_to_f16_trunc(b.mx.y) | (f32_to_f16_trunc(b.mx.z) << 16)};
+        node.box = decode_bounds(packed);
+    }
+}
+
+static inline void tight_f16_boxes(Bvh4& bvh, uint32_t arity, const Triangles& tris) {
+    std::vector<uint32_t> order = inflation_detail::preorder(bvh, arity, nullptr);
+    for (size_t i = order.size(); i-- > 0;) {
+        Bvh4Node& node = bvh.nodes[order[i]];
+        if (node.leaf()) {
+            if (node.tri() >= tris.count()) continue;
+            Aabb b = tris.bounds(node.tri());
+            node.box.mn = {f16_round_out(b.mn.x, false), f16_round_out(b.mn.y, false), f16_round_out(b.mn.z, false)};
+            node.box.mx = {f16_round_out(b.mx.x, true), f16_round_out(b.mx.y, true), f16_round_out(b.mx.z, true)};
+            continue;
+        }
+        Aabb b;
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c != INVALID && c < bvh.nodes.size()) b.grow(bvh.nodes[c].box);
+        }
+        node.box = b;
+    }
+}
+
+static inline InflationReport analyze_inflation(const Bvh4& bvh, uint32_t arity, const Triangles& tris,
+                                                const std::vector<Aabb>& exact, size_t keepWorst = 16) {
+    using namespace inflation_detail;
+    TIMELINE_ZONE("inflation");
+    InflationReport r;
+    r.arity = arity;
+    if (bvh.nodes.empty()) return r;
+
+    std::vector<uint32_t> depth;
+    std::vector<uint32_t> order = preorder(bvh, arity, &depth);
+    r.reachable = order.size();
+    r.rootSA = bvh.nodes[0].box.area();
+
+    // Heights and triangle counts bottom-up; ancestor box intersections
+    // top-down.
+    std::vector<uint32_t> height(bvh.nodes.size(), 0), triCount(bvh.nodes.size(), 0);
+    for (size_t i = order.size(); i-- > 0;) {
+        const Bvh4Node& node = bvh.nodes[order[i]];
+        if (node.leaf()) {
+            triCount[order[i]] = 1;
+            continue;
+        }
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c == INVALID || c >= bvh.nodes.size()) continue;
+            height[order[i]] = std::max(height[order[i]], height[c] + 1);
+            triCount[order[i]] += triCount[c];
+        }
+    }
+    std::vector<Aabb> clip(bvh.nodes.size());
+    clip[0] = bvh.nodes[0].box;
+    for (uint32_t n : order) {
+        const Bvh4Node& node = bvh.nodes[n];
+        if (node.leaf()) {
+            if (node.tri() < tris.count() && !clip[n].contains(tris.bounds(node.tri()))) r.trisAtRisk++;
+            continue;
+        }
+        for (uint32_t s = 0; s < arity; ++s) {
+            uint32_t c = node.child[s];
+            if (c == INVALID || c >= bvh.nodes.size()) continue;
+            clip[c].mn = vmax(clip[n].mn, bvh.nodes[c].box.mn);
+            clip[c].mx = vmin(clip[n].mx, bvh.nodes[c].box.mx);
+        }
+    }
+
+    uint32_t maxDepth = 0, maxHeight = 0;
+    for (uint32_t n : order) {
+        maxDepth = std::max(maxDepth, depth[n]);
+        maxHeight = std::max(maxHeight, height[n]);
+    }
+
+    // Per-node comparison, per-worker level tables.
+    struct Local {
+        std::vector<InflationLevel>     byDepth, byHeight;
+        std::vector<InflationViolation> violations;
+        double                          visitsStored = 0.0, visitsExact = 0.0;
+    };
+    std::vector<Local> local(worker_count());
+    for (Local& l : local) {
+        l.byDepth.resize(maxDepth + 1);
+        l.byHeight.resize(maxHeight + 1);
+    }
+    const double invRoot = r.rootSA > 0.0 ? 1.0 / r.rootSA : 0.0;
+    parallel_for_chunks(0, order.size(), 4096, [&](size_t b, size_t e, unsigned w) {
+        Local& l = local[w];
+        for (size_t i = b; i < e; ++i) {
+            uint32_t n = order[i];
+            const Aabb& st = bvh.nodes[n].box;
+            const Aabb& ex = exact[n];
+            double sSA = st.area(), eSA = ex.area();
+            for (InflationLevel* lv : {&l.byDepth[depth[n]], &l.byHeight[height[n]]}) {
+                lv->nodes++;
+                lv->storedSA += sSA;
+                lv->exactSA += eSA;
+            }
+            if (n != 0) {
+                l.visitsStored += sSA * invRoot;
+                l.visitsExact += eSA * invRoot;
+            }
+            if (ex.empty() || st.contains(ex)) continue;
+
+            InflationViolation v;
+            v.node = n;
+            v.depth = depth[n];
+            v.tris = triCount[n];
+            v.ulps = -1.0;
+            for (int a = 0; a < 3; ++a) {
+                for (int side = 0; side < 2; ++side) {
+                    float sv = side ? st.mx[a] : st.mn[a], evv = side ? ex.mx[a] : ex.mn[a];
+                    double over = side ? double(evv) - double(sv) : double(sv) - double(evv);
+                    if (over <= 0.0) continue;
+                    double ulps = over / f16_ulp(sv);
+                    if (ulps > v.ulps) {
+                        v.ulps = ulps;
+                        v.axis = a;
+                        v.maxSide = side != 0;
+                        v.exact = evv;
+                        v.stored = sv;
+                    }
+                }
+            }
+            l.byDepth[depth[n]].nonConservative++;
+            l.byHeight[height[n]].nonConservative++;
+            l.violations.push_back(v);
+        }
+    });
+
+    r.byDepth.resize(maxDepth + 1);
+    r.byHeight.resize(maxHeight + 1);
+    for (const Local& l : local) {
+        for (size_t d = 0; d <= maxDepth; ++d) {
+            r.byDepth[d].nodes += l.byDepth[d].nodes;
+            r.byDepth[d].nonConservative += l.byDepth[d].nonConservative;
+            r.byDepth[d].storedSA += l.byDepth[d].storedSA;
+            r.byDepth[d].exactSA += l.byDepth[d].exactSA;
+        }
+        for (size_t h = 0; h <= maxHeight; ++h) {
+            r.byHeight[h].nodes += l.byHeight[h].nodes;
+            r.byHeight[h].nonConservative += l.byHeight[h].nonConservative;
+            r.byHeight[h].storedSA += l.byHeight[h].storedSA;
+            r.byHeight[h].exactSA += l.byHeight[h].exactSA;
+        }
+        r.visitsStored += l.visitsStored;
+        r.visitsExact += l.visitsExact;
+        r.nonConservative += l.violations.size();
+        r.worst.insert(r.worst.end(), l.violations.begin(), l.violations.end());
+    }
+    std::sort(r.worst.begin(), r.worst.end(), [](const InflationViolation& a, const InflationViolation& b) {
+        return a.ulps != b.ulps ? a.ulps > b.ulps : a.node < b.node;
+    });
+    if (r.worst.size() > keepWorst) r.worst.resize(keepWorst);
+    return r;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+// json.hpp
+// Minimal JSON reader for the tools in tests/ (glTF headers, config files),
+// and a streaming writer for their machine-readable reports.
+// Not a general-purpose library: numbers are doubles, no \u surrogate pairs.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Null;
+    bool b = false;
+    double num = 0.0;
+    std::string str;
+    std::vector<JsonValue> arr;
+    std::map<std::string, JsonValue> obj;
+
+    bool has(const std::string& key) const {
+        return type == Object && obj.count(key) != 0;
+    }
+
+    const JsonValue& operator[](const std::string& key) const {
+        static const JsonValue null;
+        if (type != Object) return null;
+        auto it = obj.find(key);
+        return it == obj.end() ? null : it->second;
+    }
+
+    const JsonValue& operator[](size_t i) const {
+        static const JsonValue null;
+        if (type != Array || i >= arr.size()) return null;
+        return arr[i];
+    }
+
+    size_t size() const { return type == Array ? arr.size() : obj.size(); }
+
+    double number(double fallback = 0.0) const {
+        return type == Number ? num : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    bool parse(JsonValue& out) {
+        ok_ = true;
+        value(out);
+        ws();
+        return ok_;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    bool ok_ = true;
+
+    void ws() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+    }
+
+    bool eat(char c) {
+        ws();
+        if (p_ < end_ && *p_ == c) { ++p_; return true; }
+        return false;
+    }
+
+    void fail() { ok_ = false; p_ = end_; }
+
+    void value(JsonValue& v) {
+        ws();
+        if (p_ >= end_) { fail(); return; }
+
+        switch (*p_) {
+            case '{': object(v); break;
+            case '[': array(v); break;
+            case '"': v.type = JsonValue::String; string(v.str); break;
+            case 't': literal("true", 4);  v.type = JsonValue::Bool; v.b = true; break;
+            case 'f': literal("false", 5); v.type = JsonValue::Bool; v.b = false; break;
+            case 'n': literal("null", 4);  v.type = JsonValue::Null; break;
+            default:  number(v); break;
+        }
+    }
+
+    void literal(const char* s, size_t n) {
+        if (size_t(end_ - p_) < n || std::string(p_, n) != s) { fail(); return; }
+        p_ += n;
+    }
+
+    void number(JsonValue& v) {
+        char* stop = nullptr;
+        std::string tmp(p_, std::min<size_t>(size_t(end_ - p_), 64));
+        v.num = std::strtod(tmp.c_str(), &stop);
+        size_t used = size_t(stop - tmp.c_str());
+        if (used == 0) { fail(); return; }
+        v.type = JsonValue::Number;
+        p_ += used;
+    }
+
+    void string(std::string& s) {
+        ++p_; // opening quote
+        while (p_ < end_ && *p_ != '"') {
+            char c = *p_++;
+            if (c != '\\') { s.push_back(c); continue; }
+            if (p_ >= end_) break;
+            char e = *p_++;
+            switch (e) {
+                case 'n': s.push_back('\n'); break;
+                case 't': s.push_back('\t'); break;
+                case 'r': s.push_back('\r'); break;
+                case 'b': s.push_back('\b'); break;
+                case 'f': s.push_back('\f'); break;
+                case 'u': {
+                    if (end_ - p_ < 4) { fail(); return; }
+                    unsigned cp = unsigned(std::strtoul(std::string(p_, 4).c_str(), nullptr, 16));
+                    p_ += 4;
+                    if (cp < 0x80) {
+                        s.push_back(char(cp));
+                    } else if (cp < 0x800) {
+                        s.push_back(char(0xC0 | (cp >> 6)));
+                        s.push_back(char(0x80 | (cp & 0x3F)));
+                    } else {
+                        s.push_back(char(0xE0 | (cp >> 12)));
+                        s.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+                        s.push_back(char(0x80 | (cp & 0x3F)));
+                    }
+                    break;
+                }
+                default: s.push_back(e); break;
+            }
+        }
+        if (p_ >= end_) { fail(); return; }
+        ++p_; // closing quote
+    }
+
+    void array(JsonValue& v) {
+        v.type = JsonValue::Array;
+        ++p_;
+        if (eat(']')) return;
+        do {
+            v.arr.emplace_back();
+            value(v.arr.back());
+        } while (ok_ && eat(','));
+        if (!eat(']')) fail();
+    }
+
+    void object(JsonValue& v) {
+        v.type = JsonValue::Object;
+        ++p_;
+        if (eat('}')) return;
+        do {
+            ws();
+            if (p_ >= end_ || *p_ != '"') { fail(); return; }
+            std::string key;
+            string(key);
+            if (!eat(':')) { fail(); return; }
+            value(v.obj[key]);
+        } while (ok_ && eat(','));
+        if (!eat('}')) fail();
+    }
+};
+
+static inline bool parse_json(const std::string& text, JsonValue& out) {
+    JsonParser p(text.data(), text.data() + text.size());
+    return p.parse(out);
+}
+
+/* ================= Writer ================= */
+
+// Keys are written in call order; pass a key inside objects, none in arrays.
+//
+//   JsonWriter w(std::cout);
+//   w.begin_object();
+//   w.value("reps", 10);
+//   w.begin_array("samples_ms");
+//   for (double ms : samples) w.value(ms);
+//   w.end_array();
+//   w.end_object();
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream& os) : os_(os) {}
+
+    void begin_object(const char* key = nullptr) { open(key, '{'); }
+    void end_object() { close('}'); }
+    void begin_array(const char* key = nullptr) { open(key, '['); }
+    void end_array() { close(']'); }
+
+    void value(const char* key, double v) {
+        item(key);
+        if (!std::isfinite(v)) {
+            os_ << "null";
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.9g", v);
+        os_ << buf;
+    }
+    void value(const char* key, int64_t v)          { item(key); os_ << v; }
+    void value(const char* key, uint64_t v)         { item(key); os_ << v; }
+    void value(const char* key, uint32_t v)         { value(key, uint64_t(v)); }
+    void value(const char* key, int v)              { value(key, int64_t(v)); }
+    void value(const char* key, bool v)             { item(key); os_ << (v ? "true" : "false"); }
+    void value(const char* key, const char* v)      { item(key); quoted(v); }
+    void value(const char* key, const std::string& v) { value(key, v.c_str()); }
+    void null(const char* key = nullptr)            { item(key); os_ << "null"; }
+
+    template <typename T>
+    void value(const T& v) { value(nullptr, v); }
+
+private:
+    std::ostream& os_;
+    std::vector<bool> first_; // per open container: nothing written yet
+
+    void indent() { os_ << '\n' << std::string(first_.size() * 2, ' '); }
+
+    void item(const char* key) {
+        if (!first_.empty()) {
+            if (!first_.back()) os_ << ',';
+            first_.back() = false;
+            indent();
+        }
+        if (key) {
+            quoted(key);
+            os_ << ": ";
+        }
+    }
+
+    void open(const char* key, char c) {
+        item(key);
+        os_ << c;
+        first_.push_back(true);
+    }
+
+    void close(char c) {
+        bool empty = first_.back();
+        first_.pop_back();
+        if (!empty) indent();
+        os_ << c;
+        if (first_.empty()) os_ << '\n';
+    }
+
+    void quoted(const char* s) {
+        os_ << '"';
+        for (; *s; ++s) {
+            unsigned char ch = static_cast<unsigned char>(*s);
+            if (ch == '"' || ch == '\\') {
+                os_ << '\\' << *s;
+            } else if (ch < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                os_ << buf;
+            } else {
+                os_ << *s;
+            }
+        }
+        os_ << '"';
+    }
+};
+
+// Where a tool's --json FILE|- report goes: std::cout for "-", else `file`
+// opened on FILE. Returns nullptr (after saying so on stderr) if FILE
+// cannot be written.
+static inline std::ostream* open_json_output(const std::string& path, std::ofstream& file) {
+    if (path == "-") return &std::cout;
+    file.open(path);
+    if (!file) {
+        std::cerr << "Failed to write " << path << "\n";
+        return nullptr;
+    }
+    return &file;
+}
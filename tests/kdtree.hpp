@@ -0,0 +1,308 @@
+#pragma once
+
+// kdtree.hpp
+// SAH k-d tree over triangle references (pbrt-v3 style): split candidates
+// come from binned triangle bounds, triangles straddling a plane go to both
+// sides, and traversal walks cells front to back with a (node, tmin, tmax)
+// stack so closest hits can stop at the first cell that contains one.
+//
+// Nodes are 8 bytes in depth-first order; an interior node's below child
+// follows it directly:
+//
+//   interior   split (f32)        axis | above << 2
+//   leaf       primOffset (u32)   3 | count << 2
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+struct KdNode {
+    union {
+        float    split;
+        uint32_t primOffset;
+    };
+    uint32_t info;
+
+    bool     leaf() const  { return (info & 3u) == 3u; }
+    uint32_t axis() const  { return info & 3u; }
+    uint32_t above() const { return info >> 2; }
+    uint32_t count() const { return info >> 2; }
+};
+
+struct KdTree {
+    Aabb                  box;
+    std::vector<KdNode>   nodes;
+    std::vector<uint32_t> prims; // triangle indices referenced by leaves
+    uint32_t              depth = 0;
+
+    size_t bytes() const { return nodes.size() * sizeof(KdNode) + prims.size() * sizeof(uint32_t); }
+};
+
+struct KdBuildParams {
+    float    isectCost = 80.0f;
+    float    travCost = 1.0f;
+    float    emptyBonus = 0.5f;
+    uint32_t maxLeaf = 1;
+    uint32_t bins = 32;
+};
+
+/* ================= Build ================= */
+
+namespace kd_detail {
+
+static constexpr uint32_t MAX_BINS = 64;
+static constexpr uint32_t PARALLEL_BIN_MIN = 1u << 16;
+
+struct Builder {
+    const KdBuildParams&     params;
+    const std::vector<Aabb>& triBox;
+    uint32_t                 maxDepth;
+    uint32_t                 forkDepth;
+    std::atomic<uint32_t>    depth{0};
+
+    struct Bins {
+        uint32_t start[3][MAX_BINS] = {};
+        uint32_t end[3][MAX_BINS] = {};
+    };
+
+    void bin_range(const uint32_t* refs, size_t n, const Aabb& bounds, Bins& b) const {
+        const uint32_t B = params.bins;
+        for (size_t i = 0; i < n; ++i) {
+            const Aabb& tb = triBox[refs[i]];
+            for (int a = 0; a < 3; ++a) {
+                float lo = bounds.mn[a], ext = bounds.mx[a] - bounds.mn[a];
+                float s = ext > 0.0f ? float(B) / ext : 0.0f;
+                int32_t b0 = int32_t((std::max(tb.mn[a], lo) - lo) * s);
+                int32_t b1 = int32_t((std::min(tb.mx[a], bounds.mx[a]) - lo) * s);
+                b.start[a][std::clamp(b0, 0, int32_t(B) - 1)]++;
+                b.end[a][std::clamp(b1, 0, int32_t(B) - 1)]++;
+            }
+        }
+    }
+
+    // Appends the subtree for `refs` to nodes/prims; returns nothing, the
+    // root of the subtree is nodes[size before the call].
+    void build(std::vector<uint32_t>& refs, const Aabb& bounds, uint32_t d, uint32_t badRefines,
+               std::vector<KdNode>& nodes, std::vector<uint32_t>& prims) {
+        uint32_t seen = depth.load(std::memory_order_relaxed);
+        while (d > seen && !depth.compare_exchange_weak(seen, d)) {}
+
+        const size_t n = refs.size();
+        auto make_leaf = [&] {
+            KdNode leaf;
+            leaf.primOffset = uint32_t(prims.size());
+            leaf.info = 3u | uint32_t(n << 2);
+            nodes.push_back(leaf);
+            prims.insert(prims.end(), refs.begin(), refs.end());
+        };
+        if (n <= params.maxLeaf || d >= maxDepth) {
+            make_leaf();
+            return;
+        }
+
+        Bins bins;
+        if (n >= PARALLEL_BIN_MIN) {
+            std::vector<Bins> perWorker(worker_count());
+            parallel_for_chunks(0, n, 1 << 14, [&](size_t b, size_t e, unsigned w) {
+                bin_range(refs.data() + b, e - b, bounds, perWorker[w]);
+            });
+            for (const Bins& pw : perWorker)
+                for (int a = 0; a < 3; ++a)
+                    for (uint32_t k = 0; k < params.bins; ++k) {
+                        bins.start[a][k] += pw.start[a][k];
+                        bins.end[a][k] += pw.end[a][k];
+                    }
+        } else {
+            bin_range(refs.data(), n, bounds, bins);
+        }
+
+        const float invArea = 1.0f / bounds.area();
+        const float leafCost = params.isectCost * float(n);
+        float bestCost = INF;
+        int bestAxis = -1;
+        float bestSplit = 0.0f;
+
+        for (int a = 0; a < 3; ++a) {
+            float ext = bounds.mx[a] - bounds.mn[a];
+            if (ext <= 0.0f) continue;
+            uint32_t below = 0, endedBelow = 0;
+            for (uint32_t k = 1; k < params.bins; ++k) {
+                below += bins.start[a][k - 1];
+                endedBelow += bins.end[a][k - 1];
+                uint32_t above = uint32_t(n) - endedBelow;
+                float split = bounds.mn[a] + ext * float(k) / float(params.bins);
+
+                Aabb lb = bounds, rb = bounds;
+                lb.mx[a] = split;
+                rb.mn[a] = split;
+                float eb = (below == 0 || above == 0) ? params.emptyBonus : 0.0f;
+                float cost = params.travCost + params.isectCost * (1.0f - eb) *
+                                                   (lb.area() * invArea * float(below) + rb.area() * invArea * float(above));
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        if (bestCost > leafCost) ++badRefines;
+        if (bestAxis < 0 || (bestCost > 4.0f * leafCost && n < 16) || badRefines == 3) {
+            make_leaf();
+            return;
+        }
+
+        // Touching the plane counts as both sides, so flat triangles lying
+        // in it are never dropped.
+        std::vector<uint32_t> lo, hi;
+        lo.reserve(n / 2);
+        hi.reserve(n / 2);
+        for (uint32_t t : refs) {
+            if (triBox[t].mn[bestAxis] <= bestSplit) lo.push_back(t);
+            if (triBox[t].mx[bestAxis] >= bestSplit) hi.push_back(t);
+        }
+        std::vector<uint32_t>().swap(refs);
+
+        Aabb lb = bounds, rb = bounds;
+        lb.mx[bestAxis] = bestSplit;
+        rb.mn[bestAxis] = bestSplit;
+
+        const size_t self = nodes.size();
+        nodes.push_back(KdNode{});
+        nodes[self].split = bestSplit;
+
+        if (d < forkDepth) {
+            // Build the above subtree on another thread into its own arrays
+            // and splice it in behind the below subtree.
+            std::vector<KdNode> hiNodes;
+            std::vector<uint32_t> hiPrims;
+            parallel_invoke(
+                [&] {
+                    TimelineZone zone("kd subtree", hi.size());
+                    build(hi, rb, d + 1, badRefines, hiNodes, hiPrims);
+                },
+                [&] {
+                    TimelineZone zone("kd subtree", lo.size());
+                    build(lo, lb, d + 1, badRefines, nodes, prims);
+                });
+
+            const uint32_t nodeBase = uint32_t(nodes.size()), primBase = uint32_t(prims.size());
+            for (KdNode& k : hiNodes) {
+                if (k.leaf()) k.primOffset += primBase;
+                else k.info += nodeBase << 2;
+            }
+            nodes[self].info = uint32_t(bestAxis) | (nodeBase << 2);
+            nodes.insert(nodes.end(), hiNodes.begin(), hiNodes.end());
+            prims.insert(prims.end(), hiPrims.begin(), hiPrims.end());
+        } else {
+            build(lo, lb, d + 1, badRefines, nodes, prims);
+            nodes[self].info = uint32_t(bestAxis) | (uint32_t(nodes.size()) << 2);
+            build(hi, rb, d + 1, badRefines, nodes, prims);
+        }
+    }
+};
+
+} // namespace kd_detail
+
+static inline KdTree build_kdtree(const Triangles& tris, const KdBuildParams& params = {}) {
+    TIMELINE_ZONE("kd build");
+    KdTree tree;
+    const uint32_t n = tris.count();
+    if (n == 0) return tree;
+
+    std::vector<Aabb> triBox(n);
+    parallel_for(0, n, 1 << 14, [&](size_t t) { triBox[t] = tris.bounds(uint32_t(t)); });
+    for (const Aabb& b : triBox) tree.box.grow(b);
+
+    KdBuildParams p = params;
+    p.bins = std::clamp(p.bins, 2u, kd_detail::MAX_BINS);
+
+    uint32_t forkDepth = 0;
+    while ((1u << forkDepth) < worker_count()) ++forkDepth;
+    kd_detail::Builder builder{p, triBox, uint32_t(8 + 1.3 * std::log2(double(n))), forkDepth};
+
+    std::vector<uint32_t> refs(n);
+    for (uint32_t t = 0; t < n; ++t) refs[t] = t;
+    builder.build(refs, tree.box, 0, 0, tree.nodes, tree.prims);
+    tree.depth = builder.depth.load();
+    return tree;
+}
+
+/* ================= Traversal ================= */
+
+static inline Hit trace_kdtree(const KdTree& tree, const Triangles& tris, const Ray& ray, bool anyHit,
+                               TraceStats* stats = nullptr) {
+    Hit out;
+    out.t = ray.tmax;
+    if (tree.nodes.empty()) { out.t = INF; return out; }
+
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+
+    // Clip to the root box.
+    float tMin = ray.tmin, tMax = ray.tmax;
+    for (int a = 0; a < 3; ++a) {
+        float t0 = (tree.box.mn[a] - ray.origin[a]) * invDir[a];
+        float t1 = (tree.box.mx[a] - ray.origin[a]) * invDir[a];
+        if (t0 > t1) std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+    }
+    if (tMin > tMax) { out.t = INF; return out; }
+
+    struct Todo { uint32_t node; float tMin, tMax; };
+    Todo stack[64];
+    int sp = 0;
+    uint32_t node = 0;
+
+    for (;;) {
+        if (out.t < tMin) break;
+        const KdNode& k = tree.nodes[node];
+        if (stats) stats->nodes++;
+
+        if (!k.leaf()) {
+            const uint32_t a = k.axis();
+            float tPlane = (k.split - ray.origin[a]) * invDir[a];
+            bool belowFirst = ray.origin[a] < k.split || (ray.origin[a] == k.split && ray.dir[a] <= 0.0f);
+            uint32_t first = belowFirst ? node + 1 : k.above();
+            uint32_t second = belowFirst ? k.above() : node + 1;
+
+            if (tPlane > tMax || tPlane <= 0.0f) {
+                node = first;
+            } else if (tPlane < tMin) {
+                node = second;
+            } else {
+                if (sp < 64) stack[sp++] = {second, tPlane, tMax};
+                else if (stats) stats->stackDrops++;
+                node = first;
+                tMax = tPlane;
+            }
+            if (stats && uint32_t(sp) > stats->maxStack) stats->maxStack = uint32_t(sp);
+            continue;
+        }
+
+        const uint32_t* p = tree.prims.data() + k.primOffset;
+        for (uint32_t i = 0; i < k.count(); ++i) {
+            uint32_t ti = p[i];
+            if (stats) stats->triTests++;
+            float t = intersect_triangle(ray, tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+            if (t < out.t) {
+                out.t = t;
+                out.tri = ti;
+                if (anyHit) return out;
+            }
+        }
+
+        if (sp == 0) break;
+        --sp;
+        node = stack[sp].node;
+        tMin = stack[sp].tMin;
+        tMax = stack[sp].tMax;
+    }
+
+    if (!out.hit()) out.t = INF;
+    return out;
+}
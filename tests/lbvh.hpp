@@ -0,0 +1,403 @@
+#pragma once
+
+// lbvh.hpp
+// CPU port of the app's BVH build so tools can build (and time) BVHs without
+// a browser: Morton codes + sort as buildMortonAndSort in PathTracer.js,
+// Karras connectivity and bottom-up fp16 bounds as BVHBuilder.wgsl, then the
+// in-place BVH2 -> BVH4 promotion bin/test applies to the readback.
+//
+// On the dragon the topology and every leaf box are bit-identical to
+// data/BVH2.bin. ~0.4% of internal boxes differ: propagateUp on the GPU can
+// read a sibling's bounds before that write is visible, so the checked-in
+// file holds some boxes merged from stale (or still zero) children.
+//
+// Each phase adds its wall time to the CTR_BUILD_NS counter (counters.hpp);
+// build_lbvh2 also adds its triangle count, so build ns/triangle is always
+// available from a counters snapshot.
+//
+// bound_lbvh2_depth() reshapes an LBVH2 so no leaf is deeper than a given
+// depth, which bounds the traversal stack of the promoted BVH4: see
+// promoted_stack_bound().
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "bvh.hpp"
+#include "counters.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+
+/* ================= Morton codes ================= */
+
+static inline uint32_t expand_bits10(uint32_t v) {
+    v &= 1023u;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+static inline uint32_t morton3d(uint32_t x, uint32_t y, uint32_t z) {
+    return (expand_bits10(x) << 2) | (expand_bits10(y) << 1) | expand_bits10(z);
+}
+
+struct MortonOrder {
+    std::vector<uint32_t> codes; // sorted
+    std::vector<uint32_t> tris;  // triangle index per sorted slot
+};
+
+// Unsorted (code << 32 | tri) keys; sorting them orders triangles like the
+// JS comparator: code, then index. Centroids are evaluated in double like
+// the JS, so quantization (and hence the tree) matches the app bit for bit.
+static inline std::vector<uint64_t> morton_keys(const Triangles& tris) {
+    TIMELINE_ZONE("morton");
+    CounterTimer buildNs(CTR_BUILD_NS);
+    const uint32_t n = tris.count();
+    if (n == 0) return {};
+
+    auto centroid = [&](uint32_t t, int k) {
+        const float* p = tris.v.data() + size_t(t) * 9;
+        return (double(p[k]) + double(p[3 + k]) + double(p[6 + k])) / 3.0;
+    };
+
+    std::vector<double> lo(worker_count() * 3, 1e30), hi(worker_count() * 3, -1e30);
+    parallel_for_chunks(0, n, 1 << 14, [&](size_t b, size_t e, unsigned w) {
+        for (size_t t = b; t < e; ++t)
+            for (int k = 0; k < 3; ++k) {
+                double c = centroid(uint32_t(t), k);
+                lo[w * 3 + k] = std::min(lo[w * 3 + k], c);
+                hi[w * 3 + k] = std::max(hi[w * 3 + k], c);
+            }
+    });
+    double mn[3] = {1e30, 1e30, 1e30}, ext[3];
+    double mx[3] = {-1e30, -1e30, -1e30};
+    for (size_t w = 0; w < worker_count(); ++w)
+        for (int k = 0; k < 3; ++k) {
+            mn[k] = std::min(mn[k], lo[w * 3 + k]);
+            mx[k] = std::max(mx[k], hi[w * 3 + k]);
+        }
+    for (int k = 0; k < 3; ++k) ext[k] = std::max(1e-20, mx[k] - mn[k]);
+
+    std::vector<uint64_t> keys(n);
+    parallel_for(0, n, 1 << 14, [&](size_t t) {
+        uint32_t q[3];
+        for (int k = 0; k < 3; ++k) {
+            double v = (centroid(uint32_t(t), k) - mn[k]) / ext[k] * 1023.0;
+            q[k] = uint32_t(std::clamp(int32_t(v), 0, 1023));
+        }
+        keys[t] = (uint64_t(morton3d(q[0], q[1], q[2])) << 32) | t;
+    });
+    return keys;
+}
+
+static inline MortonOrder sort_morton_keys(std::vector<uint64_t>& keys) {
+    TIMELINE_ZONE("morton sort");
+    CounterTimer buildNs(CTR_BUILD_NS);
+    const size_t n = keys.size();
+    MortonOrder out;
+    parallel_sort(keys.data(), keys.data() + n, std::less<uint64_t>());
+
+    out.codes.resize(n);
+    out.tris.resize(n);
+    parallel_for(0, n, 1 << 14, [&](size_t i) {
+        out.codes[i] = uint32_t(keys[i] >> 32);
+        out.tris[i] = uint32_t(keys[i]);
+    });
+    return out;
+}
+
+static inline MortonOrder morton_sort(const Triangles& tris) {
+    std::vector<uint64_t> keys = morton_keys(tris);
+    return sort_morton_keys(keys);
+}
+
+/* ================= LBVH2 (BVHBuilder.wgsl) ================= */
+
+namespace lbvh_detail {
+
+static inline int32_t delta(const std::vector<uint32_t>& codes, int32_t i, int32_t j, int32_t n) {
+    if (j < 0 || j >= n) return -1;
+    uint32_t x = codes[size_t(i)] ^ codes[size_t(j)];
+    if (x == 0) return 32 + std::countl_zero(uint32_t(i) ^ uint32_t(j));
+    return std::countl_zero(x);
+}
+
+// Karras split of the sorted range [first, last]: the last index that still
+// shares more than the range's common prefix with `first`.
+static inline int32_t find_split(const std::vector<uint32_t>& codes, int32_t first, int32_t last, int32_t n) {
+    int32_t deltaNode = delta(codes, first, last, n);
+    int32_t split = first, step = last - first;
+    while (step > 1) {
+        step = (step + 1) >> 1;
+        int32_t s = split + step;
+        if (s < last && delta(codes, first, s, n) > deltaNode) split = s;
+    }
+    return split;
+}
+
+// writeBounds2: widen by one fp16 ULP each way before packing.
+static inline void write_bounds2(uint32_t* node, Vec3 mn, Vec3 mx) {
+    Aabb b;
+    b.mn = {increment_f16(mn.x, false, 1), increment_f16(mn.y, false, 1), increment_f16(mn.z, false, 1)};
+    b.mx = {increment_f16(mx.x, true, 1), increment_f16(mx.y, true, 1), increment_f16(mx.z, true, 1)};
+    encode_bounds(b, node);
+}
+
+} // namespace lbvh_detail
+
+// Returns the raw LBVH2 buffer in the data/BVH2.bin layout: internal nodes
+// [0, n-1), leaves [n-1, 2n-1) in Morton order.
+static inline std::vector<uint32_t> build_lbvh2(const Triangles& tris, const MortonOrder& order) {
+    using namespace lbvh_detail;
+    TIMELINE_ZONE("lbvh2 build");
+    CounterTimer buildNs(CTR_BUILD_NS);
+    const uint32_t n = tris.count();
+    counter_add(CTR_BUILD_TRIS, n);
+    const uint32_t numNodes = n ? 2 * n - 1 : 0;
+    const uint32_t internalCount = n ? n - 1 : 0;
+
+    std::vector<uint32_t> bvh2(1 + size_t(numNodes) * NODE2_STRIDE_U32, 0u);
+    bvh2[0] = numNodes;
+    if (n == 0) return bvh2;
+
+    std::vector<uint32_t> parent(numNodes, INVALID);
+    std::vector<uint32_t> flags(std::max(internalCount, 1u), 0u);
+
+    // Pass 1: connectivity.
+    {
+        TimelineZone zone("connectivity", internalCount);
+        parallel_for(0, internalCount, 1 << 12, [&](size_t iu) {
+            const int32_t i = int32_t(iu), ni = int32_t(n);
+            const auto& codes = order.codes;
+
+            int32_t d = delta(codes, i, i + 1, ni) - delta(codes, i, i - 1, ni) > 0 ? 1 : -1;
+            int32_t deltaMin = delta(codes, i, i - d, ni);
+
+            int32_t lmax = 2;
+            while (delta(codes, i, i + lmax * d, ni) > deltaMin) lmax <<= 1;
+
+            int32_t l = 0;
+            for (int32_t t = lmax >> 1; t > 0; t >>= 1)
+                if (delta(codes, i, i + (l + t) * d, ni) > deltaMin) l += t;
+
+            int32_t j = i + l * d;
+            int32_t first = std::min(i, j), last = std::max(i, j);
+            int32_t split = find_split(codes, first, last, ni);
+
+            uint32_t left = split == first ? internalCount + uint32_t(split) : uint32_t(split);
+            uint32_t right = split + 1 == last ? internalCount + uint32_t(split + 1) : uint32_t(split + 1);
+
+            uint32_t* node = bvh2.data() + node2_off(uint32_t(iu));
+            node[3] = left;
+            node[4] = right;
+            node[5] = 0;
+            parent[left] = uint32_t(iu);
+            parent[right] = uint32_t(iu);
+        });
+    }
+
+    // Pass 2: leaves, then the second child to arrive at a parent merges the
+    // two (already widened) child boxes and continues upward.
+    TIMELINE_ZONE("bounds");
+    parallel_for(0, n, 1 << 12, [&](size_t leafId) {
+        uint32_t node = internalCount + uint32_t(leafId);
+        uint32_t tri = order.tris[leafId];
+        Aabb tb = tris.bounds(tri);
+        uint32_t* p = bvh2.data() + node2_off(node);
+        write_bounds2(p, tb.mn, tb.mx);
+        p[3] = 0;
+        p[4] = 0;
+        p[5] = LEAF_FLAG | (tri & 0x7FFFFFFFu);
+
+        for (;;) {
+            uint32_t par = parent[node];
+            if (par == INVALID || par >= internalCount) break;
+            if (std::atomic_ref<uint32_t>(flags[par]).fetch_add(1, std::memory_order_acq_rel) == 0) break;
+
+            uint32_t* pp = bvh2.data() + node2_off(par);
+            Aabb lb = decode_bounds(bvh2.data() + node2_off(pp[3]));
+            Aabb rb = decode_bounds(bvh2.data() + node2_off(pp[4]));
+            write_bounds2(pp, vmin(lb.mn, rb.mn), vmax(lb.mx, rb.mx));
+            node = par;
+        }
+    });
+    return bvh2;
+}
+
+/* ================= Depth-bounded LBVH2 ================= */
+
+// Worst-case stack of the BVH4 that promote_bvh4 makes from an LBVH2 no
+// deeper than depth2 (root = 0): a BVH4 node spans two BVH2 levels, and
+// each one on the way down leaves at most 3 siblings on the stack.
+static inline uint32_t promoted_stack_bound(uint32_t depth2) { return 1 + 3 * ((depth2 + 1) / 2); }
+
+// Deepest LBVH2 whose promoted BVH4 fits a `stack`-entry stack.
+static inline uint32_t lbvh2_depth_for_stack(uint32_t stack) { return stack ? 2 * ((stack - 1) / 3) : 0; }
+
+// Rewrites the connectivity of build_lbvh2's output so no leaf is deeper
+// than maxDepth, then refits the internal boxes. Walks top-down with each
+// node's Morton range: a split that leaves either side more leaves than
+// 2^(depth left - 1) is moved to the most significant code boundary inside
+// the window that fits (nearest the middle on ties), and everything below
+// is re-split the same way. A node over range [f, l] is always indexed by
+// an end of its range as in Karras' layout, so the rebuilt subtrees reuse
+// their own internal nodes and the file layout is unchanged; when nothing
+// needs moving the buffer comes back bit-identical. Returns false (buffer
+// untouched) when n leaves cannot fit, i.e. n > 2^maxDepth. `moved` gets
+// the number of splits that were moved.
+static inline bool bound_lbvh2_depth(std::vector<uint32_t>& bvh2, const MortonOrder& order, uint32_t maxDepth,
+                                     uint32_t* moved = nullptr) {
+    using namespace lbvh_detail;
+    TIMELINE_ZONE("depth bound");
+    CounterTimer buildNs(CTR_BUILD_NS);
+    if (moved) *moved = 0;
+    const uint32_t numNodes = bvh2.empty() ? 0 : bvh2[0];
+    const uint32_t n = (numNodes + 1) / 2;
+    if (n <= 1) return true;
+    if (maxDepth < 32 && n > (1u << maxDepth)) return false;
+    const uint32_t internalCount = n - 1;
+    const int32_t ni = int32_t(n);
+    const auto& codes = order.codes;
+
+    struct Range {
+        uint32_t node;
+        int32_t  first, last;
+        uint32_t budget; // levels left below this node
+    };
+    std::vector<Range> todo{{0u, 0, ni - 1, std::min(maxDepth, 40u)}};
+    std::vector<uint32_t> preorder;
+    preorder.reserve(internalCount);
+    uint32_t movedSplits = 0;
+
+    while (!todo.empty()) {
+        const Range r = todo.back();
+        todo.pop_back();
+        preorder.push_back(r.node);
+
+        // Each side may hold at most 2^(budget - 1) leaves.
+        const int64_t cap = int64_t(1) << (r.budget - 1);
+        const int32_t lo = int32_t(std::max<int64_t>(r.first, r.last - cap));
+        const int32_t hi = int32_t(std::min<int64_t>(r.last - 1, r.first + cap - 1));
+        int32_t split = find_split(codes, r.first, r.last, ni);
+        if (split < lo || split > hi) {
+            const int32_t mid = r.first + (r.last - r.first) / 2;
+            split = lo;
+            for (int32_t s = lo + 1; s <= hi; ++s) {
+                int32_t ds = delta(codes, s, s + 1, ni), db = delta(codes, split, split + 1, ni);
+                if (ds < db || (ds == db && std::abs(s - mid) < std::abs(split - mid))) split = s;
+            }
+            movedSplits++;
+        }
+
+        const uint32_t left = split == r.first ? internalCount + uint32_t(split) : uint32_t(split);
+        const uint32_t right = split + 1 == r.last ? internalCount + uint32_t(split + 1) : uint32_t(split + 1);
+        uint32_t* node = bvh2.data() + node2_off(r.node);
+        node[3] = left;
+        node[4] = right;
+        if (left < internalCount) todo.push_back({left, r.first, split, r.budget - 1});
+        if (right < internalCount) todo.push_back({right, split + 1, r.last, r.budget - 1});
+    }
+
+    // Children come after their parent in preorder.
+    for (size_t i = preorder.size(); i-- > 0;) {
+        uint32_t* p = bvh2.data() + node2_off(preorder[i]);
+        Aabb lb = decode_bounds(bvh2.data() + node2_off(p[3]));
+        Aabb rb = decode_bounds(bvh2.data() + node2_off(p[4]));
+        write_bounds2(p, vmin(lb.mn, rb.mn), vmax(lb.mx, rb.mx));
+    }
+    if (moved) *moved = movedSplits;
+    return true;
+}
+
+/* ================= BVH2 -> BVH4 promotion ================= */
+
+// Which BVH2 descendants become a BVH4 node's children:
+//
+//   grandchildren  both BVH2 children are opened once (a leaf child stays
+//                  as itself); what bin/test and the app do
+//   greedy-sah     the largest-area internal node in the set is opened
+//                  until there are 4, so a leaf child does not leave a slot
+//                  empty and a large grandchild can open before a small
+//                  child. Can be deeper than promoted_stack_bound() allows.
+//
+// Node indices are kept either way, so opened BVH2 nodes become unreachable
+// orphans in the BVH4.
+enum Bvh4Collapse : uint32_t { COLLAPSE_GRANDCHILDREN = 0, COLLAPSE_GREEDY_SAH };
+
+static inline const char* const COLLAPSE_NAMES[] = {"grandchildren", "greedy-sah"};
+
+static inline void promote_children_4(const std::vector<uint32_t>& bvh2, uint32_t numNodes2,
+                                      uint32_t left, uint32_t right, uint32_t out[4]) {
+    uint32_t k = 0;
+    auto push = [&](uint32_t c) {
+        if (k < 4) out[k++] = c;
+    };
+    auto promote = [&](uint32_t c) {
+        if (c == INVALID) return;
+        if (is_leaf2(bvh2, c, numNodes2)) {
+            push(c);
+        } else {
+            size_t off = node2_off(c);
+            push(bvh2[off + 3]);
+            push(bvh2[off + 4]);
+        }
+    };
+    promote(left);
+    promote(right);
+    while (k < 4) out[k++] = INVALID;
+}
+
+static inline void promote_children_greedy(const std::vector<uint32_t>& bvh2, uint32_t numNodes2,
+                                           uint32_t left, uint32_t right, uint32_t out[4]) {
+    uint32_t k = 0;
+    out[k++] = left;
+    out[k++] = right;
+    while (k < 4) {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (uint32_t i = 0; i < k; ++i) {
+            if (out[i] == INVALID || is_leaf2(bvh2, out[i], numNodes2)) continue;
+            float a = decode_bounds(bvh2.data() + node2_off(out[i])).area();
+            if (a > bestArea) {
+                bestArea = a;
+                best = int(i);
+            }
+        }
+        if (best < 0) break;
+        const size_t off = node2_off(out[best]);
+        out[best] = bvh2[off + 3];
+        out[k++] = bvh2[off + 4];
+    }
+    while (k < 4) out[k++] = INVALID;
+}
+
+static inline std::vector<uint32_t> promote_bvh4(const std::vector<uint32_t>& bvh2,
+                                                 Bvh4Collapse collapse = COLLAPSE_GRANDCHILDREN) {
+    TIMELINE_ZONE("promote");
+    CounterTimer buildNs(CTR_BUILD_NS);
+    const uint32_t numNodes2 = bvh2.empty() ? 0 : bvh2[0];
+    std::vector<uint32_t> bvh4(1 + size_t(numNodes2) * NODE4_STRIDE_U32);
+    bvh4[0] = numNodes2;
+
+    parallel_for(0, numNodes2, 1 << 14, [&](size_t n) {
+        const uint32_t* p2 = bvh2.data() + node2_off(uint32_t(n));
+        uint32_t* p4 = bvh4.data() + node4_off(uint32_t(n));
+        p4[0] = p2[0];
+        p4[1] = p2[1];
+        p4[2] = p2[2];
+        if (p2[5] & LEAF_FLAG) {
+            p4[3] = p4[4] = p4[5] = p4[6] = INVALID;
+            p4[7] = p2[5];
+        } else {
+            if (collapse == COLLAPSE_GREEDY_SAH) promote_children_greedy(bvh2, numNodes2, p2[3], p2[4], p4 + 3);
+            else promote_children_4(bvh2, numNodes2, p2[3], p2[4], p4 + 3);
+            p4[7] = 0;
+        }
+    });
+    return bvh4;
+}
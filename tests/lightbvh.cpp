@@ -0,0 +1,561 @@
+// lightbvh.cpp
+// Many-light sampling with a light BVH (Estevez & Kulla 2018, "Importance
+// Sampling of Many Lights with Adaptive Tree Splitting"; pbrt-v4 layout).
+//
+// Every node stores the bounds, an orientation cone (axis, theta_o,
+// theta_e) and the total power of its lights. The build bins light
+// centroids and picks splits with the SAH-like orientation cost
+//   power * M_A(bounds) * M_Omega(cone)
+// and the sampler walks the tree once per shadow ray, choosing a child in
+// proportion to a conservative estimate of its contribution at the shading
+// point. Zero importance is only ever returned for subtrees that provably
+// cannot light the point, so the estimator stays unbiased.
+//
+// The tool scatters emissive triangles and point lights around the scene,
+// shades the primary hits of the default camera (diffuse, one shadow ray
+// per sample) and reports the variance of the one-sample estimator per
+// shadow ray for uniform, power-proportional and light-BVH selection.
+//
+//   bin/lightbvh [--scene public/assets/dragon.glb] [--bvh data/BVH4_wide.bin]
+//                [--size 320x180] [--lights 4096] [--point-fraction 0.5]
+//                [--spp 32] [--seed 1]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+static constexpr float PI = 3.14159265358979f;
+
+/* ================= Lights ================= */
+
+struct Light {
+    enum Type : uint32_t { Point, Triangle };
+
+    Type  type;
+    Vec3  p0, p1, p2;   // point lights use p0
+    Vec3  n;            // one-sided emitter normal (triangles)
+    float area = 0.0f;
+    float power = 0.0f; // radiant flux
+
+    Aabb bounds() const {
+        Aabb b;
+        b.grow(p0);
+        if (type == Triangle) { b.grow(p1); b.grow(p2); }
+        return b;
+    }
+
+    Vec3 centroid() const {
+        return type == Point ? p0 : (p0 + p1 + p2) * (1.0f / 3.0f);
+    }
+};
+
+// Normal distribution by Box-Muller; only used to spread light powers.
+static float gaussian(Rng& rng) {
+    float u1 = std::max(rng.uniform(), 1e-7f);
+    return std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * PI * rng.uniform());
+}
+
+// Lights in a shell around the normalized scene ([-1, 1]^3), emitters facing
+// roughly inwards, with log-normal powers so that a few lights dominate.
+static std::vector<Light> make_lights(uint32_t count, float pointFraction, uint64_t seed) {
+    std::vector<Light> lights(count);
+    Rng rng(seed, 0x11u);
+
+    for (Light& l : lights) {
+        Vec3 dir = normalize(Vec3{gaussian(rng), gaussian(rng), gaussian(rng)});
+        float r = 1.2f + 1.8f * rng.uniform();
+        Vec3 c = dir * r;
+        l.power = 2.0f * std::exp(1.5f * gaussian(rng)) / float(count) * 64.0f;
+
+        if (rng.uniform() < pointFraction) {
+            l.type = Light::Point;
+            l.p0 = c;
+            continue;
+        }
+
+        Vec3 facing = normalize(-dir + Vec3{gaussian(rng), gaussian(rng), gaussian(rng)} * 0.5f);
+        Vec3 t, b;
+        orthonormal_basis(facing, t, b);
+        float s = 0.02f + 0.08f * rng.uniform();
+        float a0 = 2.0f * PI * rng.uniform();
+        auto corner = [&](float a) { return c + (t * std::cos(a) + b * std::sin(a)) * s; };
+
+        l.type = Light::Triangle;
+        l.p0 = corner(a0);
+        l.p1 = corner(a0 + 2.0f * PI / 3.0f);
+        l.p2 = corner(a0 + 4.0f * PI / 3.0f);
+        Vec3 cr = cross(l.p1 - l.p0, l.p2 - l.p0);
+        l.area = 0.5f * length(cr);
+        l.n = normalize(cr);
+    }
+    return lights;
+}
+
+/* ================= Orientation cones ================= */
+
+// Directions within theta_o of the axis emit into a further theta_e
+// (pi/2 for Lambertian emitters).
+struct Cone {
+    Vec3  axis{0.0f, 0.0f, 1.0f};
+    float thetaO = 0.0f;
+    float thetaE = 0.0f;
+};
+
+static Cone light_cone(const Light& l) {
+    if (l.type == Light::Point) return {{0.0f, 0.0f, 1.0f}, PI, PI / 2.0f};
+    return {l.n, 0.0f, PI / 2.0f};
+}
+
+// Smallest cone containing both (Estevez & Kulla, Algorithm 1).
+static Cone cone_union(Cone a, Cone b) {
+    if (b.thetaO > a.thetaO) std::swap(a, b);
+
+    float thetaD = std::acos(std::clamp(dot(a.axis, b.axis), -1.0f, 1.0f));
+    float thetaE = std::max(a.thetaE, b.thetaE);
+    if (std::min(thetaD + b.thetaO, PI) <= a.thetaO) return {a.axis, a.thetaO, thetaE};
+
+    float thetaO = 0.5f * (a.thetaO + thetaD + b.thetaO);
+    if (thetaO >= PI) return {a.axis, PI, thetaE};
+
+    // Rotate a.axis towards b.axis by thetaO - a.thetaO.
+    float thetaR = thetaO - a.thetaO;
+    Vec3 w = b.axis - a.axis * dot(a.axis, b.axis);
+    if (dot(w, w) < 1e-12f) {
+        Vec3 t, u;
+        orthonormal_basis(a.axis, t, u);
+        w = t;
+    }
+    w = normalize(w);
+    return {normalize(a.axis * std::cos(thetaR) + w * std::sin(thetaR)), thetaO, thetaE};
+}
+
+// Solid-angle measure of a cone's emission (M_Omega).
+static float cone_measure(const Cone& c) {
+    float thetaW = std::min(c.thetaO + c.thetaE, PI);
+    float so = std::sin(c.thetaO), co = std::cos(c.thetaO);
+    return 2.0f * PI * (1.0f - co) +
+           0.5f * PI * (2.0f * thetaW * so - std::cos(c.thetaO - 2.0f * thetaW) - 2.0f * c.thetaO * so + co);
+}
+
+/* ================= Light BVH ================= */
+
+struct LightNode {
+    Aabb     box;
+    Cone     cone;
+    float    power = 0.0f;
+    uint32_t child[2] = {INVALID, INVALID}; // child[0] = light index for leaves
+    bool     leaf = false;
+};
+
+struct LightBvh {
+    std::vector<LightNode> nodes;
+    std::vector<uint32_t>  depthOf; // per light, for reporting
+};
+
+struct LightBuildRef {
+    uint32_t light;
+    Aabb     box;
+    Cone     cone;
+    Vec3     centroid;
+};
+
+static constexpr int LIGHT_BINS = 12;
+
+static uint32_t build_light_node(LightBvh& bvh, const std::vector<Light>& lights,
+                                 std::vector<LightBuildRef>& refs, size_t begin, size_t end, uint32_t depth) {
+    uint32_t index = uint32_t(bvh.nodes.size());
+    bvh.nodes.emplace_back();
+
+    LightNode node;
+    Aabb cbox;
+    node.cone = refs[begin].cone;
+    for (size_t i = begin; i < end; ++i) {
+        node.box.grow(refs[i].box);
+        cbox.grow(refs[i].centroid);
+        node.power += lights[refs[i].light].power;
+        if (i > begin) node.cone = cone_union(node.cone, refs[i].cone);
+    }
+
+    if (end - begin == 1) {
+        node.leaf = true;
+        node.child[0] = refs[begin].light;
+        bvh.depthOf[refs[begin].light] = depth;
+        bvh.nodes[index] = node;
+        return index;
+    }
+
+    // Binned split over all three axes. The regularizer Kr penalises thin
+    // slabs along short axes as in the paper.
+    Vec3 ext = node.box.mx - node.box.mn;
+    float maxExt = std::max(ext.x, std::max(ext.y, ext.z));
+    float bestCost = INF;
+    int bestAxis = -1, bestBin = 0;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = cbox.mn[axis], hi = cbox.mx[axis];
+        if (hi - lo <= 1e-9f) continue;
+
+        struct Bin { Aabb box; Cone cone; float power = 0.0f; uint32_t count = 0; };
+        Bin bins[LIGHT_BINS];
+        float scale = float(LIGHT_BINS) / (hi - lo);
+        for (size_t i = begin; i < end; ++i) {
+            int b = std::min(LIGHT_BINS - 1, int((refs[i].centroid[axis] - lo) * scale));
+            Bin& bin = bins[b];
+            bin.cone = bin.count ? cone_union(bin.cone, refs[i].cone) : refs[i].cone;
+            bin.box.grow(refs[i].box);
+            bin.power += lights[refs[i].light].power;
+            bin.count++;
+        }
+
+        for (int split = 1; split < LIGHT_BINS; ++split) {
+            Bin l, r;
+            for (int b = 0; b < LIGHT_BINS; ++b) {
+                if (!bins[b].count) continue;
+                Bin& side = b < split ? l : r;
+                side.cone = side.count ? cone_union(side.cone, bins[b].cone) : bins[b].cone;
+                side.box.grow(bins[b].box);
+                side.power += bins[b].power;
+                side.count += bins[b].count;
+            }
+            if (!l.count || !r.count) continue;
+
+            float kr = ext[axis] > 0.0f ? maxExt / ext[axis] : 1.0f;
+            float cost = kr * (l.power * (l.box.area() + 1e-6f) * cone_measure(l.cone) +
+                               r.power * (r.box.area() + 1e-6f) * cone_measure(r.cone));
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = split;
+            }
+        }
+    }
+
+    size_t mid;
+    if (bestAxis >= 0) {
+        float lo = cbox.mn[bestAxis];
+        float scale = float(LIGHT_BINS) / (cbox.mx[bestAxis] - lo);
+        auto it = std::partition(refs.begin() + begin, refs.begin() + end, [&](const LightBuildRef& r) {
+            return std::min(LIGHT_BINS - 1, int((r.centroid[bestAxis] - lo) * scale)) < bestBin;
+        });
+        mid = size_t(it - refs.begin());
+    } else {
+        mid = (begin + end) / 2; // coincident centroids
+    }
+
+    node.child[0] = build_light_node(bvh, lights, refs, begin, mid, depth + 1);
+    node.child[1] = build_light_node(bvh, lights, refs, mid, end, depth + 1);
+    bvh.nodes[index] = node;
+    return index;
+}
+
+static LightBvh build_light_bvh(const std::vector<Light>& lights) {
+    LightBvh bvh;
+    if (lights.empty()) return bvh;
+
+    std::vector<LightBuildRef> refs(lights.size());
+    for (uint32_t i = 0; i < lights.size(); ++i) {
+        refs[i] = {i, lights[i].bounds(), light_cone(lights[i]), lights[i].centroid()};
+    }
+    bvh.nodes.reserve(2 * lights.size());
+    bvh.depthOf.assign(lights.size(), 0);
+    build_light_node(bvh, lights, refs, 0, refs.size(), 0);
+    return bvh;
+}
+
+// cos(max(0, a - b)) from cosines and sines, without acos.
+static inline float cos_sub_clamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) return 1.0f;
+    return cosA * cosB + sinA * sinB;
+}
+
+// Conservative contribution estimate of a node at shading point p with
+// normal n (pbrt-v4 LightBounds::Importance, one-sided receiver).
+static float node_importance(const LightNode& node, Vec3 p, Vec3 n) {
+    Vec3 pc = node.box.center();
+    Vec3 diag = node.box.mx - node.box.mn;
+    float r2 = 0.25f * dot(diag, diag);
+    Vec3 toP = p - pc;
+    float d2 = dot(toP, toP);
+
+    // Every direction from p into the box lies within theta_b of the centre.
+    float cosB = -1.0f, sinB = 0.0f;
+    if (d2 > r2) {
+        float sin2 = r2 / d2;
+        sinB = std::sqrt(sin2);
+        cosB = std::sqrt(1.0f - sin2);
+    }
+    Vec3 w = d2 > 0.0f ? toP * (1.0f / std::sqrt(d2)) : Vec3{0.0f, 0.0f, 1.0f};
+
+    // Emitter side: angle between the cone and p, reduced by theta_o and theta_b.
+    float cosW = dot(node.cone.axis, w);
+    float sinW = std::sqrt(std::max(0.0f, 1.0f - cosW * cosW));
+    float cosO = std::cos(node.cone.thetaO), sinO = std::sin(node.cone.thetaO);
+    float cosWO = cos_sub_clamped(sinW, cosW, sinO, cosO);
+    float sinWO = cosW > cosO ? 0.0f : sinW * cosO - cosW * sinO;
+    float cosX = cos_sub_clamped(sinWO, cosWO, sinB, cosB);
+    if (cosB < 0.0f) cosX = 1.0f; // p inside the bounds
+    if (cosX <= std::cos(node.cone.thetaE)) return 0.0f;
+
+    // Receiver side: the incident direction is within theta_b of -w.
+    float cosI = -dot(n, w);
+    float sinI = std::sqrt(std::max(0.0f, 1.0f - cosI * cosI));
+    float cosIb = cosB < 0.0f ? 1.0f : cos_sub_clamped(sinI, cosI, sinB, cosB);
+    if (cosIb <= 0.0f) return 0.0f;
+
+    return node.power * cosX * cosIb / std::max(d2, r2);
+}
+
+// Walks root -> leaf once; returns the light and its selection probability.
+static uint32_t sample_light_bvh(const LightBvh& bvh, Vec3 p, Vec3 n, float u, float& pdf) {
+    pdf = 1.0f;
+    uint32_t idx = 0;
+    if (bvh.nodes.empty() || node_importance(bvh.nodes[0], p, n) <= 0.0f) return INVALID;
+
+    for (;;) {
+        const LightNode& node = bvh.nodes[idx];
+        if (node.leaf) return node.child[0];
+
+        float i0 = node_importance(bvh.nodes[node.child[0]], p, n);
+        float i1 = node_importance(bvh.nodes[node.child[1]], p, n);
+        if (i0 + i1 <= 0.0f) return INVALID;
+
+        float p0 = i0 / (i0 + i1);
+        if (u < p0) {
+            u = std::min(u / p0, 0x1.fffffep-1f);
+            pdf *= p0;
+            idx = node.child[0];
+        } else {
+            u = std::min((u - p0) / (1.0f - p0), 0x1.fffffep-1f);
+            pdf *= 1.0f - p0;
+            idx = node.child[1];
+        }
+    }
+}
+
+/* ================= Shading ================= */
+
+enum class Strategy { Uniform, Power, Bvh };
+
+struct Sampler {
+    const std::vector<Light>& lights;
+    const LightBvh& tree;
+    std::vector<float> powerCdf;
+
+    Sampler(const std::vector<Light>& l, const LightBvh& t) : lights(l), tree(t) {
+        powerCdf.resize(l.size());
+        double acc = 0.0;
+        for (size_t i = 0; i < l.size(); ++i) {
+            acc += l[i].power;
+            powerCdf[i] = float(acc);
+        }
+    }
+
+    uint32_t pick(Strategy s, Vec3 p, Vec3 n, float u, float& pdf) const {
+        const uint32_t count = uint32_t(lights.size());
+        switch (s) {
+        case Strategy::Uniform: {
+            pdf = 1.0f / float(count);
+            return std::min(uint32_t(u * float(count)), count - 1);
+        }
+        case Strategy::Power: {
+            float target = u * powerCdf.back();
+            uint32_t i = uint32_t(std::upper_bound(powerCdf.begin(), powerCdf.end(), target) - powerCdf.begin());
+            i = std::min(i, count - 1);
+            pdf = lights[i].power / powerCdf.back();
+            return i;
+        }
+        case Strategy::Bvh:
+            return sample_light_bvh(tree, p, n, u, pdf);
+        }
+        return INVALID;
+    }
+};
+
+struct SampleOut {
+    float value = 0.0f;
+    bool  shadowRay = false;
+};
+
+// One light sample with one shadow ray; diffuse receiver, albedo 0.8.
+static SampleOut shade_one(const Bvh4& bvh, const Triangles& tris, const Sampler& sampler,
+                           Strategy strategy, Vec3 p, Vec3 n, Rng& rng) {
+    SampleOut out;
+    float pdf;
+    uint32_t li = sampler.pick(strategy, p, n, rng.uniform(), pdf);
+    float u1 = rng.uniform(), u2 = rng.uniform();
+    if (li == INVALID || pdf <= 0.0f) return out;
+    const Light& l = sampler.lights[li];
+
+    Vec3 x;
+    float emit; // intensity towards p, with the 1/A area pdf folded in for triangles
+    if (l.type == Light::Point) {
+        x = l.p0;
+        emit = l.power / (4.0f * PI);
+    } else {
+        float su = std::sqrt(u1);
+        x = l.p0 * (1.0f - su) + l.p1 * (su * (1.0f - u2)) + l.p2 * (su * u2);
+        emit = 0.0f; // needs the direction, see below
+    }
+
+    Vec3 d = x - p;
+    float dist2 = dot(d, d);
+    float dist = std::sqrt(dist2);
+    Vec3 wi = d * (1.0f / dist);
+    float cosS = dot(n, wi);
+    if (cosS <= 0.0f) return out;
+
+    if (l.type == Light::Triangle) {
+        float cosL = -dot(l.n, wi);
+        if (cosL <= 0.0f) return out;
+        // Le = power / (pi A); area sampling pdf 1/A cancels A.
+        emit = l.power / PI * cosL;
+    }
+
+    out.shadowRay = true;
+    Ray sr{p + n * 1e-4f, wi, 0.0f, dist * (1.0f - 1e-4f)};
+    if (trace_occluded(bvh, tris, sr)) return out;
+
+    const float albedo = 0.8f;
+    out.value = albedo / PI * emit * cosS / dist2 / pdf;
+    return out;
+}
+
+/* ================= Main ================= */
+
+struct StrategyResult {
+    double mean = 0.0;        // average pixel value
+    double variance = 0.0;    // average per-pixel variance of one sample
+    double relStd = 0.0;      // average per-pixel std / mean
+    double shadowRays = 0.0;  // shadow rays per sample
+    double ms = 0.0;
+};
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string bvhPath = args.str("bvh", "data/BVH4_wide.bin");
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    uint32_t lightCount = std::max(args.u32("lights", 4096), 1u);
+    float pointFraction = float(args.num("point-fraction", 0.5));
+    uint32_t spp = std::max(args.u32("spp", 32), 2u);
+    uint64_t seed = args.u32("seed", 1);
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    Bvh4 bvh;
+    if (!load_bvh4(bvhPath.c_str(), bvh)) {
+        std::cerr << "Failed to read BVH4 " << bvhPath << "\n";
+        return 1;
+    }
+
+    std::vector<Light> lights = make_lights(lightCount, pointFraction, seed);
+
+    auto t0 = std::chrono::steady_clock::now();
+    LightBvh tree = build_light_bvh(lights);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    uint32_t maxDepth = 0;
+    double avgDepth = 0.0;
+    for (uint32_t d : tree.depthOf) {
+        maxDepth = std::max(maxDepth, d);
+        avgDepth += d;
+    }
+    avgDepth /= double(lights.size());
+
+    std::cout << "scene: " << scenePath << " (" << tris.count() << " tris)\n"
+              << "lights: " << lights.size() << " (" << pointFraction * 100.0f << "% points), light BVH: "
+              << tree.nodes.size() << " nodes, depth avg " << avgDepth << " max " << maxDepth
+              << ", built in " << buildMs << " ms\n";
+
+    // Primary hits of the default camera.
+    Camera cam;
+    std::vector<Vec3> hitP, hitN;
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x) {
+            Ray r = primary_ray(cam, float(x), float(y), width, height);
+            Hit h = trace_closest(bvh, tris, r);
+            if (!h.hit()) continue;
+            Vec3 n = tris.normal(h.tri);
+            if (dot(n, r.dir) > 0.0f) n = -n;
+            hitP.push_back(r.origin + r.dir * h.t);
+            hitN.push_back(n);
+        }
+    std::cout << "shading points: " << hitP.size() << ", " << spp << " samples each\n\n";
+    if (hitP.empty()) {
+        std::cerr << "The camera sees no geometry; nothing to shade\n";
+        return 1;
+    }
+
+    Sampler sampler(lights, tree);
+    const Strategy strategies[] = {Strategy::Uniform, Strategy::Power, Strategy::Bvh};
+    const char* names[] = {"uniform", "power", "light BVH"};
+    StrategyResult results[3];
+
+    for (int s = 0; s < 3; ++s) {
+        const size_t n = hitP.size();
+        std::vector<double> mean(n), var(n), rays(n);
+
+        auto ts = std::chrono::steady_clock::now();
+        parallel_for(0, n, 64, [&](size_t i) {
+            double s1 = 0.0, s2 = 0.0;
+            uint32_t shadow = 0;
+            for (uint32_t k = 0; k < spp; ++k) {
+                Rng rng(seed ^ (uint64_t(k) << 32), i);
+                SampleOut o = shade_one(bvh, tris, sampler, strategies[s], hitP[i], hitN[i], rng);
+                s1 += o.value;
+                s2 += double(o.value) * o.value;
+                shadow += o.shadowRay;
+            }
+            mean[i] = s1 / spp;
+            var[i] = std::max(0.0, (s2 - s1 * s1 / spp) / (spp - 1));
+            rays[i] = double(shadow) / spp;
+        });
+        results[s].ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ts).count();
+
+        size_t lit = 0;
+        for (size_t i = 0; i < n; ++i) {
+            results[s].mean += mean[i];
+            results[s].variance += var[i];
+            results[s].shadowRays += rays[i];
+            if (mean[i] > 0.0) {
+                results[s].relStd += std::sqrt(var[i]) / mean[i];
+                lit++;
+            }
+        }
+        results[s].mean /= double(n);
+        results[s].variance /= double(n);
+        results[s].shadowRays /= double(n);
+        results[s].relStd /= double(std::max<size_t>(lit, 1));
+    }
+
+    std::printf("%-10s %12s %14s %10s %12s %10s %14s\n", "strategy", "mean", "var/sample", "rel std",
+                "rays/sample", "ms", "var x shadow");
+    for (int s = 0; s < 3; ++s) {
+        const StrategyResult& r = results[s];
+        std::printf("%-10s %12.6f %14.6g %10.4f %12.3f %10.1f %14.6g\n", names[s], r.mean, r.variance,
+                    r.relStd, r.shadowRays, r.ms, r.variance * r.shadowRays);
+    }
+
+    // Equal shadow-ray budget: variance of the mean after one shadow ray's
+    // worth of samples, relative to uniform.
+    const StrategyResult& u = results[0];
+    std::cout << "\nnoise per shadow ray vs uniform (variance ratio, lower is better):\n";
+    for (int s = 1; s < 3; ++s) {
+        double ratio = (results[s].variance * results[s].shadowRays) / std::max(u.variance * u.shadowRays, 1e-30);
+        double timeRatio = (results[s].variance * results[s].ms) / std::max(u.variance * u.ms, 1e-30);
+        std::printf("  %-10s %8.4f  (%.1fx fewer shadow rays, %.1fx at equal time)\n", names[s], ratio,
+                    1.0 / ratio, 1.0 / timeRatio);
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+// lod.cpp
+// Rays/s vs image error for ray-cone LOD traversal (lod.hpp) along a camera
+// path that orbits the scene while dollying out.
+//
+// Every frame is rendered once with exact traversal (the reference) and once
+// per LOD scale. Primary rays carry the pixel cone; the sun shadow ray starts
+// with the primary footprint and widens by --spread radians, standing in for
+// a rough secondary bounce.
+//
+//   bin/test data/BVH2.bin data/BVH4_wide.bin --scene public/assets/dragon.glb --lod data/BVH4_lod.bin
+//   bin/lod [--scene public/assets/dragon.glb] [--bvh data/BVH4_wide.bin]
+//           [--lod data/BVH4_lod.bin] [--size 320x180] [--frames 12]
+//           [--near 2.5] [--far 40] [--scales 0.5,1,2,4] [--spread 0.05]
+//           [--out DIR]
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "image.hpp"
+#include "lod.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t TILE = 16;
+
+struct FrameStats {
+    double   ms = 0.0;
+    uint64_t rays = 0;
+    uint64_t nodes = 0;
+    uint64_t lodHits = 0;
+};
+
+// shade() from renderer.wgsl plus a hard sun shadow.
+static FrameStats render(const Bvh4& bvh, const std::vector<NodeLod>& lod, const Triangles& tris,
+                         const Camera& cam, float lodScale, float spread, ImageRGB& img) {
+    const Vec3 base{0.9f, 0.7f, 0.3f};
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    const uint32_t w = img.width, h = img.height;
+    const float pixelSpread = pixel_spread(cam, h);
+
+    std::vector<FrameStats> perWorker(worker_count());
+    auto t0 = std::chrono::steady_clock::now();
+
+    parallel_for_tiles(w, h, TILE, [&](Tile tl, unsigned worker) {
+        FrameStats& fs = perWorker[worker];
+        TraceStats ts;
+        for (uint32_t y = tl.y0; y < tl.y1; ++y)
+            for (uint32_t x = tl.x0; x < tl.x1; ++x) {
+                size_t i = size_t(y) * w + x;
+                uint64_t seed = uint64_t(i) * 0x2545F4914F6CDD1Dull;
+
+                Ray r = primary_ray(cam, float(x), float(y), w, h);
+                RayCone cone{0.0f, pixelSpread};
+                LodHit hit = trace_lod(bvh, lod, tris, r, cone, lodScale, false, seed, &ts);
+                fs.rays++;
+                if (!hit.hit()) {
+                    img.r[i] = img.g[i] = img.b[i] = 0.0f;
+                    continue;
+                }
+                fs.lodHits += hit.node != INVALID;
+
+                Vec3 n = hit.normal;
+                if (dot(n, r.dir) > 0.0f) n = -n;
+                float ndotl = std::max(dot(n, lightDir), 0.0f);
+
+                if (ndotl > 0.0f) {
+                    // An aggregate's plane can sit below the real surface by
+                    // up to the footprint, so lift its shadow rays that far.
+                    float bias = hit.node != INVALID ? cone.at(hit.t) : 1e-4f;
+                    Ray sr{r.origin + r.dir * hit.t + n * bias, lightDir, 0.0f, INF};
+                    RayCone sc{cone.at(hit.t), spread};
+                    fs.rays++;
+                    if (trace_lod(bvh, lod, tris, sr, sc, lodScale, true, seed ^ 0x5Bull, &ts).hit()) ndotl = 0.0f;
+                }
+                img.r[i] = base.x * (0.15f + ndotl);
+                img.g[i] = base.y * (0.15f + ndotl);
+                img.b[i] = base.z * (0.15f + ndotl);
+            }
+        fs.nodes += ts.nodes;
+    });
+
+    FrameStats total;
+    total.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    for (const FrameStats& fs : perWorker) {
+        total.rays += fs.rays;
+        total.nodes += fs.nodes;
+        total.lodHits += fs.lodHits;
+    }
+    return total;
+}
+
+// Camera on a circle of radius `dist` around the origin, looking at it.
+static Camera path_camera(float dist, float yawDeg) {
+    float a = yawDeg * 3.14159265358979f / 180.0f;
+    Camera cam;
+    cam.pos = {dist * std::sin(a), 0.0f, dist * std::cos(a)};
+    cam.quat[0] = 0.0f;
+    cam.quat[1] = std::sin(0.5f * a);
+    cam.quat[2] = 0.0f;
+    cam.quat[3] = std::cos(0.5f * a);
+    return cam;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string bvhPath = args.str("bvh", "data/BVH4_wide.bin");
+    std::string lodPath = args.str("lod", "data/BVH4_lod.bin");
+    std::string outDir = args.str("out", "");
+
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    uint32_t frames = std::max(args.u32("frames", 12), 1u);
+    float nearDist = float(args.num("near", 2.5));
+    float farDist = float(args.num("far", 40.0));
+    float spread = float(args.num("spread", 0.05));
+    std::vector<double> scales = args.nums("scales", "0.5,1,2,4");
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    Bvh4 bvh;
+    if (!load_bvh4(bvhPath.c_str(), bvh)) {
+        std::cerr << "Failed to read BVH4 " << bvhPath << "\n";
+        return 1;
+    }
+
+    std::vector<NodeLod> lod;
+    if (!load_lod(lodPath.c_str(), lod) || lod.size() != bvh.nodes.size()) {
+        std::cerr << "Failed to read LOD " << lodPath << " for " << bvhPath
+                  << " (write it with: bin/test <bvh2> <bvh4> --scene <mesh> --lod " << lodPath << ")\n";
+        return 1;
+    }
+
+    std::cout << "scene: " << scenePath << " (" << tris.count() << " tris), " << frames
+              << " frames at " << width << "x" << height << ", distance " << nearDist << " -> " << farDist
+              << ", shadow spread " << spread << " rad, " << worker_count() << " threads\n\n";
+
+    const size_t S = scales.size();
+    std::vector<FrameStats> sumLod(S);
+    std::vector<double> sumErr(S, 0.0), maxErr(S, 0.0);
+    FrameStats sumRef;
+
+    std::printf("%5s %7s %10s", "frame", "dist", "ref Mray/s");
+    for (double s : scales) std::printf("   x%-4g speedup   RMSE", s);
+    std::printf("\n");
+
+    ImageRGB ref, img;
+    ref.resize(width, height);
+    img.resize(width, height);
+
+    for (uint32_t f = 0; f < frames; ++f) {
+        float t = frames > 1 ? float(f) / float(frames - 1) : 0.0f;
+        float dist = nearDist * std::pow(farDist / nearDist, t);
+        Camera cam = path_camera(dist, 360.0f * t);
+
+        FrameStats rs = render(bvh, lod, tris, cam, 0.0f, spread, ref);
+        sumRef.ms += rs.ms;
+        sumRef.rays += rs.rays;
+        sumRef.nodes += rs.nodes;
+        std::printf("%5u %7.2f %10.3f", f, dist, rs.rays / rs.ms * 1e-3);
+
+        for (size_t k = 0; k < S; ++k) {
+            FrameStats ls = render(bvh, lod, tris, cam, float(scales[k]), spread, img);
+            double err = rmse(ref, img);
+            sumLod[k].ms += ls.ms;
+            sumLod[k].rays += ls.rays;
+            sumLod[k].nodes += ls.nodes;
+            sumLod[k].lodHits += ls.lodHits;
+            sumErr[k] += err;
+            maxErr[k] = std::max(maxErr[k], err);
+            std::printf("   %13.2fx %7.4f", (ls.rays / ls.ms) / (rs.rays / rs.ms), err);
+
+            if (!outDir.empty()) {
+                std::string path = outDir + "/lod_x" + std::to_string(scales[k]) + "_" + std::to_string(f) + ".ppm";
+                write_ppm(path.c_str(), img);
+            }
+        }
+        std::printf("\n");
+        if (!outDir.empty()) write_ppm((outDir + "/ref_" + std::to_string(f) + ".ppm").c_str(), ref);
+    }
+
+    std::printf("\n%-10s %10s %12s %12s %10s %10s\n", "mode", "Mrays/s", "nodes/ray", "LOD hits %", "mean RMSE",
+                "max RMSE");
+    std::printf("%-10s %10.3f %12.2f %12s %10s %10s\n", "exact", sumRef.rays / sumRef.ms * 1e-3,
+                double(sumRef.nodes) / sumRef.rays, "-", "-", "-");
+    for (size_t k = 0; k < S; ++k) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "lod x%g", scales[k]);
+        std::printf("%-10s %10.3f %12.2f %12.2f %10.4f %10.4f\n", name, sumLod[k].rays / sumLod[k].ms * 1e-3,
+                    double(sumLod[k].nodes) / sumLod[k].rays, 100.0 * sumLod[k].lodHits / sumLod[k].rays,
+                    sumErr[k] / frames, maxErr[k]);
+    }
+    return 0;
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+// lod.hpp
+// Per-node aggregate LOD for the BVH4 and a ray-cone traversal that stops
+// at nodes smaller than the ray's footprint.
+//
+// The converter writes one record per BVH4 node (same indices), next to
+// BVH4_wide.bin:
+//
+//   u32[0]          node count
+//   lod (4 u32)     normal | plane | coverage | area
+//
+//   normal    area-weighted average normal, octahedral pack2x16snorm
+//   plane     f32 offset d of the representative plane dot(n, x) = d
+//             through the area-weighted centroid
+//   coverage  f32 fraction of the plane-box cross-section polygon that the
+//             node's triangles cover when projected onto the plane
+//   area      f32 total triangle area
+//
+// Nodes that were never reached from the root (promotion orphans) keep
+// coverage 0, which also makes them invisible to the LOD test.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t LOD_STRIDE_U32 = 4;
+
+struct NodeLod {
+    Vec3  normal{0.0f, 0.0f, 1.0f};
+    float plane = 0.0f;
+    float coverage = 0.0f;
+    float area = 0.0f;
+};
+
+/* ================= Octahedral normals ================= */
+
+static inline float snorm16_to_f32(uint32_t v) {
+    return std::max(float(int16_t(uint16_t(v))) / 32767.0f, -1.0f);
+}
+
+static inline uint32_t f32_to_snorm16(float v) {
+    return uint32_t(uint16_t(int16_t(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f))));
+}
+
+static inline uint32_t oct_encode(Vec3 n) {
+    float s = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    float u = n.x / s, v = n.y / s;
+    if (n.z < 0.0f) {
+        float pu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float pv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = pu;
+        v = pv;
+    }
+    return f32_to_snorm16(u) | (f32_to_snorm16(v) << 16);
+}
+
+static inline Vec3 oct_decode(uint32_t packed) {
+    float u = snorm16_to_f32(packed & 0xFFFFu), v = snorm16_to_f32(packed >> 16);
+    Vec3 n{u, v, 1.0f - std::fabs(u) - std::fabs(v)};
+    if (n.z < 0.0f) {
+        float pu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float pv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        n.x = pu;
+        n.y = pv;
+    }
+    return normalize(n);
+}
+
+/* ================= Build ================= */
+
+// Area of the polygon where the plane dot(n, x) = d cuts the box: the
+// edge crossings, ordered by angle around their centroid.
+static inline float plane_box_area(const Aabb& b, Vec3 n, float d) {
+    Vec3 pts[12];
+    int count = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (int k = 0; k < 4; ++k) {
+            Vec3 p0, p1;
+            p0[u] = p1[u] = (k & 1) ? b.mx[u] : b.mn[u];
+            p0[v] = p1[v] = (k & 2) ? b.mx[v] : b.mn[v];
+            p0[axis] = b.mn[axis];
+            p1[axis] = b.mx[axis];
+            float s0 = dot(n, p0) - d, s1 = dot(n, p1) - d;
+            if ((s0 < 0.0f) == (s1 < 0.0f) || s0 == s1) continue;
+            pts[count++] = p0 + (p1 - p0) * (s0 / (s0 - s1));
+        }
+    }
+    if (count < 3) return 0.0f;
+
+    Vec3 c{0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < count; ++i) c = c + pts[i];
+    c = c * (1.0f / float(count));
+    Vec3 t, bt;
+    orthonormal_basis(n, t, bt);
+    float ang[12];
+    for (int i = 0; i < count; ++i) ang[i] = std::atan2(dot(pts[i] - c, bt), dot(pts[i] - c, t));
+    for (int i = 1; i < count; ++i)
+        for (int j = i; j > 0 && ang[j] < ang[j - 1]; --j) {
+            std::swap(ang[j], ang[j - 1]);
+            std::swap(pts[j], pts[j - 1]);
+        }
+
+    Vec3 acc{0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < count; ++i) acc = acc + cross(pts[i] - c, pts[(i + 1) % count] - c);
+    return 0.5f * std::fabs(dot(acc, n));
+}
+
+// Aggregates over each node's subtree. A depth-first walk lays the reachable
+// leaves out so every subtree is a contiguous triangle range; area, normal
+// and centroid sums then come from prefix sums, and the coverage pass (which
+// needs the node's own normal) runs over each range in parallel.
+static inline std::vector<NodeLod> build_lod(const Bvh4& bvh, const Triangles& tris) {
+    TIMELINE_ZONE("lod build");
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    std::vector<NodeLod> lod(numNodes);
+    if (numNodes == 0) return lod;
+
+    std::vector<uint32_t> order;             // triangles in DFS order
+    std::vector<uint32_t> first(numNodes, 0), last(numNodes, 0);
+    std::vector<uint8_t> reached(numNodes, 0);
+
+    struct Item { uint32_t node; bool exit; };
+    std::vector<Item> stack{{0, false}};
+    order.reserve(tris.count());
+
+    while (!stack.empty()) {
+        Item it = stack.back();
+        stack.pop_back();
+        const Bvh4Node& node = bvh.nodes[it.node];
+
+        if (it.exit) {
+            last[it.node] = uint32_t(order.size());
+            continue;
+        }
+        if (reached[it.node]) continue; // shared child: count it once
+        reached[it.node] = 1;
+        first[it.node] = uint32_t(order.size());
+
+        if (node.leaf()) {
+            if (node.tri() < tris.count()) order.push_back(node.tri());
+            last[it.node] = uint32_t(order.size());
+            continue;
+        }
+        stack.push_back({it.node, true});
+        for (int c = 3; c >= 0; --c) {
+            uint32_t ci = node.child[c];
+            if (ci != INVALID && ci < numNodes) stack.push_back({ci, false});
+        }
+    }
+
+    // Prefix sums (double: they span the whole mesh) over the DFS order
+    // make every subtree sum O(1).
+    struct Sum { double a, nx, ny, nz, cx, cy, cz; };
+    const size_t n = order.size();
+    std::vector<Sum> prefix(n + 1, Sum{0, 0, 0, 0, 0, 0, 0});
+    std::vector<Vec3> triN(n);
+    std::vector<float> triA(n);
+    for (size_t k = 0; k < n; ++k) {
+        uint32_t t = order[k];
+        Vec3 a = tris.vertex(t, 0);
+        Vec3 cr = cross(tris.vertex(t, 1) - a, tris.vertex(t, 2) - a);
+        triA[k] = 0.5f * length(cr);
+        triN[k] = normalize(cr);
+        Vec3 c = tris.centroid(t);
+        const Sum& p = prefix[k];
+        double w = triA[k];
+        prefix[k + 1] = {p.a + w, p.nx + w * triN[k].x, p.ny + w * triN[k].y, p.nz + w * triN[k].z,
+                         p.cx + w * c.x, p.cy + w * c.y, p.cz + w * c.z};
+    }
+
+    parallel_for(0, numNodes, 4096, [&](size_t ni) {
+        if (!reached[ni]) return;
+        uint32_t b = first[ni], e = last[ni];
+        if (e <= b) return;
+
+        NodeLod& out = lod[ni];
+        const Sum& pb = prefix[b];
+        const Sum& pe = prefix[e];
+        double area = pe.a - pb.a;
+        Vec3 nsum{float(pe.nx - pb.nx), float(pe.ny - pb.ny), float(pe.nz - pb.nz)};
+        Vec3 csum{float(pe.cx - pb.cx), float(pe.cy - pb.cy), float(pe.cz - pb.cz)};
+        const Aabb& box = bvh.nodes[ni].box;
+
+        Vec3 nrm;
+        if (length(nsum) > 1e-6f * float(area)) {
+            nrm = normalize(nsum);
+        } else {
+            // Normals cancel (closed pieces): face the box's thinnest axis.
+            Vec3 ext = box.mx - box.mn;
+            int axis = ext.x <= ext.y && ext.x <= ext.z ? 0 : (ext.y <= ext.z ? 1 : 2);
+            nrm = {axis == 0 ? 1.0f : 0.0f, axis == 1 ? 1.0f : 0.0f, axis == 2 ? 1.0f : 0.0f};
+        }
+        Vec3 centroid = area > 0.0 ? csum * float(1.0 / area) : box.center();
+
+        double projected = 0.0;
+        for (uint32_t k = b; k < e; ++k) projected += triA[k] * std::fabs(dot(triN[k], nrm));
+
+        out.normal = oct_decode(oct_encode(nrm)); // what readers will see
+        out.plane = dot(out.normal, centroid);
+        float cut = plane_box_area(box, out.normal, out.plane);
+        out.coverage = cut > 0.0f ? float(std::min(1.0, projected / cut)) : 1.0f;
+        out.area = float(area);
+    });
+    return lod;
+}
+
+/* ================= File IO ================= */
+
+static inline std::vector<uint32_t> encode_lod(const std::vector<NodeLod>& lod) {
+    std::vector<uint32_t> raw(1 + lod.size() * LOD_STRIDE_U32);
+    raw[0] = uint32_t(lod.size());
+    for (size_t i = 0; i < lod.size(); ++i) {
+        uint32_t* p = raw.data() + 1 + i * LOD_STRIDE_U32;
+        p[0] = oct_encode(lod[i].normal);
+        std::memcpy(&p[1], &lod[i].plane, 4);
+        std::memcpy(&p[2], &lod[i].coverage, 4);
+        std::memcpy(&p[3], &lod[i].area, 4);
+    }
+    return raw;
+}
+
+static inline bool load_lod(const char* path, std::vector<NodeLod>& out) {
+    std::vector<uint32_t> raw;
+    if (!load_u32_file(path, raw)) return false;
+    uint32_t count = raw[0];
+    if (size_t(1) + size_t(count) * LOD_STRIDE_U32 != raw.size()) return false;
+
+    out.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t* p = raw.data() + 1 + size_t(i) * LOD_STRIDE_U32;
+        out[i].normal = oct_decode(p[0]);
+        std::memcpy(&out[i].plane, &p[1], 4);
+        std::memcpy(&out[i].coverage, &p[2], 4);
+        std::memcpy(&out[i].area, &p[3], 4);
+    }
+    return true;
+}
+
+/* ================= Ray-cone traversal ================= */
+
+// Footprint width at distance t: width + t * spread (Akenine-Moller et al.,
+// "Improved Shader and Texture Level of Detail Using Ray Cones").
+struct RayCone {
+    float width = 0.0f;
+    float spread = 0.0f;
+
+    float at(float t) const { return width + spread * std::max(t, 0.0f); }
+};
+
+// Pixel spread angle of the renderer.wgsl camera.
+static inline float pixel_spread(const Camera& cam, uint32_t height) {
+    return 2.0f * std::tan(0.5f * cam.fovDeg * 3.14159265358979f / 180.0f) / float(height);
+}
+
+struct LodHit {
+    float    t = INF;
+    uint32_t tri = INVALID;   // set for exact hits
+    uint32_t node = INVALID;  // set when an aggregate terminated the ray
+    Vec3     normal{0.0f, 0.0f, 1.0f};
+
+    bool hit() const { return tri != INVALID || node != INVALID; }
+};
+
+// Slab test returning both ends of the overlap.
+static inline bool box_span(const Ray& r, Vec3 invDir, const Aabb& b, float& t0, float& t1) {
+    float t1x = (b.mn.x - r.origin.x) * invDir.x, t2x = (b.mx.x - r.origin.x) * invDir.x;
+    float t1y = (b.mn.y - r.origin.y) * invDir.y, t2y = (b.mx.y - r.origin.y) * invDir.y;
+    float t1z = (b.mn.z - r.origin.z) * invDir.z, t2z = (b.mx.z - r.origin.z) * invDir.z;
+    t0 = std::max(std::max(std::max(std::min(t1x, t2x), std::min(t1y, t2y)), std::min(t1z, t2z)), r.tmin);
+    t1 = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)), std::max(t1z, t2z));
+    return t1 >= t0;
+}
+
+// Stateless per-(ray, node) uniform for stochastic coverage.
+static inline float lod_hash01(uint64_t seed, uint32_t node) {
+    uint64_t z = seed ^ (uint64_t(node) * 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return float(z >> 40) * (1.0f / 16777216.0f);
+}
+
+// The shader's traversal order, except that an internal node whose box
+// diagonal is below lodScale * footprint at its entry distance is treated as
+// its aggregate: the representative plane clipped to the box, opaque with
+// probability `coverage`. Rays that miss the aggregate descend as usual
+// rather than skipping the subtree -- LBVH boxes overlap and are loose, so
+// independent per-node misses would otherwise punch holes through closed
+// surfaces. lodScale <= 0 disables the cut.
+static inline LodHit trace_lod(const Bvh4& bvh, const std::vector<NodeLod>& lod, const Triangles& tris,
+                               const Ray& ray, const RayCone& cone, float lodScale, bool anyHit,
+                               uint64_t seed, TraceStats* stats = nullptr) {
+    LodHit out;
+    out.t = ray.tmax;
+
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    const uint32_t numTris = tris.count();
+    if (numNodes == 0) { out.t = INF; return out; }
+
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+    uint32_t stack[STACK_MAX];
+    int sp = 0;
+    stack[0] = 0;
+
+    while (sp >= 0) {
+        uint32_t ni = stack[sp--];
+        const Bvh4Node& node = bvh.nodes[ni];
+        if (stats) stats->nodes++;
+        if (node.box.empty()) continue;
+
+        if (stats) stats->boxTests++;
+        float t0, t1;
+        if (!box_span(ray, invDir, node.box, t0, t1) || t0 >= out.t) continue;
+
+        if (node.leaf()) {
+            uint32_t ti = node.tri();
+            if (ti < numTris) {
+                if (stats) stats->triTests++;
+                float t = intersect_triangle(ray, tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+                if (t < out.t) {
+                    out.t = t;
+                    out.tri = ti;
+                    out.node = INVALID;
+                    if (anyHit) return out;
+                }
+            }
+            continue;
+        }
+
+        // Never cut a node the ray starts in: a secondary ray would hit the
+        // aggregate of the very surface it leaves.
+        if (lodScale > 0.0f && ni < lod.size() && t0 > ray.tmin) {
+            Vec3 diag = node.box.mx - node.box.mn;
+            if (length(diag) < lodScale * cone.at(t0)) {
+                const NodeLod& a = lod[ni];
+                float dn = dot(a.normal, ray.dir);
+                float t = std::fabs(dn) > 1e-12f ? (a.plane - dot(a.normal, ray.origin)) / dn : INF;
+                if (t >= t0 && t <= t1 && lod_hash01(seed, ni) < a.coverage) {
+                    if (t < out.t) {
+                        out.t = t;
+                        out.tri = INVALID;
+                        out.node = ni;
+                        out.normal = a.normal;
+                        if (anyHit) return out;
+                    }
+                    continue;
+                }
+            }
+        }
+
+        uint32_t childIdx[4];
+        float childDist[4];
+        uint32_t childCount = 0;
+        for (int c = 0; c < 4; ++c) {
+            uint32_t ci = node.child[c];
+            if (ci == INVALID || ci >= numNodes) continue;
+            const Aabb& cb = bvh.nodes[ci].box;
+            if (cb.empty()) continue;
+            if (stats) stats->boxTests++;
+            float d = intersect_aabb(ray, invDir, cb, out.t);
+            if (d < INF) {
+                childIdx[childCount] = ci;
+                childDist[childCount] = d;
+                childCount++;
+            }
+        }
+
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < childCount; ++i) {
+            if (childDist[i] < childDist[best]) best = i;
+        }
+        if (best != 0) std::swap(childIdx[0], childIdx[best]);
+
+        for (int i = int(childCount) - 1; i >= 0; --i) {
+            if (sp + 1 < int(STACK_MAX)) stack[++sp] = childIdx[i];
+            else if (stats) stats->stackDrops++;
+        }
+        if (stats && uint32_t(sp + 1) > stats->maxStack) stats->maxStack = uint32_t(sp + 1);
+    }
+
+    if (out.tri != INVALID) out.normal = tris.normal(out.tri);
+    if (!out.hit()) out.t = INF;
+    return out;
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+// memtrack.hpp
+// Memory instrumentation for the C++ tools: peak RSS, per-phase high-water
+// marks, and allocation counts / bytes through replaced global operator
+// new / delete.
+//
+//   RT_MEM=1 bin/test ...                 summary on stderr at exit
+//
+//   {
+//       MemPhase phase("convert");        // heap + RSS high-water of the scope
+//       for (...) {
+//           MemHotLoop hot("convert");    // must not allocate
+//           ...
+//       }
+//   }
+//   if (mem_hot_loop_violations()) return 1;
+//
+// Counts and bytes go to per-thread shards (one cache line each, claimed on
+// a thread's first allocation and recycled when it exits, like the timeline
+// buffers), so counting never contends. The live-byte total behind the heap
+// high-water mark is the one shared counter; the tools allocate few, large
+// buffers, and MemHotLoop is there to keep it that way. Sizes are
+// malloc_usable_size(), so new and delete agree without sized delete.
+//
+// RSS comes from /proc/self: a phase resets the kernel's VmHWM
+// (clear_refs 5) on entry and reads it on exit, so its RSS peak is its own.
+// The process peak is the maximum over everything read, since the reset also
+// clears the kernel's figure.
+//
+// The operator replacements must be defined once per program: include this
+// header from a single translation unit (every tool is one .cpp). Compile
+// with -DRT_MEMTRACK=0 to leave operator new alone; RSS figures still work
+// and the counters stay at zero.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "json.hpp"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+#endif
+
+#ifndef RT_MEMTRACK
+#define RT_MEMTRACK 1
+#endif
+
+struct MemCounters {
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t allocBytes = 0;
+    uint64_t freeBytes = 0;
+
+    MemCounters operator-(const MemCounters& o) const {
+        return {allocs - o.allocs, frees - o.frees, allocBytes - o.allocBytes, freeBytes - o.freeBytes};
+    }
+};
+
+struct MemPhaseStats {
+    const char* name = "";
+    MemCounters counters;       // inside the phase, all threads
+    int64_t     heapStart = 0;  // live bytes
+    int64_t     heapPeak = 0;
+    int64_t     heapEnd = 0;
+    uint64_t    rssStart = 0;   // bytes
+    uint64_t    rssPeak = 0;
+    uint64_t    rssEnd = 0;
+    bool        rssScoped = false; // rssPeak is the phase's own (clear_refs worked)
+};
+
+namespace memtrack_detail {
+
+static constexpr unsigned MAX_SHARDS = 1024;
+
+struct alignas(64) Shard {
+    std::atomic<uint64_t> allocs{0}, frees{0}, allocBytes{0}, freeBytes{0};
+    std::atomic<uint64_t> hotAllocs{0};
+    uint32_t              hotDepth = 0; // owning thread only
+};
+
+// Constant-initialized and trivially destructible, so the operators work
+// during static initialization and after static teardown.
+struct State {
+    Shard                 shards[MAX_SHARDS]; // [0] is shared by threads that find no free shard
+    std::atomic<unsigned> used{1};
+    std::atomic_flag      freeLock = ATOMIC_FLAG_INIT;
+    unsigned              freeList[MAX_SHARDS];
+    unsigned              freeCount = 0;
+    std::atomic<int64_t>  live{0};
+    std::atomic<int64_t>  peak{0};
+    std::atomic<uint64_t> rssPeak{0};
+    std::atomic<uint64_t> hotViolations{0};
+    std::atomic<const char*> firstHotLoop{nullptr};
+};
+
+static inline State& state() {
+    static State s;
+    return s;
+}
+
+static inline unsigned claim_shard() {
+    State& s = state();
+    while (s.freeLock.test_and_set(std::memory_order_acquire)) {}
+    unsigned idx = s.freeCount ? s.freeList[--s.freeCount] : 0;
+    s.freeLock.clear(std::memory_order_release);
+    if (idx) return idx;
+    idx = s.used.fetch_add(1, std::memory_order_relaxed);
+    return idx < MAX_SHARDS ? idx : 0;
+}
+
+static inline void release_shard(unsigned idx) {
+    State& s = state();
+    if (!idx) return;
+    s.shards[idx].hotDepth = 0;
+    while (s.freeLock.test_and_set(std::memory_order_acquire)) {}
+    s.freeList[s.freeCount++] = idx;
+    s.freeLock.clear(std::memory_order_release);
+}
+
+struct Slot {
+    int  idx = -1; // -1 before the first allocation, -2 once the thread is exiting
+    ~Slot() {
+        if (idx > 0) release_shard(unsigned(idx));
+        idx = -2;
+    }
+};
+
+static inline Shard& thread_shard() {
+    thread_local Slot slot;
+    if (slot.idx == -1) slot.idx = int(claim_shard());
+    return state().shards[slot.idx < 0 ? 0 : slot.idx];
+}
+
+static inline void on_alloc(void* p) {
+#if defined(__linux__)
+    uint64_t n = malloc_usable_size(p);
+#else
+    uint64_t n = 0;
+#endif
+    Shard& sh = thread_shard();
+    sh.allocs.fetch_add(1, std::memory_order_relaxed);
+    sh.allocBytes.fetch_add(n, std::memory_order_relaxed);
+    if (sh.hotDepth) sh.hotAllocs.fetch_add(1, std::memory_order_relaxed);
+
+    State& s = state();
+    int64_t live = s.live.fetch_add(int64_t(n), std::memory_order_relaxed) + int64_t(n);
+    int64_t peak = s.peak.load(std::memory_order_relaxed);
+    while (live > peak && !s.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+static inline void on_free(void* p) {
+    if (!p) return;
+#if defined(__linux__)
+    uint64_t n = malloc_usable_size(p);
+#else
+    uint64_t n = 0;
+#endif
+    Shard& sh = thread_shard();
+    sh.frees.fetch_add(1, std::memory_order_relaxed);
+    sh.freeBytes.fetch_add(n, std::memory_order_relaxed);
+    state().live.fetch_sub(int64_t(n), std::memory_order_relaxed);
+}
+
+static inline void* alloc(size_t size, size_t align, bool nothrow) {
+    if (size == 0) size = 1;
+    void* p = nullptr;
+    if (align <= alignof(std::max_align_t)) p = std::malloc(size);
+    else if (posix_memalign(&p, align, size) != 0) p = nullptr;
+    if (!p) {
+        if (nothrow) return nullptr;
+        throw std::bad_alloc();
+    }
+    on_alloc(p);
+    return p;
+}
+
+static inline void dealloc(void* p) {
+    on_free(p);
+    std::free(p);
+}
+
+// One /proc/self file read into a stack buffer: the tracker must not
+// allocate while it measures.
+static inline size_t read_proc(const char* path, char* buf, size_t cap) {
+#if defined(__linux__)
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = ::read(fd, buf, cap - 1);
+    ::close(fd);
+    if (n <= 0) return 0;
+    buf[n] = 0;
+    return size_t(n);
+#else
+    (void)path;
+    (void)cap;
+    buf[0] = 0;
+    return 0;
+#endif
+}
+
+// A "Key:  N kB" line of a /proc file, in bytes.
+static inline uint64_t proc_kb_bytes(const char* path, const char* key) {
+    char buf[4096];
+    if (!read_proc(path, buf, sizeof(buf))) return 0;
+    const char* p = std::strstr(buf, key);
+    return p ? std::strtoull(p + std::strlen(key), nullptr, 10) * 1024 : 0;
+}
+
+// "VmHWM:" / "VmRSS:" from /proc/self/status, in bytes.
+static inline uint64_t status_bytes(const char* key) { return proc_kb_bytes("/proc/self/status", key); }
+
+static inline bool reset_rss_peak() {
+#if defined(__linux__)
+    int fd = ::open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return false;
+    bool ok = ::write(fd, "5", 1) == 1;
+    ::close(fd);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+static inline void note_rss_peak(uint64_t v) {
+    std::atomic<uint64_t>& p = state().rssPeak;
+    uint64_t cur = p.load(std::memory_order_relaxed);
+    while (v > cur && !p.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+struct PhaseLog {
+    std::mutex                 mutex;
+    std::vector<MemPhaseStats> phases;
+};
+
+// Never destroyed: the atexit report may run after static destructors.
+static inline PhaseLog& phase_log() {
+    static PhaseLog* log = new PhaseLog;
+    return *log;
+}
+
+} // namespace memtrack_detail
+
+static inline constexpr bool mem_tracking() { return RT_MEMTRACK != 0; }
+
+// Totals over every thread so far.
+static inline MemCounters mem_counters() {
+    memtrack_detail::State& s = memtrack_detail::state();
+    MemCounters c;
+    unsigned n = std::min(s.used.load(std::memory_order_relaxed), memtrack_detail::MAX_SHARDS);
+    for (unsigned i = 0; i < n; ++i) {
+        c.allocs += s.shards[i].allocs.load(std::memory_order_relaxed);
+        c.frees += s.shards[i].frees.load(std::memory_order_relaxed);
+        c.allocBytes += s.shards[i].allocBytes.load(std::memory_order_relaxed);
+        c.freeBytes += s.shards[i].freeBytes.load(std::memory_order_relaxed);
+    }
+    return c;
+}
+
+static inline int64_t mem_heap_live() { return memtrack_detail::state().live.load(std::memory_order_relaxed); }
+static inline int64_t mem_heap_peak() { return memtrack_detail::state().peak.load(std::memory_order_relaxed); }
+static inline uint64_t mem_rss() { return memtrack_detail::status_bytes("VmRSS:"); }
+
+// /proc/meminfo MemAvailable in bytes, 0 when unknown.
+static inline uint64_t mem_available() { return memtrack_detail::proc_kb_bytes("/proc/meminfo", "MemAvailable:"); }
+
+// Process peak RSS, including peaks of phases whose reset hid them from the
+// kernel's VmHWM.
+static inline uint64_t mem_rss_peak() {
+    memtrack_detail::note_rss_peak(memtrack_detail::status_bytes("VmHWM:"));
+    return memtrack_detail::state().rssPeak.load(std::memory_order_relaxed);
+}
+
+// Scoped phase; the result is available from stats() after the destructor
+// runs and is appended to mem_phases(). Phases may nest: the outer heap peak
+// is restored on exit, but the outer RSS peak then only covers the time
+// after the inner phase.
+class MemPhase {
+public:
+    explicit MemPhase(const char* name) {
+        using namespace memtrack_detail;
+        stats_.name = name;
+        start_ = mem_counters();
+        savedPeak_ = state().peak.exchange(mem_heap_live(), std::memory_order_relaxed);
+        stats_.heapStart = mem_heap_live();
+        note_rss_peak(status_bytes("VmHWM:"));
+        stats_.rssScoped = reset_rss_peak();
+        stats_.rssStart = mem_rss();
+    }
+
+    ~MemPhase() { finish(); }
+
+    // Ends the phase early; the destructor then does nothing.
+    const MemPhaseStats& finish() {
+        using namespace memtrack_detail;
+        if (done_) return stats_;
+        done_ = true;
+        stats_.counters = mem_counters() - start_;
+        stats_.heapEnd = mem_heap_live();
+        stats_.heapPeak = mem_heap_peak();
+        int64_t outer = std::max(savedPeak_, stats_.heapPeak), cur = state().peak.load(std::memory_order_relaxed);
+        while (outer > cur && !state().peak.compare_exchange_weak(cur, outer, std::memory_order_relaxed)) {}
+        stats_.rssEnd = mem_rss();
+        stats_.rssPeak = std::max(status_bytes("VmHWM:"), stats_.rssEnd);
+        note_rss_peak(stats_.rssPeak);
+        PhaseLog& log = phase_log();
+        std::lock_guard<std::mutex> lock(log.mutex);
+        log.phases.push_back(stats_);
+        return stats_;
+    }
+
+    const MemPhaseStats& stats() const { return stats_; }
+
+    MemPhase(const MemPhase&) = delete;
+    MemPhase& operator=(const MemPhase&) = delete;
+
+private:
+    MemPhaseStats stats_;
+    MemCounters   start_;
+    int64_t       savedPeak_ = 0;
+    bool          done_ = false;
+};
+
+static inline std::vector<MemPhaseStats> mem_phases() {
+    memtrack_detail::PhaseLog& log = memtrack_detail::phase_log();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    return log.phases;
+}
+
+// Marks the calling thread's scope as allocation-free. Any operator new on
+// this thread before the destructor is a violation: counted, and the first
+// offending loop's name kept for the report. Put it inside the worker
+// lambda, not around a parallel_for (which starts threads).
+class MemHotLoop {
+public:
+    explicit MemHotLoop(const char* name) : name_(name), shard_(memtrack_detail::thread_shard()) {
+        start_ = shard_.hotAllocs.load(std::memory_order_relaxed);
+        shard_.hotDepth++;
+    }
+
+    ~MemHotLoop() {
+        shard_.hotDepth--;
+        uint64_t n = shard_.hotAllocs.load(std::memory_order_relaxed) - start_;
+        if (!n || shard_.hotDepth) return; // the outermost scope reports
+        memtrack_detail::State& s = memtrack_detail::state();
+        s.hotViolations.fetch_add(n, std::memory_order_relaxed);
+        const char* none = nullptr;
+        s.firstHotLoop.compare_exchange_strong(none, name_, std::memory_order_relaxed);
+    }
+
+    MemHotLoop(const MemHotLoop&) = delete;
+    MemHotLoop& operator=(const MemHotLoop&) = delete;
+
+private:
+    const char*              name_;
+    memtrack_detail::Shard&  shard_;
+    uint64_t                 start_ = 0;
+};
+
+// Allocations made inside MemHotLoop scopes so far.
+static inline uint64_t mem_hot_loop_violations() {
+    return memtrack_detail::state().hotViolations.load(std::memory_order_relaxed);
+}
+
+// Prints the violation (if any) to `out`; true when there was one.
+static inline bool report_hot_loop_violations(FILE* out) {
+    uint64_t n = mem_hot_loop_violations();
+    if (!n) return false;
+    const char* name = memtrack_detail::state().firstHotLoop.load(std::memory_order_relaxed);
+    std::fprintf(out, "memtrack: %llu allocation(s) inside hot loops (first in \"%s\")\n", (unsigned long long)n,
+                 name ? name : "?");
+    return true;
+}
+
+/* ================= Reporting ================= */
+
+static inline void print_mem_phases(FILE* out, const std::vector<MemPhaseStats>& phases) {
+    std::fprintf(out, "%-12s %10s %10s %11s %11s %11s %11s\n", "phase", "allocs", "frees", "alloc MB", "heap +MB",
+                 "heap pk MB", "RSS pk MB");
+    for (const MemPhaseStats& p : phases)
+        std::fprintf(out, "%-12s %10llu %10llu %11.1f %+11.1f %11.1f %10.1f%s\n", p.name,
+                     (unsigned long long)p.counters.allocs, (unsigned long long)p.counters.frees,
+                     p.counters.allocBytes / 1048576.0, (p.heapEnd - p.heapStart) / 1048576.0,
+                     p.heapPeak / 1048576.0, p.rssPeak / 1048576.0, p.rssScoped ? "" : "*");
+    if (std::any_of(phases.begin(), phases.end(), [](const MemPhaseStats& p) { return !p.rssScoped; }))
+        std::fprintf(out, "* clear_refs unavailable: RSS peak since process start\n");
+}
+
+static inline void print_mem_summary(FILE* out) {
+    MemCounters c = mem_counters();
+    std::fprintf(out, "memtrack: peak RSS %.1f MB, heap peak %.1f MB, %llu allocs / %llu frees, %.1f MB allocated%s\n",
+                 mem_rss_peak() / 1048576.0, mem_heap_peak() / 1048576.0, (unsigned long long)c.allocs,
+                 (unsigned long long)c.frees, c.allocBytes / 1048576.0,
+                 mem_tracking() ? "" : " (RT_MEMTRACK=0: heap not tracked)");
+    std::vector<MemPhaseStats> phases = mem_phases();
+    if (!phases.empty()) print_mem_phases(out, phases);
+    report_hot_loop_violations(out);
+}
+
+static inline void write_mem_phase_json(JsonWriter& w, const MemPhaseStats& p) {
+    w.begin_object();
+    w.value("name", p.name);
+    w.value("allocs", p.counters.allocs);
+    w.value("frees", p.counters.frees);
+    w.value("alloc_bytes", p.counters.allocBytes);
+    w.value("free_bytes", p.counters.freeBytes);
+    w.value("heap_start", p.heapStart);
+    w.value("heap_peak", p.heapPeak);
+    w.value("heap_end", p.heapEnd);
+    w.value("rss_start", p.rssStart);
+    w.value("rss_peak", p.rssPeak);
+    w.value("rss_end", p.rssEnd);
+    w.value("rss_scoped", p.rssScoped);
+    w.end_object();
+}
+
+// {"peak_rss", "heap_peak", "allocs", ..., "phases": [...], "hot_loop_allocs"}
+static inline void write_mem_json(JsonWriter& w, const char* key = "memory") {
+    MemCounters c = mem_counters();
+    w.begin_object(key);
+    w.value("tracking", mem_tracking());
+    w.value("peak_rss", mem_rss_peak());
+    w.value("heap_peak", mem_heap_peak());
+    w.value("allocs", c.allocs);
+    w.value("frees", c.frees);
+    w.value("alloc_bytes", c.allocBytes);
+    w.value("free_bytes", c.freeBytes);
+    w.begin_array("phases");
+    for (const MemPhaseStats& p : mem_phases()) write_mem_phase_json(w, p);
+    w.end_array();
+    w.value("hot_loop_allocs", mem_hot_loop_violations());
+    w.end_object();
+}
+
+namespace memtrack_detail {
+
+// RT_MEM=1 (any non-empty value but "0") prints the summary at exit.
+static inline bool register_exit_report() {
+    const char* env = std::getenv("RT_MEM");
+    if (env && *env && std::strcmp(env, "0") != 0) std::atexit([] { print_mem_summary(stderr); });
+    return true;
+}
+
+static const bool exitReport = register_exit_report();
+
+} // namespace memtrack_detail
+
+/* ================= Operator replacements ================= */
+
+#if RT_MEMTRACK
+void* operator new(size_t n) { return memtrack_detail::alloc(n, 0, false); }
+void* operator new[](size_t n) { return memtrack_detail::alloc(n, 0, false); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return memtrack_detail::alloc(n, 0, true); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return memtrack_detail::alloc(n, 0, true); }
+void* operator new(size_t n, std::align_val_t a) { return memtrack_detail::alloc(n, size_t(a), false); }
+void* operator new[](size_t n, std::align_val_t a) { return memtrack_detail::alloc(n, size_t(a), false); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return memtrack_detail::alloc(n, size_t(a), true);
+}
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return memtrack_detail::alloc(n, size_t(a), true);
+}
+
+void operator delete(void* p) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p) noexcept { memtrack_detail::dealloc(p); }
+void operator delete(void* p, size_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p, size_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { memtrack_detail::dealloc(p); }
+void operator delete(void* p, std::align_val_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { memtrack_detail::dealloc(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { memtrack_detail::dealloc(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { memtrack_detail::dealloc(p); }
+#endif
@@ -0,0 +1,381 @@
+// packetsim.cpp
+// GPU-free cost model of the shader's traversal. Every invocation of a
+// frame runs through traverse_bvh4_packet (packetsim.hpp), the CPU copy
+// of traverseBVH4Packet, which yields per-packet control-flow counts. Its
+// node and triangle reads then go through the cache model (cachesim.hpp)
+// in dispatch order, and the two combine into a relative frame cost per
+// BVH file and node layout.
+//
+//   bin/packetsim [--scene public/assets/dragon.glb]
+//                 [--bvh data/BVH4_wide.bin,data/BVH2.bin|lbvh]
+//                 [--size 320x180] [--pos 0,0,2.5] [--quat 0,0,0,1] [--fov 70]
+//                 [--layouts file,aligned,dfs,bfs] [--simd 8]
+//                 [--l1 64K,64,8] [--l2 512K,64,16|0] [--weights 1,4,20,100]
+//                 [--json out.json|-]
+//
+// Per BVH it prints:
+//   steps       loop iterations per invocation
+//   lanes       mean fraction of the 4 lanes active in the popped mask,
+//               then the share of steps with 1..4 lanes active
+//   simd eff    sum of ALU ops / (simd * sum over lock-step groups of the
+//               group's largest count): lanes idling on a longer neighbour
+//   stack       per-invocation peak depth p50 / p99 / max, pushes dropped
+//   mismatch    lanes whose hit differs from trace_closest (should be 0)
+//
+// The cost per ray is  w_alu * ALU + w_l1 * L1 requests + w_l2 * L2 hits
+// + w_dram * DRAM lines, with ALU summed per lock-step group at the
+// group's maximum (the SIMD issue count). --weights sets the four
+// factors; the defaults are rough issue-cycle ratios for an integrated
+// GPU. Only the "rel" column, relative to the first row, is meaningful.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "cachesim.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "packetsim.hpp"
+#include "parallel.hpp"
+
+// Invocation-level results of one frame.
+struct FrameEmulation {
+    RayTraces   traces;          // one "ray" per invocation, width x height invocations
+    std::vector<PacketStats> stats;
+    uint64_t    rays = 0;
+    uint64_t    mismatches = 0;
+};
+
+static FrameEmulation emulate_frame(const Bvh4& bvh, const Triangles& tris, const Camera& cam, uint32_t width,
+                                    uint32_t height, const ShaderOpCosts& cost) {
+    FrameEmulation f;
+    const uint32_t gw = (width + SHADER_PACKET - 1) / SHADER_PACKET;
+    const uint32_t gh = (height + SHADER_PACKET - 1) / SHADER_PACKET;
+    f.traces.width = gw;
+    f.traces.height = gh;
+    f.stats.resize(size_t(gw) * gh);
+
+    struct Row {
+        std::vector<uint32_t> access, count;
+        uint64_t              rays = 0, mismatches = 0;
+    };
+    std::vector<Row> rows(gh);
+    parallel_for(0, gh, 1, [&](size_t gy) {
+        Row& row = rows[gy];
+        row.count.resize(gw);
+        for (uint32_t gx = 0; gx < gw; ++gx) {
+            Ray rays[PACKET_LANES];
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < PACKET_LANES; ++i) {
+                uint32_t px = gx * SHADER_PACKET + i % SHADER_PACKET;
+                uint32_t py = uint32_t(gy) * SHADER_PACKET + i / SHADER_PACKET;
+                if (px >= width || py >= height) {
+                    rays[i] = Ray{cam.pos, {0.0f, 0.0f, -1.0f}};
+                    continue;
+                }
+                rays[i] = primary_ray(cam, float(px), float(py), width, height);
+                mask |= 1u << i;
+            }
+            Hit hits[PACKET_LANES];
+            size_t before = row.access.size();
+            traverse_bvh4_packet(bvh, tris, rays, mask, hits, f.stats[gy * gw + gx], cost, &row.access);
+            row.count[gx] = uint32_t(row.access.size() - before);
+
+            for (uint32_t i = 0; i < PACKET_LANES; ++i) {
+                if (!(mask >> i & 1u)) continue;
+                row.rays++;
+                Hit ref = trace_closest(bvh, tris, rays[i]);
+                if (ref.hit() != hits[i].hit() ||
+                    (ref.hit() && std::fabs(ref.t - hits[i].t) > 1e-5f * std::max(1.0f, ref.t)))
+                    row.mismatches++;
+            }
+        }
+    });
+
+    f.traces.offset.assign(f.traces.rays() + 1, 0);
+    for (uint32_t gy = 0; gy < gh; ++gy) {
+        Row& row = rows[gy];
+        for (uint32_t gx = 0; gx < gw; ++gx) {
+            size_t i = size_t(gy) * gw + gx;
+            f.traces.offset[i + 1] = f.traces.offset[i] + row.count[gx];
+        }
+        f.traces.access.insert(f.traces.access.end(), row.access.begin(), row.access.end());
+        f.rays += row.rays;
+        f.mismatches += row.mismatches;
+        row = Row{};
+    }
+    return f;
+}
+
+// Invocation ids of every workgroup in dispatch order, cut into lock-step
+// groups of `simd` consecutive local invocations.
+template <class Fn>
+static void for_each_workgroup(uint32_t gw, uint32_t gh, uint32_t simd, Fn&& fn) {
+    std::vector<uint32_t> ids, groupStart;
+    for (uint32_t wy = 0; wy * SHADER_WORKGROUP < gh; ++wy)
+        for (uint32_t wx = 0; wx * SHADER_WORKGROUP < gw; ++wx) {
+            ids.clear();
+            groupStart.clear();
+            for (uint32_t l = 0; l < SHADER_WORKGROUP * SHADER_WORKGROUP; ++l) {
+                if (l % simd == 0) groupStart.push_back(uint32_t(ids.size()));
+                uint32_t gx = wx * SHADER_WORKGROUP + l % SHADER_WORKGROUP;
+                uint32_t gy = wy * SHADER_WORKGROUP + l / SHADER_WORKGROUP;
+                if (gx < gw && gy < gh) ids.push_back(gy * gw + gx);
+            }
+            groupStart.push_back(uint32_t(ids.size()));
+            fn(ids, groupStart);
+        }
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double q) {
+    if (v.empty()) return 0;
+    size_t k = std::min(v.size() - 1, size_t(q * double(v.size())));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+struct ControlSummary {
+    double   steps = 0.0, nodes = 0.0, tris = 0.0, alu = 0.0; // per ray except steps (per invocation)
+    double   laneFraction = 0.0;
+    double   laneShare[PACKET_LANES + 1] = {};
+    double   simdEfficiency = 0.0;
+    uint64_t simdAlu = 0;        // sum over groups of the largest ALU count
+    uint32_t stackP50 = 0, stackP99 = 0, stackMax = 0;
+    uint64_t stackDrops = 0;
+};
+
+static ControlSummary summarize(const FrameEmulation& f, uint32_t simd) {
+    ControlSummary s;
+    uint64_t steps = 0, laneSteps = 0, nodes = 0, tris = 0, alu = 0, byLanes[PACKET_LANES + 1] = {};
+    std::vector<uint32_t> peaks;
+    peaks.reserve(f.stats.size());
+    for (const PacketStats& p : f.stats) {
+        steps += p.steps;
+        laneSteps += p.laneSteps;
+        nodes += p.nodeFetches;
+        tris += p.triFetches;
+        alu += p.alu;
+        for (uint32_t k = 0; k <= PACKET_LANES; ++k) byLanes[k] += p.stepsByLanes[k];
+        s.stackDrops += p.stackDrops;
+        peaks.push_back(p.maxStack);
+    }
+    for_each_workgroup(f.traces.width, f.traces.height, simd,
+                       [&](const std::vector<uint32_t>& ids, const std::vector<uint32_t>& groupStart) {
+                           for (size_t g = 0; g + 1 < groupStart.size(); ++g) {
+                               uint64_t peak = 0;
+                               for (uint32_t k = groupStart[g]; k < groupStart[g + 1]; ++k)
+                                   peak = std::max(peak, f.stats[ids[k]].alu);
+                               s.simdAlu += peak;
+                           }
+                       });
+    const double rays = double(std::max<uint64_t>(f.rays, 1));
+    s.steps = double(steps) / double(std::max<size_t>(f.stats.size(), 1));
+    s.nodes = double(nodes) / rays;
+    s.tris = double(tris) / rays;
+    s.alu = double(alu) / rays;
+    s.laneFraction = steps ? double(laneSteps) / double(steps * PACKET_LANES) : 0.0;
+    for (uint32_t k = 0; k <= PACKET_LANES; ++k) s.laneShare[k] = steps ? double(byLanes[k]) / double(steps) : 0.0;
+    s.simdEfficiency = s.simdAlu ? double(alu) / double(uint64_t(simd) * s.simdAlu) : 0.0;
+    s.stackP50 = percentile(peaks, 0.5);
+    s.stackP99 = percentile(peaks, 0.99);
+    s.stackMax = peaks.empty() ? 0 : *std::max_element(peaks.begin(), peaks.end());
+    return s;
+}
+
+struct VariantRow {
+    std::string   bvh, layout;
+    CacheCounters c;
+    double        aluPerRay = 0.0, costPerRay = 0.0;
+};
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::vector<std::string> bvhPaths = args.strs("bvh", "data/BVH4_wide.bin,data/BVH2.bin");
+    std::vector<std::string> layoutNames = args.strs("layouts", "file,aligned,dfs,bfs");
+    std::string jsonPath = args.str("json", "");
+    uint32_t simd = std::max(args.u32("simd", 8), 1u);
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+    std::vector<double> weights = args.nums("weights", "1,4,20,100");
+    if (weights.size() != 4) {
+        std::cerr << "--weights takes alu,l1,l2,dram\n";
+        return 1;
+    }
+
+    Camera cam;
+    std::vector<double> pos = args.nums("pos", ""), quat = args.nums("quat", "");
+    if (pos.size() == 3) cam.pos = {float(pos[0]), float(pos[1]), float(pos[2])};
+    if (quat.size() == 4)
+        for (int k = 0; k < 4; ++k) cam.quat[k] = float(quat[k]);
+    cam.fovDeg = float(args.num("fov", cam.fovDeg));
+
+    CacheConfig l1, l2;
+    std::string l1Spec = args.str("l1", "64K,64,8"), l2Spec = args.str("l2", "512K,64,16");
+    if (!parse_cache_config(l1Spec, l1) || !l1.size) {
+        std::cerr << "--l1 must be SIZE,LINE,WAYS (got " << l1Spec << ")\n";
+        return 1;
+    }
+    if (!parse_cache_config(l2Spec, l2) || (l2.size && l2.line % l1.line != 0)) {
+        std::cerr << "--l2 must be 0 or SIZE,LINE,WAYS with LINE a multiple of the L1 line (got " << l2Spec
+                  << ")\n";
+        return 1;
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %ux%u, simd %u, L1 %s, L2 %s, weights %g,%g,%g,%g\n", scenePath.c_str(),
+                 tris.count(), width, height, simd, l1Spec.c_str(), l2Spec.c_str(), weights[0], weights[1],
+                 weights[2], weights[3]);
+
+    const ShaderOpCosts cost;
+    std::vector<ControlSummary> summaries;
+    std::vector<uint64_t> mismatches;
+    std::vector<VariantRow> rows;
+    for (const std::string& path : bvhPaths) {
+        Bvh4 bvh;
+        uint32_t arity = 4;
+        if (path == "lbvh") {
+            bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, morton_sort(tris))));
+        } else {
+            std::vector<uint32_t> raw;
+            if (!load_u32_file(path.c_str(), raw) || raw.empty()) {
+                std::cerr << "Failed to read " << path << "\n";
+                return 1;
+            }
+            arity = bvh_file_arity(raw);
+            if (!arity) {
+                std::cerr << path << ": length matches neither the BVH2 nor the BVH4 stride\n";
+                return 1;
+            }
+            bvh = arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw);
+        }
+
+        FrameEmulation frame = emulate_frame(bvh, tris, cam, width, height, cost);
+        ControlSummary s = summarize(frame, simd);
+        summaries.push_back(s);
+        mismatches.push_back(frame.mismatches);
+
+        std::fprintf(text, "\n%s (BVH%u)\n", path.c_str(), arity);
+        std::fprintf(text, "  steps %.1f/inv  node fetches %.1f/ray  tri fetches %.2f/ray  ALU %.0f/ray\n",
+                     s.steps, s.nodes, s.tris, s.alu);
+        std::fprintf(text, "  lanes %.1f%% active  (1: %.1f%%  2: %.1f%%  3: %.1f%%  4: %.1f%%)  simd eff %.1f%%\n",
+                     100.0 * s.laneFraction, 100.0 * s.laneShare[1], 100.0 * s.laneShare[2],
+                     100.0 * s.laneShare[3], 100.0 * s.laneShare[4], 100.0 * s.simdEfficiency);
+        std::fprintf(text, "  stack p50 %u  p99 %u  max %u  dropped %llu  mismatch %llu/%llu\n", s.stackP50,
+                     s.stackP99, s.stackMax, (unsigned long long)s.stackDrops,
+                     (unsigned long long)frame.mismatches, (unsigned long long)frame.rays);
+
+        const uint32_t nodeBytes = (arity == 2 ? NODE2_STRIDE_U32 : NODE4_STRIDE_U32) * 4;
+        std::vector<MemoryLayout> layouts = make_layouts(bvh, nodeBytes);
+        for (const std::string& name : layoutNames) {
+            const MemoryLayout* lay = nullptr;
+            for (const MemoryLayout& m : layouts)
+                if (m.name == name) lay = &m;
+            if (!lay) {
+                std::cerr << "Unknown layout " << name << " (file, aligned, dfs, bfs)\n";
+                return 1;
+            }
+            CacheHierarchy mem;
+            mem.init(l1, l2);
+            for_each_workgroup(frame.traces.width, frame.traces.height, simd,
+                               [&](const std::vector<uint32_t>& ids, const std::vector<uint32_t>& groupStart) {
+                                   replay_lockstep(frame.traces, *lay, ids, groupStart, mem);
+                               });
+            VariantRow row;
+            row.bvh = path;
+            row.layout = name;
+            row.c = mem.counters;
+            row.c.rays = frame.rays;
+            const double rays = double(std::max<uint64_t>(frame.rays, 1));
+            row.aluPerRay = double(s.simdAlu) * simd / rays;
+            row.costPerRay = (weights[0] * double(s.simdAlu) * simd + weights[1] * double(row.c.requests) +
+                              weights[2] * double(row.c.l2Hits) + weights[3] * double(row.c.dramLines)) /
+                             rays;
+            rows.push_back(row);
+        }
+    }
+
+    std::fprintf(text, "\n%-22s %-8s %9s %8s %7s %7s %10s %9s %6s\n", "bvh", "layout", "SIMD ALU", "L1 req", "L1 hit",
+                 "L2 hit", "DRAM B", "cost/ray", "rel");
+    const double base = rows.empty() ? 1.0 : rows[0].costPerRay;
+    for (const VariantRow& r : rows) {
+        const double rays = double(std::max<uint64_t>(r.c.rays, 1));
+        const double misses = double(r.c.requests - r.c.l1Hits);
+        std::fprintf(text, "%-22s %-8s %9.0f %8.1f %6.1f%% %6.1f%% %10.0f %9.0f %6.3f\n", r.bvh.c_str(),
+                     r.layout.c_str(), r.aluPerRay, r.c.requests / rays,
+                     r.c.requests ? 100.0 * r.c.l1Hits / r.c.requests : 0.0,
+                     misses > 0.0 ? 100.0 * r.c.l2Hits / misses : 0.0,
+                     double(r.c.dramLines) * (l2.size ? l2.line : l1.line) / rays, r.costPerRay,
+                     base > 0.0 ? r.costPerRay / base : 0.0);
+    }
+
+    uint64_t totalMismatches = 0;
+    for (uint64_t m : mismatches) totalMismatches += m;
+    int status = totalMismatches ? 1 : 0;
+    if (status) std::fprintf(text, "\nFAIL: packet traversal disagrees with trace_closest on %llu lanes\n",
+                             (unsigned long long)totalMismatches);
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/packetsim");
+    w.value("scene", scenePath);
+    w.value("width", width);
+    w.value("height", height);
+    w.value("simd", simd);
+    w.begin_array("weights");
+    for (double x : weights) w.value(x);
+    w.end_array();
+    w.begin_array("bvhs");
+    for (size_t b = 0; b < summaries.size(); ++b) {
+        const ControlSummary& s = summaries[b];
+        w.begin_object();
+        w.value("bvh", bvhPaths[b]);
+        w.value("steps_per_invocation", s.steps);
+        w.value("node_fetches_per_ray", s.nodes);
+        w.value("tri_fetches_per_ray", s.tris);
+        w.value("alu_per_ray", s.alu);
+        w.value("active_lane_fraction", s.laneFraction);
+        w.begin_array("steps_by_active_lanes");
+        for (uint32_t k = 1; k <= PACKET_LANES; ++k) w.value(s.laneShare[k]);
+        w.end_array();
+        w.value("simd_efficiency", s.simdEfficiency);
+        w.value("stack_p50", s.stackP50);
+        w.value("stack_p99", s.stackP99);
+        w.value("stack_max", s.stackMax);
+        w.value("stack_drops", s.stackDrops);
+        w.value("mismatches", mismatches[b]);
+        w.end_object();
+    }
+    w.end_array();
+    w.begin_array("variants");
+    for (const VariantRow& r : rows) {
+        w.begin_object();
+        w.value("bvh", r.bvh);
+        w.value("layout", r.layout);
+        w.value("rays", r.c.rays);
+        w.value("simd_alu_per_ray", r.aluPerRay);
+        w.value("requests", r.c.requests);
+        w.value("l1_hits", r.c.l1Hits);
+        w.value("l2_hits", r.c.l2Hits);
+        w.value("dram_lines", r.c.dramLines);
+        w.value("cost_per_ray", r.costPerRay);
+        w.value("relative", base > 0.0 ? r.costPerRay / base : 0.0);
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
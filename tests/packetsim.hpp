@@ -0,0 +1,190 @@
+#pragma once
+
+// packetsim.hpp
+// Scalar emulation of traverseBVH4Packet in renderer.wgsl: one 2x2 packet
+// walks the tree with a lane mask per stack entry, testing each popped
+// node and then every child against the lanes that reached it, pushing
+// hit children far to near and dropping pushes past STACK_MAX exactly as
+// the shader does. Besides the hits it counts what the invocation pays:
+// loop steps, node and triangle fetches, active lanes per step, stack
+// depth and an estimate of scalar ALU ops from ShaderOpCosts.
+//
+// The reads can be recorded in the TraceStats::accesses convention (popped
+// node, each tested child, leaf triangle | TRACE_TRI_BIT) and replayed per
+// invocation through cachesim.hpp.
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "cachesim.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t PACKET_LANES = SHADER_PACKET * SHADER_PACKET;
+
+// Scalar ops per shader construct, counted by hand from renderer.wgsl: a
+// vec3 op is 3, a load, compare or select 1, a reciprocal 4. Only the
+// relative weight of the pieces matters to the frame-cost estimate.
+struct ShaderOpCosts {
+    uint32_t pop = 4;          // index + mask load, sp -= 1, loop test
+    uint32_t nodeFetch = 14;   // getBVHNode4: 8 loads, 3 unpack2x16float, flag
+    uint32_t emptyTest = 4;    // any(node.min > node.max)
+    uint32_t aabbCall = 6;     // intersectAABBPacketMask: its own empty test, minT select
+    uint32_t aabbLane = 30;    // 2 sub + 2 mul (vec3), 10 min/max, hit test, minT update
+    uint32_t laneOff = 2;      // a masked-off lane in either per-lane loop
+    uint32_t anyLane = 4;
+    uint32_t triFetch = 32;    // getTriangle (9 loads), edges, normalize(cross)
+    uint32_t triLane = 52;     // Moller-Trumbore through the t compare
+    uint32_t childSlot = 3;    // INVALID / range test
+    uint32_t childKeep = 7;    // childIdx / childDist / childMasks stores
+    uint32_t sortStep = 2;     // nearest-child select per child
+    uint32_t swap = 12;
+    uint32_t push = 7;         // bound test, sp += 1, index + mask store
+};
+
+struct PacketStats {
+    uint32_t steps = 0;        // loop iterations (pops)
+    uint32_t nodeFetches = 0;  // getBVHNode4 calls
+    uint32_t triFetches = 0;
+    uint32_t laneSteps = 0;    // sum over steps of the popped mask's active lanes
+    uint32_t stepsByLanes[PACKET_LANES + 1] = {};
+    uint32_t maxStack = 0;
+    uint32_t stackDrops = 0;
+    uint64_t alu = 0;
+};
+
+// Mask bit i = lane i; lanes outside initMask get no hit. Rays use tmin 0
+// and an unbounded tmax, like the shader.
+static inline void traverse_bvh4_packet(const Bvh4& bvh, const Triangles& tris, const Ray (&rays)[PACKET_LANES],
+                                        uint32_t initMask, Hit (&out)[PACKET_LANES], PacketStats& st,
+                                        const ShaderOpCosts& cost = {},
+                                        std::vector<uint32_t>* accesses = nullptr) {
+    for (Hit& h : out) h = Hit{};
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    const uint32_t numTris = tris.count();
+    st.alu += cost.anyLane;
+    if (numNodes == 0 || numTris == 0 || !initMask) return;
+
+    Vec3 invDir[PACKET_LANES];
+    for (uint32_t i = 0; i < PACKET_LANES; ++i) invDir[i] = safe_inv_dir(rays[i].dir);
+
+    // Shader: intersectAABBPacketMask + the anyLane that follows it.
+    auto test_box = [&](const Aabb& box, uint32_t inMask, float& minT) {
+        uint32_t hitMask = 0;
+        minT = INF;
+        st.alu += cost.aabbCall + cost.anyLane;
+        for (uint32_t i = 0; i < PACKET_LANES; ++i) {
+            if (!(inMask >> i & 1u)) {
+                st.alu += cost.laneOff;
+                continue;
+            }
+            st.alu += cost.aabbLane;
+            float d = intersect_aabb(rays[i], invDir[i], box, out[i].t);
+            if (d < INF) {
+                hitMask |= 1u << i;
+                minT = std::min(minT, d);
+            }
+        }
+        return hitMask;
+    };
+
+    uint32_t stack[STACK_MAX], stackMask[STACK_MAX];
+    int sp = 0;
+    stack[0] = 0;
+    stackMask[0] = initMask;
+
+    while (sp >= 0) {
+        uint32_t nodeIndex = stack[sp];
+        uint32_t laneMask = stackMask[sp];
+        sp--;
+        st.steps++;
+        uint32_t active = uint32_t(std::popcount(laneMask));
+        st.laneSteps += active;
+        st.stepsByLanes[active]++;
+        st.alu += cost.pop + cost.nodeFetch + cost.emptyTest;
+        st.nodeFetches++;
+        if (accesses) accesses->push_back(nodeIndex);
+
+        const Bvh4Node& node = bvh.nodes[nodeIndex];
+        if (node.box.empty()) continue;
+
+        float nodeMinT;
+        uint32_t hitMask = test_box(node.box, laneMask, nodeMinT);
+        if (!hitMask) continue;
+
+        if (node.leaf()) {
+            uint32_t ti = node.tri();
+            if (ti < numTris) {
+                st.triFetches++;
+                st.alu += cost.triFetch;
+                if (accesses) accesses->push_back(ti | TRACE_TRI_BIT);
+                for (uint32_t i = 0; i < PACKET_LANES; ++i) {
+                    if (!(hitMask >> i & 1u)) {
+                        st.alu += cost.laneOff;
+                        continue;
+                    }
+                    st.alu += cost.triLane;
+                    float t = intersect_triangle(rays[i], tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+                    if (t < out[i].t) {
+                        out[i].t = t;
+                        out[i].tri = ti;
+                    }
+                }
+            }
+            continue;
+        }
+
+        uint32_t childIdx[4], childMask[4];
+        float childDist[4];
+        uint32_t childCount = 0;
+        for (int c = 0; c < 4; ++c) {
+            uint32_t ci = node.child[c];
+            st.alu += cost.childSlot;
+            if (ci == INVALID || ci >= numNodes) continue;
+
+            st.nodeFetches++;
+            st.alu += cost.nodeFetch + cost.emptyTest;
+            if (accesses) accesses->push_back(ci);
+            const Aabb& cb = bvh.nodes[ci].box;
+            if (cb.empty()) continue;
+
+            float cminT;
+            uint32_t cmask = test_box(cb, hitMask, cminT);
+            if (cmask) {
+                st.alu += cost.childKeep;
+                childIdx[childCount] = ci;
+                childDist[childCount] = cminT;
+                childMask[childCount] = cmask;
+                childCount++;
+            }
+        }
+
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < childCount; ++i) {
+            st.alu += cost.sortStep;
+            if (childDist[i] < childDist[best]) best = i;
+        }
+        if (best != 0) {
+            st.alu += cost.swap;
+            std::swap(childIdx[0], childIdx[best]);
+            std::swap(childDist[0], childDist[best]);
+            std::swap(childMask[0], childMask[best]);
+        }
+
+        for (int i = int(childCount) - 1; i >= 0; --i) {
+            st.alu += cost.push;
+            if (sp + 1 < int(STACK_MAX)) {
+                ++sp;
+                stack[sp] = childIdx[i];
+                stackMask[sp] = childMask[i];
+            } else {
+                st.stackDrops++;
+            }
+        }
+        st.maxStack = std::max(st.maxStack, uint32_t(sp + 1));
+    }
+
+    for (Hit& h : out)
+        if (!h.hit()) h.t = INF;
+}
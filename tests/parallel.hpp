@@ -0,0 +1,138 @@
+#pragma once
+
+// parallel.hpp
+// Fork/join helpers for the C++ tools. Work is handed out in fixed-size
+// chunks from an atomic counter, so uneven chunks (image tiles near the
+// dragon vs. empty sky) balance themselves.
+//
+// With tracing on (timeline.hpp) every fork/join shows up as a
+// "parallel_for" slice on the calling thread and every chunk as a "task"
+// slice on the worker that ran it, with the chunk's first index as argument.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "timeline.hpp"
+
+static inline unsigned worker_count() {
+    static const unsigned n = [] {
+        if (const char* env = std::getenv("RT_THREADS")) {
+            int v = std::atoi(env);
+            if (v > 0) return unsigned(v);
+        }
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw ? hw : 1u;
+    }();
+    return n;
+}
+
+// fn(begin, end, worker) is called for consecutive chunks of [begin, end).
+template <typename Fn>
+static inline void parallel_for_chunks(size_t begin, size_t end, size_t grain, Fn&& fn) {
+    if (end <= begin) return;
+    grain = std::max<size_t>(grain, 1);
+
+    size_t chunks = (end - begin + grain - 1) / grain;
+    unsigned workers = unsigned(std::min<size_t>(worker_count(), chunks));
+
+    if (workers <= 1) {
+        TimelineZone zone("task", begin);
+        fn(begin, end, 0u);
+        return;
+    }
+
+    TIMELINE_ZONE("parallel_for");
+    std::atomic<size_t> next{0};
+    auto run = [&](unsigned w) {
+        for (;;) {
+            size_t c = next.fetch_add(1, std::memory_order_relaxed);
+            if (c >= chunks) break;
+            size_t b = begin + c * grain;
+            TimelineZone zone("task", b);
+            fn(b, std::min(end, b + grain), w);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w) pool.emplace_back(run, w);
+    run(0);
+    for (auto& t : pool) t.join();
+}
+
+template <typename Fn>
+static inline void parallel_for(size_t begin, size_t end, size_t grain, Fn&& fn) {
+    parallel_for_chunks(begin, end, grain, [&](size_t b, size_t e, unsigned) {
+        for (size_t i = b; i < e; ++i) fn(i);
+    });
+}
+
+// Runs a() on a new thread and b() on this one; subtree builds use it to fork
+// while there are idle workers.
+template <typename A, typename B>
+static inline void parallel_invoke(A&& a, B&& b) {
+    std::thread t(std::forward<A>(a));
+    b();
+    t.join();
+}
+
+struct Tile {
+    uint32_t x0, y0, x1, y1;
+};
+
+// fn(tile, worker) over square tiles covering a width x height image.
+template <typename Fn>
+static inline void parallel_for_tiles(uint32_t width, uint32_t height, uint32_t tileSize, Fn&& fn) {
+    uint32_t tx = (width + tileSize - 1) / tileSize;
+    uint32_t ty = (height + tileSize - 1) / tileSize;
+
+    parallel_for_chunks(0, size_t(tx) * ty, 1, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) {
+            uint32_t x = uint32_t(i % tx) * tileSize;
+            uint32_t y = uint32_t(i / tx) * tileSize;
+            fn(Tile{x, y, std::min(width, x + tileSize), std::min(height, y + tileSize)}, w);
+        }
+    });
+}
+
+// Sorts [first, last) by sorting one run per worker and merging pairs of runs
+// in parallel rounds. Not stable; give equal keys a tie-breaker.
+template <typename T, typename Less>
+static inline void parallel_sort(T* first, T* last, Less less) {
+    size_t n = size_t(last - first);
+    unsigned workers = unsigned(std::min<size_t>(worker_count(), n / 4096 + 1));
+    if (workers <= 1) {
+        TimelineZone zone("sort", n);
+        std::sort(first, last, less);
+        return;
+    }
+
+    std::vector<size_t> bounds(workers + 1);
+    for (unsigned w = 0; w <= workers; ++w) bounds[w] = n * w / workers;
+    parallel_for(0, workers, 1, [&](size_t w) {
+        TimelineZone zone("sort run", bounds[w + 1] - bounds[w]);
+        std::sort(first + bounds[w], first + bounds[w + 1], less);
+    });
+
+    std::vector<T> tmp(n);
+    T* src = first;
+    T* dst = tmp.data();
+    while (bounds.size() > 2) {
+        size_t runs = bounds.size() - 1;
+        parallel_for(0, (runs + 1) / 2, 1, [&](size_t p) {
+            size_t a = bounds[2 * p], m = bounds[std::min(2 * p + 1, runs)], b = bounds[std::min(2 * p + 2, runs)];
+            TimelineZone zone("merge", b - a);
+            std::merge(src + a, src + m, src + m, src + b, dst + a, less);
+        });
+        std::vector<size_t> next;
+        for (size_t i = 0; i < bounds.size(); i += 2) next.push_back(bounds[i]);
+        if (next.back() != n) next.push_back(n);
+        bounds.swap(next);
+        std::swap(src, dst);
+    }
+    if (src != first) std::copy(src, src + n, first);
+}
@@ -0,0 +1,154 @@
+// perf.cpp
+// Hardware counters (perf.hpp) around each stage of the BVH pipeline, to
+// tell memory-bound phases from branch-bound ones:
+//
+//   load      read the LBVH2 readback (data/BVH2.bin)
+//   promote   BVH2 -> BVH4 (lbvh.hpp, as bin/test)
+//   save      write the BVH4
+//   morton    centroid quantization + Morton codes      (--scene only)
+//   sort      sort of the (code, tri) keys               (--scene only)
+//   build     LBVH2 connectivity + fp16 bounds           (--scene only)
+//   traverse  primary + sun shadow rays through the BVH4 (--scene only)
+//
+// Per-item columns divide by the phase's natural unit: BVH nodes for the
+// file phases and the build, triangles for Morton and sort, nodes visited
+// for traversal. The traversal loop must not allocate (memtrack.hpp
+// MemHotLoop); the tool exits 1 if it does.
+//
+// A last, unlisted phase checks that phases are isolated: a serial spin
+// measured right after a spin on every worker must show the task clock of
+// one thread, whatever RT_THREADS is. The tool exits 1 if it shows more.
+//
+//   bin/perf [--bvh2 data/BVH2.bin] [--out data/BVH4_wide.bin]
+//            [--scene public/assets/dragon.glb] [--size 640x360] [--json out.json|-]
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+
+// Busy work the optimizer cannot drop.
+static uint64_t spin_ms(double ms) {
+    BenchTimer t;
+    volatile uint64_t x = 0;
+    while (t.ms() < ms)
+        for (int i = 0; i < 4096; ++i) x = x + uint64_t(i);
+    return x;
+}
+
+// True unless a serial phase after a parallel one shows the workers' CPU
+// time; `cpuMs` / `wallMs` are the serial phase's (cpuMs < 0 when the task
+// clock is unavailable).
+static bool check_phase_isolation(PerfCounters& pc, double& cpuMs, double& wallMs) {
+    pc.measure([] { parallel_for_chunks(0, worker_count(), 1, [](size_t, size_t, unsigned) { spin_ms(20.0); }); });
+    PerfSample s = pc.measure([] { spin_ms(20.0); });
+    wallMs = s.ms;
+    cpuMs = s.valid[PERF_TASK_CLOCK] ? s.value[PERF_TASK_CLOCK] * 1e-6 : -1.0;
+    return cpuMs < 0.0 || cpuMs <= wallMs * 1.25 + 2.0;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::string bvh2Path = args.str("bvh2", "data/BVH2.bin");
+    std::string outPath = args.str("out", "data/BVH4_wide.bin");
+    std::string scenePath = args.str("scene", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+
+    PerfCounters pc;
+    std::vector<PerfPhase> phases;
+
+    // ---- converter phases ----
+    std::vector<uint32_t> bvh2, bvh4;
+    bool ok = true;
+    PerfSample s = pc.measure([&] { ok = load_u32_file(bvh2Path.c_str(), bvh2) && !bvh2.empty(); });
+    if (!ok) {
+        std::cerr << "Failed to read BVH2 " << bvh2Path << "\n";
+        return 1;
+    }
+    const uint64_t fileNodes = bvh2[0];
+    phases.push_back({"load", "nodes", fileNodes, s});
+    phases.push_back({"promote", "nodes", fileNodes, pc.measure([&] { bvh4 = promote_bvh4(bvh2); })});
+    s = pc.measure([&] { ok = save_u32_file(outPath.c_str(), bvh4); });
+    if (!ok) {
+        std::cerr << "Failed to write " << outPath << "\n";
+        return 1;
+    }
+    phases.push_back({"save", "nodes", fileNodes, s});
+
+    // ---- build + traversal phases ----
+    if (!scenePath.empty()) {
+        Triangles tris;
+        if (!load_scene(scenePath.c_str(), tris)) return 1;
+        const uint64_t n = tris.count();
+
+        std::vector<uint64_t> keys;
+        MortonOrder order;
+        std::vector<uint32_t> built;
+        phases.push_back({"morton", "tris", n, pc.measure([&] { keys = morton_keys(tris); })});
+        phases.push_back({"sort", "tris", n, pc.measure([&] { order = sort_morton_keys(keys); })});
+        phases.push_back({"build", "nodes", 2 * n - 1, pc.measure([&] { built = build_lbvh2(tris, order); })});
+
+        Bvh4 bvh = decode_bvh4(promote_bvh4(built));
+        Camera cam;
+        const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+        std::vector<TraceStats> perWorker(worker_count());
+
+        s = pc.measure([&] {
+            TIMELINE_ZONE("traverse");
+            parallel_for_chunks(0, size_t(width) * height, 256, [&](size_t b, size_t e, unsigned w) {
+                MemHotLoop hot("traverse");
+                for (size_t i = b; i < e; ++i) {
+                    Ray r = primary_ray(cam, float(i % width), float(i / width), width, height);
+                    Hit hit = trace_closest(bvh, tris, r, &perWorker[w]);
+                    if (!hit.hit()) continue;
+                    Vec3 nrm = tris.normal(hit.tri);
+                    if (dot(nrm, r.dir) > 0.0f) nrm = -nrm;
+                    if (dot(nrm, lightDir) <= 0.0f) continue;
+                    trace_occluded(bvh, tris, Ray{r.origin + r.dir * hit.t + nrm * 1e-4f, lightDir, 0.0f, INF},
+                                   &perWorker[w]);
+                }
+            });
+        });
+        uint64_t visited = 0;
+        for (const TraceStats& ts : perWorker) visited += ts.nodes;
+        phases.push_back({"traverse", "visits", visited, s});
+    }
+
+    double checkCpuMs = 0.0, checkWallMs = 0.0;
+    const bool isolated = check_phase_isolation(pc, checkCpuMs, checkWallMs);
+
+    // With --json - the JSON owns stdout and the table moves to stderr.
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    print_perf_table(text, phases, pc);
+    if (checkCpuMs >= 0.0)
+        std::fprintf(text, "\nphase isolation: serial phase after a %u-thread phase: %.1f CPU ms over %.1f ms%s\n",
+                     worker_count(), checkCpuMs, checkWallMs, isolated ? "" : " -- FAIL: earlier workers leak in");
+    int status = report_hot_loop_violations(stderr) ? 1 : 0;
+    if (!isolated) status = 1;
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/perf");
+    w.value("hardware_counters", pc.any_hardware());
+    w.value("phase_isolation", isolated);
+    if (!pc.error().empty()) w.value("counter_error", pc.error());
+    write_perf_json(w, phases);
+    write_mem_json(w);
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+// perf.hpp
+// Linux perf_event_open counters around pipeline phases: cycles,
+// instructions, LLC misses, dTLB load misses and branch misses, plus two
+// software events (task clock, page faults) that still work where the PMU is
+// hidden (containers, VMs, perf_event_paranoid > 2).
+//
+// Every event is opened on its own, so one missing counter does not take the
+// others with it; unavailable counters print as "n/a". Counters follow the
+// calling thread and (inherit=1) every thread it starts while enabled, which
+// covers the fork/join workers in parallel.hpp. RT_PERF=0 skips opening them.
+//
+// A phase is the difference of two read()s, not a reset: the kernel folds an
+// exited worker's counts into the parent event where PERF_EVENT_IOC_RESET
+// does not clear them, so after a reset every phase would also carry the
+// workers of the phases before it.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "json.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum PerfEvent {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_TASK_CLOCK,   // ns
+    PERF_PAGE_FAULTS,
+    PERF_EVENT_COUNT
+};
+
+static inline const char* perf_event_name(int e) {
+    static const char* names[PERF_EVENT_COUNT] = {"cycles",        "instructions",  "llc_misses", "dtlb_misses",
+                                                  "branch_misses", "task_clock_ns", "page_faults"};
+    return names[e];
+}
+
+struct PerfSample {
+    double   ms = 0.0;                      // wall clock
+    uint64_t value[PERF_EVENT_COUNT] = {};
+    bool     valid[PERF_EVENT_COUNT] = {};
+
+    double ipc() const {
+        return valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] && value[PERF_CYCLES]
+                   ? double(value[PERF_INSTRUCTIONS]) / double(value[PERF_CYCLES])
+                   : -1.0;
+    }
+};
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (int& fd : fd_) fd = -1;
+        const char* env = std::getenv("RT_PERF");
+        if (env && std::atoi(env) == 0) {
+            error_ = "disabled by RT_PERF=0";
+            return;
+        }
+#if defined(__linux__)
+        struct Def { uint32_t type; uint64_t config; };
+        const Def defs[PERF_EVENT_COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        };
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = defs[e].type;
+            attr.config = defs[e].config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fd_[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd_[e] < 0 && error_.empty()) error_ = std::string(perf_event_name(e)) + ": " + std::strerror(errno);
+        }
+#else
+        error_ = "perf_event_open needs Linux";
+#endif
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : fd_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(int e) const { return fd_[e] >= 0; }
+    bool any_hardware() const {
+        for (int e = 0; e < PERF_TASK_CLOCK; ++e)
+            if (available(e)) return true;
+        return false;
+    }
+    // First open failure, for the "counters unavailable" note.
+    const std::string& error() const { return error_; }
+
+    void start() {
+#if defined(__linux__)
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e)
+            if (!read_event(e, start_[e])) start_[e][0] = start_[e][1] = start_[e][2] = 0;
+        for (int fd : fd_)
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+        timer_ = BenchTimer();
+    }
+
+    // Scaled up by enabled/running time when the PMU had to multiplex.
+    PerfSample stop() {
+        PerfSample s;
+#if defined(__linux__)
+        for (int fd : fd_)
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        s.ms = timer_.ms();
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+            uint64_t buf[3];
+            if (!read_event(e, buf)) continue;
+            for (int k = 0; k < 3; ++k) buf[k] -= start_[e][k];
+            if (buf[2] == 0) continue; // never scheduled
+            s.value[e] = buf[2] < buf[1] ? uint64_t(double(buf[0]) * double(buf[1]) / double(buf[2])) : buf[0];
+            s.valid[e] = true;
+        }
+#else
+        s.ms = timer_.ms();
+#endif
+        return s;
+    }
+
+    template <typename Fn>
+    PerfSample measure(Fn&& fn) {
+        start();
+        fn();
+        return stop();
+    }
+
+private:
+    // value, time enabled, time running; children that exited included.
+    bool read_event(int e, uint64_t (&buf)[3]) const {
+#if defined(__linux__)
+        return fd_[e] >= 0 && read(fd_[e], buf, sizeof(buf)) == ssize_t(sizeof(buf));
+#else
+        (void)e;
+        (void)buf;
+        return false;
+#endif
+    }
+
+    int         fd_[PERF_EVENT_COUNT];
+    uint64_t    start_[PERF_EVENT_COUNT][3] = {};
+    std::string error_;
+    BenchTimer  timer_;
+};
+
+/* ================= Reporting ================= */
+
+// One measured phase; `items` is what the per-item columns divide by (BVH
+// nodes, triangles, or nodes visited for traversal).
+struct PerfPhase {
+    std::string name;
+    std::string itemName;
+    uint64_t    items = 0;
+    PerfSample  sample;
+};
+
+static inline void print_perf_table(FILE* out, const std::vector<PerfPhase>& phases, const PerfCounters& pc) {
+    auto cell = [](char* buf, size_t n, bool ok, double v, const char* fmt) {
+        if (ok) std::snprintf(buf, n, fmt, v);
+        else std::snprintf(buf, n, "n/a");
+    };
+
+    std::fprintf(out, "%-9s %9s %10s %-10s %8s %8s %8s %8s %9s %8s %9s\n", "phase", "ms", "items", "(item)",
+                 "Mcycles", "IPC", "LLC/it", "dTLB/it", "brmiss/it", "CPU ms", "pgfaults");
+    for (const PerfPhase& p : phases) {
+        const PerfSample& s = p.sample;
+        double per = p.items ? 1.0 / double(p.items) : 0.0;
+        char c[6][24];
+        cell(c[0], 24, s.valid[PERF_CYCLES], s.value[PERF_CYCLES] * 1e-6, "%.1f");
+        cell(c[1], 24, s.ipc() >= 0.0, s.ipc(), "%.2f");
+        cell(c[2], 24, s.valid[PERF_LLC_MISSES], s.value[PERF_LLC_MISSES] * per, "%.3f");
+        cell(c[3], 24, s.valid[PERF_DTLB_MISSES], s.value[PERF_DTLB_MISSES] * per, "%.3f");
+        cell(c[4], 24, s.valid[PERF_BRANCH_MISSES], s.value[PERF_BRANCH_MISSES] * per, "%.3f");
+        cell(c[5], 24, s.valid[PERF_TASK_CLOCK], s.value[PERF_TASK_CLOCK] * 1e-6, "%.1f");
+        char faults[24];
+        cell(faults, 24, s.valid[PERF_PAGE_FAULTS], double(s.value[PERF_PAGE_FAULTS]), "%.0f");
+        std::fprintf(out, "%-9s %9.2f %10llu %-10s %8s %8s %8s %8s %9s %8s %9s\n", p.name.c_str(), s.ms,
+                     (unsigned long long)p.items, p.itemName.c_str(), c[0], c[1], c[2], c[3], c[4], c[5], faults);
+    }
+    if (!pc.any_hardware())
+        std::fprintf(out, "\nhardware counters unavailable (%s); only wall clock and software events shown.\n",
+                     pc.error().c_str());
+}
+
+static inline void write_perf_json(JsonWriter& w, const std::vector<PerfPhase>& phases) {
+    w.begin_object("phases");
+    for (const PerfPhase& p : phases) {
+        const PerfSample& s = p.sample;
+        w.begin_object(p.name.c_str());
+        w.value("ms", s.ms);
+        w.value("items", p.items);
+        w.value("item", p.itemName);
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+            if (s.valid[e]) w.value(perf_event_name(e), s.value[e]);
+            else w.null(perf_event_name(e));
+        }
+        w.value("ipc", s.ipc() >= 0.0 ? s.ipc() : NAN);
+        w.end_object();
+    }
+    w.end_object();
+}
@@ -0,0 +1,543 @@
+#pragma once
+
+// quality.hpp
+// Tree-quality metrics for a BVH2 or BVH4 (decoded with decode_bvh2 /
+// decode_bvh4), so every change to the build pipeline can be scored:
+//
+//   SAH cost        (Ct * sum SA(internal) + Ci * sum SA(leaf) * tris) / SA(root)
+//   EPO             end-point overlap (Aila, Karras, Laine 2013): the surface
+//                   area of triangles inside a node's box that are not in its
+//                   subtree, cost-weighted and divided by the total triangle
+//                   area. Needs the triangles.
+//   sibling overlap sum over internal nodes of SA(child_i & child_j), over
+//                   SA(root) and as a share of the children's SA
+//   depth           nodes and leaves per depth, max and mean leaf depth
+//   child slots     valid-child histogram and how often each slot is INVALID
+//   orphans         nodes unreachable from the root (and their bytes)
+//   leaves          a leaf holds one triangle in these formats, so the leaf
+//                   size distribution that matters is leaf children per
+//                   internal node
+//   bytes / tri     file bytes and reachable bytes per distinct triangle
+//
+// Reachability and the per-node metrics come from one DFS split into
+// subtrees across the workers; EPO is a box query per reachable node, also
+// in parallel. Shared children, cycles and out-of-range indices are counted,
+// not followed; EPO is skipped when any are found.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "json.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+
+struct BvhQualityParams {
+    double ct  = 1.0; // cost of visiting an internal node
+    double ci  = 1.0; // cost of a triangle test
+    bool   epo = true;
+};
+
+struct BvhQuality {
+    uint32_t arity = 4;
+    uint64_t nodes = 0, fileBytes = 0;
+    uint64_t reachable = 0, internals = 0, leaves = 0, orphans = 0;
+    uint64_t triangles = 0;    // distinct triangles referenced by reachable leaves
+    uint64_t duplicateTris = 0; // leaves referencing an already-seen triangle
+    uint64_t shared = 0;        // child links to an already-visited node
+    uint64_t badIndices = 0;    // child links past the node count
+
+    double sah = 0.0;
+    double epo = NAN; // NaN: not computed
+    double overlapSA = 0.0, childSA = 0.0, rootSA = 0.0;
+
+    uint32_t              maxDepth = 0;
+    double                meanLeafDepth = 0.0;
+    std::vector<uint64_t> nodesAtDepth, leavesAtDepth;
+    uint64_t              childCount[5] = {};   // internal nodes by valid children
+    uint64_t              slotInvalid[4] = {};  // internal nodes with slot s == INVALID
+    uint64_t              leafChildren[5] = {}; // internal nodes by leaf children
+
+    double ms = 0.0, epoMs = 0.0;
+
+    double bytes_per_tri() const { return triangles ? double(fileBytes) / double(triangles) : 0.0; }
+    double reachable_bytes_per_tri() const {
+        return triangles ? double(fileBytes) * double(reachable) / double(std::max<uint64_t>(nodes, 1)) /
+                               double(triangles)
+                         : 0.0;
+    }
+    uint64_t node_bytes() const { return arity == 2 ? NODE2_STRIDE_U32 * 4 : NODE4_STRIDE_U32 * 4; }
+};
+
+namespace quality_detail {
+
+struct Accum {
+    uint64_t reachable = 0, internals = 0, leaves = 0, duplicateTris = 0, shared = 0, badIndices = 0;
+    double   sahInternal = 0.0, sahLeaf = 0.0, overlapSA = 0.0, childSA = 0.0, leafDepthSum = 0.0;
+    std::vector<uint64_t> nodesAtDepth, leavesAtDepth;
+    uint64_t childCount[5] = {}, slotInvalid[4] = {}, leafChildren[5] = {};
+};
+
+struct Item {
+    uint32_t node, depth;
+};
+
+static inline double intersect_area(const Aabb& a, const Aabb& b) {
+    Aabb i;
+    i.mn = vmax(a.mn, b.mn);
+    i.mx = vmin(a.mx, b.mx);
+    return i.area();
+}
+
+static inline bool overlaps(const Aabb& a, const Aabb& b) {
+    return a.mn.x <= b.mx.x && b.mn.x <= a.mx.x && a.mn.y <= b.mx.y && b.mn.y <= a.mx.y && a.mn.z <= b.mx.z &&
+           b.mn.z <= a.mx.z;
+}
+
+static inline bool same_box(const Aabb& a, const Aabb& b) {
+    return a.mn.x == b.mn.x && a.mn.y == b.mn.y && a.mn.z == b.mn.z && a.mx.x == b.mx.x && a.mx.y == b.mx.y &&
+           a.mx.z == b.mx.z;
+}
+
+// Area of the triangle's part inside the box (Sutherland-Hodgman against the
+// six slabs).
+static inline double clipped_area(Vec3 a, Vec3 b, Vec3 c, const Aabb& box) {
+    Vec3 poly[16] = {a, b, c}, tmp[16];
+    int n = 3;
+    for (int axis = 0; axis < 3 && n; ++axis) {
+        for (int side = 0; side < 2 && n; ++side) {
+            const float plane = side ? box.mx[axis] : box.mn[axis];
+            const float sign = side ? -1.0f : 1.0f; // inside: sign * (p - plane) >= 0
+            int inside = 0;
+            for (int i = 0; i < n; ++i) inside += sign * (poly[i][axis] - plane) >= 0.0f;
+            if (inside == n) continue;
+            if (inside == 0) return 0.0;
+            int m = 0;
+            for (int i = 0; i < n; ++i) {
+                Vec3 p = poly[i], q = poly[(i + 1) % n];
+                float dp = sign * (p[axis] - plane), dq = sign * (q[axis] - plane);
+                if (dp >= 0.0f) tmp[m++] = p;
+                if ((dp >= 0.0f) != (dq >= 0.0f)) {
+                    float t = dp / (dp - dq);
+                    Vec3 x = p + (q - p) * t;
+                    x[axis] = plane;
+                    tmp[m++] = x;
+                }
+            }
+            n = m;
+            for (int i = 0; i < n; ++i) poly[i] = tmp[i];
+        }
+    }
+    if (n < 3) return 0.0;
+    Vec3 s{0.0f, 0.0f, 0.0f};
+    for (int i = 1; i + 1 < n; ++i) {
+        Vec3 x = cross(poly[i] - poly[0], poly[i + 1] - poly[0]);
+        s = s + x;
+    }
+    return 0.5 * double(length(s));
+}
+
+class Analyzer {
+public:
+    Analyzer(const Bvh4& bvh, uint32_t arity) : bvh_(bvh), arity_(arity), visited_(bvh.nodes.size(), 0) {
+        uint32_t maxTri = 0;
+        for (const Bvh4Node& n : bvh.nodes)
+            if (n.leaf()) maxTri = std::max(maxTri, n.tri());
+        triSeen_.assign(size_t(maxTri) + 1, 0);
+    }
+
+    // Claims the node for this walk; false if another path got there first.
+    bool claim(uint32_t n) {
+        return std::atomic_ref<uint8_t>(visited_[n]).exchange(1, std::memory_order_relaxed) == 0;
+    }
+
+    void visit(const Item& it, Accum& a, std::vector<Item>& out) {
+        if (!claim(it.node)) {
+            a.shared++;
+            return;
+        }
+        const Bvh4Node& node = bvh_.nodes[it.node];
+        const double sa = node.box.area();
+        a.reachable++;
+        if (a.nodesAtDepth.size() <= it.depth) {
+            a.nodesAtDepth.resize(it.depth + 1, 0);
+            a.leavesAtDepth.resize(it.depth + 1, 0);
+        }
+        a.nodesAtDepth[it.depth]++;
+
+        if (node.leaf()) {
+            a.leaves++;
+            a.leavesAtDepth[it.depth]++;
+            a.leafDepthSum += it.depth;
+            a.sahLeaf += sa;
+            if (std::atomic_ref<uint8_t>(triSeen_[node.tri()]).exchange(1, std::memory_order_relaxed))
+                a.duplicateTris++;
+            return;
+        }
+
+        a.internals++;
+        a.sahInternal += sa;
+        uint32_t valid = 0, leafKids = 0;
+        for (uint32_t s = 0; s < arity_; ++s) {
+            uint32_t c = node.child[s];
+            if (c == INVALID) {
+                a.slotInvalid[s]++;
+                continue;
+            }
+            if (c >= bvh_.nodes.size()) {
+                a.badIndices++;
+                continue;
+            }
+            valid++;
+            const Bvh4Node& cn = bvh_.nodes[c];
+            if (cn.leaf()) leafKids++;
+            a.childSA += cn.box.area();
+            for (uint32_t t = s + 1; t < arity_; ++t) {
+                uint32_t d = node.child[t];
+                if (d != INVALID && d < bvh_.nodes.size()) a.overlapSA += intersect_area(cn.box, bvh_.nodes[d].box);
+            }
+            out.push_back({c, it.depth + 1});
+        }
+        a.childCount[valid]++;
+        a.leafChildren[leafKids]++;
+    }
+
+    void walk(const Item& root, Accum& a) {
+        std::vector<Item> stack{root};
+        while (!stack.empty()) {
+            Item it = stack.back();
+            stack.pop_back();
+            visit(it, a, stack);
+        }
+    }
+
+    uint64_t distinct_tris() const {
+        uint64_t n = 0;
+        for (uint8_t s : triSeen_) n += s;
+        return n;
+    }
+
+    bool reached(uint32_t n) const { return visited_[n] != 0; }
+
+private:
+    const Bvh4&          bvh_;
+    uint32_t             arity_;
+    std::vector<uint8_t> visited_;
+    std::vector<uint8_t> triSeen_;
+};
+
+static inline void merge(Accum& dst, const Accum& src) {
+    dst.reachable += src.reachable;
+    dst.internals += src.internals;
+    dst.leaves += src.leaves;
+    dst.duplicateTris += src.duplicateTris;
+    dst.shared += src.shared;
+    dst.badIndices += src.badIndices;
+    dst.sahInternal += src.sahInternal;
+    dst.sahLeaf += src.sahLeaf;
+    dst.overlapSA += src.overlapSA;
+    dst.childSA += src.childSA;
+    dst.leafDepthSum += src.leafDepthSum;
+    if (dst.nodesAtDepth.size() < src.nodesAtDepth.size()) {
+        dst.nodesAtDepth.resize(src.nodesAtDepth.size(), 0);
+        dst.leavesAtDepth.resize(src.nodesAtDepth.size(), 0);
+    }
+    for (size_t d = 0; d < src.nodesAtDepth.size(); ++d) {
+        dst.nodesAtDepth[d] += src.nodesAtDepth[d];
+        dst.leavesAtDepth[d] += src.leavesAtDepth[d];
+    }
+    for (int i = 0; i < 5; ++i) dst.childCount[i] += src.childCount[i];
+    for (int i = 0; i < 4; ++i) dst.slotInvalid[i] += src.slotInvalid[i];
+    for (int i = 0; i < 5; ++i) dst.leafChildren[i] += src.leafChildren[i];
+}
+
+// EPO, top-down: a node's outside triangles can only come from its parent's
+// outside set or its siblings' subtrees, so each node filters the list it is
+// handed instead of querying from the root. A list entry whose box lies
+// inside the node's box contributes its whole subtree area (precomputed);
+// leaves are clipped. Boxes are taken at their word: a stored box that does
+// not contain its children skews EPO the same way it skews traversal.
+class EpoWalker {
+public:
+    EpoWalker(const Bvh4& bvh, uint32_t arity, const Triangles& tris, const std::vector<double>& triArea,
+              const BvhQualityParams& params)
+        : bvh_(bvh), arity_(arity), tris_(tris), params_(params), subtreeArea_(bvh.nodes.size(), 0.0) {
+        std::vector<uint32_t> order, stack{0u};
+        order.reserve(bvh.nodes.size());
+        while (!stack.empty()) {
+            uint32_t n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            if (!bvh.nodes[n].leaf()) push_children(n, stack);
+        }
+        for (size_t i = order.size(); i-- > 0;) {
+            const Bvh4Node& node = bvh.nodes[order[i]];
+            double a = 0.0;
+            if (node.leaf()) {
+                a = node.tri() < triArea.size() ? triArea[node.tri()] : 0.0;
+            } else {
+                for (uint32_t s = 0; s < arity; ++s)
+                    if (node.child[s] != INVALID) a += subtreeArea_[node.child[s]];
+            }
+            subtreeArea_[order[i]] = a;
+        }
+    }
+
+    // Outside area of n from its candidate list; `kept` receives the entries
+    // that still overlap n (contained subtrees and leaves) for its children.
+    double refine(uint32_t n, const std::vector<uint32_t>& outside, std::vector<uint32_t>& kept,
+                  std::vector<uint32_t>& stack) const {
+        const Aabb box = bvh_.nodes[n].box;
+        double area = 0.0;
+        stack.assign(outside.begin(), outside.end());
+        while (!stack.empty()) {
+            uint32_t r = stack.back();
+            stack.pop_back();
+            const Bvh4Node& node = bvh_.nodes[r];
+            if (!overlaps(node.box, box)) continue;
+            if (box.contains(node.box)) {
+                area += subtreeArea_[r];
+                kept.push_back(r);
+            } else if (node.leaf()) {
+                // The fp16 leaf box is wider than the triangle; test the
+                // triangle's own box before clipping.
+                uint32_t t = node.tri();
+                if (t < tris_.count()) {
+                    if (box.contains(tris_.bounds(t))) area += subtreeArea_[r];
+                    else area += clipped_area(tris_.vertex(t, 0), tris_.vertex(t, 1), tris_.vertex(t, 2), box);
+                }
+                kept.push_back(r);
+            } else {
+                push_children(r, stack);
+            }
+        }
+        return (bvh_.nodes[n].leaf() ? params_.ci : params_.ct) * area;
+    }
+
+    // Candidate list for child slot s of n: n's kept entries plus the siblings.
+    void child_list(uint32_t n, uint32_t s, const std::vector<uint32_t>& kept, std::vector<uint32_t>& out) const {
+        out = kept;
+        for (uint32_t o = 0; o < arity_; ++o)
+            if (o != s && bvh_.nodes[n].child[o] != INVALID) out.push_back(bvh_.nodes[n].child[o]);
+    }
+
+    double walk(uint32_t n, const std::vector<uint32_t>& outside) const {
+        std::vector<uint32_t> kept, stack, list;
+        double sum = refine(n, outside, kept, stack);
+        if (bvh_.nodes[n].leaf()) return sum;
+        for (uint32_t s = 0; s < arity_; ++s) {
+            if (bvh_.nodes[n].child[s] == INVALID) continue;
+            child_list(n, s, kept, list);
+            sum += walk(bvh_.nodes[n].child[s], list);
+        }
+        return sum;
+    }
+
+private:
+    const Bvh4&             bvh_;
+    uint32_t                arity_;
+    const Triangles&        tris_;
+    BvhQualityParams        params_;
+    std::vector<double>     subtreeArea_;
+
+    void push_children(uint32_t n, std::vector<uint32_t>& stack) const {
+        for (uint32_t s = 0; s < arity_; ++s)
+            if (bvh_.nodes[n].child[s] != INVALID) stack.push_back(bvh_.nodes[n].child[s]);
+    }
+};
+
+// Cost-weighted outside area summed over the tree; breadth-first from the
+// root until every worker has subtrees, as in analyze_bvh.
+static inline double epo_sum(const Bvh4& bvh, uint32_t arity, const Triangles& tris,
+                             const std::vector<double>& triArea, const BvhQualityParams& params) {
+    EpoWalker walker(bvh, arity, tris, triArea, params);
+
+    struct Pending {
+        uint32_t              node;
+        std::vector<uint32_t> outside;
+    };
+    std::vector<Pending> items;
+    items.push_back({0u, {}});
+    double sum = 0.0;
+    const size_t target = size_t(worker_count()) * 16;
+    size_t head = 0;
+    std::vector<uint32_t> kept, stack;
+    while (head < items.size() && items.size() - head < target) {
+        const uint32_t n = items[head].node;
+        kept.clear();
+        sum += walker.refine(n, items[head].outside, kept, stack);
+        std::vector<uint32_t>().swap(items[head].outside);
+        ++head;
+        if (bvh.nodes[n].leaf()) continue;
+        for (uint32_t s = 0; s < arity; ++s) {
+            if (bvh.nodes[n].child[s] == INVALID) continue;
+            Pending p{bvh.nodes[n].child[s], {}};
+            walker.child_list(n, s, kept, p.outside);
+            items.push_back(std::move(p));
+        }
+    }
+
+    std::vector<double> perWorker(worker_count(), 0.0);
+    parallel_for_chunks(head, items.size(), 1, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) perWorker[w] += walker.walk(items[i].node, items[i].outside);
+    });
+    for (double s : perWorker) sum += s;
+    return sum;
+}
+
+} // namespace quality_detail
+
+// `tris` may be null; EPO is then left as NaN.
+static inline BvhQuality analyze_bvh(const Bvh4& bvh, uint32_t arity, const Triangles* tris,
+                                     const BvhQualityParams& params = {}) {
+    using namespace quality_detail;
+    TIMELINE_ZONE("bvh quality");
+    BenchTimer timer;
+    BvhQuality q;
+    q.arity = arity;
+    q.nodes = bvh.nodes.size();
+    q.fileBytes = 4 + q.nodes * q.node_bytes();
+    if (bvh.nodes.empty()) return q;
+
+    Analyzer an(bvh, arity);
+
+    // Breadth-first from the root until there are enough subtrees to keep
+    // every worker busy, then one DFS per subtree.
+    Accum top;
+    std::vector<Item> items{{0, 0}};
+    const size_t target = size_t(worker_count()) * 16;
+    size_t head = 0;
+    while (head < items.size() && items.size() - head < target) {
+        Item it = items[head++];
+        an.visit(it, top, items);
+    }
+
+    std::vector<Accum> perWorker(worker_count());
+    parallel_for_chunks(head, items.size(), 1, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) an.walk(items[i], perWorker[w]);
+    });
+    for (const Accum& a : perWorker) merge(top, a);
+
+    q.reachable = top.reachable;
+    q.internals = top.internals;
+    q.leaves = top.leaves;
+    q.orphans = q.nodes - q.reachable;
+    q.triangles = an.distinct_tris();
+    q.duplicateTris = top.duplicateTris;
+    q.shared = top.shared;
+    q.badIndices = top.badIndices;
+    q.rootSA = bvh.nodes[0].box.area();
+    q.overlapSA = top.overlapSA;
+    q.childSA = top.childSA;
+    q.sah = q.rootSA > 0.0 ? (params.ct * top.sahInternal + params.ci * top.sahLeaf) / q.rootSA : 0.0;
+    q.nodesAtDepth = top.nodesAtDepth;
+    q.leavesAtDepth = top.leavesAtDepth;
+    q.maxDepth = q.nodesAtDepth.empty() ? 0 : uint32_t(q.nodesAtDepth.size() - 1);
+    q.meanLeafDepth = q.leaves ? top.leafDepthSum / double(q.leaves) : 0.0;
+    for (int i = 0; i < 5; ++i) q.childCount[i] = top.childCount[i];
+    for (int i = 0; i < 4; ++i) q.slotInvalid[i] = top.slotInvalid[i];
+    for (int i = 0; i < 5; ++i) q.leafChildren[i] = top.leafChildren[i];
+
+    if (tris && params.epo && q.shared == 0 && q.badIndices == 0) {
+        TIMELINE_ZONE("epo");
+        BenchTimer epoTimer;
+        std::vector<double> triArea(tris->count());
+        parallel_for(0, tris->count(), 1 << 14, [&](size_t t) {
+            Vec3 a = tris->vertex(uint32_t(t), 0);
+            triArea[t] = 0.5 * double(length(cross(tris->vertex(uint32_t(t), 1) - a, tris->vertex(uint32_t(t), 2) - a)));
+        });
+        double total = 0.0;
+        for (double a : triArea) total += a;
+        if (total > 0.0) q.epo = epo_sum(bvh, arity, *tris, triArea, params) / total;
+        q.epoMs = epoTimer.ms();
+    }
+    q.ms = timer.ms();
+    return q;
+}
+
+/* ================= Reporting ================= */
+
+static inline void print_bvh_quality(FILE* out, const char* label, const BvhQuality& q) {
+    auto pct = [](uint64_t a, uint64_t b) { return b ? 100.0 * double(a) / double(b) : 0.0; };
+
+    std::fprintf(out, "=== BVH%u quality: %s ===\n", q.arity, label);
+    std::fprintf(out, "nodes          %llu (%.2f MB), %llu triangles, %.1f bytes/tri (%.1f reachable)\n",
+                 (unsigned long long)q.nodes, q.fileBytes / 1048576.0, (unsigned long long)q.triangles,
+                 q.bytes_per_tri(), q.reachable_bytes_per_tri());
+    std::fprintf(out, "reachable      %llu: %llu internal, %llu leaves; orphans %llu (%.2f MB)\n",
+                 (unsigned long long)q.reachable, (unsigned long long)q.internals, (unsigned long long)q.leaves,
+                 (unsigned long long)q.orphans, q.orphans * q.node_bytes() / 1048576.0);
+    if (q.shared || q.badIndices || q.duplicateTris)
+        std::fprintf(out, "BROKEN         %llu shared links, %llu bad indices, %llu duplicate triangles\n",
+                     (unsigned long long)q.shared, (unsigned long long)q.badIndices,
+                     (unsigned long long)q.duplicateTris);
+    std::fprintf(out, "SAH cost       %.2f\n", q.sah);
+    if (std::isnan(q.epo)) std::fprintf(out, "EPO            n/a (needs the mesh: bin/quality --scene)\n");
+    else std::fprintf(out, "EPO            %.2f (%.0f ms)\n", q.epo, q.epoMs);
+    std::fprintf(out, "overlap        siblings %.2f x root SA, %.1f%% of child SA\n",
+                 q.rootSA > 0.0 ? q.overlapSA / q.rootSA : 0.0, q.childSA > 0.0 ? 100.0 * q.overlapSA / q.childSA : 0.0);
+    std::fprintf(out, "depth          max %u, mean leaf %.2f\n", q.maxDepth, q.meanLeafDepth);
+
+    std::fprintf(out, "child slots   ");
+    for (uint32_t k = 0; k <= q.arity; ++k)
+        std::fprintf(out, " %u:%.1f%%", k, pct(q.childCount[k], q.internals));
+    std::fprintf(out, "\nslot INVALID  ");
+    for (uint32_t s = 0; s < q.arity; ++s)
+        std::fprintf(out, " [%u] %.1f%%", s, pct(q.slotInvalid[s], q.internals));
+    std::fprintf(out, "\nleaf children ");
+    for (uint32_t k = 0; k <= q.arity; ++k)
+        std::fprintf(out, " %u:%.1f%%", k, pct(q.leafChildren[k], q.internals));
+
+    std::fprintf(out, "\n%5s %10s %10s\n", "depth", "nodes", "leaves");
+    for (size_t d = 0; d < q.nodesAtDepth.size(); ++d)
+        std::fprintf(out, "%5zu %10llu %10llu\n", d, (unsigned long long)q.nodesAtDepth[d],
+                     (unsigned long long)q.leavesAtDepth[d]);
+    std::fprintf(out, "analyzed in %.1f ms on %u threads\n", q.ms, worker_count());
+}
+
+static inline void write_bvh_quality_json(JsonWriter& w, const BvhQuality& q) {
+    w.value("arity", q.arity);
+    w.value("nodes", q.nodes);
+    w.value("file_bytes", q.fileBytes);
+    w.value("reachable", q.reachable);
+    w.value("internals", q.internals);
+    w.value("leaves", q.leaves);
+    w.value("orphans", q.orphans);
+    w.value("orphan_bytes", q.orphans * q.node_bytes());
+    w.value("triangles", q.triangles);
+    w.value("duplicate_triangles", q.duplicateTris);
+    w.value("shared_links", q.shared);
+    w.value("bad_indices", q.badIndices);
+    w.value("bytes_per_tri", q.bytes_per_tri());
+    w.value("reachable_bytes_per_tri", q.reachable_bytes_per_tri());
+    w.value("sah", q.sah);
+    w.value("epo", q.epo);
+    w.value("root_sa", q.rootSA);
+    w.value("sibling_overlap_sa", q.overlapSA);
+    w.value("sibling_overlap_vs_root", q.rootSA > 0.0 ? q.overlapSA / q.rootSA : 0.0);
+    w.value("sibling_overlap_vs_children", q.childSA > 0.0 ? q.overlapSA / q.childSA : 0.0);
+    w.value("max_depth", q.maxDepth);
+    w.value("mean_leaf_depth", q.meanLeafDepth);
+    w.begin_array("nodes_at_depth");
+    for (uint64_t n : q.nodesAtDepth) w.value(n);
+    w.end_array();
+    w.begin_array("leaves_at_depth");
+    for (uint64_t n : q.leavesAtDepth) w.value(n);
+    w.end_array();
+    w.begin_array("child_count");
+    for (uint32_t k = 0; k <= q.arity; ++k) w.value(q.childCount[k]);
+    w.end_array();
+    w.begin_array("slot_invalid");
+    for (uint32_t s = 0; s < q.arity; ++s) w.value(q.slotInvalid[s]);
+    w.end_array();
+    w.begin_array("leaf_children");
+    for (uint32_t k = 0; k <= q.arity; ++k) w.value(q.leafChildren[k]);
+    w.end_array();
+    w.value("ms", q.ms);
+    w.value("epo_ms", q.epoMs);
+}
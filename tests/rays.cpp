@@ -0,0 +1,194 @@
+// rays.cpp
+// Capture and replay of ray sets (rayset.hpp). --write generates the rays
+// of one camera pose over a scene, answers them with the app's BVH4 and
+// stores rays + reference hits; --replay feeds a stored set to any number
+// of traversal kernels, times each ray kind and checks every answer
+// against the stored one.
+//
+//   bin/rays --write rays.bin [--scene public/assets/dragon.glb]
+//            [--kinds primary,shadow,ao,diffuse] [--size 640x360]
+//            [--pos 0,0,2.5] [--quat 0,0,0,1] [--fov 70] [--ao-dist 0.25]
+//   bin/rays --replay rays.bin [--scene public/assets/dragon.glb]
+//            [--kernels bvh4,kdtree,grid,data/BVH4_wide.bin]
+//            [--reps 3] [--json out.json|-]
+//
+// A kernel is an accel.hpp name (built from the scene in-process) or a
+// BVH2 / BVH4 file traversed with trace.hpp. The scene must be the one the
+// set was captured over (triangle count and hash in the header). Replay
+// reports the median of --reps timed passes and exits 1 on any mismatch.
+// The app's BVH files do mismatch: their nearest-rounded fp16 boxes lose
+// a few hits (bin/inflation), so they are not in the default list.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "accel.hpp"
+#include "args.hpp"
+#include "bench.hpp"
+#include "json.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "rayset.hpp"
+
+struct ReplayResult {
+    std::string kernel;
+    uint32_t    kind = 0;
+    uint64_t    rays = 0;
+    uint64_t    mismatches = 0;
+    uint64_t    nodes = 0;
+    BenchPhase  phase;
+};
+
+static ReplayResult replay_kind(const Accel& accel, const RaySet& set, uint32_t kind, uint32_t reps) {
+    ReplayResult r;
+    r.kernel = accel.name();
+    r.kind = kind;
+    size_t begin, end;
+    set.range(kind, begin, end);
+    r.rays = end - begin;
+    r.phase.name = RAY_KIND_NAMES[kind];
+    r.phase.items = r.rays;
+    const bool closest = ray_kind_closest(kind);
+
+    std::vector<Hit> got(end - begin);
+    for (uint32_t rep = 0; rep < reps; ++rep) {
+        BenchTimer t;
+        parallel_for(begin, end, 256, [&](size_t i) {
+            if (closest) got[i - begin] = accel.intersect(set.rays[i]);
+            else got[i - begin].tri = accel.occluded(set.rays[i]) ? 0u : INVALID;
+        });
+        r.phase.ms.push_back(t.ms());
+    }
+    if (!set.ref.empty())
+        for (size_t i = begin; i < end; ++i) r.mismatches += !ray_result_matches(kind, got[i - begin], set.ref[i]);
+
+    std::vector<TraceStats> perWorker(worker_count());
+    parallel_for_chunks(begin, end, 256, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) {
+            if (closest) accel.intersect(set.rays[i], &perWorker[w]);
+            else accel.occluded(set.rays[i], &perWorker[w]);
+        }
+    });
+    for (const TraceStats& ts : perWorker) r.nodes += ts.nodes;
+    return r;
+}
+
+static int write_mode(const Args& args, const std::string& outPath, const Triangles& tris) {
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+    uint32_t kinds = 0;
+    if (!parse_ray_kinds(args.strs("kinds", "primary,shadow,ao,diffuse"), kinds) || !kinds) {
+        std::cerr << "--kinds takes primary, shadow, ao, diffuse\n";
+        return 1;
+    }
+    Camera cam;
+    std::vector<double> pos = args.nums("pos", ""), quat = args.nums("quat", "");
+    if (pos.size() == 3) cam.pos = {float(pos[0]), float(pos[1]), float(pos[2])};
+    if (quat.size() == 4)
+        for (int k = 0; k < 4; ++k) cam.quat[k] = float(quat[k]);
+    cam.fovDeg = float(args.num("fov", cam.fovDeg));
+
+    Bvh4Accel ref;
+    ref.build(tris);
+    RaySet set = generate_ray_set(
+        tris, cam, width, height, kinds, float(args.num("ao-dist", 0.25)),
+        [&](const Ray& r) { return ref.intersect(r, nullptr); },
+        [&](const Ray& r) { return ref.occluded(r, nullptr); });
+    if (!write_ray_set(outPath.c_str(), set)) {
+        std::cerr << "Failed to write " << outPath << "\n";
+        return 1;
+    }
+
+    std::printf("%s: %zu rays (", outPath.c_str(), set.size());
+    for (uint32_t k = 0; k < RAY_KINDS; ++k) {
+        size_t b, e;
+        set.range(k, b, e);
+        std::printf("%s%s %zu", k ? ", " : "", RAY_KIND_NAMES[k], e - b);
+    }
+    std::printf("), %.1f MB\n", double(sizeof(RaySetHeader) + set.size() * (sizeof(RayRecord) + sizeof(RefRecord))) /
+                                    double(1 << 20));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string writePath = args.str("write", ""), replayPath = args.str("replay", "");
+    std::string jsonPath = args.str("json", "");
+    if (writePath.empty() == replayPath.empty()) {
+        std::cerr << "Give one of --write FILE or --replay FILE\n";
+        return 1;
+    }
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    if (!writePath.empty()) return write_mode(args, writePath, tris);
+
+    RaySet set;
+    if (!read_ray_set(replayPath.c_str(), set)) return 1;
+    if (set.sceneTris != tris.count() || set.sceneHash != scene_hash(tris)) {
+        std::cerr << replayPath << " was captured over a different scene (" << set.sceneTris << " tris) than "
+                  << scenePath << " (" << tris.count() << " tris)\n";
+        return 1;
+    }
+    uint32_t reps = std::max(args.u32("reps", 3), 1u);
+
+    std::vector<std::unique_ptr<Accel>> kernels;
+    for (const std::string& name : args.strs("kernels", "bvh4,kdtree,grid")) {
+        std::unique_ptr<Accel> a = make_accel_or_file(name);
+        if (!a) return 1;
+        a->build(tris);
+        kernels.push_back(std::move(a));
+    }
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %zu rays, %ux%u, %s, %u reps, %u threads%s\n\n", replayPath.c_str(), set.size(),
+                 set.width, set.height, scenePath.c_str(), reps, worker_count(),
+                 set.ref.empty() ? ", no reference hits" : "");
+    std::fprintf(text, "%-22s %-8s %9s %10s %9s %10s %9s\n", "kernel", "kind", "rays", "median ms", "Mrays/s",
+                 "nodes/ray", "mismatch");
+
+    std::vector<ReplayResult> results;
+    uint64_t mismatches = 0;
+    for (const auto& k : kernels)
+        for (uint32_t kind = 0; kind < RAY_KINDS; ++kind) {
+            ReplayResult r = replay_kind(*k, set, kind, reps);
+            if (!r.rays) continue;
+            BenchSummary s = summarize(r.phase.ms);
+            std::fprintf(text, "%-22s %-8s %9llu %10.2f %9.2f %10.1f %9llu\n", r.kernel.c_str(),
+                         RAY_KIND_NAMES[kind], (unsigned long long)r.rays, s.median, r.phase.items_per_s(s) * 1e-6,
+                         double(r.nodes) / double(r.rays), (unsigned long long)r.mismatches);
+            mismatches += r.mismatches;
+            results.push_back(std::move(r));
+        }
+    int status = mismatches ? 1 : 0;
+    if (status) std::fprintf(text, "\nFAIL: %llu answers differ from the stored references\n",
+                             (unsigned long long)mismatches);
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/rays");
+    w.value("rayset", replayPath);
+    w.value("scene", scenePath);
+    w.value("rays", uint64_t(set.size()));
+    w.begin_array("results");
+    for (const ReplayResult& r : results) {
+        w.begin_object();
+        w.value("kernel", r.kernel);
+        w.value("nodes", r.nodes);
+        w.value("mismatches", r.mismatches);
+        write_bench_phase(w, r.phase, "rays");
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+// rayset.hpp
+// Ray sets: the primary, sun-shadow, AO and diffuse-bounce rays of one
+// camera pose, with the reference answer for each, so every traversal
+// kernel can be timed and checked on identical inputs. Secondary rays
+// leave from the exact primary hits (1e-4 along the facing normal); AO
+// and diffuse share one cosine-weighted direction per pixel, AO capped at
+// aoDist. Primary and diffuse rays ask for the closest hit, shadow and AO
+// rays only for occlusion (ref.tri 0 = blocked, INVALID = clear).
+//
+// File layout (little-endian, as the GPU buffers):
+//   RaySetHeader                96 bytes
+//   RayRecord x count           40 bytes each: origin, dir, tmin, tmax, kind, pixel
+//   RefRecord x count           8 bytes each: t, tri (when RAYSET_HAS_REFS)
+// Rays are stored grouped by kind, in kind order. The header carries the
+// camera, frame size and a hash of the scene's triangles; replaying over
+// another scene is refused.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+enum RayKind : uint32_t { RAY_PRIMARY = 0, RAY_SHADOW, RAY_AO, RAY_DIFFUSE, RAY_KINDS };
+
+static inline const char* const RAY_KIND_NAMES[RAY_KINDS] = {"primary", "shadow", "ao", "diffuse"};
+
+static inline bool ray_kind_closest(uint32_t kind) { return kind == RAY_PRIMARY || kind == RAY_DIFFUSE; }
+
+// Bit mask of kinds from names; false on an unknown name.
+static inline bool parse_ray_kinds(const std::vector<std::string>& names, uint32_t& mask) {
+    mask = 0;
+    for (const std::string& n : names) {
+        uint32_t k = 0;
+        while (k < RAY_KINDS && n != RAY_KIND_NAMES[k]) ++k;
+        if (k == RAY_KINDS) return false;
+        mask |= 1u << k;
+    }
+    return true;
+}
+
+static constexpr uint32_t RAYSET_MAGIC = 0x53594152u; // "RAYS"
+static constexpr uint32_t RAYSET_VERSION = 1;
+static constexpr uint32_t RAYSET_HAS_REFS = 1u;
+
+struct RaySetHeader {
+    uint32_t magic = RAYSET_MAGIC;
+    uint32_t version = RAYSET_VERSION;
+    uint64_t count = 0;
+    uint32_t width = 0, height = 0;
+    uint32_t sceneTris = 0;
+    uint32_t flags = 0;
+    uint64_t sceneHash = 0;
+    float    camPos[3] = {};
+    float    camQuat[4] = {};
+    float    fovDeg = 0.0f;
+    float    aoDist = 0.0f;
+    uint32_t kindCount[RAY_KINDS] = {};
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(RaySetHeader) == 96, "RaySetHeader is a file format");
+
+struct RayRecord {
+    float    origin[3], dir[3];
+    float    tmin, tmax;
+    uint32_t kind;
+    uint32_t pixel; // y * width + x of the primary ray it came from
+};
+static_assert(sizeof(RayRecord) == 40, "RayRecord is a file format");
+
+struct RefRecord {
+    float    t;
+    uint32_t tri;
+};
+static_assert(sizeof(RefRecord) == 8, "RefRecord is a file format");
+
+struct RaySet {
+    uint32_t width = 0, height = 0;
+    Camera   camera;
+    float    aoDist = 0.25f;
+    uint32_t sceneTris = 0;
+    uint64_t sceneHash = 0;
+
+    std::vector<Ray>      rays;
+    std::vector<uint32_t> kind;
+    std::vector<uint32_t> pixel;
+    std::vector<Hit>      ref; // empty when the set carries no references
+
+    size_t size() const { return rays.size(); }
+
+    // [begin, end) of the rays of one kind.
+    void range(uint32_t k, size_t& begin, size_t& end) const {
+        begin = 0;
+        while (begin < kind.size() && kind[begin] < k) ++begin;
+        end = begin;
+        while (end < kind.size() && kind[end] == k) ++end;
+    }
+};
+
+// FNV-1a over the vertex floats.
+static inline uint64_t scene_hash(const Triangles& tris) {
+    uint64_t h = 1469598103934665603ull;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(tris.v.data());
+    for (size_t i = 0, n = tris.v.size() * sizeof(float); i < n; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+/* ================= Generation ================= */
+
+// `closest(ray) -> Hit` and `occluded(ray) -> bool` are the reference
+// kernel: it finds the primary hits and answers every ray.
+template <class Closest, class Occluded>
+static inline RaySet generate_ray_set(const Triangles& tris, const Camera& cam, uint32_t width, uint32_t height,
+                                      uint32_t kindMask, float aoDist, Closest&& closest, Occluded&& occluded) {
+    RaySet set;
+    set.width = width;
+    set.height = height;
+    set.camera = cam;
+    set.aoDist = aoDist;
+    set.sceneTris = tris.count();
+    set.sceneHash = scene_hash(tris);
+
+    const size_t n = size_t(width) * height;
+    std::vector<Ray> primary(n);
+    std::vector<Hit> primaryHit(n);
+    for (size_t i = 0; i < n; ++i)
+        primary[i] = primary_ray(cam, float(i % width), float(i / width), width, height);
+    parallel_for(0, n, 256, [&](size_t i) { primaryHit[i] = closest(primary[i]); });
+
+    std::vector<Ray> byKind[RAY_KINDS];
+    std::vector<uint32_t> pixels[RAY_KINDS];
+    byKind[RAY_PRIMARY] = primary;
+    pixels[RAY_PRIMARY].resize(n);
+    for (size_t i = 0; i < n; ++i) pixels[RAY_PRIMARY][i] = uint32_t(i);
+
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    for (size_t i = 0; i < n; ++i) {
+        const Ray& pr = primary[i];
+        const Hit& hit = primaryHit[i];
+        if (!hit.hit()) continue;
+        Vec3 nrm = tris.normal(hit.tri);
+        if (dot(nrm, pr.dir) > 0.0f) nrm = -nrm;
+        Vec3 p = pr.origin + pr.dir * hit.t + nrm * 1e-4f;
+
+        if (dot(nrm, lightDir) > 0.0f) {
+            byKind[RAY_SHADOW].push_back(Ray{p, lightDir, 0.0f, INF});
+            pixels[RAY_SHADOW].push_back(uint32_t(i));
+        }
+        Rng rng(uint64_t(i), 11);
+        float u1 = rng.uniform(), u2 = rng.uniform();
+        Vec3 d = sample_cosine_hemisphere(nrm, u1, u2);
+        byKind[RAY_AO].push_back(Ray{p, d, 0.0f, aoDist});
+        pixels[RAY_AO].push_back(uint32_t(i));
+        byKind[RAY_DIFFUSE].push_back(Ray{p, d, 0.0f, INF});
+        pixels[RAY_DIFFUSE].push_back(uint32_t(i));
+    }
+
+    for (uint32_t k = 0; k < RAY_KINDS; ++k) {
+        if (!(kindMask >> k & 1u)) continue;
+        set.rays.insert(set.rays.end(), byKind[k].begin(), byKind[k].end());
+        set.pixel.insert(set.pixel.end(), pixels[k].begin(), pixels[k].end());
+        set.kind.resize(set.rays.size(), k);
+    }
+
+    set.ref.resize(set.size());
+    parallel_for(0, set.size(), 256, [&](size_t i) {
+        if (ray_kind_closest(set.kind[i])) {
+            set.ref[i] = closest(set.rays[i]);
+        } else {
+            set.ref[i].tri = occluded(set.rays[i]) ? 0u : INVALID;
+        }
+    });
+    return set;
+}
+
+/* ================= File I/O ================= */
+
+static inline bool write_ray_set(const char* path, const RaySet& set) {
+    RaySetHeader h;
+    h.count = set.size();
+    h.width = set.width;
+    h.height = set.height;
+    h.sceneTris = set.sceneTris;
+    h.sceneHash = set.sceneHash;
+    h.flags = set.ref.size() == set.size() ? RAYSET_HAS_REFS : 0u;
+    h.camPos[0] = set.camera.pos.x;
+    h.camPos[1] = set.camera.pos.y;
+    h.camPos[2] = set.camera.pos.z;
+    std::memcpy(h.camQuat, set.camera.quat, sizeof(h.camQuat));
+    h.fovDeg = set.camera.fovDeg;
+    h.aoDist = set.aoDist;
+    for (uint32_t k : set.kind) h.kindCount[k]++;
+
+    std::vector<RayRecord> recs(set.size());
+    for (size_t i = 0; i < set.size(); ++i) {
+        const Ray& r = set.rays[i];
+        recs[i] = RayRecord{{r.origin.x, r.origin.y, r.origin.z}, {r.dir.x, r.dir.y, r.dir.z}, r.tmin, r.tmax,
+                            set.kind[i], set.pixel[i]};
+    }
+
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    f.write(reinterpret_cast<const char*>(recs.data()), std::streamsize(recs.size() * sizeof(RayRecord)));
+    if (h.flags & RAYSET_HAS_REFS) {
+        std::vector<RefRecord> refs(set.size());
+        for (size_t i = 0; i < set.size(); ++i) refs[i] = RefRecord{set.ref[i].t, set.ref[i].tri};
+        f.write(reinterpret_cast<const char*>(refs.data()), std::streamsize(refs.size() * sizeof(RefRecord)));
+    }
+    return bool(f);
+}
+
+// Prints the reason to stderr on failure.
+static inline bool read_ray_set(const char* path, RaySet& set) {
+    std::ifstream f(path, std::ios::binary);
+    RaySetHeader h;
+    if (!f || !f.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+        std::cerr << "Failed to read " << path << "\n";
+        return false;
+    }
+    if (h.magic != RAYSET_MAGIC || h.version != RAYSET_VERSION) {
+        std::cerr << path << ": not a version " << RAYSET_VERSION << " ray set\n";
+        return false;
+    }
+
+    // Check the header's count against the file before sizing anything by it.
+    const uint64_t perRay = sizeof(RayRecord) + (h.flags & RAYSET_HAS_REFS ? sizeof(RefRecord) : 0);
+    f.seekg(0, std::ios::end);
+    const uint64_t payload = uint64_t(f.tellg()) - sizeof(h);
+    f.seekg(sizeof(h));
+    if (!f || uint64_t(h.count) > payload / perRay) {
+        std::cerr << path << ": truncated (" << h.count << " rays in the header)\n";
+        return false;
+    }
+
+    std::vector<RayRecord> recs(h.count);
+    if (!f.read(reinterpret_cast<char*>(recs.data()), std::streamsize(recs.size() * sizeof(RayRecord)))) {
+        std::cerr << path << ": truncated (" << h.count << " rays in the header)\n";
+        return false;
+    }
+    std::vector<RefRecord> refs;
+    if (h.flags & RAYSET_HAS_REFS) {
+        refs.resize(h.count);
+        if (!f.read(reinterpret_cast<char*>(refs.data()), std::streamsize(refs.size() * sizeof(RefRecord)))) {
+            std::cerr << path << ": truncated reference hits\n";
+            return false;
+        }
+    }
+
+    set = RaySet{};
+    set.width = h.width;
+    set.height = h.height;
+    set.camera.pos = {h.camPos[0], h.camPos[1], h.camPos[2]};
+    std::memcpy(set.camera.quat, h.camQuat, sizeof(h.camQuat));
+    set.camera.fovDeg = h.fovDeg;
+    set.aoDist = h.aoDist;
+    set.sceneTris = h.sceneTris;
+    set.sceneHash = h.sceneHash;
+    set.rays.resize(h.count);
+    set.kind.resize(h.count);
+    set.pixel.resize(h.count);
+    for (size_t i = 0; i < recs.size(); ++i) {
+        const RayRecord& r = recs[i];
+        if (r.kind >= RAY_KINDS || (i && r.kind < recs[i - 1].kind)) {
+            std::cerr << path << ": ray " << i << " has a bad or out-of-order kind " << r.kind << "\n";
+            return false;
+        }
+        set.rays[i] = Ray{{r.origin[0], r.origin[1], r.origin[2]}, {r.dir[0], r.dir[1], r.dir[2]}, r.tmin, r.tmax};
+        set.kind[i] = r.kind;
+        set.pixel[i] = r.pixel;
+    }
+    if (!refs.empty()) {
+        set.ref.resize(h.count);
+        for (size_t i = 0; i < refs.size(); ++i) {
+            set.ref[i].t = refs[i].t;
+            set.ref[i].tri = refs[i].tri;
+        }
+    }
+    return true;
+}
+
+// Same test as bin/accel: a closest hit mismatches only if hit/miss or t
+// differs (coplanar triangles may tie), an occlusion answer if it flips.
+static inline bool ray_result_matches(uint32_t kind, const Hit& got, const Hit& ref) {
+    if (!ray_kind_closest(kind)) return got.hit() == ref.hit();
+    return got.hit() == ref.hit() && (!got.hit() || std::fabs(got.t - ref.t) <= 1e-4f * (1.0f + ref.t));
+}
@@ -0,0 +1,480 @@
+// regress.cpp
+// Benchmark regression gate for the builder, converter and traversal.
+// Runs a fixed suite in-process, compares every case against a baseline
+// recorded on the same machine and exits 1 when any case is significantly
+// slower.
+//
+//   bin/regress [--baseline data/bench_baseline.json] [--cases convert,morton,...]
+//               [--reps 10] [--warmup 2] [--alpha 0.01] [--force] [--json out.json|-]
+//   bin/regress --record [--calibrate 5] [--floor 0.02] [--baseline ...]
+//
+// Cases (dragon by default; --scene, --bvh2 and --size change the inputs):
+//
+//   convert   BVH2 -> BVH4 promotion of --bvh2 (lbvh.hpp, as bin/test)
+//   morton    centroid quantization + Morton codes
+//   sort      sort of the (code, tri) keys
+//   lbvh2     LBVH2 connectivity + fp16 bounds
+//   trace     primary rays from the default camera through the BVH4
+//
+// A case regresses when both hold:
+//
+//   - Mann-Whitney: current samples rank above the baseline's, one-sided
+//     p < --alpha
+//   - the 95% bootstrap interval of median(current) / median(baseline) lies
+//     entirely above 1 + threshold
+//
+// The rank test alone flags shifts far below anything that matters; the
+// threshold keeps run-to-run drift (page placement, frequency, other load)
+// from failing the gate. It is calibrated by --record: the suite runs in
+// --calibrate separate processes, and each case's threshold is
+// max(--floor, 3 * sqrt(2) * relative stddev of the per-process medians),
+// i.e. three standard deviations of the difference of two runs. The
+// baseline keeps every calibration sample, pooled. The thresholds are only
+// as tight as the machine is quiet: on a shared 1-core sandbox they come
+// out at 17-64%, which catches gross regressions and nothing else, and
+// --record says so when a case is above 10%. Record on a dedicated,
+// idle host.
+//
+// Every suite run, calibration or gate, is a fresh `--once` child process,
+// so both sides see the same process-level conditions. The trace loop runs
+// under MemHotLoop (memtrack.hpp); a child that allocates there fails.
+//
+// Timings are only comparable on the machine that recorded the baseline:
+// same CPU model, thread count, compiler and compile flags (machine_id()).
+// On a mismatch the gate is skipped (exit 0) with a message instead of
+// reporting every case as a regression; --force compares anyway. The
+// baseline is machine-local and not checked in (data/bench_baseline.json
+// is ignored): record it with --record on the host that runs the gate.
+// --inject 1.1 multiplies the measured times, to check the gate fires.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+static const char* const CASE_NAMES[] = {"convert", "morton", "sort", "lbvh2", "trace"};
+
+struct SuiteParams {
+    std::string              scenePath = "public/assets/dragon.glb";
+    std::string              bvh2Path = "data/BVH2.bin";
+    std::vector<std::string> cases;
+    uint32_t                 reps = 10, warmup = 2;
+    uint32_t                 width = 320, height = 180;
+};
+
+using Samples = std::map<std::string, std::vector<double>>;
+
+static std::string cpu_model() {
+    std::ifstream f("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.rfind("model name", 0) != 0) continue;
+        size_t c = line.find(':');
+        if (c != std::string::npos) return line.substr(line.find_first_not_of(" \t", c + 1));
+    }
+    return "unknown CPU";
+}
+
+// build/build-test.sh passes its CXXFLAGS as RT_BUILD_FLAGS; other builds
+// get what the predefined macros reveal (no -O2/-O3 split, no -flto).
+static std::string build_flags() {
+#ifdef RT_BUILD_FLAGS
+    return RT_BUILD_FLAGS;
+#else
+    std::string s;
+#if defined(__OPTIMIZE_SIZE__)
+    s += "-Os";
+#elif defined(__OPTIMIZE__)
+    s += "-O";
+#else
+    s += "-O0";
+#endif
+#if defined(__AVX512F__)
+    s += " avx512f";
+#elif defined(__AVX2__)
+    s += " avx2";
+#elif defined(__SSE4_2__)
+    s += " sse4.2";
+#endif
+#ifdef __FMA__
+    s += " fma";
+#endif
+#ifdef __FAST_MATH__
+    s += " fast-math";
+#endif
+    return s;
+#endif
+}
+
+static std::string machine_id() {
+    return cpu_model() + ", " + std::to_string(std::thread::hardware_concurrency()) + " threads, g++ " +
+           __VERSION__ + ", " + build_flags() + (RT_COUNTERS ? "" : " RT_COUNTERS=0");
+}
+
+/* ================= Suite ================= */
+
+template <typename Setup, typename Fn>
+static void time_case(const SuiteParams& sp, std::vector<double>& out, Setup&& setup, Fn&& fn) {
+    for (uint32_t i = 0; i < sp.warmup + sp.reps; ++i) {
+        setup();
+        BenchTimer t;
+        fn();
+        double ms = t.ms();
+        if (i >= sp.warmup) out.push_back(ms);
+    }
+}
+
+static bool run_suite(const SuiteParams& sp, Samples& out) {
+    auto wants = [&](const char* name) {
+        return std::find(sp.cases.begin(), sp.cases.end(), name) != sp.cases.end();
+    };
+
+    if (wants("convert")) {
+        std::vector<uint32_t> bvh2, bvh4;
+        if (!load_u32_file(sp.bvh2Path.c_str(), bvh2) || bvh2.empty()) {
+            std::cerr << "Failed to read BVH2 " << sp.bvh2Path << "\n";
+            return false;
+        }
+        time_case(sp, out["convert"], [&] { bvh4.clear(); }, [&] { bvh4 = promote_bvh4(bvh2); });
+    }
+
+    if (!wants("morton") && !wants("sort") && !wants("lbvh2") && !wants("trace")) return true;
+    Triangles tris;
+    if (!load_scene(sp.scenePath.c_str(), tris)) return false;
+    std::vector<uint64_t> keys = morton_keys(tris), scratch;
+    MortonOrder order = sort_morton_keys(scratch = keys);
+    std::vector<uint32_t> bvh2;
+
+    if (wants("morton")) time_case(sp, out["morton"], [] {}, [&] { scratch = morton_keys(tris); });
+    if (wants("sort"))
+        time_case(sp, out["sort"], [&] { scratch = keys; }, [&] { order = sort_morton_keys(scratch); });
+    if (wants("lbvh2")) time_case(sp, out["lbvh2"], [&] { bvh2.clear(); }, [&] { bvh2 = build_lbvh2(tris, order); });
+
+    if (wants("trace")) {
+        Bvh4 bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, order)));
+        Camera cam;
+        const size_t n = size_t(sp.width) * sp.height;
+        std::vector<uint64_t> hits(worker_count());
+        time_case(sp, out["trace"], [] {}, [&] {
+            parallel_for_chunks(0, n, 256, [&](size_t b, size_t e, unsigned w) {
+                MemHotLoop hot("trace");
+                for (size_t i = b; i < e; ++i) {
+                    Ray r = primary_ray(cam, float(i % sp.width), float(i / sp.width), sp.width, sp.height);
+                    hits[w] += trace_closest(bvh, tris, r).hit();
+                }
+            });
+        });
+    }
+    return true;
+}
+
+/* ================= Baseline ================= */
+
+struct CaseBaseline {
+    std::vector<double> samples;    // pooled over the calibration runs
+    std::vector<double> runMedians; // one per calibration process
+    double              noise = 0.0;     // relative stddev of runMedians
+    double              threshold = 0.0; // relative slowdown that counts
+};
+
+struct Baseline {
+    std::string                         machine;
+    uint32_t                            reps = 0, runs = 0;
+    std::map<std::string, CaseBaseline> cases;
+};
+
+static bool load_baseline(const std::string& path, Baseline& out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::stringstream ss;
+    ss << f.rdbuf();
+    JsonValue doc;
+    if (!parse_json(ss.str(), doc) || doc.type != JsonValue::Object) return false;
+    out.machine = doc["machine"].str;
+    out.reps = uint32_t(doc["reps"].number());
+    out.runs = uint32_t(doc["runs"].number());
+    for (const auto& [name, c] : doc["cases"].obj) {
+        CaseBaseline cb;
+        for (const JsonValue& v : c["samples_ms"].arr) cb.samples.push_back(v.number());
+        for (const JsonValue& v : c["run_medians_ms"].arr) cb.runMedians.push_back(v.number());
+        cb.noise = c["noise"].number();
+        cb.threshold = c["threshold"].number();
+        if (!cb.samples.empty()) out.cases[name] = std::move(cb);
+    }
+    return !out.cases.empty();
+}
+
+static bool save_baseline(const std::string& path, const Baseline& b) {
+    std::ofstream f(path);
+    if (!f) return false;
+    JsonWriter w(f);
+    w.begin_object();
+    w.value("tool", "bin/regress");
+    w.value("machine", b.machine);
+    w.value("reps", b.reps);
+    w.value("runs", b.runs);
+    w.begin_object("cases");
+    for (const auto& [name, c] : b.cases) {
+        w.begin_object(name.c_str());
+        w.value("median_ms", summarize(c.samples).median);
+        w.value("noise", c.noise);
+        w.value("threshold", c.threshold);
+        w.begin_array("run_medians_ms");
+        for (double v : c.runMedians) w.value(v);
+        w.end_array();
+        w.begin_array("samples_ms");
+        for (double v : c.samples) w.value(v);
+        w.end_array();
+        w.end_object();
+    }
+    w.end_object();
+    w.end_object();
+    return bool(f);
+}
+
+// Runs `self --once ...` and parses the samples it prints.
+static bool run_child(const std::string& cmd, Samples& out) {
+    FILE* p = popen(cmd.c_str(), "r");
+    if (!p) return false;
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), p)) > 0) text.append(buf, n);
+    if (pclose(p) != 0) return false;
+    JsonValue doc;
+    if (!parse_json(text, doc)) return false;
+    for (const auto& [name, arr] : doc["cases"].obj)
+        for (const JsonValue& v : arr.arr) out[name].push_back(v.number());
+    return true;
+}
+
+static std::string shell_quote(const std::string& s) {
+    std::string q = "'";
+    for (char c : s) q += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return q + "'";
+}
+
+static std::string child_command(const char* self, const SuiteParams& sp) {
+    std::string cmd = shell_quote(self) + " --once --scene " + shell_quote(sp.scenePath) + " --bvh2 " +
+                      shell_quote(sp.bvh2Path) + " --reps " + std::to_string(sp.reps) + " --warmup " +
+                      std::to_string(sp.warmup) + " --size " + std::to_string(sp.width) + "x" +
+                      std::to_string(sp.height) + " --cases ";
+    for (size_t i = 0; i < sp.cases.size(); ++i) cmd += (i ? "," : "") + sp.cases[i];
+    return cmd;
+}
+
+/* ================= Comparison ================= */
+
+struct CaseResult {
+    std::string   name;
+    BenchSummary  base, cur;
+    RankTest      slower, faster;
+    RatioInterval ratio;
+    double        threshold = 0.0;
+    const char*   verdict = "ok";
+};
+
+static CaseResult compare_case(const std::string& name, const CaseBaseline& b, const std::vector<double>& cur,
+                               double alpha) {
+    CaseResult r;
+    r.name = name;
+    r.base = summarize(b.samples);
+    r.cur = summarize(cur);
+    r.slower = mann_whitney_greater(b.samples, cur);
+    r.faster = mann_whitney_greater(cur, b.samples);
+    r.ratio = bootstrap_median_ratio(b.samples, cur);
+    r.threshold = b.threshold;
+    if (r.slower.p < alpha && r.ratio.lo > 1.0 + r.threshold) r.verdict = "SLOWER";
+    else if (r.faster.p < alpha && r.ratio.hi < 1.0 - r.threshold) r.verdict = "faster";
+    else if (r.slower.p < alpha || r.faster.p < alpha) r.verdict = "noise";
+    return r;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    SuiteParams sp;
+    sp.scenePath = args.str("scene", sp.scenePath.c_str());
+    sp.bvh2Path = args.str("bvh2", sp.bvh2Path.c_str());
+    sp.cases = args.strs("cases", "convert,morton,sort,lbvh2,trace");
+    sp.reps = std::max<uint32_t>(2, args.u32("reps", sp.reps));
+    sp.warmup = args.u32("warmup", sp.warmup);
+    args.size2("size", sp.width, sp.height);
+    std::string baselinePath = args.str("baseline", "data/bench_baseline.json");
+    std::string jsonPath = args.str("json", "");
+    const double alpha = args.num("alpha", 0.01);
+    const double inject = args.num("inject", 1.0);
+
+    for (const std::string& c : sp.cases)
+        if (std::find(std::begin(CASE_NAMES), std::end(CASE_NAMES), c) == std::end(CASE_NAMES)) {
+            std::cerr << "Unknown case " << c << " (convert, morton, sort, lbvh2, trace)\n";
+            return 1;
+        }
+
+    // ---- child mode: one suite run, samples as JSON on stdout ----
+    if (args.has("once")) {
+        Samples s;
+        if (!run_suite(sp, s)) return 1;
+        JsonWriter w(std::cout);
+        w.begin_object();
+        w.begin_object("cases");
+        for (const auto& [name, v] : s) {
+            w.begin_array(name.c_str());
+            for (double ms : v) w.value(ms);
+            w.end_array();
+        }
+        w.end_object();
+        w.end_object();
+        return report_hot_loop_violations(stderr) ? 1 : 0;
+    }
+
+    // ---- record: calibrate over separate processes ----
+    if (args.has("record")) {
+        const uint32_t runs = std::max<uint32_t>(3, args.u32("calibrate", 5));
+        const double floor = args.num("floor", 0.02);
+        const std::string cmd = child_command(argv[0], sp);
+
+        Baseline b;
+        b.machine = machine_id();
+        b.reps = sp.reps;
+        b.runs = runs;
+        for (uint32_t r = 0; r < runs; ++r) {
+            Samples s;
+            std::fprintf(stderr, "calibration run %u/%u\n", r + 1, runs);
+            if (!run_child(cmd, s)) {
+                std::cerr << "Calibration run failed: " << cmd << "\n";
+                return 1;
+            }
+            for (const auto& [name, v] : s) {
+                CaseBaseline& c = b.cases[name];
+                c.samples.insert(c.samples.end(), v.begin(), v.end());
+                c.runMedians.push_back(summarize(v).median);
+            }
+        }
+        std::printf("%-8s %10s %9s %10s\n", "case", "median ms", "noise", "threshold");
+        int wide = 0;
+        for (auto& [name, c] : b.cases) {
+            BenchSummary m = summarize(c.runMedians);
+            c.noise = m.mean > 0.0 ? m.stddev / m.mean : 0.0;
+            c.threshold = std::max(floor, 3.0 * std::sqrt(2.0) * c.noise);
+            std::printf("%-8s %10.3f %8.2f%% %9.2f%%\n", name.c_str(), summarize(c.samples).median, 100.0 * c.noise,
+                        100.0 * c.threshold);
+            wide += c.threshold > 0.10;
+        }
+        if (wide)
+            std::printf("note: %d case(s) only fail above a 10%%+ slowdown; this machine is too noisy for a "
+                        "tight gate (record on an idle, dedicated host)\n",
+                        wide);
+        if (!save_baseline(baselinePath, b)) {
+            std::cerr << "Failed to write " << baselinePath << "\n";
+            return 1;
+        }
+        std::printf("baseline: %s (%u runs x %u reps, %s)\n", baselinePath.c_str(), runs, sp.reps, b.machine.c_str());
+        return 0;
+    }
+
+    // ---- gate ----
+    Baseline b;
+    if (!load_baseline(baselinePath, b)) {
+        std::cerr << "Failed to read baseline " << baselinePath << " (record one on this machine with --record)\n";
+        return 1;
+    }
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    if (b.machine != machine_id()) {
+        std::fprintf(text, "baseline recorded on \"%s\"\n     running on \"%s\"\n", b.machine.c_str(),
+                     machine_id().c_str());
+        if (!args.has("force")) {
+            std::fprintf(text, "SKIP: timings from another machine or build are not comparable; record a baseline "
+                               "here with --record (or pass --force)\n");
+            if (jsonPath.empty()) return 0;
+            std::ofstream file;
+            std::ostream* out = open_json_output(jsonPath, file);
+            if (!out) return 1;
+            JsonWriter w(*out);
+            w.begin_object();
+            w.value("tool", "bin/regress");
+            w.value("baseline", baselinePath);
+            w.value("machine", machine_id());
+            w.value("baseline_machine", b.machine);
+            w.value("skipped", true);
+            w.end_object();
+            return 0;
+        }
+        std::fprintf(text, "--force: comparing anyway\n\n");
+    }
+
+    Samples cur;
+    const std::string cmd = child_command(argv[0], sp);
+    if (!run_child(cmd, cur)) {
+        std::cerr << "Suite run failed: " << cmd << "\n";
+        return 1;
+    }
+    std::vector<CaseResult> results;
+    for (const std::string& name : sp.cases) {
+        auto it = b.cases.find(name);
+        if (it == b.cases.end()) {
+            std::fprintf(text, "%-8s not in the baseline, skipped\n", name.c_str());
+            continue;
+        }
+        for (double& ms : cur[name]) ms *= inject;
+        results.push_back(compare_case(name, it->second, cur[name], alpha));
+    }
+
+    std::fprintf(text, "%-8s %10s %10s %8s %17s %9s %9s %6s  %s\n", "case", "base ms", "now ms", "ratio",
+                 "95% CI", "p slower", "p faster", "thresh", "verdict");
+    int slower = 0;
+    for (const CaseResult& r : results) {
+        std::fprintf(text, "%-8s %10.3f %10.3f %8.3f   [%.3f, %.3f] %9.2g %9.2g %5.1f%%  %s\n", r.name.c_str(),
+                     r.base.median, r.cur.median, r.ratio.ratio, r.ratio.lo, r.ratio.hi, r.slower.p, r.faster.p,
+                     100.0 * r.threshold, r.verdict);
+        slower += r.verdict[0] == 'S';
+    }
+    std::fprintf(text, "\n%s: %d of %zu cases significantly slower\n", slower ? "FAIL" : "PASS", slower,
+                 results.size());
+    const int status = slower ? 1 : 0;
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/regress");
+    w.value("baseline", baselinePath);
+    w.value("machine", machine_id());
+    w.value("baseline_machine", b.machine);
+    w.value("alpha", alpha);
+    w.value("pass", !slower);
+    w.begin_array("cases");
+    for (const CaseResult& r : results) {
+        w.begin_object();
+        w.value("name", r.name);
+        w.value("verdict", r.verdict);
+        w.value("base_median_ms", r.base.median);
+        w.value("median_ms", r.cur.median);
+        w.value("ratio", r.ratio.ratio);
+        w.value("ratio_lo", r.ratio.lo);
+        w.value("ratio_hi", r.ratio.hi);
+        w.value("p_slower", r.slower.p);
+        w.value("p_faster", r.faster.p);
+        w.value("threshold", r.threshold);
+        w.begin_array("samples_ms");
+        for (double ms : cur[r.name]) w.value(ms);
+        w.end_array();
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
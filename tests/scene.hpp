@@ -0,0 +1,297 @@
+#pragma once
+
+// scene.hpp
+// Triangle buffers for the C++ tools: the same flat f32 layout the app uploads
+// to the `triangles` storage buffer (9 floats per triangle, v0 v1 v2).
+//
+// Scenes come either from a raw dump (.bin, little-endian f32) or straight
+// from a .glb, flattened and cube-normalized exactly like Scene.js so that
+// triangle indices line up with data/BVH2.bin.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "bvh.hpp"
+#include "json.hpp"
+
+struct Triangles {
+    std::vector<float> v; // 9 per triangle
+
+    uint32_t count() const { return uint32_t(v.size() / 9); }
+
+    Vec3 vertex(uint32_t tri, int k) const {
+        const float* p = v.data() + size_t(tri) * 9 + size_t(k) * 3;
+        return {p[0], p[1], p[2]};
+    }
+
+    Aabb bounds(uint32_t tri) const {
+        Aabb b;
+        b.grow(vertex(tri, 0));
+        b.grow(vertex(tri, 1));
+        b.grow(vertex(tri, 2));
+        return b;
+    }
+
+    Vec3 centroid(uint32_t tri) const {
+        return (vertex(tri, 0) + vertex(tri, 1) + vertex(tri, 2)) * (1.0f / 3.0f);
+    }
+
+    Vec3 normal(uint32_t tri) const {
+        Vec3 a = vertex(tri, 0);
+        return normalize(cross(vertex(tri, 1) - a, vertex(tri, 2) - a));
+    }
+};
+
+/* ================= Raw dumps ================= */
+
+static inline bool load_triangle_file(const char* path, Triangles& out) {
+    std::vector<uint8_t> bytes;
+    if (!load_bytes_file(path, bytes)) return false;
+    if (bytes.size() % 36) return false;
+    out.v.resize(bytes.size() / 4);
+    std::memcpy(out.v.data(), bytes.data(), bytes.size());
+    return true;
+}
+
+static inline bool save_triangle_file(const char* path, const Triangles& tris) {
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    f.write(reinterpret_cast<const char*>(tris.v.data()),
+            std::streamsize(tris.v.size() * sizeof(float)));
+    return bool(f);
+}
+
+/* ================= GLB ================= */
+
+namespace glb_detail {
+
+struct Mat4 {
+    double m[16]; // column-major, as glTF stores it
+
+    static Mat4 identity() {
+        Mat4 r{};
+        r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0;
+        return r;
+    }
+
+    Mat4 operator*(const Mat4& b) const {
+        Mat4 r{};
+        for (int c = 0; c < 4; ++c)
+            for (int rr = 0; rr < 4; ++rr) {
+                double s = 0.0;
+                for (int k = 0; k < 4; ++k) s += m[k * 4 + rr] * b.m[c * 4 + k];
+                r.m[c * 4 + rr] = s;
+            }
+        return r;
+    }
+};
+
+static inline Mat4 node_matrix(const JsonValue& node) {
+    if (node.has("matrix") && node["matrix"].size() == 16) {
+        Mat4 r;
+        for (int i = 0; i < 16; ++i) r.m[i] = node["matrix"][i].number();
+        return r;
+    }
+
+    double t[3] = {0, 0, 0}, q[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+    for (int i = 0; i < 3; ++i) t[i] = node["translation"][i].number(t[i]);
+    for (int i = 0; i < 4; ++i) q[i] = node["rotation"][i].number(q[i]);
+    for (int i = 0; i < 3; ++i) s[i] = node["scale"][i].number(s[i]);
+
+    double x = q[0], y = q[1], z = q[2], w = q[3];
+    Mat4 r = Mat4::identity();
+    r.m[0]  = (1 - 2 * (y * y + z * z)) * s[0];
+    r.m[1]  = (2 * (x * y + z * w)) * s[0];
+    r.m[2]  = (2 * (x * z - y * w)) * s[0];
+    r.m[4]  = (2 * (x * y - z * w)) * s[1];
+    r.m[5]  = (1 - 2 * (x * x + z * z)) * s[1];
+    r.m[6]  = (2 * (y * z + x * w)) * s[1];
+    r.m[8]  = (2 * (x * z + y * w)) * s[2];
+    r.m[9]  = (2 * (y * z - x * w)) * s[2];
+    r.m[10] = (1 - 2 * (x * x + y * y)) * s[2];
+    r.m[12] = t[0];
+    r.m[13] = t[1];
+    r.m[14] = t[2];
+    return r;
+}
+
+struct Ctx {
+    const JsonValue& doc;
+    const uint8_t* bin;
+    size_t binSize;
+    std::vector<double>& out; // world-space xyz per vertex, 3 per triangle
+};
+
+static inline bool accessor_view(const Ctx& ctx, uint32_t acc,
+                          const uint8_t*& base, size_t& stride,
+                          size_t& count, uint32_t& compType) {
+    const JsonValue& a = ctx.doc["accessors"][acc];
+    if (!a.has("bufferView")) return false;
+    const JsonValue& bv = ctx.doc["bufferViews"][size_t(a["bufferView"].number())];
+
+    size_t off = size_t(bv["byteOffset"].number(0)) + size_t(a["byteOffset"].number(0));
+    compType = uint32_t(a["componentType"].number());
+    count = size_t(a["count"].number());
+
+    size_t compSize = (compType == 5126 || compType == 5125) ? 4 : (compType == 5123 ? 2 : 1);
+    size_t comps = a["type"].str == "VEC3" ? 3 : 1;
+    stride = size_t(bv["byteStride"].number(double(compSize * comps)));
+
+    if (count == 0) return false;
+    if (off + (count - 1) * stride + compSize * comps > ctx.binSize) return false;
+    base = ctx.bin + off;
+    return true;
+}
+
+static inline void emit_primitive(Ctx& ctx, const JsonValue& prim, const Mat4& world) {
+    if (prim["mode"].number(4) != 4) return;
+    if (!prim["attributes"].has("POSITION")) return;
+
+    const uint8_t* pos;
+    size_t posStride, posCount;
+    uint32_t posType;
+    if (!accessor_view(ctx, uint32_t(prim["attributes"]["POSITION"].number()),
+                       pos, posStride, posCount, posType) || posType != 5126) {
+        return;
+    }
+
+    auto vertex = [&](size_t i) {
+        float p[3];
+        std::memcpy(p, pos + i * posStride, 12);
+        const double* m = world.m;
+        ctx.out.push_back(m[0] * p[0] + m[4] * p[1] + m[8]  * p[2] + m[12]);
+        ctx.out.push_back(m[1] * p[0] + m[5] * p[1] + m[9]  * p[2] + m[13]);
+        ctx.out.push_back(m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]);
+    };
+
+    if (!prim.has("indices")) {
+        for (size_t i = 0; i + 2 < posCount; i += 3) {
+            vertex(i); vertex(i + 1); vertex(i + 2);
+        }
+        return;
+    }
+
+    const uint8_t* idx;
+    size_t idxStride, idxCount;
+    uint32_t idxType;
+    if (!accessor_view(ctx, uint32_t(prim["indices"].number()), idx, idxStride, idxCount, idxType)) return;
+
+    auto index = [&](size_t i) -> size_t {
+        const uint8_t* p = idx + i * idxStride;
+        if (idxType == 5125) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+        if (idxType == 5123) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+        return *p;
+    };
+
+    for (size_t i = 0; i + 2 < idxCount; i += 3) {
+        size_t a = index(i), b = index(i + 1), c = index(i + 2);
+        if (a >= posCount || b >= posCount || c >= posCount) continue;
+        vertex(a); vertex(b); vertex(c);
+    }
+}
+
+// Pre-order, primitives before child nodes: the order THREE's Object3D.traverse
+// visits the scene GLTFLoader builds, which is what Scene.parseGLTF flattens.
+static inline void visit_node(Ctx& ctx, uint32_t n, const Mat4& parent, int depth) {
+    if (depth > 64) return;
+    const JsonValue& node = ctx.doc["nodes"][n];
+    Mat4 world = parent * node_matrix(node);
+
+    if (node.has("mesh")) {
+        const JsonValue& mesh = ctx.doc["meshes"][size_t(node["mesh"].number())];
+        for (const JsonValue& prim : mesh["primitives"].arr) emit_primitive(ctx, prim, world);
+    }
+
+    for (const JsonValue& c : node["children"].arr) {
+        visit_node(ctx, uint32_t(c.number()), world, depth + 1);
+    }
+}
+
+} // namespace glb_detail
+
+// Scene.normalizeMesh "cube" mode: center on the AABB and scale to [-1, 1].
+static inline void normalize_cube(std::vector<double>& xyz) {
+    if (xyz.empty()) return;
+
+    double mn[3] = { 1e300,  1e300,  1e300};
+    double mx[3] = {-1e300, -1e300, -1e300};
+    for (size_t i = 0; i < xyz.size(); i += 3)
+        for (int k = 0; k < 3; ++k) {
+            mn[k] = std::min(mn[k], xyz[i + k]);
+            mx[k] = std::max(mx[k], xyz[i + k]);
+        }
+
+    double center[3], maxDim = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        center[k] = (mn[k] + mx[k]) * 0.5;
+        maxDim = std::max(maxDim, mx[k] - mn[k]);
+    }
+    double scale = maxDim > 0.0 ? 2.0 / maxDim : 1.0;
+
+    for (size_t i = 0; i < xyz.size(); i += 3)
+        for (int k = 0; k < 3; ++k) xyz[i + k] = (xyz[i + k] - center[k]) * scale;
+}
+
+static inline bool load_glb_triangles(const char* path, Triangles& out, bool normalize = true) {
+    std::vector<uint8_t> file;
+    if (!load_bytes_file(path, file) || file.size() < 20) return false;
+
+    uint32_t header[3];
+    std::memcpy(header, file.data(), 12);
+    if (header[0] != 0x46546C67u || header[1] != 2) return false; // "glTF" v2
+
+    JsonValue doc;
+    const uint8_t* bin = nullptr;
+    size_t binSize = 0;
+
+    size_t off = 12;
+    while (off + 8 <= file.size()) {
+        uint32_t len, type;
+        std::memcpy(&len, file.data() + off, 4);
+        std::memcpy(&type, file.data() + off + 4, 4);
+        off += 8;
+        if (off + len > file.size()) return false;
+
+        if (type == 0x4E4F534Au) { // JSON
+            std::string text(reinterpret_cast<const char*>(file.data() + off), len);
+            if (!parse_json(text, doc)) return false;
+        } else if (type == 0x004E4942u) { // BIN
+            bin = file.data() + off;
+            binSize = len;
+        }
+        off += (len + 3) & ~size_t(3);
+    }
+    if (doc.type != JsonValue::Object || !bin) return false;
+
+    std::vector<double> xyz;
+    glb_detail::Ctx ctx{doc, bin, binSize, xyz};
+
+    size_t sceneIdx = size_t(doc["scene"].number(0));
+    const JsonValue& roots = doc["scenes"][sceneIdx]["nodes"];
+    for (const JsonValue& r : roots.arr) {
+        glb_detail::visit_node(ctx, uint32_t(r.number()), glb_detail::Mat4::identity(), 0);
+    }
+
+    if (normalize) normalize_cube(xyz);
+
+    out.v.resize(xyz.size());
+    for (size_t i = 0; i < xyz.size(); ++i) out.v[i] = float(xyz[i]);
+    return true;
+}
+
+static inline bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// .glb -> parsed + normalized like the app, anything else -> raw f32 dump.
+static inline bool load_scene(const char* path, Triangles& out) {
+    TIMELINE_ZONE("load scene");
+    bool ok = ends_with(path, ".glb") ? load_glb_triangles(path, out)
+                                      : load_triangle_file(path, out);
+    if (!ok) std::cerr << "Failed to read scene " << path << "\n";
+    return ok;
+}
@@ -0,0 +1,306 @@
+// stackdepth.cpp
+// How deep the traversal stack really gets. For each BVH4 it reports the
+// static worst case (every valid child hit, verify.hpp's bound) and the
+// distribution of per-ray peak stack depth under trace.hpp's near-first
+// walk for the primary / shadow / AO / diffuse rays of one frame, plus
+// 2x2 primary packets through packetsim.hpp as the shader runs them. From
+// that it prints the smallest STACK_MAX that is safe for the tree and what
+// it saves in per-invocation stack memory. A peak of 0 is a ray that
+// missed the root box.
+//
+//   bin/stackdepth [data/BVH4_wide.bin data/BVH2.bin ...]
+//                  [--scene public/assets/dragon.glb] [--size 480x270]
+//                  [--stack 32 | --max-depth 20] [--out bounded.bin]
+//                  [--json out.json|-]
+//
+// The scene's LBVH (lbvh.hpp) is always included; BVH2 files are promoted
+// first. --stack S (or --max-depth D on the LBVH2) adds the same LBVH
+// reshaped by bound_lbvh2_depth() so its worst case fits S entries, and
+// shows what the bound costs in nodes per ray; --out writes that BVH4.
+// Stack memory counts each entry as a u32 index plus a 4-lane LaneMask at
+// 4 bytes per bool, the usual register footprint. Exits 1 if the bounded
+// tree cannot be built, fails verify.hpp, or exceeds its bound.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "packetsim.hpp"
+#include "rayset.hpp"
+#include "verify.hpp"
+
+static constexpr uint32_t STACK_ENTRY_BYTES = 4 + PACKET_LANES * 4;
+
+static const double PERCENTILES[] = {50.0, 90.0, 99.0, 99.9};
+static const char* const PERCENTILE_KEYS[] = {"p50", "p90", "p99", "p99_9"};
+
+// Peak stack entries per ray (or packet), as a histogram over 1..STACK_MAX.
+struct DepthHistogram {
+    uint64_t count[STACK_MAX + 1] = {};
+    uint64_t total = 0;
+    uint64_t drops = 0;
+    uint64_t nodes = 0;
+
+    void add(uint32_t peak, uint64_t rayNodes, uint64_t rayDrops) {
+        count[std::min(peak, STACK_MAX)]++;
+        total++;
+        nodes += rayNodes;
+        drops += rayDrops;
+    }
+    void add(const DepthHistogram& o) {
+        for (uint32_t i = 0; i <= STACK_MAX; ++i) count[i] += o.count[i];
+        total += o.total;
+        drops += o.drops;
+        nodes += o.nodes;
+    }
+    uint32_t percentile(double p) const {
+        const double want = p / 100.0 * double(total);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i <= STACK_MAX; ++i) {
+            seen += count[i];
+            if (seen > 0 && double(seen) >= want) return i;
+        }
+        return STACK_MAX;
+    }
+    uint32_t max() const {
+        for (uint32_t i = STACK_MAX + 1; i-- > 0;)
+            if (count[i]) return i;
+        return 0;
+    }
+    double nodes_per_ray() const { return total ? double(nodes) / double(total) : 0.0; }
+};
+
+enum { ROW_PACKET = RAY_KINDS, ROWS };
+static const char* const ROW_NAMES[ROWS] = {"primary", "shadow", "ao", "diffuse", "packet 2x2"};
+
+struct Profile {
+    std::string    name;
+    uint32_t       depth2 = 0;     // LBVH2 depth before promotion, when known
+    uint32_t       moved = 0;      // splits moved by bound_lbvh2_depth
+    double         boundMs = 0.0;  // bound_lbvh2_depth time
+    VerifyReport   report;
+    DepthHistogram rows[ROWS];
+    double         ms = 0.0;
+
+    uint32_t observed() const {
+        uint32_t m = 0;
+        for (const DepthHistogram& h : rows) m = std::max(m, h.max());
+        return m;
+    }
+};
+
+static void profile_tree(Profile& p, const Bvh4& bvh, const Triangles& tris, const RaySet& set) {
+    p.report = verify_bvh(bvh, 4, &tris, 1.0, 0);
+    BenchTimer timer;
+
+    std::vector<DepthHistogram> perWorker(worker_count() * ROWS);
+    parallel_for_chunks(0, set.size(), 1024, [&](size_t b, size_t e, unsigned w) {
+        for (size_t i = b; i < e; ++i) {
+            TraceStats st;
+            const uint32_t kind = set.kind[i];
+            if (ray_kind_closest(kind)) trace_closest(bvh, tris, set.rays[i], &st);
+            else trace_occluded(bvh, tris, set.rays[i], &st);
+            perWorker[w * ROWS + kind].add(st.maxStack, st.nodes, st.stackDrops);
+        }
+    });
+
+    const uint32_t gw = (set.width + SHADER_PACKET - 1) / SHADER_PACKET;
+    const uint32_t gh = (set.height + SHADER_PACKET - 1) / SHADER_PACKET;
+    parallel_for_chunks(0, size_t(gw) * gh, 64, [&](size_t b, size_t e, unsigned w) {
+        for (size_t g = b; g < e; ++g) {
+            const uint32_t gx = uint32_t(g % gw), gy = uint32_t(g / gw);
+            Ray rays[PACKET_LANES];
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < PACKET_LANES; ++i) {
+                uint32_t px = gx * SHADER_PACKET + i % SHADER_PACKET;
+                uint32_t py = gy * SHADER_PACKET + i / SHADER_PACKET;
+                if (px >= set.width || py >= set.height) {
+                    rays[i] = Ray{set.camera.pos, {0.0f, 0.0f, -1.0f}};
+                    continue;
+                }
+                rays[i] = primary_ray(set.camera, float(px), float(py), set.width, set.height);
+                mask |= 1u << i;
+            }
+            Hit hits[PACKET_LANES];
+            PacketStats st;
+            traverse_bvh4_packet(bvh, tris, rays, mask, hits, st);
+            perWorker[w * ROWS + ROW_PACKET].add(st.maxStack, st.nodeFetches, st.stackDrops);
+        }
+    });
+    for (unsigned w = 0; w < worker_count(); ++w)
+        for (uint32_t r = 0; r < ROWS; ++r) p.rows[r].add(perWorker[w * ROWS + r]);
+    p.ms = timer.ms();
+}
+
+static void print_profile(FILE* out, const Profile& p, const Profile* base) {
+    const VerifyReport& r = p.report;
+    std::fprintf(out, "=== %s: %u nodes, depth %u", p.name.c_str(), r.nodes, r.depth);
+    if (p.depth2) std::fprintf(out, " (LBVH2 %u)", p.depth2);
+    std::fprintf(out, ", worst-case stack %u, %.0f ms ===\n", r.maxStack, p.ms);
+    if (p.moved) std::fprintf(out, "  bound moved %u splits in %.1f ms\n", p.moved, p.boundMs);
+    if (r.errors()) std::fprintf(out, "  verify: %llu errors\n", (unsigned long long)r.errors());
+
+    std::fprintf(out, "  %-11s %9s", "peak stack", "rays");
+    for (double pc : PERCENTILES) std::fprintf(out, "  p%-5g", pc);
+    std::fprintf(out, "  %5s  %7s  %9s\n", "max", "drops", "nodes/ray");
+    for (uint32_t row = 0; row < ROWS; ++row) {
+        const DepthHistogram& h = p.rows[row];
+        if (!h.total) continue;
+        std::fprintf(out, "  %-11s %9llu", ROW_NAMES[row], (unsigned long long)h.total);
+        for (double pc : PERCENTILES) std::fprintf(out, "  %6u", h.percentile(pc));
+        std::fprintf(out, "  %5u  %7llu  %9.1f", h.max(), (unsigned long long)h.drops, h.nodes_per_ray());
+        if (base && base->rows[row].nodes_per_ray() > 0.0)
+            std::fprintf(out, "  %+.1f%%", (h.nodes_per_ray() / base->rows[row].nodes_per_ray() - 1.0) * 100.0);
+        std::fprintf(out, "\n");
+    }
+
+    const uint32_t safe = r.maxStack;
+    std::fprintf(out, "  safe STACK_MAX %u: %u B per invocation (%+.0f%% vs %u); observed peak %u\n\n", safe,
+                 safe * STACK_ENTRY_BYTES, (double(safe) / double(STACK_MAX) - 1.0) * 100.0, STACK_MAX,
+                 p.observed());
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::vector<std::string> paths = args.positional();
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string outPath = args.str("out", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 480, height = 270;
+    args.size2("size", width, height);
+    const uint32_t stackTarget = args.u32("stack", 0);
+    uint32_t maxDepth = args.u32("max-depth", 0);
+    if (stackTarget && !maxDepth) maxDepth = lbvh2_depth_for_stack(stackTarget);
+    const bool bounded = args.has("stack") || args.has("max-depth");
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+    std::vector<uint64_t> keys = morton_keys(tris);
+    MortonOrder order = sort_morton_keys(keys);
+    std::vector<uint32_t> bvh2 = build_lbvh2(tris, order);
+    Bvh4 built = decode_bvh4(promote_bvh4(bvh2));
+
+    RaySet set = generate_ray_set(
+        tris, Camera{}, width, height, (1u << RAY_KINDS) - 1, 0.25f,
+        [&](const Ray& r) { return trace_closest(built, tris, r); },
+        [&](const Ray& r) { return trace_occluded(built, tris, r); });
+
+    std::vector<Profile> profiles;
+    {
+        Profile p;
+        p.name = "built BVH4";
+        p.depth2 = verify_bvh(decode_bvh2(bvh2), 2, nullptr, 1.0, 0).depth;
+        profile_tree(p, built, tris, set);
+        profiles.push_back(std::move(p));
+    }
+    for (const std::string& path : paths) {
+        std::vector<uint32_t> raw;
+        if (!load_u32_file(path.c_str(), raw) || raw.empty()) {
+            std::cerr << "Failed to read " << path << "\n";
+            return 1;
+        }
+        const uint32_t arity = bvh_file_arity(raw);
+        if (!arity) {
+            std::cerr << path << ": length fits neither BVH2 nor BVH4\n";
+            return 1;
+        }
+        Profile p;
+        p.name = path;
+        if (arity == 2) {
+            p.name += " (promoted)";
+            p.depth2 = verify_bvh(decode_bvh2(raw), 2, nullptr, 1.0, 0).depth;
+            raw = promote_bvh4(raw);
+        }
+        profile_tree(p, decode_bvh4(raw), tris, set);
+        profiles.push_back(std::move(p));
+    }
+
+    int status = 0;
+    if (bounded) {
+        Profile p;
+        p.name = "bounded BVH4";
+        std::vector<uint32_t> b2 = bvh2;
+        BenchTimer t;
+        if (!bound_lbvh2_depth(b2, order, maxDepth, &p.moved)) {
+            std::cerr << tris.count() << " leaves do not fit LBVH2 depth " << maxDepth << "\n";
+            return 1;
+        }
+        p.boundMs = t.ms();
+        p.depth2 = verify_bvh(decode_bvh2(b2), 2, nullptr, 1.0, 0).depth;
+        std::vector<uint32_t> raw = promote_bvh4(b2);
+        profile_tree(p, decode_bvh4(raw), tris, set);
+        if (p.report.errors() || p.depth2 > maxDepth || p.report.maxStack > promoted_stack_bound(maxDepth))
+            status = 1;
+        if (!outPath.empty() && !save_u32_file(outPath.c_str(), raw)) {
+            std::cerr << "Failed to write " << outPath << "\n";
+            return 1;
+        }
+        profiles.push_back(std::move(p));
+    }
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, %ux%u, %zu rays + %u packets, %u threads\n", scenePath.c_str(), tris.count(),
+                 width, height, set.size(), uint32_t(profiles[0].rows[ROW_PACKET].total), worker_count());
+    std::fprintf(text, "STACK_MAX %u: %u B per invocation (%u B per entry: u32 + LaneMask)\n", STACK_MAX,
+                 STACK_MAX * STACK_ENTRY_BYTES, STACK_ENTRY_BYTES);
+    if (bounded)
+        std::fprintf(text, "bound: LBVH2 depth <= %u -> BVH4 stack <= %u%s\n", maxDepth,
+                     promoted_stack_bound(maxDepth), stackTarget ? "" : " (from --max-depth)");
+    std::fprintf(text, "\n");
+    for (const Profile& p : profiles) print_profile(text, p, &p == &profiles[0] ? nullptr : &profiles[0]);
+    if (status) std::fprintf(text, "FAIL: bounded tree is invalid or exceeds its bound\n");
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/stackdepth");
+    w.value("scene", scenePath);
+    w.value("width", width);
+    w.value("height", height);
+    w.value("stack_max", STACK_MAX);
+    w.value("entry_bytes", STACK_ENTRY_BYTES);
+    if (bounded) w.value("max_depth", maxDepth);
+    w.begin_array("trees");
+    for (const Profile& p : profiles) {
+        w.begin_object();
+        w.value("name", p.name);
+        w.value("nodes", p.report.nodes);
+        w.value("depth", p.report.depth);
+        w.value("lbvh2_depth", p.depth2);
+        w.value("worst_case_stack", p.report.maxStack);
+        w.value("observed_peak", p.observed());
+        w.value("moved_splits", p.moved);
+        w.value("verify_errors", p.report.errors());
+        w.begin_array("rows");
+        for (uint32_t row = 0; row < ROWS; ++row) {
+            const DepthHistogram& h = p.rows[row];
+            if (!h.total) continue;
+            w.begin_object();
+            w.value("kind", ROW_NAMES[row]);
+            w.value("rays", h.total);
+            for (size_t i = 0; i < std::size(PERCENTILES); ++i)
+                w.value(PERCENTILE_KEYS[i], h.percentile(PERCENTILES[i]));
+            w.value("max", h.max());
+            w.value("drops", h.drops);
+            w.value("nodes_per_ray", h.nodes_per_ray());
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,163 @@
+// svo.cpp
+// Sparse voxel octree / DAG (svo.hpp) vs the BVH4 for the ray types voxels
+// can stand in for: sun shadow rays and short AO rays.
+//
+// Primary rays are traced exactly through the BVH4 to get surface points;
+// the resulting shadow and AO rays are then fired through the BVH4 (the
+// reference) and through an SVO and a DAG at each --levels resolution.
+// Voxel rays start --bias voxels off the surface along the normal, since the
+// surface's own voxels would otherwise occlude them.
+//
+//   bin/svo [--scene public/assets/dragon.glb] [--levels 8,9,10,11]
+//           [--size 640x360] [--ao-dist 0.25] [--bias 1.5]
+//
+// The BVH4 is built in-process with lbvh.hpp (as the app builds it), so its
+// build time and size sit next to the voxel structures'.
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "parallel.hpp"
+#include "svo.hpp"
+#include "trace.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+struct RaySet {
+    const char*       name;
+    std::vector<Ray>  rays;
+    std::vector<Vec3> normals; // surface normal at each ray's origin
+};
+
+struct Agreement {
+    double   ms = 0.0;
+    uint64_t extra = 0;  // occluded here, visible in the reference
+    uint64_t missed = 0; // visible here, occluded in the reference
+};
+
+template <typename Fn>
+static Agreement run_set(const RaySet& set, const std::vector<uint8_t>* ref, std::vector<uint8_t>& out, Fn&& occluded) {
+    out.assign(set.rays.size(), 0);
+    auto t0 = Clock::now();
+    parallel_for(0, set.rays.size(), 1024, [&](size_t i) { out[i] = occluded(set.rays[i], set.normals[i]); });
+    Agreement a;
+    a.ms = ms_since(t0);
+    if (ref)
+        for (size_t i = 0; i < out.size(); ++i) {
+            a.extra += out[i] && !(*ref)[i];
+            a.missed += !out[i] && (*ref)[i];
+        }
+    return a;
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+    std::vector<double> levelList = args.nums("levels", "8,9,10,11");
+    float aoDist = float(args.num("ao-dist", 0.25));
+    float bias = float(args.num("bias", 1.5));
+
+    Triangles tris;
+    if (!load_scene(scenePath.c_str(), tris)) return 1;
+
+    auto b0 = Clock::now();
+    std::vector<uint32_t> raw4 = promote_bvh4(build_lbvh2(tris, morton_sort(tris)));
+    double bvhMs = ms_since(b0);
+    Bvh4 bvh = decode_bvh4(raw4);
+
+    std::cout << "scene: " << scenePath << " (" << tris.count() << " tris), " << width << "x" << height
+              << ", AO distance " << aoDist << ", voxel bias " << bias << ", " << worker_count() << " threads\n\n";
+
+    // Surface points from exact primary rays.
+    Camera cam;
+    const Vec3 lightDir = normalize(Vec3{1.0f, 1.5f, 1.0f});
+    std::vector<Hit> hits(size_t(width) * height);
+    parallel_for(0, hits.size(), 256, [&](size_t i) {
+        hits[i] = trace_closest(bvh, tris, primary_ray(cam, float(i % width), float(i / width), width, height));
+    });
+
+    RaySet shadow{"shadow", {}, {}}, ao{"ao", {}, {}};
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (!hits[i].hit()) continue;
+        Ray pr = primary_ray(cam, float(i % width), float(i / width), width, height);
+        Vec3 n = tris.normal(hits[i].tri);
+        if (dot(n, pr.dir) > 0.0f) n = -n;
+        Vec3 p = pr.origin + pr.dir * hits[i].t;
+
+        if (dot(n, lightDir) > 0.0f) {
+            shadow.rays.push_back(Ray{p + n * 1e-4f, lightDir, 0.0f, INF});
+            shadow.normals.push_back(n);
+        }
+        Rng rng(uint64_t(i), 7);
+        float u1 = rng.uniform(), u2 = rng.uniform();
+        ao.rays.push_back(Ray{p + n * 1e-4f, sample_cosine_hemisphere(n, u1, u2), 0.0f, aoDist});
+        ao.normals.push_back(n);
+    }
+
+    const RaySet* sets[2] = {&shadow, &ao};
+    std::vector<uint8_t> ref[2], got;
+    Agreement bvhRun[2];
+    for (int s = 0; s < 2; ++s)
+        bvhRun[s] = run_set(*sets[s], nullptr, ref[s], [&](const Ray& r, Vec3) { return trace_occluded(bvh, tris, r); });
+
+    std::printf("%-10s %10s %10s %12s %12s %10s %10s %10s %10s\n", "accel", "build ms", "MB", "shadow Mr/s",
+                "AO Mr/s", "shadow +%", "shadow -%", "AO +%", "AO -%");
+    std::printf("%-10s %10.1f %10.2f %12.3f %12.3f %10s %10s %10s %10s\n", "bvh4", bvhMs,
+                raw4.size() * 4.0 / (1 << 20), shadow.rays.size() / bvhRun[0].ms * 1e-3,
+                ao.rays.size() / bvhRun[1].ms * 1e-3, "-", "-", "-", "-");
+
+    for (double lvd : levelList) {
+        for (int dag = 0; dag < 2; ++dag) {
+            auto s0 = Clock::now();
+            Svo svo = build_svo(tris, uint32_t(lvd), dag != 0);
+            double buildMs = ms_since(s0);
+
+            Agreement a[2];
+            for (int s = 0; s < 2; ++s) {
+                a[s] = run_set(*sets[s], &ref[s], got, [&](const Ray& r, Vec3 n) {
+                    Ray vr = r;
+                    vr.origin = r.origin + n * (bias * svo.voxelSize);
+                    return svo_occluded(svo, vr);
+                });
+            }
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "%s %u^3", dag ? "dag" : "svo", 1u << svo.levels);
+            auto pct = [](uint64_t k, size_t n) { return n ? 100.0 * double(k) / double(n) : 0.0; };
+            std::printf("%-10s %10.1f %10.2f %12.3f %12.3f %10.2f %10.2f %10.2f %10.2f\n", name, buildMs,
+                        svo.bytes() / double(1 << 20), shadow.rays.size() / a[0].ms * 1e-3,
+                        ao.rays.size() / a[1].ms * 1e-3, pct(a[0].extra, shadow.rays.size()),
+                        pct(a[0].missed, shadow.rays.size()), pct(a[1].extra, ao.rays.size()),
+                        pct(a[1].missed, ao.rays.size()));
+        }
+    }
+
+    std::printf("\n+%%: occluded by voxels but visible in the BVH4; -%%: the reverse.\n");
+    size_t reachable = 0;
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const Bvh4Node& node = bvh.nodes[stack.back()];
+        stack.pop_back();
+        ++reachable;
+        if (!node.leaf())
+            for (uint32_t c : node.child)
+                if (c != INVALID) stack.push_back(c);
+    }
+    std::printf("%zu shadow rays, %zu AO rays; BVH4 size includes %zu unreachable promotion orphans (%.2f MB).\n",
+                shadow.rays.size(), ao.rays.size(), bvh.nodes.size() - reachable,
+                (bvh.nodes.size() - reachable) * NODE4_STRIDE_U32 * 4.0 / (1 << 20));
+    return 0;
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+// svo.hpp
+// Sparse voxel octree over a triangle soup, with optional reduction to a
+// sparse voxel DAG (identical subtrees stored once), and a hierarchical DDA
+// ray marcher. Voxels answer "is anything there" only, so this is meant for
+// ray types that tolerate a voxel-sized error: shadow and AO visibility.
+//
+// Layout (u32 words, root at word 0), one node per occupied cell:
+//
+//   mask                 bit c set if child octant c is occupied
+//   ptr[popcount(mask)]  word offset of each occupied child, in bit order
+//
+// Nodes on the last level have no pointers; their mask bits are the voxels.
+// Octant c = (x << 2) | (y << 1) | z, the bit order of morton3d().
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+static constexpr uint32_t SVO_MAX_LEVELS = 16;
+
+struct Svo {
+    Aabb     box;            // cube around the scene
+    uint32_t levels = 0;     // resolution is 2^levels voxels per axis
+    float    voxelSize = 0.0f;
+    bool     dag = false;
+
+    std::vector<uint32_t> words;
+    std::vector<uint32_t> nodesPerLevel;
+    uint64_t voxels = 0;     // occupied leaf voxels
+
+    size_t bytes() const { return words.size() * sizeof(uint32_t); }
+};
+
+/* ================= Voxelization ================= */
+
+namespace svo_detail {
+
+// Akenine-Moller triangle/box overlap (SAT over 13 axes), box at the origin.
+static inline bool tri_box_overlap(Vec3 half, Vec3 v0, Vec3 v1, Vec3 v2) {
+    const Vec3 e[3] = {v1 - v0, v2 - v1, v0 - v2};
+    const Vec3 v[3] = {v0, v1, v2};
+
+    for (int i = 0; i < 3; ++i)
+        for (int a = 0; a < 3; ++a) {
+            // axis = unit(a) x e[i]
+            Vec3 unit{a == 0 ? 1.0f : 0.0f, a == 1 ? 1.0f : 0.0f, a == 2 ? 1.0f : 0.0f};
+            Vec3 ax = cross(unit, e[i]);
+            float p0 = dot(ax, v[0]), p1 = dot(ax, v[1]), p2 = dot(ax, v[2]);
+            float r = half.x * std::fabs(ax.x) + half.y * std::fabs(ax.y) + half.z * std::fabs(ax.z);
+            if (std::min({p0, p1, p2}) > r || std::max({p0, p1, p2}) < -r) return false;
+        }
+
+    for (int a = 0; a < 3; ++a)
+        if (std::min({v0[a], v1[a], v2[a]}) > half[a] || std::max({v0[a], v1[a], v2[a]}) < -half[a]) return false;
+
+    Vec3 n = cross(e[0], e[1]);
+    float d = dot(n, v0);
+    float r = half.x * std::fabs(n.x) + half.y * std::fabs(n.y) + half.z * std::fabs(n.z);
+    return std::fabs(d) <= r;
+}
+
+static inline uint64_t morton3d_64(uint32_t x, uint32_t y, uint32_t z) {
+    auto spread = [](uint64_t v) {
+        v &= 0x1FFFFF;
+        v = (v | (v << 32)) & 0x1F00000000FFFFull;
+        v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+        v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+        v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+        v = (v | (v << 2)) & 0x1249249249249249ull;
+        return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+// Sorted, unique Morton codes of every voxel a triangle touches. Voxels are
+// slightly enlarged in the overlap test so triangles lying exactly on a
+// voxel face mark both sides.
+static inline std::vector<uint64_t> voxelize(const Triangles& tris, const Aabb& box, uint32_t levels) {
+    TIMELINE_ZONE("voxelize");
+    const uint32_t res = 1u << levels;
+    const float scale = float(res) / (box.mx.x - box.mn.x);
+    const Vec3 half{0.5001f, 0.5001f, 0.5001f};
+
+    std::vector<std::vector<uint64_t>> perWorker(worker_count());
+    parallel_for_chunks(0, tris.count(), 1 << 12, [&](size_t b, size_t e, unsigned w) {
+        std::vector<uint64_t>& out = perWorker[w];
+        for (size_t t = b; t < e; ++t) {
+            Vec3 v0 = (tris.vertex(uint32_t(t), 0) - box.mn) * scale;
+            Vec3 v1 = (tris.vertex(uint32_t(t), 1) - box.mn) * scale;
+            Vec3 v2 = (tris.vertex(uint32_t(t), 2) - box.mn) * scale;
+
+            uint32_t lo[3], hi[3];
+            for (int a = 0; a < 3; ++a) {
+                float mn = std::min({v0[a], v1[a], v2[a]}), mx = std::max({v0[a], v1[a], v2[a]});
+                lo[a] = uint32_t(std::clamp(int32_t(std::floor(mn - 0.001f)), 0, int32_t(res - 1)));
+                hi[a] = uint32_t(std::clamp(int32_t(std::floor(mx + 0.001f)), 0, int32_t(res - 1)));
+            }
+
+            for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+                for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+                    for (uint32_t z = lo[2]; z <= hi[2]; ++z) {
+                        Vec3 c{float(x) + 0.5f, float(y) + 0.5f, float(z) + 0.5f};
+                        if (tri_box_overlap(half, v0 - c, v1 - c, v2 - c)) out.push_back(morton3d_64(x, y, z));
+                    }
+        }
+        // Dedupe locally so the merge sorts far fewer codes.
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    });
+
+    size_t total = 0;
+    for (const auto& v : perWorker) total += v.size();
+    std::vector<uint64_t> codes;
+    codes.reserve(total);
+    for (auto& v : perWorker) {
+        codes.insert(codes.end(), v.begin(), v.end());
+        std::vector<uint64_t>().swap(v);
+    }
+    parallel_sort(codes.data(), codes.data() + codes.size(), std::less<uint64_t>());
+    codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+    return codes;
+}
+
+// One octree level: node codes (sorted), child masks, and for each node the
+// index of its first child on the next level.
+struct Level {
+    std::vector<uint64_t> codes;
+    std::vector<uint8_t>  masks;
+    std::vector<uint32_t> firstChild;
+};
+
+static inline Level parent_level(const std::vector<uint64_t>& childCodes) {
+    Level lv;
+    for (size_t i = 0; i < childCodes.size(); ++i) {
+        uint64_t p = childCodes[i] >> 3;
+        if (lv.codes.empty() || lv.codes.back() != p) {
+            lv.codes.push_back(p);
+            lv.masks.push_back(0);
+            lv.firstChild.push_back(uint32_t(i));
+        }
+        lv.masks.back() |= uint8_t(1u << (childCodes[i] & 7));
+    }
+    return lv;
+}
+
+} // namespace svo_detail
+
+/* ================= Build ================= */
+
+// Voxelizes at 2^levels per axis, builds the levels bottom-up from the sorted
+// voxel codes and serializes them breadth-first. With dag=true, nodes with
+// the same mask and the same (already merged) children are stored once; the
+// merge sorts each level's node keys, so it parallelizes like the rest.
+static inline Svo build_svo(const Triangles& tris, uint32_t levels, bool dag) {
+    using namespace svo_detail;
+    TIMELINE_ZONE("svo build");
+    Svo svo;
+    svo.levels = levels = std::clamp(levels, 1u, SVO_MAX_LEVELS);
+    svo.dag = dag;
+
+    Aabb sb;
+    for (uint32_t t = 0; t < tris.count(); ++t) sb.grow(tris.bounds(t));
+    if (sb.empty()) return svo;
+    Vec3 ext = sb.mx - sb.mn;
+    float side = std::max({ext.x, ext.y, ext.z}) * 1.001f + 1e-6f;
+    Vec3 c = sb.center();
+    svo.box.mn = c - Vec3{side, side, side} * 0.5f;
+    svo.box.mx = c + Vec3{side, side, side} * 0.5f;
+    svo.voxelSize = side / float(1u << levels);
+
+    std::vector<uint64_t> voxels = voxelize(tris, svo.box, levels);
+    svo.voxels = voxels.size();
+
+    // lv[d] holds the nodes at depth d (0 = root); lv[levels-1] masks are voxels.
+    std::vector<Level> lv(levels);
+    lv[levels - 1] = parent_level(voxels);
+    for (int d = int(levels) - 2; d >= 0; --d) lv[size_t(d)] = parent_level(lv[size_t(d) + 1].codes);
+    std::vector<uint64_t>().swap(voxels);
+
+    // canon[d][i]: index of node i among the nodes actually stored at depth d.
+    std::vector<std::vector<uint32_t>> canon(levels);
+    std::vector<uint32_t> stored(levels);
+    for (int d = int(levels) - 1; d >= 0; --d) {
+        const Level& L = lv[size_t(d)];
+        const size_t n = L.codes.size();
+        std::vector<uint32_t>& cn = canon[size_t(d)];
+        cn.resize(n);
+
+        if (!dag) {
+            for (size_t i = 0; i < n; ++i) cn[i] = uint32_t(i);
+            stored[size_t(d)] = uint32_t(n);
+            continue;
+        }
+
+        // Key = mask + canonical children; sort node indices by key and give
+        // each run of equal keys one id.
+        using Key = std::array<uint32_t, 9>;
+        std::vector<Key> keys(n);
+        parallel_for(0, n, 1 << 12, [&](size_t i) {
+            Key& k = keys[i];
+            k.fill(INVALID);
+            k[0] = L.masks[i];
+            if (size_t(d) + 1 < levels) {
+                uint32_t pc = std::popcount(uint32_t(L.masks[i]));
+                for (uint32_t j = 0; j < pc; ++j) k[1 + j] = canon[size_t(d) + 1][L.firstChild[i] + j];
+            }
+        });
+        std::vector<uint32_t> idx(n);
+        for (size_t i = 0; i < n; ++i) idx[i] = uint32_t(i);
+        parallel_sort(idx.data(), idx.data() + n, [&](uint32_t a, uint32_t b) {
+            return keys[a] != keys[b] ? keys[a] < keys[b] : a < b;
+        });
+        uint32_t id = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0 && keys[idx[i]] != keys[idx[i - 1]]) ++id;
+            cn[idx[i]] = id;
+        }
+        stored[size_t(d)] = n ? id + 1 : 0;
+    }
+
+    // Representative (first) node for each stored id, then word offsets.
+    std::vector<std::vector<uint32_t>> rep(levels);
+    std::vector<std::vector<uint32_t>> offset(levels);
+    size_t words = 0;
+    for (uint32_t d = 0; d < levels; ++d) {
+        const Level& L = lv[d];
+        rep[d].assign(stored[d], INVALID);
+        for (size_t i = 0; i < L.codes.size(); ++i)
+            if (rep[d][canon[d][i]] == INVALID) rep[d][canon[d][i]] = uint32_t(i);
+
+        offset[d].resize(stored[d]);
+        for (uint32_t s = 0; s < stored[d]; ++s) {
+            offset[d][s] = uint32_t(words);
+            words += 1 + (d + 1 < levels ? std::popcount(uint32_t(L.masks[rep[d][s]])) : 0);
+        }
+        svo.nodesPerLevel.push_back(stored[d]);
+    }
+
+    svo.words.resize(words);
+    for (uint32_t d = 0; d < levels; ++d) {
+        const Level& L = lv[d];
+        parallel_for(0, stored[d], 1 << 12, [&](size_t s) {
+            uint32_t i = rep[d][s];
+            uint32_t* w = svo.words.data() + offset[d][s];
+            w[0] = L.masks[i];
+            if (d + 1 < levels) {
+                uint32_t pc = std::popcount(uint32_t(L.masks[i]));
+                for (uint32_t j = 0; j < pc; ++j) w[1 + j] = offset[d + 1][canon[d + 1][L.firstChild[i] + j]];
+            }
+        });
+    }
+    return svo;
+}
+
+/* ================= Ray marching ================= */
+
+struct SvoStats {
+    uint64_t steps = 0;   // empty cells skipped
+    uint64_t fetches = 0; // node words read while descending
+};
+
+struct SvoHit {
+    float    t = INF;
+    uint32_t axis = 0;    // axis of the voxel face the ray entered through
+
+    bool hit() const { return t < INF; }
+};
+
+// Hierarchical DDA: descend to the deepest node containing the current cell;
+// if the child there is empty, jump to where the ray leaves that whole empty
+// cell, and restart the descent from the deepest ancestor the old and new
+// cells share. Works in grid space, where t is unchanged.
+template <bool CountStats>
+static SvoHit trace_svo_impl(const Svo& svo, const Ray& ray, SvoStats* stats) {
+    SvoHit out;
+    if (svo.words.empty()) return out;
+
+    const uint32_t L = svo.levels;
+    const int32_t res = int32_t(1u << L);
+    const float scale = float(res) / (svo.box.mx.x - svo.box.mn.x);
+    const Vec3 o = (ray.origin - svo.box.mn) * scale;
+    const Vec3 d = ray.dir * scale;
+    const Vec3 inv = safe_inv_dir(d);
+
+    // Clip to the grid.
+    float t0 = ray.tmin, t1 = ray.tmax;
+    uint32_t axis = 0;
+    for (int a = 0; a < 3; ++a) {
+        float ta = (0.0f - o[a]) * inv[a], tb = (float(res) - o[a]) * inv[a];
+        if (ta > tb) std::swap(ta, tb);
+        if (ta > t0) { t0 = ta; axis = uint32_t(a); }
+        t1 = std::min(t1, tb);
+    }
+    if (t0 > t1) return out;
+
+    int32_t cell[3];
+    for (int a = 0; a < 3; ++a) cell[a] = std::clamp(int32_t(std::floor(o[a] + d[a] * t0)), 0, res - 1);
+
+    uint32_t stack[SVO_MAX_LEVELS];
+    stack[0] = 0;
+    uint32_t depth = 0;
+    float t = t0;
+
+    for (;;) {
+        uint32_t shift;
+        for (;;) {
+            uint32_t node = stack[depth];
+            uint32_t mask = svo.words[node];
+            shift = L - 1 - depth;
+            uint32_t c = (((uint32_t(cell[0]) >> shift) & 1u) << 2) | (((uint32_t(cell[1]) >> shift) & 1u) << 1) |
+                         ((uint32_t(cell[2]) >> shift) & 1u);
+            if (CountStats) stats->fetches++;
+            if (!(mask & (1u << c))) break;
+            if (depth == L - 1) {
+                out.t = t;
+                out.axis = axis;
+                return out;
+            }
+            stack[++depth] = svo.words[node + 1 + std::popcount(mask & ((1u << c) - 1u))];
+        }
+
+        // Leave the empty cell of side 2^shift containing `cell`.
+        if (CountStats) stats->steps++;
+        int32_t size = 1 << shift;
+        int32_t base[3];
+        float tNext = INF;
+        uint32_t exitAxis = 0;
+        for (int a = 0; a < 3; ++a) {
+            base[a] = (cell[a] >> shift) << shift;
+            float plane = float(d[a] > 0.0f ? base[a] + size : base[a]);
+            float ta = d[a] != 0.0f ? (plane - o[a]) * inv[a] : INF;
+            if (ta < tNext) { tNext = ta; exitAxis = uint32_t(a); }
+        }
+        if (tNext > t1) return out;
+
+        int32_t next[3];
+        for (int a = 0; a < 3; ++a) {
+            if (uint32_t(a) == exitAxis) {
+                next[a] = d[a] > 0.0f ? base[a] + size : base[a] - 1;
+            } else {
+                next[a] = std::clamp(int32_t(std::floor(o[a] + d[a] * tNext)), base[a], base[a] + size - 1);
+            }
+        }
+        if (next[exitAxis] < 0 || next[exitAxis] >= res) return out;
+
+        uint32_t diff = uint32_t((cell[0] ^ next[0]) | (cell[1] ^ next[1]) | (cell[2] ^ next[2]));
+        depth = L - uint32_t(std::bit_width(diff));
+        for (int a = 0; a < 3; ++a) cell[a] = next[a];
+        t = std::max(t, tNext);
+        axis = exitAxis;
+    }
+}
+
+static inline SvoHit trace_svo(const Svo& svo, const Ray& ray, SvoStats* stats = nullptr) {
+    return stats ? trace_svo_impl<true>(svo, ray, stats) : trace_svo_impl<false>(svo, ray, nullptr);
+}
+
+static inline bool svo_occluded(const Svo& svo, const Ray& ray, SvoStats* stats = nullptr) {
+    return trace_svo(svo, ray, stats).hit();
+}
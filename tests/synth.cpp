@@ -0,0 +1,312 @@
+// synth.cpp
+// Scaling curves over the synthetic scenes in synth.hpp: for every kind and
+// size, generate the triangles in memory, run the builders (the app's
+// LBVH2 + BVH4 promotion phase by phase, optionally the k-d tree and grid
+// from accel.hpp) and trace primary rays from the default camera through
+// each structure.
+//
+//   bin/synth [--kinds random,grid,clusters,slivers,spheres,stadium]
+//             [--tris 1k,10k,100k,1m] [--seed 1] [--clusters 32]
+//             [--accels bvh4,kdtree,grid] [--size 320x180] [--reps 1]
+//             [--json out.json|-]
+//   bin/synth --write scene.bin --kinds stadium --tris 1b [--seed 1]
+//
+// Sizes take k / m / b suffixes. Each timed phase reports the median of
+// --reps runs. "slope" is the scaling exponent between consecutive sizes,
+// log(t2 / t1) / log(n2 / n1): 1.0 is linear, above it superlinear.
+// "heap pk" / "RSS pk" are the measured high-water marks of the build
+// (memtrack.hpp), triangles included. The primary-ray loop runs under
+// MemHotLoop; the tool exits 1 if it allocated.
+//
+// The in-memory pipeline needs roughly 300 bytes per triangle at its peak,
+// so sizes that do not fit MemAvailable are skipped with a note; the k-d
+// tree and grid are not in that estimate and duplicate references heavily
+// on slivers (1M slivers do not fit in 5 GB). --write
+// streams one scene to a raw f32 dump (load with --scene in any tool)
+// without holding it, which is how the 1B-triangle scenes are made.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "accel.hpp"
+#include "args.hpp"
+#include "bench.hpp"
+#include "memtrack.hpp"
+#include "synth.hpp"
+
+struct ScalePoint {
+    uint64_t            tris = 0;
+    bool                skipped = false;
+    double              genMs = 0.0;
+    std::vector<double> phaseMs; // per Curve::phases
+    double              buildMs = 0.0;
+    double              traceMs = 0.0;
+    uint64_t            rays = 0, hits = 0;
+    TraceStats          stats;
+    size_t              bytes = 0;
+    int64_t             heapPeak = 0; // during the build, memtrack.hpp
+    uint64_t            rssPeak = 0;
+    uint32_t            depth = 0;
+};
+
+struct Curve {
+    std::string              kind, accel;
+    std::vector<std::string> phases;
+    std::vector<ScalePoint>  points;
+};
+
+// Peak of the BVH4 pipeline: triangles, sorted keys + order, LBVH2, BVH4
+// and its decoded copy, all alive together.
+static uint64_t pipeline_bytes(uint64_t tris) {
+    return tris * (36 + 8 + 8 + 2 * 24 + 2 * 32 + 2 * sizeof(Bvh4Node));
+}
+
+static double median_ms(const std::vector<double>& v) { return summarize(v).median; }
+
+template <typename Fn>
+static double timed(Fn&& fn) {
+    BenchTimer t;
+    fn();
+    return t.ms();
+}
+
+// intersect(ray, stats) -> Hit
+template <typename Intersect>
+static void trace_primary(Intersect&& intersect, uint32_t width, uint32_t height, ScalePoint& pt) {
+    Camera cam;
+    const size_t n = size_t(width) * height;
+    std::vector<TraceStats> stats(worker_count());
+    std::vector<uint64_t> hits(worker_count(), 0);
+    pt.traceMs = timed([&] {
+        parallel_for_chunks(0, n, 256, [&](size_t b, size_t e, unsigned w) {
+            MemHotLoop hot("trace");
+            for (size_t i = b; i < e; ++i) {
+                Ray r = primary_ray(cam, float(i % width), float(i / width), width, height);
+                if (intersect(r, &stats[w]).hit()) hits[w]++;
+            }
+        });
+    });
+    pt.rays = n;
+    for (unsigned w = 0; w < worker_count(); ++w) {
+        pt.stats.add(stats[w]);
+        pt.hits += hits[w];
+    }
+}
+
+// LBVH2 + promotion timed phase by phase, as Bvh4Accel::build runs them.
+static void run_bvh4(const Triangles& tris, uint32_t reps, uint32_t width, uint32_t height, ScalePoint& pt) {
+    std::vector<double> ms[3];
+    std::vector<uint32_t> bvh4;
+    MemPhase phase("bvh4 build");
+    for (uint32_t r = 0; r < reps; ++r) {
+        MortonOrder order;
+        std::vector<uint32_t> bvh2;
+        ms[0].push_back(timed([&] { order = morton_sort(tris); }));
+        ms[1].push_back(timed([&] { bvh2 = build_lbvh2(tris, order); }));
+        ms[2].push_back(timed([&] { bvh4 = promote_bvh4(bvh2); }));
+    }
+    for (auto& m : ms) {
+        pt.phaseMs.push_back(median_ms(m));
+        pt.buildMs += pt.phaseMs.back();
+    }
+    pt.heapPeak = phase.finish().heapPeak;
+    pt.rssPeak = phase.stats().rssPeak;
+
+    Bvh4 bvh = decode_bvh4(bvh4);
+    pt.bytes = bvh4.size() * sizeof(uint32_t);
+    trace_primary([&](const Ray& r, TraceStats* s) { return trace_closest(bvh, tris, r, s); }, width, height, pt);
+}
+
+static void run_accel(const std::string& name, const Triangles& tris, uint32_t reps, uint32_t width,
+                      uint32_t height, ScalePoint& pt) {
+    std::unique_ptr<Accel> accel;
+    std::vector<double> ms;
+    MemPhase phase("accel build");
+    for (uint32_t r = 0; r < reps; ++r) {
+        accel.reset();
+        accel = make_accel(name);
+        ms.push_back(timed([&] { accel->build(tris); }));
+    }
+    pt.heapPeak = phase.finish().heapPeak;
+    pt.rssPeak = phase.stats().rssPeak;
+    pt.buildMs = median_ms(ms);
+    pt.phaseMs.push_back(pt.buildMs);
+    AccelMemory mem = accel->memory();
+    pt.bytes = mem.bytes;
+    pt.depth = mem.depth;
+    trace_primary([&](const Ray& r, TraceStats* s) { return accel->intersect(r, s); }, width, height, pt);
+}
+
+static double slope(const ScalePoint& a, const ScalePoint& b, double ya, double yb) {
+    if (a.skipped || b.skipped || ya <= 0.0 || yb <= 0.0 || a.tris == b.tris) return NAN;
+    return std::log(yb / ya) / std::log(double(b.tris) / double(a.tris));
+}
+
+static void print_curve(FILE* out, const Curve& c) {
+    std::fprintf(out, "=== %s / %s ===\n%12s %9s", c.kind.c_str(), c.accel.c_str(), "tris", "gen ms");
+    for (const std::string& p : c.phases) std::fprintf(out, " %11s", (p + " ms").c_str());
+    std::fprintf(out, " %9s %6s %10s %10s %10s %8s %9s %9s %6s\n", "ns/tri", "slope", "MB", "heap pk MB",
+                 "RSS pk MB", "Mrays/s", "visits", "tri tests", "hit%");
+    for (size_t i = 0; i < c.points.size(); ++i) {
+        const ScalePoint& p = c.points[i];
+        if (p.skipped) {
+            std::fprintf(out, "%12llu skipped: needs ~%.1f GB, %.1f GB available\n", (unsigned long long)p.tris,
+                         pipeline_bytes(p.tris) * 1e-9, mem_available() * 1e-9);
+            continue;
+        }
+        std::fprintf(out, "%12llu %9.2f", (unsigned long long)p.tris, p.genMs);
+        for (double ms : p.phaseMs) std::fprintf(out, " %11.2f", ms);
+        double s = i ? slope(c.points[i - 1], p, c.points[i - 1].buildMs, p.buildMs) : NAN;
+        double n = double(std::max<uint64_t>(p.rays, 1));
+        char slopeText[16] = "-";
+        if (!std::isnan(s)) std::snprintf(slopeText, sizeof(slopeText), "%.2f", s);
+        std::fprintf(out, " %9.1f %6s %10.1f %10.1f %10.1f %8.2f %9.1f %9.1f %5.1f%%\n",
+                     p.buildMs * 1e6 / double(p.tris), slopeText, p.bytes / 1048576.0, p.heapPeak / 1048576.0,
+                     p.rssPeak / 1048576.0,
+                     p.traceMs > 0.0 ? p.rays / (p.traceMs * 1e3) : 0.0, p.stats.nodes / n, p.stats.triTests / n,
+                     100.0 * p.hits / n);
+    }
+    std::fprintf(out, "\n");
+}
+
+static void write_curve_json(JsonWriter& w, const Curve& c) {
+    w.begin_object();
+    w.value("kind", c.kind);
+    w.value("accel", c.accel);
+    w.begin_array("points");
+    for (size_t i = 0; i < c.points.size(); ++i) {
+        const ScalePoint& p = c.points[i];
+        w.begin_object();
+        w.value("tris", p.tris);
+        w.value("skipped", p.skipped);
+        if (!p.skipped) {
+            w.value("generate_ms", p.genMs);
+            for (size_t k = 0; k < c.phases.size(); ++k) w.value((c.phases[k] + "_ms").c_str(), p.phaseMs[k]);
+            w.value("build_ms", p.buildMs);
+            double s = i ? slope(c.points[i - 1], p, c.points[i - 1].buildMs, p.buildMs) : NAN;
+            if (std::isnan(s)) w.null("build_slope");
+            else w.value("build_slope", s);
+            w.value("bytes", uint64_t(p.bytes));
+            w.value("heap_peak", p.heapPeak);
+            w.value("rss_peak", p.rssPeak);
+            if (p.depth) w.value("depth", p.depth);
+            w.value("rays", p.rays);
+            w.value("hits", p.hits);
+            w.value("trace_ms", p.traceMs);
+            w.value("nodes_visited", p.stats.nodes);
+            w.value("box_tests", p.stats.boxTests);
+            w.value("tri_tests", p.stats.triTests);
+        }
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::vector<std::string> kinds = args.strs("kinds", "random,grid,clusters,slivers,spheres,stadium");
+    std::vector<std::string> sizeArgs = args.strs("tris", "1k,10k,100k,1m");
+    std::vector<std::string> accels = args.strs("accels", "bvh4");
+    std::string writePath = args.str("write", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t reps = std::max<uint32_t>(1, args.u32("reps", 1));
+    uint32_t width = 320, height = 180;
+    args.size2("size", width, height);
+
+    SynthParams base;
+    base.seed = uint64_t(args.num("seed", 1));
+    base.clusters = args.u32("clusters", base.clusters);
+
+    std::vector<uint64_t> sizes;
+    for (const std::string& s : sizeArgs) {
+        uint64_t n = parse_synth_count(s);
+        if (!n) {
+            std::cerr << "Bad --tris entry " << s << "\n";
+            return 1;
+        }
+        sizes.push_back(n);
+    }
+    for (const std::string& a : accels)
+        if (!make_accel(a)) {
+            std::cerr << "Unknown accel " << a << "\n";
+            return 1;
+        }
+
+    if (!writePath.empty()) {
+        if (kinds.size() != 1 || sizes.size() != 1) {
+            std::cerr << "--write takes exactly one --kinds and one --tris\n";
+            return 1;
+        }
+        SynthParams p = base;
+        p.kind = kinds[0];
+        p.tris = sizes[0];
+        double ms = timed([&] { p.tris = write_synth_scene(p, writePath.c_str()) ? p.tris : 0; });
+        if (!p.tris) return 1;
+        std::printf("%s: %llu %s triangles (seed %llu), %.2f GB in %.0f ms\n", writePath.c_str(),
+                    (unsigned long long)p.tris, p.kind.c_str(), (unsigned long long)p.seed, p.tris * 36e-9, ms);
+        return 0;
+    }
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::vector<Curve> curves;
+    for (const std::string& kind : kinds) {
+        size_t first = curves.size();
+        for (const std::string& a : accels) {
+            Curve c;
+            c.kind = kind;
+            c.accel = a;
+            c.phases = a == "bvh4" ? std::vector<std::string>{"morton", "lbvh2", "promote"}
+                                   : std::vector<std::string>{"build"};
+            curves.push_back(c);
+        }
+        for (uint64_t n : sizes) {
+            ScalePoint pt;
+            pt.tris = n;
+            const uint64_t avail = mem_available();
+            if (avail && pipeline_bytes(n) > avail) {
+                pt.skipped = true;
+                for (size_t i = first; i < curves.size(); ++i) curves[i].points.push_back(pt);
+                continue;
+            }
+            SynthParams p = base;
+            p.kind = kind;
+            p.tris = n;
+            Triangles tris;
+            bool ok = true;
+            pt.genMs = timed([&] { ok = generate_scene(p, tris); });
+            if (!ok) return 1;
+            for (size_t i = first; i < curves.size(); ++i) {
+                ScalePoint q = pt;
+                if (curves[i].accel == "bvh4") run_bvh4(tris, reps, width, height, q);
+                else run_accel(curves[i].accel, tris, reps, width, height, q);
+                curves[i].points.push_back(q);
+            }
+        }
+        for (size_t i = first; i < curves.size(); ++i) print_curve(text, curves[i]);
+    }
+    const int status = report_hot_loop_violations(stderr) ? 1 : 0;
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/synth");
+    w.value("seed", base.seed);
+    w.value("reps", reps);
+    w.value("width", width);
+    w.value("height", height);
+    w.begin_array("curves");
+    for (const Curve& c : curves) write_curve_json(w, c);
+    w.end_array();
+    w.value("hot_loop_allocs", mem_hot_loop_violations());
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+// synth.hpp
+// Parametric triangle soups for scaling runs, in the same [-1, 1] cube the
+// app normalizes real assets to, so the default camera frames them:
+//
+//   random    uniform centroids, triangle edges ~ the mean spacing
+//   grid      tessellated heightfield facing +z, 2 triangles per cell
+//   clusters  Gaussian blobs with log-uniform radii (--clusters of them)
+//   slivers   long, thin triangles at random orientations (0.05..0.3 x 0.001)
+//   spheres   lat-long tessellated spheres of ~4K triangles each
+//   stadium   "teapot in a stadium": a coarse bowl of radius 1 around a
+//             dense sphere of radius 0.005, 200x smaller, holding almost
+//             every triangle
+//
+// Output depends only on (kind, count, seed): triangles are produced in
+// fixed chunks with one PCG stream per chunk, so any thread count and
+// generate_scene() vs write_synth_scene() give identical bytes. The last
+// sphere of "spheres" / the teapot may be open at its top pole when the
+// count does not fill it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+static inline const char* const SYNTH_KINDS[] = {"random", "grid", "clusters", "slivers", "spheres", "stadium"};
+
+// "100k" -> 100000 (k / m / b suffixes); 0 on parse errors.
+static inline uint64_t parse_synth_count(const std::string& s) {
+    char* end = nullptr;
+    double v = std::strtod(s.c_str(), &end);
+    if (end == s.c_str() || v <= 0.0) return 0;
+    switch (*end) {
+    case 'k': case 'K': v *= 1e3; ++end; break;
+    case 'm': case 'M': v *= 1e6; ++end; break;
+    case 'b': case 'B': case 'g': case 'G': v *= 1e9; ++end; break;
+    default: break;
+    }
+    return *end ? 0 : uint64_t(v + 0.5);
+}
+
+struct SynthParams {
+    std::string kind = "random";
+    uint64_t    tris = 100000;
+    uint64_t    seed = 1;
+    uint32_t    clusters = 32; // "clusters" only
+};
+
+namespace synth_detail {
+
+static constexpr uint64_t CHUNK = 1u << 16;
+
+enum Kind { RANDOM, GRID, CLUSTERS, SLIVERS, SPHERES, STADIUM, KINDS };
+
+static inline void store(float* out, Vec3 a, Vec3 b, Vec3 c) {
+    const Vec3 v[3] = {a, b, c};
+    for (int k = 0; k < 3; ++k) {
+        out[k * 3 + 0] = v[k].x;
+        out[k * 3 + 1] = v[k].y;
+        out[k * 3 + 2] = v[k].z;
+    }
+}
+
+struct Sphere {
+    Vec3     center{0.0f, 0.0f, 0.0f};
+    float    radius = 1.0f;
+    float    lat0 = -1.5707963f, lat1 = 1.5707963f; // latitude band, z is the pole axis
+    uint32_t stacks = 1, slices = 3;
+
+    uint64_t tris() const { return uint64_t(stacks) * slices * 2; }
+
+    Vec3 point(uint32_t st, uint32_t sl) const {
+        float lat = lat0 + (lat1 - lat0) * float(st) / float(stacks);
+        float lon = 6.28318530718f * float(sl % slices) / float(slices);
+        return center + Vec3{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon), std::sin(lat)} * radius;
+    }
+
+    void emit(uint64_t local, float* out) const {
+        uint32_t st = uint32_t(local / (uint64_t(slices) * 2)), sl = uint32_t(local / 2 % slices);
+        Vec3 a = point(st, sl), b = point(st, sl + 1), c = point(st + 1, sl), d = point(st + 1, sl + 1);
+        if (local & 1) store(out, a, d, c);
+        else store(out, a, b, d);
+    }
+};
+
+// Smallest stacks x (2 stacks) slices tessellation holding `tris`.
+static inline void tessellate(Sphere& s, uint64_t tris) {
+    s.stacks = std::max<uint32_t>(1, uint32_t(std::ceil(std::sqrt(double(tris) / 4.0))));
+    s.slices = std::max<uint32_t>(3, s.stacks * 2);
+}
+
+struct Cluster {
+    Vec3  center{0.0f, 0.0f, 0.0f};
+    float sigma = 0.1f;
+    float edge = 0.01f;
+};
+
+static inline float signed_unit(Rng& rng) { return rng.uniform() * 2.0f - 1.0f; }
+
+static inline Vec3 unit_vector(Rng& rng) {
+    float z = signed_unit(rng), phi = 6.28318530718f * rng.uniform();
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+static inline float gaussian(Rng& rng) {
+    float u1 = std::max(rng.uniform(), 1e-7f), u2 = rng.uniform();
+    return std::sqrt(-2.0f * std::log(u1)) * std::cos(6.28318530718f * u2);
+}
+
+// Random triangle of edge ~`edge` around c.
+static inline void jitter_triangle(Rng& rng, Vec3 c, float edge, float* out) {
+    Vec3 v[3];
+    for (Vec3& p : v) p = c + Vec3{signed_unit(rng), signed_unit(rng), signed_unit(rng)} * (0.5f * edge);
+    store(out, v[0], v[1], v[2]);
+}
+
+} // namespace synth_detail
+
+class SynthGenerator {
+public:
+    // false (with a message) for unknown kinds or counts past the u32
+    // triangle index.
+    bool init(const SynthParams& p) {
+        using namespace synth_detail;
+        p_ = p;
+        if (p.tris == 0 || p.tris > 0xFFFFFFFFull) {
+            std::cerr << "synth: triangle count must be in 1..4294967295\n";
+            return false;
+        }
+        kind_ = KINDS;
+        for (int k = 0; k < KINDS; ++k)
+            if (p.kind == SYNTH_KINDS[k]) kind_ = Kind(k);
+        const double n = double(p.tris);
+        Rng rng(p.seed ^ 0x5EEDull, 0xC0FFEEull);
+
+        if (kind_ == RANDOM) {
+            edge_ = 2.0f / float(std::cbrt(n));
+        } else if (kind_ == GRID) {
+            cols_ = std::max<uint64_t>(1, uint64_t(std::ceil(std::sqrt(n / 2.0))));
+            rows_ = (p.tris / 2 + cols_) / cols_;
+            for (float& ph : phase_) ph = 6.28318530718f * rng.uniform();
+        } else if (kind_ == CLUSTERS) {
+            clusters_.resize(std::max<uint32_t>(1, p.clusters));
+            const double perCluster = n / double(clusters_.size());
+            for (Cluster& c : clusters_) {
+                c.center = Vec3{signed_unit(rng), signed_unit(rng), signed_unit(rng)} * 0.8f;
+                c.sigma = 0.2f * std::exp(-3.0f * rng.uniform()); // 0.01 .. 0.2
+                c.edge = 4.0f * c.sigma / float(std::cbrt(std::max(1.0, perCluster)));
+            }
+        } else if (kind_ == SLIVERS) {
+            // nothing to precompute
+        } else if (kind_ == SPHERES) {
+            Sphere proto;
+            tessellate(proto, std::min<uint64_t>(p.tris, 4096));
+            const uint64_t count = (p.tris + proto.tris() - 1) / proto.tris();
+            const float r = 0.6f / float(std::cbrt(double(count)));
+            spheres_.resize(count, proto);
+            for (Sphere& s : spheres_) {
+                s.radius = r * (0.5f + 0.5f * rng.uniform());
+                s.center = Vec3{signed_unit(rng), signed_unit(rng), signed_unit(rng)} * (1.0f - s.radius);
+            }
+        } else if (kind_ == STADIUM) {
+            // Stands: lower hemisphere, open toward the default camera.
+            Sphere stands;
+            stands.lat1 = 0.0f;
+            tessellate(stands, std::max<uint64_t>(1, std::min<uint64_t>(p.tris / 16, 8192)));
+            stands.stacks = std::max<uint32_t>(1, stands.stacks / 2); // half the latitude range
+            standsTris_ = std::min<uint64_t>(stands.tris(), p.tris);
+            Sphere teapot;
+            teapot.radius = 0.005f;
+            tessellate(teapot, std::max<uint64_t>(1, p.tris - standsTris_));
+            spheres_ = {stands, teapot};
+        } else {
+            std::cerr << "synth: unknown kind " << p.kind << " (random, grid, clusters, slivers, spheres, stadium)\n";
+            return false;
+        }
+        return true;
+    }
+
+    const SynthParams& params() const { return p_; }
+    uint64_t           chunks() const { return (p_.tris + synth_detail::CHUNK - 1) / synth_detail::CHUNK; }
+    uint64_t           chunk_begin(uint64_t c) const { return c * synth_detail::CHUNK; }
+    uint64_t           chunk_end(uint64_t c) const { return std::min(p_.tris, (c + 1) * synth_detail::CHUNK); }
+
+    // Triangles [chunk_begin(c), chunk_end(c)), 9 floats each.
+    void generate_chunk(uint64_t c, float* out) const {
+        using namespace synth_detail;
+        Rng rng(p_.seed, c);
+        for (uint64_t t = chunk_begin(c), e = chunk_end(c); t < e; ++t, out += 9) {
+            if (kind_ == RANDOM) {
+                jitter_triangle(rng, Vec3{signed_unit(rng), signed_unit(rng), signed_unit(rng)}, edge_, out);
+            } else if (kind_ == GRID) {
+                uint64_t q = t / 2, row = q / cols_, col = q % cols_;
+                Vec3 a = grid_point(col, row), b = grid_point(col + 1, row);
+                Vec3 cc = grid_point(col, row + 1), d = grid_point(col + 1, row + 1);
+                if (t & 1) store(out, a, d, cc);
+                else store(out, a, b, d);
+            } else if (kind_ == CLUSTERS) {
+                const Cluster& cl = clusters_[rng.next() % clusters_.size()];
+                Vec3 o{gaussian(rng), gaussian(rng), gaussian(rng)};
+                jitter_triangle(rng, cl.center + o * cl.sigma, cl.edge, out);
+            } else if (kind_ == SLIVERS) {
+                Vec3 c{signed_unit(rng), signed_unit(rng), signed_unit(rng)};
+                Vec3 dir = unit_vector(rng), side, up;
+                orthonormal_basis(dir, side, up);
+                float half = 0.5f * (0.05f + 0.25f * rng.uniform());
+                store(out, c - dir * half, c + dir * half, c + side * 0.001f);
+            } else if (kind_ == SPHERES) {
+                const uint64_t per = spheres_[0].tris();
+                spheres_[t / per].emit(t % per, out);
+            } else { // stadium
+                if (t < standsTris_) spheres_[0].emit(t, out);
+                else spheres_[1].emit(t - standsTris_, out);
+            }
+        }
+    }
+
+private:
+    Vec3 grid_point(uint64_t col, uint64_t row) const {
+        float x = -1.0f + 2.0f * float(col) / float(cols_);
+        float y = -1.0f + 2.0f * float(row) / float(std::max<uint64_t>(rows_, cols_));
+        float z = 0.1f * std::sin(3.0f * x + phase_[0]) * std::cos(4.0f * y + phase_[1]) +
+                  0.03f * std::sin(17.0f * x + 13.0f * y + phase_[2]);
+        return {x, y, z};
+    }
+
+    SynthParams                        p_;
+    synth_detail::Kind                 kind_ = synth_detail::KINDS;
+    float                              edge_ = 0.0f;
+    uint64_t                           cols_ = 1, rows_ = 1, standsTris_ = 0;
+    float                              phase_[3] = {0.0f, 0.0f, 0.0f};
+    std::vector<synth_detail::Cluster> clusters_;
+    std::vector<synth_detail::Sphere>  spheres_;
+};
+
+static inline bool generate_scene(const SynthParams& p, Triangles& out) {
+    TIMELINE_ZONE("synth");
+    SynthGenerator gen;
+    if (!gen.init(p)) return false;
+    out.v.resize(size_t(p.tris) * 9);
+    parallel_for_chunks(0, gen.chunks(), 1, [&](size_t b, size_t e, unsigned) {
+        for (size_t c = b; c < e; ++c) gen.generate_chunk(c, out.v.data() + gen.chunk_begin(c) * 9);
+    });
+    return true;
+}
+
+// Streams the scene to a raw f32 dump (scene.hpp layout) in batches, so
+// counts far beyond RAM can be written.
+static inline bool write_synth_scene(const SynthParams& p, const char* path) {
+    TIMELINE_ZONE("synth write");
+    SynthGenerator gen;
+    if (!gen.init(p)) return false;
+    std::ofstream f(path, std::ios::binary);
+    if (!f) {
+        std::cerr << "Failed to write " << path << "\n";
+        return false;
+    }
+    const uint64_t batch = std::max<uint64_t>(worker_count(), 1) * 64; // chunks per write
+    std::vector<float> buf;
+    for (uint64_t c0 = 0; c0 < gen.chunks(); c0 += batch) {
+        uint64_t c1 = std::min(gen.chunks(), c0 + batch), t0 = gen.chunk_begin(c0);
+        buf.resize(size_t(gen.chunk_end(c1 - 1) - t0) * 9);
+        parallel_for_chunks(c0, c1, 1, [&](size_t b, size_t e, unsigned) {
+            for (size_t c = b; c < e; ++c) gen.generate_chunk(c, buf.data() + (gen.chunk_begin(c) - t0) * 9);
+        });
+        f.write(reinterpret_cast<const char*>(buf.data()), std::streamsize(buf.size() * sizeof(float)));
+        if (!f) {
+            std::cerr << "Failed to write " << path << "\n";
+            return false;
+        }
+    }
+    return true;
+}
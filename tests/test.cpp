@@ -4,162 +4,32 @@
 #include <fstream>
 #include <iostream>
 #include <chrono>
-#include <queue>
-
-static constexpr uint32_t NODE2_STRIDE_U32 = 6;
-static constexpr uint32_t NODE4_STRIDE_U32 = 8;
-static constexpr uint32_t LEAF_FLAG = 0x80000000u;
-static constexpr uint32_t INVALID   = 0xFFFFFFFFu;
-
-/* ================= File IO ================= */
-
-static bool load_u32_file(const char* path, std::vector<uint32_t>& out) {
-    std::ifstream f(path, std::ios::binary | std::ios::ate);
-    if (!f) return false;
-    std::streamsize size = f.tellg();
-    if (size <= 0 || (size & 3)) return false;
-    f.seekg(0, std::ios::beg);
-    out.resize(size_t(size >> 2));
-    return bool(f.read(reinterpret_cast<char*>(out.data()), size));
-}
-
-static bool save_u32_file(const char* path, const std::vector<uint32_t>& data) {
-    std::ofstream f(path, std::ios::binary);
-    if (!f) return false;
-    f.write(reinterpret_cast<const char*>(data.data()),
-            std::streamsize(data.size() << 2));
-    return bool(f);
-}
-
-/* ================= BVH helpers ================= */
-
-static inline size_t node2_off(uint32_t n) {
-    return size_t(1u + n * NODE2_STRIDE_U32);
-}
-
-static inline size_t node4_off(uint32_t n) {
-    return size_t(1u + n * NODE4_STRIDE_U32);
-}
-
-static inline bool is_leaf2(const std::vector<uint32_t>& bvh2,
-                            uint32_t n,
-                            uint32_t numNodes2) {
-    if (n >= numNodes2) return true;
-    return (bvh2[node2_off(n) + 5] & LEAF_FLAG) != 0;
-}
 
-static void print_bvh4_first_depth3(
-    const std::vector<uint32_t>& bvh4,
-    uint32_t numNodes4
-) {
-    struct Item {
-        uint32_t node;
-        uint32_t depth;
-    };
+#include "args.hpp"
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "lbvh.hpp"
+#include "lod.hpp"
+#include "memtrack.hpp"
+#include "quality.hpp"
+#include "scene.hpp"
 
-    std::queue<Item> q;
-    q.push({0, 0}); // root
+/* ================= BVH2 → BVH4 ================= */
 
-    std::cout << "\n=== BVH4 first depth-3 nodes ===\n";
-
-    while (!q.empty()) {
-        Item it = q.front();
-        q.pop();
-
-        if (it.node >= numNodes4) continue;
-
-        size_t off = node4_off(it.node);
-        uint32_t meta = bvh4[off + 7];
-
-        std::cout
-            << "Node " << it.node
-            << " | depth " << it.depth
-            << " | " << ((meta & LEAF_FLAG) ? "LEAF" : "INTERNAL")
-            << " | kids: ";
-
-        // print children
-        for (int i = 0; i < 4; i++) {
-            uint32_t c = bvh4[off + 3 + i];
-            if (c != INVALID) std::cout << c << " ";
-        }
-        std::cout << "\n";
-
-        // stop expanding beyond depth 3
-        if (it.depth == 3) continue;
-
-        // expand only internal nodes
-        if (!(meta & LEAF_FLAG)) {
-            for (int i = 0; i < 4; i++) {
-                uint32_t c = bvh4[off + 3 + i];
-                if (c != INVALID) {
-                    q.push({c, it.depth + 1});
-                }
-            }
-        }
-    }
-
-    std::cout << "================================\n\n";
-}
-
-/* ================= BVH2 → BVH4 promotion ================= */
-
-static inline void promote_children_4(
-    const std::vector<uint32_t>& bvh2,
-    uint32_t numNodes2,
-    uint32_t left,
-    uint32_t right,
-    uint32_t out[4]
-) {
-    uint32_t k = 0;
-
-    auto push = [&](uint32_t c) {
-        if (k < 4) out[k++] = c;
-    };
-
-    auto promote = [&](uint32_t c) {
-        if (c == INVALID) return;
-
-        if (is_leaf2(bvh2, c, numNodes2)) {
-            push(c);
-        } else {
-            size_t off = node2_off(c);
-            push(bvh2[off + 3]); // left child
-            push(bvh2[off + 4]); // right child
-        }
-    };
-
-    promote(left);
-    promote(right);
-
-    while (k < 4) out[k++] = INVALID;
-}
-
-/* ================= Main ================= */
-
-int main(int argc, char** argv) {
-    const char* inPath  = "data/BVH2.bin";
-    const char* outPath = "data/BVH4_wide.bin";
-
-    if (argc > 1) inPath  = argv[1];
-    if (argc > 2) outPath = argv[2];
-
-    std::vector<uint32_t> bvh2;
-    if (!load_u32_file(inPath, bvh2)) {
-        std::cerr << "Failed to read BVH2\n";
-        return 1;
-    }
+struct ConvertCounts {
+    uint64_t leaves = 0;
+    uint64_t internals = 0;
+};
 
+static std::vector<uint32_t> convert_bvh2_to_bvh4(const std::vector<uint32_t>& bvh2, ConvertCounts& counts) {
+    TIMELINE_ZONE("convert");
     uint32_t numNodes2 = bvh2[0];
 
     std::vector<uint32_t> bvh4;
     bvh4.resize(size_t(1) + size_t(numNodes2) * NODE4_STRIDE_U32);
     bvh4[0] = numNodes2;
 
-    uint64_t leafCount = 0;
-    uint64_t internalCount = 0;
-
-    auto t0 = std::chrono::high_resolution_clock::now();
-
+    MemHotLoop hot("convert");
     for (uint32_t n = 0; n < numNodes2; ++n) {
         size_t o2 = node2_off(n);
         size_t o4 = node4_off(n);
@@ -172,14 +42,14 @@ int main(int argc, char** argv) {
         uint32_t meta = bvh2[o2 + 5];
 
         if (meta & LEAF_FLAG) {
-            leafCount++;
+            counts.leaves++;
             bvh4[o4 + 3] = INVALID;
             bvh4[o4 + 4] = INVALID;
             bvh4[o4 + 5] = INVALID;
             bvh4[o4 + 6] = INVALID;
             bvh4[o4 + 7] = meta;
         } else {
-            internalCount++;
+            counts.internals++;
 
             uint32_t left  = bvh2[o2 + 3];
             uint32_t right = bvh2[o2 + 4];
@@ -194,15 +64,193 @@ int main(int argc, char** argv) {
             bvh4[o4 + 7] = 0;
         }
     }
+    return bvh4;
+}
+
+/* ================= Benchmark ================= */
+
+// --warmup untimed passes, then --bench timed repetitions of the whole
+// load -> convert -> save pipeline, each phase timed on its own. Loads after
+// the first are served from the page cache, so "load" is parse + copy cost,
+// not disk speed.
+//
+// One more untimed pass runs under memtrack.hpp phases for the allocation
+// and high-water table; the run fails if the convert loop allocated.
+static int run_benchmark(const std::string& inPath, const std::string& outPath, uint32_t warmup, uint32_t reps,
+                         const std::string& jsonPath) {
+    BenchPhase load, convert, save, total;
+    load.name = "load";
+    convert.name = "convert";
+    save.name = "save";
+    total.name = "total";
+
+    for (uint32_t i = 0; i < warmup + reps; ++i) {
+        TimelineZone rep(i < warmup ? "warmup" : "rep", i);
+        std::vector<uint32_t> bvh2;
+        BenchTimer t0;
+        if (!load_u32_file(inPath.c_str(), bvh2) || bvh2.empty()) {
+            std::cerr << "Failed to read BVH2\n";
+            return 1;
+        }
+        double msLoad = t0.ms();
+
+        ConvertCounts counts;
+        BenchTimer t1;
+        std::vector<uint32_t> bvh4 = convert_bvh2_to_bvh4(bvh2, counts);
+        double msConvert = t1.ms();
+
+        BenchTimer t2;
+        if (!save_u32_file(outPath.c_str(), bvh4)) {
+            std::cerr << "Failed to write " << outPath << "\n";
+            return 1;
+        }
+        double msSave = t2.ms();
+
+        if (i < warmup) continue;
+        uint64_t nodes = bvh2[0], in = bvh2.size() * 4, out = bvh4.size() * 4;
+        load.items = convert.items = save.items = total.items = nodes;
+        load.bytes = in;
+        convert.bytes = in + out;
+        save.bytes = out;
+        total.bytes = in + (in + out) + out;
+        load.ms.push_back(msLoad);
+        convert.ms.push_back(msConvert);
+        save.ms.push_back(msSave);
+        total.ms.push_back(msLoad + msConvert + msSave);
+    }
+
+    std::vector<MemPhaseStats> mem;
+    {
+        std::vector<uint32_t> bvh2, bvh4;
+        ConvertCounts counts;
+        bool ok = true;
+        {
+            MemPhase phase("load");
+            ok = load_u32_file(inPath.c_str(), bvh2);
+            mem.push_back(phase.finish());
+        }
+        {
+            MemPhase phase("convert");
+            if (ok) bvh4 = convert_bvh2_to_bvh4(bvh2, counts);
+            mem.push_back(phase.finish());
+        }
+        {
+            MemPhase phase("save");
+            if (ok) save_u32_file(outPath.c_str(), bvh4);
+            mem.push_back(phase.finish());
+        }
+    }
 
+    // With --json - the JSON owns stdout and the table moves to stderr.
+    std::ostream& log = jsonPath == "-" ? std::cerr : std::cout;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%u warm-up + %u timed reps, %llu nodes\n\n", warmup, reps,
+                  (unsigned long long)total.items);
+    log << line;
+    std::snprintf(line, sizeof(line), "%-8s %9s %9s %9s %9s %9s %11s %8s\n", "phase", "min ms", "median", "mean",
+                  "stddev", "p99", "Mnodes/s", "GB/s");
+    log << line;
+    for (const BenchPhase* p : {&load, &convert, &save, &total}) {
+        BenchSummary s = summarize(p->ms);
+        std::snprintf(line, sizeof(line), "%-8s %9.3f %9.3f %9.3f %9.3f %9.3f %11.2f %8.2f\n", p->name.c_str(), s.min,
+                      s.median, s.mean, s.stddev, s.p99, p->items_per_s(s) * 1e-6, p->gb_per_s(s));
+        log << line;
+    }
+    log << "\n";
+    log.flush();
+    print_mem_phases(jsonPath == "-" ? stderr : stdout, mem);
+    const int status = report_hot_loop_violations(stderr) ? 1 : 0;
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/test");
+    w.value("input", inPath);
+    w.value("output", outPath);
+    w.value("warmup", warmup);
+    w.value("reps", reps);
+    w.begin_object("phases");
+    for (const BenchPhase* p : {&load, &convert, &save, &total}) write_bench_phase(w, *p, "nodes");
+    w.end_object();
+    w.begin_array("memory");
+    for (const MemPhaseStats& p : mem) write_mem_phase_json(w, p);
+    w.end_array();
+    w.value("hot_loop_allocs", mem_hot_loop_violations());
+    w.end_object();
+    return status;
+}
+
+/* ================= Main ================= */
+
+// bin/test [in.bin] [out.bin] [--scene dragon.glb --lod out_lod.bin]
+//          [--bench N [--warmup 3] [--json out.json|-]] [--trace trace.json]
+//
+// --trace (or RT_TRACE=trace.json) writes a Chrome trace of every zone in
+// timeline.hpp; open it in ui.perfetto.dev.
+//
+// --lod also writes the per-node aggregates from lod.hpp; they need the
+// triangles, so --scene must name the mesh the BVH2 was built from.
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    const auto& pos = args.positional();
+    std::string inPath  = pos.size() > 0 ? pos[0] : "data/BVH2.bin";
+    std::string outPath = pos.size() > 1 ? pos[1] : "data/BVH4_wide.bin";
+    std::string scenePath = args.str("scene", "");
+    std::string lodPath = args.str("lod", "");
+    std::string tracePath = args.str("trace", "");
+    if (!tracePath.empty()) timeline_open(tracePath);
+
+    if (args.has("bench")) {
+        return run_benchmark(inPath, outPath, args.u32("warmup", 3), std::max(args.u32("bench", 10), 1u),
+                             args.str("json", ""));
+    }
+
+    std::vector<uint32_t> bvh2;
+    if (!load_u32_file(inPath.c_str(), bvh2)) {
+        std::cerr << "Failed to read BVH2\n";
+        return 1;
+    }
+
+    ConvertCounts counts;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> bvh4 = convert_bvh2_to_bvh4(bvh2, counts);
     auto t1 = std::chrono::high_resolution_clock::now();
     double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
 
     std::cout << "BVH2 → BVH4 (O(N)) time: " << ms << " ms\n";
-    std::cout << "leaves: " << leafCount << " internals: " << internalCount << "\n";
+    std::cout << "leaves: " << counts.leaves << " internals: " << counts.internals << "\n";
+
+    // Tree metrics without EPO, which needs the mesh and takes seconds;
+    // bin/quality --scene computes it.
+    BvhQualityParams quality;
+    quality.epo = false;
+    std::cout << "\n";
+    print_bvh_quality(stdout, outPath.c_str(), analyze_bvh(decode_bvh4(bvh4), 4, nullptr, quality));
+    std::cout << "\n";
+
+    save_u32_file(outPath.c_str(), bvh4);
+
+    if (!lodPath.empty()) {
+        Triangles tris;
+        if (scenePath.empty() || !load_scene(scenePath.c_str(), tris)) {
+            std::cerr << "--lod needs --scene with the mesh the BVH was built from\n";
+            return 1;
+        }
 
-    print_bvh4_first_depth3(bvh4, numNodes2);
+        auto l0 = std::chrono::high_resolution_clock::now();
+        std::vector<NodeLod> lod = build_lod(decode_bvh4(bvh4), tris);
+        auto l1 = std::chrono::high_resolution_clock::now();
 
-    save_u32_file(outPath, bvh4);
+        std::cout << "LOD aggregates time: "
+                  << std::chrono::duration<double, std::milli>(l1 - l0).count() << " ms\n";
+        if (!save_u32_file(lodPath.c_str(), encode_lod(lod))) {
+            std::cerr << "Failed to write " << lodPath << "\n";
+            return 1;
+        }
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#pragma once
+
+// timeline.hpp
+// Scoped-zone tracing for the C++ tools, written as Chrome trace-event JSON
+// (open in https://ui.perfetto.dev or chrome://tracing).
+//
+//   RT_TRACE=build.json bin/test ...      or   timeline_open("build.json")
+//
+//   void build() {
+//       TIMELINE_ZONE("build");            // one slice per call
+//       TimelineZone z("chunk", count);    // slice with an "n" argument
+//   }
+//
+// Each thread appends complete ("X") events to its own ring buffer; nothing
+// is shared on the hot path. When the ring wraps, the oldest events are
+// overwritten and counted as dropped. parallel.hpp starts fresh threads for
+// every fork/join, so a buffer is handed back when its thread exits and
+// reused by the next one: a worker lane in the viewer is a slot, not an OS
+// thread. The JSON is written by timeline_flush(), registered with atexit
+// when tracing is turned on.
+//
+// Disabled, a zone costs one relaxed atomic load. Zone names must outlive
+// the flush (string literals).
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TimelineEvent {
+    const char* name;
+    uint64_t    startNs;
+    uint64_t    durNs;
+    uint64_t    arg;
+    bool        hasArg;
+};
+
+struct TimelineBuffer {
+    static constexpr size_t CAPACITY = 1u << 15; // power of two
+
+    uint32_t                   lane = 0;
+    bool                       main = false;
+    std::vector<TimelineEvent> ring;
+    uint64_t                   head = 0; // events ever pushed
+
+    void push(const TimelineEvent& e) { ring[head++ & (CAPACITY - 1)] = e; }
+};
+
+class Timeline {
+public:
+    // Never destroyed: the atexit flush may run after static destructors.
+    static Timeline& get() {
+        static Timeline* t = new Timeline;
+        return *t;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    bool open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (enabled()) return true;
+        path_ = path;
+        mainThread_ = std::this_thread::get_id();
+        epoch_ = std::chrono::steady_clock::now();
+        enabled_.store(true, std::memory_order_release);
+        std::atexit([] { Timeline::get().flush(); });
+        return true;
+    }
+
+    uint64_t now_ns() const {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_)
+                            .count());
+    }
+
+    TimelineBuffer* acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TimelineBuffer* b;
+        if (!free_.empty()) {
+            b = free_.back();
+            free_.pop_back();
+        } else {
+            all_.push_back(std::make_unique<TimelineBuffer>());
+            b = all_.back().get();
+            b->lane = uint32_t(all_.size());
+            b->ring.resize(TimelineBuffer::CAPACITY);
+        }
+        if (std::this_thread::get_id() == mainThread_) b->main = true;
+        return b;
+    }
+
+    void release(TimelineBuffer* b) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(b);
+    }
+
+    // Writes every buffered event; call once the worker threads are joined.
+    bool flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled() || flushed_) return false;
+        flushed_ = true;
+
+        FILE* f = std::fopen(path_.c_str(), "wb");
+        if (!f) {
+            std::fprintf(stderr, "timeline: cannot write %s\n", path_.c_str());
+            return false;
+        }
+
+        std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rt tools\"}}");
+        uint64_t written = 0, dropped = 0;
+        for (const auto& b : all_) {
+            std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                         b->lane, b->main ? "main" : "worker", b->lane);
+            std::fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                         b->lane, b->lane);
+
+            uint64_t first = b->head > TimelineBuffer::CAPACITY ? b->head - TimelineBuffer::CAPACITY : 0;
+            dropped += first;
+            for (uint64_t i = first; i < b->head; ++i) {
+                const TimelineEvent& e = b->ring[i & (TimelineBuffer::CAPACITY - 1)];
+                std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", e.name,
+                             b->lane, e.startNs * 1e-3, e.durNs * 1e-3);
+                if (e.hasArg) std::fprintf(f, ",\"args\":{\"n\":%llu}", (unsigned long long)e.arg);
+                std::fprintf(f, "}");
+                ++written;
+            }
+        }
+        std::fprintf(f, "\n]}\n");
+        std::fclose(f);
+        std::fprintf(stderr, "timeline: %llu events (%llu dropped) from %zu lanes -> %s\n",
+                     (unsigned long long)written, (unsigned long long)dropped, all_.size(), path_.c_str());
+        return true;
+    }
+
+private:
+    Timeline() {
+        if (const char* env = std::getenv("RT_TRACE")) {
+            if (*env) open(env);
+        }
+    }
+
+    std::atomic<bool>                            enabled_{false};
+    bool                                         flushed_ = false;
+    std::string                                  path_;
+    std::thread::id                              mainThread_;
+    std::chrono::steady_clock::time_point        epoch_;
+    std::mutex                                   mutex_;
+    std::vector<std::unique_ptr<TimelineBuffer>> all_;
+    std::vector<TimelineBuffer*>                 free_;
+};
+
+namespace timeline_detail {
+
+// Per-thread buffer, returned to the pool when the thread exits.
+struct Slot {
+    TimelineBuffer* buffer = nullptr;
+    ~Slot() {
+        if (buffer) Timeline::get().release(buffer);
+    }
+};
+
+static inline TimelineBuffer& thread_buffer() {
+    thread_local Slot slot;
+    if (!slot.buffer) slot.buffer = Timeline::get().acquire();
+    return *slot.buffer;
+}
+
+} // namespace timeline_detail
+
+static inline bool timeline_open(const std::string& path) { return Timeline::get().open(path); }
+static inline bool timeline_flush() { return Timeline::get().flush(); }
+
+class TimelineZone {
+public:
+    explicit TimelineZone(const char* name) : name_(name), arg_(0), hasArg_(false) { begin(); }
+    TimelineZone(const char* name, uint64_t arg) : name_(name), arg_(arg), hasArg_(true) { begin(); }
+
+    ~TimelineZone() {
+        if (!active_) return;
+        Timeline& t = Timeline::get();
+        uint64_t end = t.now_ns();
+        timeline_detail::thread_buffer().push({name_, start_, end - start_, arg_, hasArg_});
+    }
+
+    TimelineZone(const TimelineZone&) = delete;
+    TimelineZone& operator=(const TimelineZone&) = delete;
+
+private:
+    const char* name_;
+    uint64_t    arg_;
+    bool        hasArg_;
+    bool        active_ = false;
+    uint64_t    start_ = 0;
+
+    void begin() {
+        Timeline& t = Timeline::get();
+        if (!t.enabled()) return;
+        active_ = true;
+        start_ = t.now_ns();
+    }
+};
+
+#define TIMELINE_CAT2(a, b) a##b
+#define TIMELINE_CAT(a, b) TIMELINE_CAT2(a, b)
+#define TIMELINE_ZONE(name) TimelineZone TIMELINE_CAT(timelineZone_, __LINE__)(name)
@@ -0,0 +1,335 @@
+#pragma once
+
+// trace.hpp
+// Headless CPU mirror of the renderer.wgsl camera and BVH4 traversal.
+// Single-ray, but with the shader's control flow: node box re-tested on pop,
+// nearest child swapped into slot 0, far -> near pushes, and pushes silently
+// dropped once the STACK_MAX-entry stack is full.
+//
+// trace_closest_counted / trace_occluded_counted also count the ray's work
+// into a caller-owned RayCounts (counters.hpp) that the caller flushes once
+// per chunk; the plain walks count nothing.
+
+#include <cmath>
+#include <cstdint>
+
+#include "bvh.hpp"
+#include "counters.hpp"
+#include "scene.hpp"
+
+static constexpr float INF = 1e30f;
+
+struct Ray {
+    Vec3  origin;
+    Vec3  dir;
+    float tmin = 0.0f;
+    float tmax = INF;
+};
+
+struct Hit {
+    float    t = INF;
+    uint32_t tri = INVALID;
+
+    bool hit() const { return tri != INVALID; }
+};
+
+// Set on a triangle index in TraceStats::accesses; node indices are stored bare.
+static constexpr uint32_t TRACE_TRI_BIT = 0x80000000u;
+
+// Per-ray work counters; zero-cost to ignore when unused.
+struct TraceStats {
+    uint64_t nodes = 0;          // nodes popped
+    uint64_t boxTests = 0;
+    uint64_t triTests = 0;
+    uint64_t stackDrops = 0;     // pushes lost at STACK_MAX
+    uint32_t maxStack = 0;
+
+    // When set, every buffer read the shader would make, in order: the popped
+    // node, each child node whose box is tested, and the triangle at a leaf
+    // (index | TRACE_TRI_BIT). add() does not merge these.
+    std::vector<uint32_t>* accesses = nullptr;
+
+    void add(const TraceStats& o) {
+        nodes += o.nodes;
+        boxTests += o.boxTests;
+        triTests += o.triTests;
+        stackDrops += o.stackDrops;
+        maxStack = maxStack > o.maxStack ? maxStack : o.maxStack;
+    }
+};
+
+/* ================= Camera ================= */
+
+// Matches RendererUBO as filled by PathTracer.render(): 70 deg vertical fov,
+// camera looking down -Z, rotated by the FPSCamera quaternion.
+struct Camera {
+    Vec3  pos{0.0f, 0.0f, 2.5f};
+    float quat[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    float fovDeg = 70.0f;
+};
+
+static inline Vec3 rotate_by_quat(Vec3 v, const float q[4]) {
+    Vec3 u{q[0], q[1], q[2]};
+    float s = q[3];
+    Vec3 uv = cross(u, v);
+    Vec3 uuv = cross(u, uv);
+    return v + 2.0f * (s * uv + uuv);
+}
+
+static inline Vec3 safe_inv_dir(Vec3 d) {
+    return {
+        std::fabs(d.x) > 1e-8f ? 1.0f / d.x : INF,
+        std::fabs(d.y) > 1e-8f ? 1.0f / d.y : INF,
+        std::fabs(d.z) > 1e-8f ? 1.0f / d.z : INF,
+    };
+}
+
+static inline Ray primary_ray(const Camera& cam, float px, float py,
+                              uint32_t width, uint32_t height) {
+    float focal = 1.0f / std::tan(0.5f * cam.fovDeg * 3.14159265358979f / 180.0f);
+    float aspect = float(width) / float(height);
+
+    float u = (px + 0.5f) / float(width);
+    float v = (py + 0.5f) / float(height);
+    float x = u * 2.0f - 1.0f;
+    float y = v * 2.0f - 1.0f;
+
+    Ray r;
+    r.origin = cam.pos;
+    r.dir = rotate_by_quat(normalize(Vec3{x * aspect, y, -focal}), cam.quat);
+    return r;
+}
+
+// Inverse of primary_ray: world point -> continuous pixel coordinates.
+// Returns false for points behind the camera.
+static inline bool project_to_pixel(const Camera& cam, Vec3 p,
+                                    uint32_t width, uint32_t height,
+                                    float& px, float& py) {
+    float conj[4] = {-cam.quat[0], -cam.quat[1], -cam.quat[2], cam.quat[3]};
+    Vec3 d = rotate_by_quat(p - cam.pos, conj);
+    if (d.z >= -1e-6f) return false;
+
+    float focal = 1.0f / std::tan(0.5f * cam.fovDeg * 3.14159265358979f / 180.0f);
+    float aspect = float(width) / float(height);
+
+    float x = d.x * focal / (-d.z * aspect);
+    float y = d.y * focal / (-d.z);
+    px = (x + 1.0f) * 0.5f * float(width) - 0.5f;
+    py = (y + 1.0f) * 0.5f * float(height) - 0.5f;
+    return true;
+}
+
+/* ================= Intersection ================= */
+
+// Slab test; returns entry distance or INF on miss.
+static inline float intersect_aabb(const Ray& r, Vec3 invDir, const Aabb& b, float bestT) {
+    float t1x = (b.mn.x - r.origin.x) * invDir.x, t2x = (b.mx.x - r.origin.x) * invDir.x;
+    float t1y = (b.mn.y - r.origin.y) * invDir.y, t2y = (b.mx.y - r.origin.y) * invDir.y;
+    float t1z = (b.mn.z - r.origin.z) * invDir.z, t2z = (b.mx.z - r.origin.z) * invDir.z;
+
+    float tmin = std::max(std::max(std::min(t1x, t2x), std::min(t1y, t2y)), std::min(t1z, t2z));
+    float tmax = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)), std::max(t1z, t2z));
+
+    bool hit = (tmax >= std::max(tmin, r.tmin)) && (tmin < bestT);
+    return hit ? tmin : INF;
+}
+
+// Moller-Trumbore with the shader's epsilons.
+static inline float intersect_triangle(const Ray& r, Vec3 v0, Vec3 v1, Vec3 v2) {
+    const float eps = 1e-7f;
+    Vec3 e1 = v1 - v0;
+    Vec3 e2 = v2 - v0;
+    Vec3 p = cross(r.dir, e2);
+    float det = dot(e1, p);
+    if (std::fabs(det) < eps) return INF;
+
+    float invDet = 1.0f / det;
+    Vec3 s = r.origin - v0;
+    float u = invDet * dot(s, p);
+    if (u < 0.0f || u > 1.0f) return INF;
+
+    Vec3 q = cross(s, e1);
+    float v = invDet * dot(r.dir, q);
+    if (v < 0.0f || u + v > 1.0f) return INF;
+
+    float t = invDet * dot(e2, q);
+    return (t > eps && t > r.tmin) ? t : INF;
+}
+
+/* ================= BVH4 traversal ================= */
+
+// anyHit=true turns the closest-hit walk into an occlusion query that stops
+// at the first triangle hit inside [tmin, tmax). Counted adds the ray's work
+// to `counts` (counters.hpp); without it the per-node increments compile out.
+template <bool CountStats, bool Counted>
+static Hit traverse_bvh4_impl(const Bvh4& bvh, const Triangles& tris, const Ray& ray,
+                              bool anyHit, TraceStats* stats, RayCounts* counts) {
+    Hit out;
+    out.t = ray.tmax;
+
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    const uint32_t numTris = tris.count();
+    if (numNodes == 0 || numTris == 0) { out.t = INF; return out; }
+
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+
+    uint32_t stack[STACK_MAX];
+    int sp = 0;
+    stack[0] = 0;
+
+    // Nodes popped in the high half, box tests in the low half: one register
+    // add per node instead of two in the hot loop.
+    uint64_t nodeBox = 0;
+    uint32_t triTests = 0, stackDrops = 0;
+    auto finish = [&]() -> Hit {
+        const uint32_t nodes = uint32_t(nodeBox >> 32), boxTests = uint32_t(nodeBox);
+        if (CountStats) {
+            stats->nodes += nodes;
+            stats->boxTests += boxTests;
+            stats->triTests += triTests;
+            stats->stackDrops += stackDrops;
+        }
+        if (Counted) {
+            counts->rays++;
+            counts->nodes += nodes;
+            counts->boxTests += boxTests;
+            counts->triTests += triTests;
+            counts->stackDrops += stackDrops;
+        }
+        return out;
+    };
+
+    while (sp >= 0) {
+        uint32_t nodeIndex = stack[sp--];
+        const Bvh4Node& node = bvh.nodes[nodeIndex];
+        if (CountStats && stats->accesses) stats->accesses->push_back(nodeIndex);
+
+        if (node.box.empty()) { nodeBox += uint64_t(1) << 32; continue; }
+
+        nodeBox += (uint64_t(1) << 32) | 1;
+        if (intersect_aabb(ray, invDir, node.box, out.t) >= INF) continue;
+
+        if (node.leaf()) {
+            uint32_t ti = node.tri();
+            if (ti < numTris) {
+                triTests++;
+                if (CountStats && stats->accesses) stats->accesses->push_back(ti | TRACE_TRI_BIT);
+                float t = intersect_triangle(ray, tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+                if (t < out.t) {
+                    out.t = t;
+                    out.tri = ti;
+                    if (anyHit) return finish();
+                }
+            }
+            continue;
+        }
+
+        uint32_t childIdx[4];
+        float childDist[4];
+        uint32_t childCount = 0;
+
+        for (int c = 0; c < 4; ++c) {
+            uint32_t ci = node.child[c];
+            if (ci == INVALID || ci >= numNodes) continue;
+            if (CountStats && stats->accesses) stats->accesses->push_back(ci);
+            const Aabb& cb = bvh.nodes[ci].box;
+            if (cb.empty()) continue;
+
+            nodeBox++;
+            float d = intersect_aabb(ray, invDir, cb, out.t);
+            if (d < INF) {
+                childIdx[childCount] = ci;
+                childDist[childCount] = d;
+                childCount++;
+            }
+        }
+
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < childCount; ++i) {
+            if (childDist[i] < childDist[best]) best = i;
+        }
+        if (best != 0) std::swap(childIdx[0], childIdx[best]);
+
+        for (int i = int(childCount) - 1; i >= 0; --i) {
+            if (sp + 1 < int(STACK_MAX)) {
+                stack[++sp] = childIdx[i];
+            } else {
+                stackDrops++;
+            }
+        }
+        if (CountStats && uint32_t(sp + 1) > stats->maxStack) stats->maxStack = uint32_t(sp + 1);
+    }
+
+    if (!out.hit()) out.t = INF;
+    return finish();
+}
+
+static inline Hit trace_closest(const Bvh4& bvh, const Triangles& tris, const Ray& ray,
+                                TraceStats* stats = nullptr) {
+    return stats ? traverse_bvh4_impl<true, false>(bvh, tris, ray, false, stats, nullptr)
+                 : traverse_bvh4_impl<false, false>(bvh, tris, ray, false, nullptr, nullptr);
+}
+
+static inline bool trace_occluded(const Bvh4& bvh, const Triangles& tris, const Ray& ray,
+                                  TraceStats* stats = nullptr) {
+    Hit h = stats ? traverse_bvh4_impl<true, false>(bvh, tris, ray, true, stats, nullptr)
+                  : traverse_bvh4_impl<false, false>(bvh, tris, ray, true, nullptr, nullptr);
+    return h.hit();
+}
+
+// The same walks, also adding their work to `counts` for the production
+// counters; flush it with counters_add_rays() once per chunk of rays.
+static inline Hit trace_closest_counted(const Bvh4& bvh, const Triangles& tris, const Ray& ray, RayCounts& counts,
+                                        TraceStats* stats = nullptr) {
+    return stats ? traverse_bvh4_impl<true, bool(RT_COUNTERS)>(bvh, tris, ray, false, stats, &counts)
+                 : traverse_bvh4_impl<false, bool(RT_COUNTERS)>(bvh, tris, ray, false, nullptr, &counts);
+}
+
+static inline bool trace_occluded_counted(const Bvh4& bvh, const Triangles& tris, const Ray& ray,
+                                          RayCounts& counts, TraceStats* stats = nullptr) {
+    Hit h = stats ? traverse_bvh4_impl<true, bool(RT_COUNTERS)>(bvh, tris, ray, true, stats, &counts)
+                  : traverse_bvh4_impl<false, bool(RT_COUNTERS)>(bvh, tris, ray, true, nullptr, &counts);
+    return h.hit();
+}
+
+/* ================= Sampling ================= */
+
+// PCG32 (O'Neill); one stream per pixel/sample keeps renders reproducible
+// regardless of thread count.
+struct Rng {
+    uint64_t state;
+    uint64_t inc;
+
+    Rng(uint64_t seed, uint64_t stream) : state(0), inc((stream << 1u) | 1u) {
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+    }
+
+    float uniform() { return float(next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+static inline void orthonormal_basis(Vec3 n, Vec3& t, Vec3& b) {
+    // Duff et al. 2017
+    float sign = std::copysign(1.0f, n.z);
+    float a = -1.0f / (sign + n.z);
+    float c = n.x * n.y * a;
+    t = {1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x};
+    b = {c, sign + n.y * n.y * a, -n.y};
+}
+
+static inline Vec3 sample_cosine_hemisphere(Vec3 n, float u1, float u2) {
+    float r = std::sqrt(u1);
+    float phi = 6.28318530718f * u2;
+    Vec3 t, b;
+    orthonormal_basis(n, t, b);
+    return normalize(t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - u1)));
+}
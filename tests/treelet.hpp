@@ -0,0 +1,363 @@
+#pragma once
+
+// treelet.hpp
+// Treelet ray scheduling for trees far larger than the last-level cache
+// (Aila & Karras 2010 treelets, Navratil et al. 2007 ray queues). The BVH4
+// is cut into treelets of at most `budget` bytes of nodes and triangles, and
+// a ray only runs while the top of its stack lies in the treelet being
+// processed; when it would pop a node of another treelet it is parked in
+// that treelet's queue. Workers repeatedly take the longest idle queue and
+// run all of its rays through that one treelet, so the treelet is fetched
+// once per queue instead of once per ray.
+//
+// Treelets grow top-down, adding the frontier node with the largest box
+// surface area (the one most rays will enter) until the budget is full;
+// what is left on the frontier becomes pending subtree roots. A treelet
+// whose subtrees run out before its budget does takes the next pending
+// root too, so small subtrees share treelets instead of each making a
+// tiny one. Pending roots are taken in depth-first order, so the subtrees
+// packed together are neighbours in the tree (and in space). After
+// relayout_treelets() every treelet is one contiguous range of the node
+// buffer, with its leaves' triangles contiguous too.
+//
+// Per ray, the kernel is trace.hpp's walk step for step (same pops, pushes,
+// drops and reads), so the answers match trace_closest / trace_occluded
+// exactly; only the interleaving of rays changes. Each in-flight ray keeps
+// its own STACK_MAX-entry stack (256 bytes).
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+
+struct TreeletPartition {
+    std::vector<uint32_t> treelet; // node -> treelet, INVALID when unreachable
+    std::vector<uint32_t> order;   // nodes treelet by treelet, each as it grew
+    std::vector<uint32_t> begin;   // treelet t is order[begin[t] .. begin[t + 1])
+    std::vector<uint64_t> bytes;   // per treelet, nodes + leaf triangles
+
+    uint32_t count() const { return uint32_t(bytes.size()); }
+    uint32_t root(uint32_t t) const { return order[begin[t]]; }
+};
+
+static inline float box_area(const Aabb& b) {
+    if (b.empty()) return 0.0f;
+    Vec3 d = b.mx - b.mn;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// `nodeBytes` is what one node costs in the budget (the GPU's 32-byte BVH4
+// node by default); a leaf adds its 36-byte triangle.
+static inline TreeletPartition partition_treelets(const Bvh4& bvh, uint64_t budget,
+                                                  uint32_t nodeBytes = NODE4_STRIDE_U32 * 4) {
+    TreeletPartition out;
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    out.treelet.assign(numNodes, INVALID);
+    out.begin.push_back(0);
+    if (!numNodes) return out;
+
+    std::vector<uint32_t> rank(numNodes, 0);
+    {
+        const std::vector<uint32_t> dfs = bvh_reachable_order(bvh, true);
+        for (uint32_t i = 0; i < dfs.size(); ++i) rank[dfs[i]] = i;
+    }
+    using Entry = std::pair<float, uint32_t>; // (area, node) or (-rank, node)
+    std::priority_queue<Entry> frontier, roots;
+    roots.push({0.0f, 0});
+    uint64_t bytes = 0;
+    auto close = [&]() {
+        for (; !frontier.empty(); frontier.pop()) {
+            const uint32_t n = frontier.top().second;
+            roots.push({-float(rank[n]), n});
+        }
+        out.bytes.push_back(bytes);
+        out.begin.push_back(uint32_t(out.order.size()));
+        bytes = 0;
+    };
+    while (!roots.empty() || !frontier.empty()) {
+        if (frontier.empty()) {
+            const uint32_t n = roots.top().second;
+            roots.pop();
+            frontier.push({box_area(bvh.nodes[n].box), n});
+        }
+        while (!frontier.empty()) {
+            const uint32_t n = frontier.top().second;
+            const Bvh4Node& node = bvh.nodes[n];
+            const uint64_t cost = nodeBytes + (node.leaf() ? 36 : 0);
+            if (bytes && bytes + cost > budget) {
+                close();
+                break;
+            }
+            frontier.pop();
+            out.treelet[n] = out.count();
+            out.order.push_back(n);
+            bytes += cost;
+            if (node.leaf()) continue;
+            for (uint32_t c : node.child)
+                if (c != INVALID && c < numNodes && out.treelet[c] == INVALID)
+                    frontier.push({box_area(bvh.nodes[c].box), c});
+        }
+    }
+    if (bytes) close();
+    return out;
+}
+
+// Renumbers nodes into partition order and triangles into the order their
+// leaves appear there (unreferenced triangles last), and rewrites `part`
+// for the new tree.
+static inline void relayout_treelets(const Bvh4& bvh, const Triangles& tris, TreeletPartition& part, Bvh4& outBvh,
+                                     Triangles& outTris) {
+    std::vector<uint32_t> triOrder, triSlot(tris.count(), INVALID);
+    for (uint32_t n : part.order) {
+        const Bvh4Node& node = bvh.nodes[n];
+        if (!node.leaf() || node.tri() >= triSlot.size() || triSlot[node.tri()] != INVALID) continue;
+        triSlot[node.tri()] = uint32_t(triOrder.size());
+        triOrder.push_back(node.tri());
+    }
+    for (uint32_t t = 0; t < triSlot.size(); ++t)
+        if (triSlot[t] == INVALID) {
+            triSlot[t] = uint32_t(triOrder.size());
+            triOrder.push_back(t);
+        }
+
+    outBvh = relayout_bvh(bvh, part.order);
+    for (Bvh4Node& node : outBvh.nodes)
+        if (node.leaf() && node.tri() < triSlot.size()) node.meta = LEAF_FLAG | triSlot[node.tri()];
+    outTris.v.resize(tris.v.size());
+    for (uint32_t i = 0; i < triOrder.size(); ++i)
+        std::copy_n(tris.v.begin() + size_t(triOrder[i]) * 9, 9, outTris.v.begin() + size_t(i) * 9);
+
+    part.treelet.assign(part.order.size(), INVALID);
+    for (uint32_t t = 0; t < part.count(); ++t)
+        for (uint32_t i = part.begin[t]; i < part.begin[t + 1]; ++i) {
+            part.treelet[i] = t;
+            part.order[i] = i;
+        }
+}
+
+/* ================= Scheduler ================= */
+
+struct TreeletRunStats {
+    uint64_t runs = 0;       // queues taken
+    uint64_t entries = 0;    // rays run through a treelet, summed over runs
+    uint32_t maxQueue = 0;
+    TraceStats trace;        // nodes, box / triangle tests, drops
+};
+
+namespace treelet_detail {
+
+struct RayState {
+    Hit      hit;
+    int32_t  sp = 0;
+    uint32_t nodes = 0, boxTests = 0, triTests = 0, stackDrops = 0;
+};
+
+// Runs one ray while the top of its stack is in treelet `t`. Returns the
+// treelet of the node it stopped at, or INVALID when the ray is done.
+// `read(access)` sees TraceStats::accesses' reads in order.
+template <class Read>
+static inline uint32_t advance(const Bvh4& bvh, const Triangles& tris, const TreeletPartition& part,
+                               const Ray& ray, bool anyHit, uint32_t t, RayState& s, uint32_t* stack, Read&& read) {
+    const uint32_t numNodes = uint32_t(bvh.nodes.size());
+    const uint32_t numTris = tris.count();
+    const Vec3 invDir = safe_inv_dir(ray.dir);
+
+    while (s.sp >= 0) {
+        uint32_t nodeIndex = stack[s.sp];
+        if (part.treelet[nodeIndex] != t) return part.treelet[nodeIndex];
+        s.sp--;
+        const Bvh4Node& node = bvh.nodes[nodeIndex];
+        s.nodes++;
+        read(nodeIndex);
+
+        if (node.box.empty()) continue;
+
+        s.boxTests++;
+        if (intersect_aabb(ray, invDir, node.box, s.hit.t) >= INF) continue;
+
+        if (node.leaf()) {
+            uint32_t ti = node.tri();
+            if (ti < numTris) {
+                s.triTests++;
+                read(ti | TRACE_TRI_BIT);
+                float d = intersect_triangle(ray, tris.vertex(ti, 0), tris.vertex(ti, 1), tris.vertex(ti, 2));
+                if (d < s.hit.t) {
+                    s.hit.t = d;
+                    s.hit.tri = ti;
+                    if (anyHit) {
+                        s.sp = -1;
+                        return INVALID;
+                    }
+                }
+            }
+            continue;
+        }
+
+        uint32_t childIdx[4];
+        float childDist[4];
+        uint32_t childCount = 0;
+        for (int c = 0; c < 4; ++c) {
+            uint32_t ci = node.child[c];
+            if (ci == INVALID || ci >= numNodes) continue;
+            read(ci);
+            const Aabb& cb = bvh.nodes[ci].box;
+            if (cb.empty()) continue;
+
+            s.boxTests++;
+            float d = intersect_aabb(ray, invDir, cb, s.hit.t);
+            if (d < INF) {
+                childIdx[childCount] = ci;
+                childDist[childCount] = d;
+                childCount++;
+            }
+        }
+
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < childCount; ++i)
+            if (childDist[i] < childDist[best]) best = i;
+        if (best != 0) std::swap(childIdx[0], childIdx[best]);
+
+        for (int i = int(childCount) - 1; i >= 0; --i) {
+            if (s.sp + 1 < int(STACK_MAX)) stack[++s.sp] = childIdx[i];
+            else s.stackDrops++;
+        }
+    }
+    return INVALID;
+}
+
+} // namespace treelet_detail
+
+// Traces rays [0, n) through `bvh` (partitioned by `part`) with per-treelet
+// queues, writing out[i]; `closest(i)` picks a closest-hit or an occlusion
+// query for ray i (out[i].tri is 0 for blocked, INVALID for clear).
+// `workers` threads take queues; `read` must be thread-safe unless it is 1.
+template <class Closest, class Read>
+static inline void trace_treelets(const Bvh4& bvh, const Triangles& tris, const TreeletPartition& part,
+                                  const Ray* rays, size_t n, Closest&& closest, Hit* out, TreeletRunStats* stats,
+                                  unsigned workers, Read&& read) {
+    using namespace treelet_detail;
+    if (!n) return;
+    if (bvh.nodes.empty() || !tris.count()) {
+        for (size_t i = 0; i < n; ++i) out[i] = Hit{};
+        return;
+    }
+
+    const uint32_t numTreelets = part.count();
+    std::vector<RayState> state(n);
+    std::vector<uint32_t> stacks(n * STACK_MAX);
+    std::vector<std::vector<uint32_t>> queue(numTreelets);
+    std::vector<uint8_t> busy(numTreelets, 0);
+    // Longest idle queue first; an entry is stale once its queue's length
+    // has changed or the queue is taken, and every change pushes a fresh one.
+    std::priority_queue<std::pair<size_t, uint32_t>> ready;
+    std::vector<TreeletRunStats> perWorker(std::max(workers, 1u));
+
+    const uint32_t rootTreelet = part.treelet[0];
+    queue[rootTreelet].resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        state[i].hit.t = rays[i].tmax;
+        stacks[i * STACK_MAX] = 0;
+        queue[rootTreelet][i] = uint32_t(i);
+    }
+    ready.push({n, rootTreelet});
+    size_t inFlight = n;
+    std::mutex m;
+    std::condition_variable cv;
+
+    auto work = [&](unsigned w) {
+        TreeletRunStats& ws = perWorker[w];
+        std::vector<uint32_t> mine;
+        std::vector<std::pair<uint32_t, uint32_t>> forward; // (treelet, ray)
+        std::unique_lock<std::mutex> lock(m);
+        for (;;) {
+            uint32_t t = INVALID;
+            while (!ready.empty() && t == INVALID) {
+                auto [size, c] = ready.top();
+                ready.pop();
+                if (!busy[c] && size && queue[c].size() == size) t = c;
+            }
+            if (t == INVALID) {
+                if (!inFlight) break;
+                cv.wait(lock);
+                continue;
+            }
+            busy[t] = 1;
+            mine.swap(queue[t]);
+            lock.unlock();
+
+            ws.runs++;
+            ws.entries += mine.size();
+            ws.maxQueue = std::max(ws.maxQueue, uint32_t(mine.size()));
+            forward.clear();
+            size_t done = 0;
+            RayCounts counts;
+            for (uint32_t r : mine) {
+                RayState& s = state[r];
+                const bool anyHit = !closest(size_t(r));
+                uint32_t next = advance(bvh, tris, part, rays[r], anyHit, t, s, &stacks[size_t(r) * STACK_MAX], read);
+                if (next != INVALID) {
+                    forward.push_back({next, r});
+                    continue;
+                }
+                if (anyHit) {
+                    out[r] = Hit{};
+                    if (s.hit.hit()) out[r].tri = 0;
+                } else {
+                    out[r] = s.hit;
+                    if (!s.hit.hit()) out[r].t = INF;
+                }
+                ws.trace.nodes += s.nodes;
+                ws.trace.boxTests += s.boxTests;
+                ws.trace.triTests += s.triTests;
+                ws.trace.stackDrops += s.stackDrops;
+                counts.rays++;
+                counts.nodes += s.nodes;
+                counts.boxTests += s.boxTests;
+                counts.triTests += s.triTests;
+                counts.stackDrops += s.stackDrops;
+                done++;
+            }
+            counters_add_rays(counts);
+            std::sort(forward.begin(), forward.end());
+            mine.clear();
+
+            lock.lock();
+            busy[t] = 0;
+            if (!queue[t].empty()) ready.push({queue[t].size(), t});
+            for (size_t b = 0, e; b < forward.size(); b = e) {
+                const uint32_t u = forward[b].first;
+                for (e = b; e < forward.size() && forward[e].first == u; ++e) queue[u].push_back(forward[e].second);
+                if (!busy[u]) ready.push({queue[u].size(), u});
+            }
+            inFlight -= done;
+            cv.notify_all();
+        }
+    };
+    parallel_for_chunks(0, perWorker.size(), 1, [&](size_t b, size_t e, unsigned) {
+        for (size_t w = b; w < e; ++w) work(unsigned(w));
+    });
+
+    if (stats) {
+        for (const TreeletRunStats& ws : perWorker) {
+            stats->runs += ws.runs;
+            stats->entries += ws.entries;
+            stats->maxQueue = std::max(stats->maxQueue, ws.maxQueue);
+            stats->trace.add(ws.trace);
+        }
+    }
+}
+
+template <class Closest>
+static inline void trace_treelets(const Bvh4& bvh, const Triangles& tris, const TreeletPartition& part,
+                                  const Ray* rays, size_t n, Closest&& closest, Hit* out,
+                                  TreeletRunStats* stats = nullptr) {
+    trace_treelets(bvh, tris, part, rays, n, closest, out, stats, worker_count(), [](uint32_t) {});
+}
@@ -0,0 +1,321 @@
+// treelets.cpp
+// Treelet ray scheduling (treelet.hpp) against plain depth-first traversal
+// on a scene whose BVH is many times the last-level cache: a synthetic
+// soup (synth.hpp) of --tris triangles, or any --scene.
+//
+//   bin/treelets [--synth random] [--tris 100m] [--seed 1] [--scene FILE]
+//                [--kinds diffuse] [--size 640x360] [--treelet 32K]
+//                [--l1 32K,64,8] [--llc 8M,64,16] [--model 1] [--reps 3]
+//                [--json out.json|-]
+//
+// Three runs over the same ray set (rayset.hpp kinds; diffuse bounces are
+// the incoherent case the scheduler is for):
+//
+//   depth-first / file     trace.hpp per ray, the tree as built
+//   depth-first / treelet  the same, on the treelet-ordered buffers
+//   treelet queues         trace_treelets() on those buffers
+//
+// Wall clock is the median of --reps; the LLC column is the hardware
+// counter (perf.hpp) of that run when the PMU is visible. "DRAM" is the
+// cachesim.hpp model (an L1 in front of an LLC, 32-byte GPU nodes, one
+// worker, so the whole scheduler order is one stream): L1 misses and lines
+// pulled from memory per ray. It covers node and triangle reads only; the
+// queues also move each ray's state (ray, hit, stack top: two or three
+// lines) at every treelet entry. --model 0 skips it. The tool exits 1 if
+// the scheduler does not return exactly the depth-first answers.
+//
+// A scene takes about 250 bytes per triangle at its peak (two copies of
+// the tree and triangles during the relayout), 25 GB at 100M; sizes that
+// do not fit MemAvailable are refused with the estimate.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "cachesim.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "perf.hpp"
+#include "rayset.hpp"
+#include "synth.hpp"
+#include "treelet.hpp"
+
+static constexpr uint64_t BYTES_PER_TRI = 250;
+
+struct ModeRow {
+    std::string name;
+    double      ms = 0.0;        // median
+    PerfSample  perf;            // of the median run
+    CacheCounters model;
+    TraceStats  trace;
+};
+
+template <typename Fn>
+static void time_reps(uint32_t reps, PerfCounters& pc, ModeRow& row, Fn&& fn) {
+    std::vector<double> ms;
+    std::vector<PerfSample> samples;
+    for (uint32_t r = 0; r < reps; ++r) {
+        samples.push_back(pc.measure(fn));
+        ms.push_back(samples.back().ms);
+    }
+    row.ms = summarize(ms).median;
+    size_t pick = 0;
+    for (size_t i = 1; i < samples.size(); ++i)
+        if (std::fabs(samples[i].ms - row.ms) < std::fabs(samples[pick].ms - row.ms)) pick = i;
+    row.perf = samples[pick];
+}
+
+// Depth-first over every ray, answers in `out`.
+static void trace_depth_first(const Bvh4& bvh, const Triangles& tris, const RaySet& set, std::vector<Hit>& out,
+                              TraceStats* stats) {
+    std::vector<TraceStats> perWorker(worker_count());
+    parallel_for_chunks(0, set.size(), 64, [&](size_t b, size_t e, unsigned w) {
+        TraceStats* s = stats ? &perWorker[w] : nullptr;
+        for (size_t i = b; i < e; ++i) {
+            if (ray_kind_closest(set.kind[i])) {
+                out[i] = trace_closest(bvh, tris, set.rays[i], s);
+            } else {
+                out[i] = Hit{};
+                if (trace_occluded(bvh, tris, set.rays[i], s)) out[i].tri = 0;
+            }
+        }
+    });
+    if (stats)
+        for (const TraceStats& s : perWorker) stats->add(s);
+}
+
+static MemoryLayout model_layout(const Bvh4& bvh) {
+    MemoryLayout lay;
+    lay.name = "aligned";
+    lay.nodeBytes = NODE4_STRIDE_U32 * 4;
+    lay.nodeBase = lay.nodeBytes;
+    lay.triBase = (lay.nodeBase + uint64_t(bvh.nodes.size()) * lay.nodeBytes + 4095) & ~uint64_t(4095);
+    return lay;
+}
+
+static void request_lines(const MemoryLayout& lay, uint32_t access, CacheHierarchy& mem, std::vector<uint64_t>& lines) {
+    lines.clear();
+    cachesim_detail::push_lines(lay, access, mem.line(), lines);
+    mem.counters.reads++;
+    for (uint64_t l : lines) mem.request(l);
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::string scenePath = args.str("scene", "");
+    std::string jsonPath = args.str("json", "");
+    uint32_t width = 640, height = 360;
+    args.size2("size", width, height);
+    const uint32_t reps = std::max(args.u32("reps", 3), 1u);
+    const bool model = args.u32("model", 1) != 0;
+
+    SynthParams synth;
+    synth.kind = args.str("synth", "random");
+    synth.tris = parse_synth_count(args.str("tris", "100m"));
+    synth.seed = uint64_t(args.num("seed", 1));
+    uint32_t kindMask = 0;
+    CacheConfig budgetCfg, l1, llc;
+    if (!parse_ray_kinds(args.strs("kinds", "diffuse"), kindMask) || !kindMask) {
+        std::cerr << "Bad --kinds (primary, shadow, ao, diffuse)\n";
+        return 1;
+    }
+    if (!parse_cache_config(args.str("treelet", "32K"), budgetCfg) || !budgetCfg.size) {
+        std::cerr << "Bad --treelet (bytes, K / M suffixes)\n";
+        return 1;
+    }
+    if (!parse_cache_config(args.str("l1", "32K,64,8"), l1) || !l1.size ||
+        !parse_cache_config(args.str("llc", "8M,64,16"), llc) || (llc.size && llc.line % l1.line != 0)) {
+        std::cerr << "Bad --l1 / --llc (SIZE,LINE,WAYS; the LLC line a multiple of the L1 line)\n";
+        return 1;
+    }
+
+    Triangles tris;
+    std::string sceneName = scenePath;
+    if (!scenePath.empty()) {
+        if (!load_scene(scenePath.c_str(), tris)) return 1;
+    } else {
+        if (!synth.tris) {
+            std::cerr << "Bad --tris\n";
+            return 1;
+        }
+        const uint64_t avail = mem_available();
+        if (avail && synth.tris * BYTES_PER_TRI > avail) {
+            std::cerr << synth.tris << " triangles need ~" << synth.tris * BYTES_PER_TRI * 1e-9 << " GB, "
+                      << avail * 1e-9 << " GB available; pass a smaller --tris\n";
+            return 1;
+        }
+        if (!generate_scene(synth, tris)) return 1;
+        sceneName = "synth " + synth.kind + " seed " + std::to_string(synth.seed);
+    }
+
+    BenchTimer buildTimer;
+    Bvh4 bvh = decode_bvh4(promote_bvh4(build_lbvh2(tris, morton_sort(tris))));
+    const double buildMs = buildTimer.ms();
+    RaySet set = generate_ray_set(
+        tris, Camera{}, width, height, kindMask, 0.25f, [&](const Ray& r) { return trace_closest(bvh, tris, r); },
+        [&](const Ray& r) { return trace_occluded(bvh, tris, r); });
+    if (!set.size()) {
+        std::cerr << "No rays (nothing hit by the primary rays?)\n";
+        return 1;
+    }
+    auto closest = [&](size_t i) { return ray_kind_closest(set.kind[i]); };
+
+    PerfCounters pc;
+    std::vector<ModeRow> rows(3);
+    rows[0].name = "depth-first / file";
+    rows[1].name = "depth-first / treelet";
+    rows[2].name = "treelet queues";
+    std::vector<Hit> dfHits(set.size()), tlHits(set.size());
+    std::vector<uint64_t> lines;
+
+    auto model_depth_first = [&](const Bvh4& b, const Triangles& t, ModeRow& row) {
+        if (!model) return;
+        const MemoryLayout lay = model_layout(b);
+        CacheHierarchy mem;
+        mem.init(l1, llc);
+        std::vector<uint32_t> acc;
+        for (size_t i = 0; i < set.size(); ++i) {
+            TraceStats st;
+            acc.clear();
+            st.accesses = &acc;
+            if (closest(i)) trace_closest(b, t, set.rays[i], &st);
+            else trace_occluded(b, t, set.rays[i], &st);
+            for (uint32_t a : acc) request_lines(lay, a, mem, lines);
+        }
+        row.model = mem.counters;
+        row.model.rays = set.size();
+    };
+
+    // Depth-first on the tree as built.
+    time_reps(reps, pc, rows[0], [&] { trace_depth_first(bvh, tris, set, dfHits, nullptr); });
+    trace_depth_first(bvh, tris, set, dfHits, &rows[0].trace);
+    model_depth_first(bvh, tris, rows[0]);
+
+    // Treelets, then both walks on the reordered buffers.
+    BenchTimer partTimer;
+    TreeletPartition part = partition_treelets(bvh, budgetCfg.size);
+    Bvh4 tlBvh;
+    Triangles tlTris;
+    relayout_treelets(bvh, tris, part, tlBvh, tlTris);
+    const double partMs = partTimer.ms();
+    bvh = Bvh4{};
+    tris = Triangles{};
+
+    time_reps(reps, pc, rows[1], [&] { trace_depth_first(tlBvh, tlTris, set, dfHits, nullptr); });
+    trace_depth_first(tlBvh, tlTris, set, dfHits, &rows[1].trace);
+    model_depth_first(tlBvh, tlTris, rows[1]);
+
+    TreeletRunStats runStats;
+    time_reps(reps, pc, rows[2], [&] {
+        runStats = TreeletRunStats{};
+        trace_treelets(tlBvh, tlTris, part, set.rays.data(), set.size(), closest, tlHits.data(), &runStats);
+    });
+    rows[2].trace = runStats.trace;
+    if (model) {
+        const MemoryLayout lay = model_layout(tlBvh);
+        CacheHierarchy mem;
+        mem.init(l1, llc);
+        trace_treelets(tlBvh, tlTris, part, set.rays.data(), set.size(), closest, tlHits.data(), nullptr, 1,
+                       [&](uint32_t a) { request_lines(lay, a, mem, lines); });
+        rows[2].model = mem.counters;
+        rows[2].model.rays = set.size();
+    }
+
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < set.size(); ++i)
+        if (dfHits[i].tri != tlHits[i].tri || (dfHits[i].hit() && dfHits[i].t != tlHits[i].t)) mismatches++;
+
+    uint64_t maxBytes = 0;
+    for (uint64_t b : part.bytes) maxBytes = std::max(maxBytes, b);
+    const double n = double(set.size());
+    const uint64_t treeBytes = uint64_t(tlBvh.nodes.size()) * NODE4_STRIDE_U32 * 4;
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s: %u tris, BVH4 %zu nodes (%.1f MB as 32-byte nodes + %.1f MB triangles), %u threads\n",
+                 sceneName.c_str(), tlTris.count(), tlBvh.nodes.size(), treeBytes / 1048576.0,
+                 tlTris.v.size() * 4 / 1048576.0, worker_count());
+    std::fprintf(text, "build %.0f ms; %zu rays (", buildMs, set.size());
+    for (uint32_t k = 0, first = 1; k < RAY_KINDS; ++k)
+        if (kindMask >> k & 1u) {
+            std::fprintf(text, "%s%s", first ? "" : ", ", RAY_KIND_NAMES[k]);
+            first = 0;
+        }
+    std::fprintf(text, ") from a %ux%u frame\n", width, height);
+    std::fprintf(text, "treelets: %u of <= %u KB (mean %.1f KB, max %.1f KB), partition + relayout %.0f ms\n",
+                 part.count(), budgetCfg.size >> 10, double(treeBytes + tlTris.v.size() * 4) / part.count() / 1024.0,
+                 maxBytes / 1024.0, partMs);
+    std::fprintf(text, "queues: %llu runs, %.1f rays per run (max %u), %.2f treelets entered per ray\n",
+                 (unsigned long long)runStats.runs,
+                 double(runStats.entries) / double(std::max<uint64_t>(runStats.runs, 1)), runStats.maxQueue,
+                 double(runStats.entries) / n);
+    if (model)
+        std::fprintf(text, "model: L1 %uK/%u/%u, LLC %uK/%u/%u, one worker\n", l1.size >> 10, l1.line, l1.ways,
+                     llc.size >> 10, llc.line, llc.ways);
+    std::fprintf(text, "\n%-22s %9s %8s %8s %8s %9s %9s %9s %8s\n", "mode", "ms", "Mrays/s", "nodes/r", "LLC/ray",
+                 "L1 mi/ray", "DRAM/ray", "DRAM MB", "vs df");
+    for (const ModeRow& r : rows) {
+        char llcText[24] = "n/a", l1Text[24] = "-", dram[24] = "-", mb[24] = "-", rel[24] = "-";
+        if (r.perf.valid[PERF_LLC_MISSES])
+            std::snprintf(llcText, sizeof(llcText), "%.1f", r.perf.value[PERF_LLC_MISSES] / n);
+        if (model) {
+            std::snprintf(l1Text, sizeof(l1Text), "%.1f", (r.model.requests - r.model.l1Hits) / n);
+            std::snprintf(dram, sizeof(dram), "%.1f", r.model.dramLines / n);
+            std::snprintf(mb, sizeof(mb), "%.1f", r.model.dramLines * double(llc.line) / 1048576.0);
+            std::snprintf(rel, sizeof(rel), "%+.1f%%",
+                          (double(r.model.dramLines) / double(rows[0].model.dramLines) - 1.0) * 100.0);
+        }
+        std::fprintf(text, "%-22s %9.1f %8.2f %8.1f %8s %9s %9s %9s %8s\n", r.name.c_str(), r.ms,
+                     r.ms > 0.0 ? n / (r.ms * 1e3) : 0.0, r.trace.nodes / n, llcText, l1Text, dram, mb, rel);
+    }
+    if (!pc.any_hardware())
+        std::fprintf(text, "\nhardware counters unavailable (%s); LLC/ray not measured.\n", pc.error().c_str());
+
+    int status = 0;
+    if (mismatches) {
+        std::fprintf(text, "\nFAIL: treelet queues answer %llu rays differently from depth-first\n",
+                     (unsigned long long)mismatches);
+        status = 1;
+    }
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/treelets");
+    w.value("scene", sceneName);
+    w.value("tris", uint64_t(tlTris.count()));
+    w.value("nodes", uint64_t(tlBvh.nodes.size()));
+    w.value("rays", uint64_t(set.size()));
+    w.value("threads", uint64_t(worker_count()));
+    w.value("treelet_budget", uint64_t(budgetCfg.size));
+    w.value("treelets", uint64_t(part.count()));
+    w.value("queue_runs", runStats.runs);
+    w.value("treelet_entries", runStats.entries);
+    w.value("mismatches", mismatches);
+    w.begin_array("modes");
+    for (const ModeRow& r : rows) {
+        w.begin_object();
+        w.value("name", r.name);
+        w.value("ms", r.ms);
+        w.value("rays_per_s", r.ms > 0.0 ? n / (r.ms * 1e-3) : 0.0);
+        w.value("nodes_visited", r.trace.nodes);
+        if (r.perf.valid[PERF_LLC_MISSES]) w.value("llc_misses", r.perf.value[PERF_LLC_MISSES]);
+        else w.null("llc_misses");
+        if (model) {
+            w.value("model_requests", r.model.requests);
+            w.value("model_llc_hits", r.model.l2Hits);
+            w.value("model_dram_lines", r.model.dramLines);
+        }
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
@@ -0,0 +1,163 @@
+// verify.cpp
+// Checks BVH2 / BVH4 files for structural defects (verify.hpp): ranges,
+// sharing and cycles, leaf metadata, box containment within the fp16
+// tolerance, every triangle reachable exactly once, and the worst-case
+// traversal stack against STACK_MAX. Fast enough to run after every asset
+// build.
+//
+//   bin/verify [data/BVH2.bin data/BVH4_wide.bin ...]
+//              [--scene public/assets/dragon.glb | --no-scene] [--built]
+//              [--ulps 1] [--list 10] [--strict] [--json out.json|-]
+//
+// --built also verifies the scene's LBVH2 and BVH4 as lbvh.hpp builds them.
+// Without a scene the triangle count comes from the leaves and leaf boxes
+// are not checked against their triangles. Exits 1 if any file has an
+// error (or, with --strict, a warning).
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.hpp"
+#include "bench.hpp"
+#include "json.hpp"
+#include "lbvh.hpp"
+#include "memtrack.hpp"
+#include "verify.hpp"
+
+struct Verified {
+    std::string  path;
+    double       ms = 0.0;
+    VerifyReport report;
+};
+
+static void print_report(FILE* out, const Verified& v) {
+    const VerifyReport& r = v.report;
+    if (!r.arity)
+        std::fprintf(out, "=== %s: %u nodes in word 0, length fits neither stride ===\n", v.path.c_str(), r.nodes);
+    else
+        std::fprintf(out,
+                     "=== %s: BVH%u, %u nodes (%u reachable, %u leaves), %u tris, depth %u, stack <= %u, %.1f ms ===\n",
+                     v.path.c_str(), r.arity, r.nodes, r.reachable, r.leaves, r.tris, r.depth, r.maxStack, v.ms);
+    for (uint32_t c = 0; c < VERIFY_CHECKS; ++c) {
+        if (!r.count[c]) continue;
+        const char* sev = VERIFY_INFO[c].severity == VERIFY_ERROR     ? "error"
+                          : VERIFY_INFO[c].severity == VERIFY_WARNING ? "warning"
+                                                                      : "note";
+        std::fprintf(out, "  %-12s %-8s %llu\n", VERIFY_INFO[c].name, sev, (unsigned long long)r.count[c]);
+        for (const VerifyIssue& is : r.examples) {
+            if (is.check != c || c == VERIFY_ORPHANS) continue;
+            std::fprintf(out, "    ");
+            if (is.node != INVALID)
+                std::fprintf(out, "%s %u", c == VERIFY_TRI_MISSING || c == VERIFY_TRI_DUP ? "tri" : "node", is.node);
+            if (is.other != INVALID)
+                std::fprintf(out, "  %s %u", c == VERIFY_CONTAIN || c == VERIFY_SHARED ? "parent"
+                                             : c == VERIFY_CHILD_RANGE                 ? "child"
+                                                                                       : "tri",
+                             is.other);
+            if (c == VERIFY_CONTAIN || c == VERIFY_TRI_BOX) std::fprintf(out, "  %.2f ulps out", is.amount);
+            if (c == VERIFY_TRI_DUP) std::fprintf(out, "  %.0f leaves", is.amount);
+            if (c == VERIFY_STACK) std::fprintf(out, "%.0f entries > STACK_MAX %u", is.amount, STACK_MAX);
+            if (c == VERIFY_HEADER) std::fprintf(out, "file has %.0f words", is.amount);
+            std::fprintf(out, "\n");
+        }
+    }
+    if (!r.errors() && !r.warnings()) std::fprintf(out, "  ok\n");
+    std::fprintf(out, "\n");
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    std::vector<std::string> paths = args.positional();
+    if (paths.empty() && !args.has("built")) paths = {"data/BVH2.bin", "data/BVH4_wide.bin"};
+    std::string scenePath = args.str("scene", "public/assets/dragon.glb");
+    std::string jsonPath = args.str("json", "");
+    const bool useScene = !args.has("no-scene");
+    const bool strict = args.has("strict");
+    const double ulps = args.num("ulps", 1.0);
+    const size_t list = args.u32("list", 10);
+
+    Triangles tris;
+    if ((useScene || args.has("built")) && !load_scene(scenePath.c_str(), tris)) return 1;
+    const Triangles* checkTris = useScene ? &tris : nullptr;
+
+    std::vector<Verified> results;
+    auto run = [&](const std::string& name, const std::vector<uint32_t>& raw) {
+        Verified v;
+        v.path = name;
+        BenchTimer t;
+        v.report = verify_bvh_file(raw, checkTris, ulps, list);
+        v.ms = t.ms();
+        results.push_back(std::move(v));
+    };
+    for (const std::string& path : paths) {
+        std::vector<uint32_t> raw;
+        if (!load_u32_file(path.c_str(), raw) || raw.empty()) {
+            std::cerr << "Failed to read " << path << "\n";
+            return 1;
+        }
+        run(path, raw);
+    }
+    if (args.has("built")) {
+        std::vector<uint64_t> keys = morton_keys(tris);
+        MortonOrder order = sort_morton_keys(keys);
+        std::vector<uint32_t> bvh2 = build_lbvh2(tris, order);
+        run("built LBVH2", bvh2);
+        run("built BVH4", promote_bvh4(bvh2));
+    }
+
+    FILE* text = jsonPath == "-" ? stderr : stdout;
+    std::fprintf(text, "%s, tolerance %.2f fp16 ulps, %u threads\n\n",
+                 checkTris ? scenePath.c_str() : "no scene", ulps, worker_count());
+    int status = 0;
+    for (const Verified& v : results) {
+        print_report(text, v);
+        if (v.report.errors() || (strict && v.report.warnings())) status = 1;
+    }
+    if (status) std::fprintf(text, "FAIL: %s\n", strict ? "errors or warnings" : "errors");
+
+    if (jsonPath.empty()) return status;
+    std::ofstream file;
+    std::ostream* out = open_json_output(jsonPath, file);
+    if (!out) return 1;
+    JsonWriter w(*out);
+    w.begin_object();
+    w.value("tool", "bin/verify");
+    w.value("scene", checkTris ? scenePath : std::string());
+    w.value("ulps", ulps);
+    w.begin_array("files");
+    for (const Verified& v : results) {
+        const VerifyReport& r = v.report;
+        w.begin_object();
+        w.value("path", v.path);
+        w.value("ms", v.ms);
+        w.value("arity", r.arity);
+        w.value("nodes", r.nodes);
+        w.value("reachable", r.reachable);
+        w.value("leaves", r.leaves);
+        w.value("tris", r.tris);
+        w.value("depth", r.depth);
+        w.value("max_stack", r.maxStack);
+        w.value("errors", r.errors());
+        w.value("warnings", r.warnings());
+        w.begin_object("checks");
+        for (uint32_t c = 0; c < VERIFY_CHECKS; ++c) w.value(VERIFY_INFO[c].name, r.count[c]);
+        w.end_object();
+        w.begin_array("examples");
+        for (const VerifyIssue& is : r.examples) {
+            w.begin_object();
+            w.value("check", VERIFY_INFO[is.check].name);
+            if (is.node != INVALID) w.value("index", is.node);
+            if (is.other != INVALID) w.value("other", is.other);
+            w.value("amount", is.amount);
+            w.end_object();
+        }
+        w.end_array();
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    return status;
+}
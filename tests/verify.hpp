@@ -0,0 +1,267 @@
+#pragma once
+
+// verify.hpp
+// Structural check of a BVH2 / BVH4 buffer. renderer.wgsl skips children
+// with ci >= numNodes and boxes with any(mn > mx), so a corrupt file renders
+// with holes instead of failing; this reports every such defect instead.
+//
+// The tree is walked breadth-first from node 0, one parallel pass per
+// level; every reachable node is checked as it is reached:
+//
+//   header        node count in word 0 does not match the file length
+//   child-range   child index past the node count
+//   shared        node reached from two parents, or from a descendant (a
+//                 cycle); either way the walk does not follow it again
+//   no-children   internal node without a single valid child
+//   leaf-meta     leaf whose triangle index is past the triangle count
+//   empty-box     reachable box with mn > mx or NaN: the shader skips the
+//                 whole subtree
+//   contain       child box sticks out of its parent's by more than the fp16
+//                 tolerance; rays through the gap miss the child
+//   tri-box       leaf box does not hold its triangle (needs the scene)
+//   tri-missing   triangle no reachable leaf references
+//   tri-dup       triangle referenced by more than one reachable leaf
+//   stack         worst-case traversal stack above STACK_MAX: pushes can
+//                 be dropped for some ray (warning)
+//   orphans       unreachable nodes (note; the in-place BVH4 promotion
+//                 leaves one per absorbed BVH2 node)
+//
+// The tolerance is `ulps` fp16 ULPs at the outer box's face: nearest and
+// truncating fp16 rounding each move a face by under one ULP. The stack
+// bound assumes every valid child is hit: a node's children are pushed on
+// top of what is left below it, so a child can be popped with
+// stack(parent) - 1 + children(parent) entries in use.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+
+enum VerifyCheck : uint32_t {
+    VERIFY_HEADER = 0,
+    VERIFY_CHILD_RANGE,
+    VERIFY_SHARED,
+    VERIFY_NO_CHILDREN,
+    VERIFY_LEAF_META,
+    VERIFY_EMPTY_BOX,
+    VERIFY_CONTAIN,
+    VERIFY_TRI_BOX,
+    VERIFY_TRI_MISSING,
+    VERIFY_TRI_DUP,
+    VERIFY_STACK,
+    VERIFY_ORPHANS,
+    VERIFY_CHECKS
+};
+
+enum VerifySeverity : uint32_t { VERIFY_ERROR, VERIFY_WARNING, VERIFY_NOTE };
+
+struct VerifyCheckInfo {
+    const char*    name;
+    VerifySeverity severity;
+};
+
+static inline const VerifyCheckInfo VERIFY_INFO[VERIFY_CHECKS] = {
+    {"header", VERIFY_ERROR},   {"child-range", VERIFY_ERROR}, {"shared", VERIFY_ERROR},
+    {"no-children", VERIFY_ERROR}, {"leaf-meta", VERIFY_ERROR}, {"empty-box", VERIFY_ERROR},
+    {"contain", VERIFY_ERROR},  {"tri-box", VERIFY_ERROR},     {"tri-missing", VERIFY_ERROR},
+    {"tri-dup", VERIFY_ERROR},  {"stack", VERIFY_WARNING},     {"orphans", VERIFY_NOTE},
+};
+
+struct VerifyIssue {
+    uint32_t check = 0;
+    uint32_t node = INVALID;  // triangle index for tri-missing / tri-dup
+    uint32_t other = INVALID; // parent, child or triangle involved
+    double   amount = 0.0;    // overshoot in fp16 ULPs, stack entries, ...
+};
+
+struct VerifyReport {
+    uint32_t arity = 0;
+    uint32_t nodes = 0;
+    uint32_t reachable = 0;
+    uint32_t leaves = 0;
+    uint32_t tris = 0;     // triangle count checked against
+    uint32_t depth = 0;    // deepest reachable node, root = 0
+    uint32_t maxStack = 0; // worst-case stack entries
+    uint64_t count[VERIFY_CHECKS] = {};
+    std::vector<VerifyIssue> examples; // up to `list` per check, by node
+
+    uint64_t errors() const {
+        uint64_t n = 0;
+        for (uint32_t c = 0; c < VERIFY_CHECKS; ++c) n += VERIFY_INFO[c].severity == VERIFY_ERROR ? count[c] : 0;
+        return n;
+    }
+    uint64_t warnings() const {
+        uint64_t n = 0;
+        for (uint32_t c = 0; c < VERIFY_CHECKS; ++c) n += VERIFY_INFO[c].severity == VERIFY_WARNING ? count[c] : 0;
+        return n;
+    }
+};
+
+namespace verify_detail {
+
+// Per-worker issue counts plus the first few of each kind.
+struct Sink {
+    uint64_t                 count[VERIFY_CHECKS] = {};
+    std::vector<VerifyIssue> examples;
+    uint32_t                 kept[VERIFY_CHECKS] = {};
+    uint32_t                 leaves = 0;
+    uint32_t                 maxStack = 0;
+
+    void add(size_t list, uint32_t check, uint32_t node, uint32_t other = INVALID, double amount = 0.0) {
+        count[check]++;
+        if (kept[check] < list) {
+            kept[check]++;
+            examples.push_back({check, node, other, amount});
+        }
+    }
+};
+
+static inline bool bad_box(const Aabb& b) {
+    return b.empty() || std::isnan(b.mn.x) || std::isnan(b.mn.y) || std::isnan(b.mn.z) || std::isnan(b.mx.x) ||
+           std::isnan(b.mx.y) || std::isnan(b.mx.z);
+}
+
+} // namespace verify_detail
+
+// `tris` may be null: the triangle count is then taken from the leaves
+// (highest index + 1) and tri-box is skipped.
+static inline VerifyReport verify_bvh(const Bvh4& bvh, uint32_t arity, const Triangles* tris, double ulps = 1.0,
+                                      size_t list = 10) {
+    using namespace verify_detail;
+    VerifyReport r;
+    r.arity = arity;
+    r.nodes = uint32_t(bvh.nodes.size());
+    if (bvh.nodes.empty()) return r;
+    const uint32_t numNodes = r.nodes;
+
+    if (tris) r.tris = tris->count();
+    else {
+        std::vector<uint32_t> maxTri(worker_count(), 0);
+        parallel_for_chunks(0, numNodes, 1 << 14, [&](size_t b, size_t e, unsigned w) {
+            for (size_t n = b; n < e; ++n)
+                if (bvh.nodes[n].leaf()) maxTri[w] = std::max(maxTri[w], bvh.nodes[n].tri() + 1);
+        });
+        r.tris = *std::max_element(maxTri.begin(), maxTri.end());
+    }
+
+    std::vector<uint32_t> visits(numNodes, 0), stackAt(numNodes, 0), triRefs(r.tris, 0);
+    std::vector<Sink> sinks(worker_count());
+    std::vector<std::vector<uint32_t>> nextPer(worker_count());
+    std::vector<uint32_t> frontier{0u}, next;
+    visits[0] = 1;
+    stackAt[0] = 1;
+
+    for (uint32_t depth = 0; !frontier.empty(); ++depth) {
+        r.depth = depth;
+        r.reachable += uint32_t(frontier.size());
+        parallel_for_chunks(0, frontier.size(), 256, [&](size_t b, size_t e, unsigned w) {
+            Sink& sink = sinks[w];
+            std::vector<uint32_t>& out = nextPer[w];
+            for (size_t i = b; i < e; ++i) {
+                const uint32_t n = frontier[i];
+                const Bvh4Node& node = bvh.nodes[n];
+                const bool boxOk = !bad_box(node.box);
+                if (!boxOk) sink.add(list, VERIFY_EMPTY_BOX, n);
+
+                if (node.leaf()) {
+                    sink.leaves++;
+                    sink.maxStack = std::max(sink.maxStack, stackAt[n]);
+                    const uint32_t ti = node.tri();
+                    if (ti >= r.tris) {
+                        sink.add(list, VERIFY_LEAF_META, n, ti);
+                        continue;
+                    }
+                    std::atomic_ref<uint32_t>(triRefs[ti]).fetch_add(1, std::memory_order_relaxed);
+                    if (tris && boxOk) {
+                        double over = aabb_overshoot_ulps(node.box, tris->bounds(ti));
+                        if (over > ulps) sink.add(list, VERIFY_TRI_BOX, n, ti, over);
+                    }
+                    continue;
+                }
+
+                uint32_t valid = 0;
+                for (uint32_t s = 0; s < arity; ++s) {
+                    uint32_t c = node.child[s];
+                    if (c == INVALID) continue;
+                    if (c >= numNodes) sink.add(list, VERIFY_CHILD_RANGE, n, c);
+                    else valid++;
+                }
+                if (!valid) {
+                    sink.add(list, VERIFY_NO_CHILDREN, n);
+                    continue;
+                }
+                const uint32_t childStack = stackAt[n] - 1 + valid;
+                sink.maxStack = std::max(sink.maxStack, childStack);
+
+                for (uint32_t s = 0; s < arity; ++s) {
+                    uint32_t c = node.child[s];
+                    if (c == INVALID || c >= numNodes) continue;
+                    if (std::atomic_ref<uint32_t>(visits[c]).fetch_add(1, std::memory_order_relaxed) != 0) {
+                        sink.add(list, VERIFY_SHARED, c, n);
+                        continue;
+                    }
+                    stackAt[c] = childStack;
+                    out.push_back(c);
+                    const Aabb& cb = bvh.nodes[c].box;
+                    if (boxOk && !bad_box(cb)) {
+                        double over = aabb_overshoot_ulps(node.box, cb);
+                        if (over > ulps) sink.add(list, VERIFY_CONTAIN, c, n, over);
+                    }
+                }
+            }
+        });
+        next.clear();
+        for (std::vector<uint32_t>& v : nextPer) {
+            next.insert(next.end(), v.begin(), v.end());
+            v.clear();
+        }
+        frontier.swap(next);
+    }
+
+    parallel_for_chunks(0, r.tris, 1 << 14, [&](size_t b, size_t e, unsigned w) {
+        for (size_t t = b; t < e; ++t) {
+            if (triRefs[t] == 0) sinks[w].add(list, VERIFY_TRI_MISSING, uint32_t(t));
+            else if (triRefs[t] > 1) sinks[w].add(list, VERIFY_TRI_DUP, uint32_t(t), INVALID, triRefs[t]);
+        }
+    });
+
+    for (const Sink& s : sinks) {
+        for (uint32_t c = 0; c < VERIFY_CHECKS; ++c) r.count[c] += s.count[c];
+        r.examples.insert(r.examples.end(), s.examples.begin(), s.examples.end());
+        r.leaves += s.leaves;
+        r.maxStack = std::max(r.maxStack, s.maxStack);
+    }
+    if (r.maxStack > STACK_MAX) {
+        r.count[VERIFY_STACK] = 1;
+        r.examples.push_back({VERIFY_STACK, INVALID, INVALID, double(r.maxStack)});
+    }
+    r.count[VERIFY_ORPHANS] = numNodes - r.reachable;
+
+    std::sort(r.examples.begin(), r.examples.end(), [](const VerifyIssue& a, const VerifyIssue& b) {
+        return a.check != b.check ? a.check < b.check : a.node < b.node;
+    });
+    std::vector<VerifyIssue> kept;
+    for (size_t i = 0; i < r.examples.size(); ++i)
+        if (i < list || r.examples[i].check != r.examples[i - list].check) kept.push_back(r.examples[i]);
+    r.examples.swap(kept);
+    return r;
+}
+
+// A raw BVH2 / BVH4 buffer: checks the header, then decodes and verifies.
+static inline VerifyReport verify_bvh_file(const std::vector<uint32_t>& raw, const Triangles* tris, double ulps = 1.0,
+                                           size_t list = 10) {
+    const uint32_t arity = bvh_file_arity(raw);
+    if (!arity) {
+        VerifyReport r;
+        r.nodes = raw.empty() ? 0 : raw[0];
+        r.count[VERIFY_HEADER] = 1;
+        r.examples.push_back({VERIFY_HEADER, INVALID, INVALID, double(raw.size())});
+        return r;
+    }
+    return verify_bvh(arity == 2 ? decode_bvh2(raw) : decode_bvh4(raw), arity, tris, ulps, list);
+}